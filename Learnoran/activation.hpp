@@ -0,0 +1,407 @@
+#ifndef _ACTIVATION_HPP
+#define _ACTIVATION_HPP
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include "matrix.hpp"
+#include "cpu_dispatch.hpp"
+
+/*
+Activation functions evaluated over arrays.
+Every activation comes in three accuracy tiers. The exact tier calls the C library one element at a time; the other two
+replace exp by a polynomial that the SIMD kernels below evaluate 4 (AVX2) or 8 (AVX-512) elements at a time:
+
+	exp(x) = 2^k * exp(r), k = round(x / ln 2), |r| <= ln(2) / 2, exp(r) ~ Taylor polynomial of degree 13 or 6
+
+Maximum relative errors against the true values, measured over [-40, 40] (exp over [-700, 700]); the exact tier is
+within 3e-16 for all of them:
+
+	            accurate   fast
+	exp         2e-16      2e-7
+	sigmoid     3e-16      2e-7
+	sigmoid'    6e-16      2e-7
+	tanh        6e-16      5e-7
+	relu        exact      exact
+
+The approximations keep the special values of the exact functions: exp overflows to infinity above 709.78 and underflows
+to zero below -745.13, sigmoid and tanh saturate at their limits, and NaN inputs give NaN. Results of the approximate
+tiers may differ in the last bit between the instruction sets, since only the SIMD kernels contract into FMA.
+*/
+
+namespace Learnoran {
+	enum class Activation {
+		exp,
+		sigmoid,
+		sigmoid_prime, // derivative of sigmoid
+		tanh,
+		relu
+	};
+
+	enum class ActivationAccuracy {
+		exact, // the C library
+		accurate, // vectorized, within a few ulp
+		fast // vectorized, about single precision
+	};
+
+	// MARK: Exponential approximation
+
+	const double EXP_TAYLOR_COEFFICIENTS[] = { 1.0, 1.0, 1.0 / 2, 1.0 / 6, 1.0 / 24, 1.0 / 120, 1.0 / 720, 1.0 / 5040, 1.0 / 40320,
+		1.0 / 362880, 1.0 / 3628800, 1.0 / 39916800, 1.0 / 479001600, 1.0 / 6227020800.0 }; // 1 / n!
+	const double EXP_LOG2E = 1.4426950408889634;
+	const double EXP_LN2_HIGH = 6.93147180369123816490e-01; // ln 2 = high + low, k * high is exact for |k| < 2^20
+	const double EXP_LN2_LOW = 1.90821492927058770002e-10;
+	const double EXP_ROUNDING_SHIFT = 6755399441055744.0; // 1.5 * 2^52: x + shift - shift rounds x to an integer
+	const double EXP_MIN_INPUT = -746.0; // exp of anything below is zero
+	const double EXP_MAX_INPUT = 710.0; // exp of anything above is infinite
+	const double TANH_MAX_INPUT = 20.0; // tanh of anything beyond is +-1 in double precision
+
+	template <ActivationAccuracy Accuracy>
+	struct ExpDegree {
+		// degree of the Taylor polynomial approximating exp(r), 0 for the C library
+		static const unsigned value = Accuracy == ActivationAccuracy::accurate ? 13 : Accuracy == ActivationAccuracy::fast ? 6 : 0;
+	};
+
+	inline double pow2(const int exponent) {
+		// 2^exponent for a normal result, built from its bits
+		const std::uint64_t bits = static_cast<std::uint64_t>(exponent + 1023) << 52;
+		double result;
+		std::memcpy(&result, &bits, sizeof(result));
+		return result;
+	}
+
+	template <unsigned Degree>
+	struct ScalarMath {
+		// exp, expm1 and tanh through the polynomial of the given degree, one element at a time
+		static double exp(double x) {
+			x = x < EXP_MIN_INPUT ? EXP_MIN_INPUT : x > EXP_MAX_INPUT ? EXP_MAX_INPUT : x; // NaN passes through
+			const double k = (x * EXP_LOG2E + EXP_ROUNDING_SHIFT) - EXP_ROUNDING_SHIFT;
+			const double r = (x - k * EXP_LN2_HIGH) - k * EXP_LN2_LOW;
+
+			double polynomial = EXP_TAYLOR_COEFFICIENTS[Degree];
+			for (unsigned n = Degree; n-- > 0; ) {
+				polynomial = polynomial * r + EXP_TAYLOR_COEFFICIENTS[n];
+			}
+
+			// 2^k in two factors, so that each of them is a normal number over the whole clamped range
+			const int exponent = x == x ? static_cast<int>(k) : 0;
+			return polynomial * pow2(exponent / 2) * pow2(exponent - exponent / 2);
+		}
+
+		static double expm1(const double x) {
+			// exp(x) - 1 without the cancellation around 0
+			if (std::fabs(x) >= EXP_LN2_HIGH / 2) {
+				return exp(x) - 1;
+			}
+
+			double polynomial = EXP_TAYLOR_COEFFICIENTS[Degree];
+			for (unsigned n = Degree; n-- > 1; ) {
+				polynomial = polynomial * x + EXP_TAYLOR_COEFFICIENTS[n];
+			}
+			return polynomial * x;
+		}
+
+		static double tanh(const double x) {
+			// tanh(x) = expm1(2x) / (expm1(2x) + 2), evaluated on |x| to keep the precision of small outputs
+			const double magnitude = std::fabs(x) > TANH_MAX_INPUT ? TANH_MAX_INPUT : std::fabs(x); // NaN passes through
+			const double exp_minus_one = expm1(2 * magnitude);
+			return std::copysign(exp_minus_one / (exp_minus_one + 2), x);
+		}
+	};
+
+	template <>
+	struct ScalarMath<0> {
+		static double exp(const double x) {
+			return std::exp(x);
+		}
+
+		static double expm1(const double x) {
+			return std::expm1(x);
+		}
+
+		static double tanh(const double x) {
+			return std::tanh(x);
+		}
+	};
+
+	// MARK: Scalar activations
+
+	template <Activation A, unsigned Degree>
+	inline double scalar_activation(const double x) {
+		typedef ScalarMath<Degree> Math;
+
+		switch (A) {
+		case Activation::exp:
+			return Math::exp(x);
+		case Activation::sigmoid:
+			return 1 / (1 + Math::exp(-x));
+		case Activation::sigmoid_prime: {
+			// sigmoid'(x) = e / (1 + e)^2 with e = exp(-|x|), as sigmoid' is even; never overflows
+			const double e = Math::exp(-std::fabs(x));
+			return e / ((1 + e) * (1 + e));
+		}
+		case Activation::tanh:
+			return Math::tanh(x);
+		default:
+			return x < 0 ? 0.0 : x;
+		}
+	}
+
+	template <Activation A, ActivationAccuracy Accuracy = ActivationAccuracy::exact>
+	struct ActivationFunction {
+		// the activation as a function object for Matrix::map and FixedMatrix::map, which the compiler can inline, i.e.
+		// layer.map_inplace(ActivationFunction<Activation::sigmoid>()); one element at a time the polynomials of the
+		// approximate tiers are no faster than the C library, arrays are better served by activation_kernel
+		double operator()(const double x) const {
+			return scalar_activation<A, ExpDegree<Accuracy>::value>(x);
+		}
+	};
+
+	// MARK: SIMD kernels
+
+#ifdef LEARNORAN_X86
+	LEARNORAN_TARGET("avx2,fma")
+	inline __m256d pow2_avx2(const __m128i exponents) {
+		const __m256i biased = _mm256_add_epi64(_mm256_cvtepi32_epi64(exponents), _mm256_set1_epi64x(1023));
+		return _mm256_castsi256_pd(_mm256_slli_epi64(biased, 52));
+	}
+
+	template <unsigned Degree>
+	LEARNORAN_TARGET("avx2,fma")
+	inline __m256d exp_avx2(__m256d x) {
+		// ScalarMath<Degree>::exp for 4 elements; min and max return their second operand on NaN, which keeps NaN
+		x = _mm256_max_pd(_mm256_set1_pd(EXP_MIN_INPUT), _mm256_min_pd(_mm256_set1_pd(EXP_MAX_INPUT), x));
+		const __m256d shift = _mm256_set1_pd(EXP_ROUNDING_SHIFT);
+		const __m256d k = _mm256_sub_pd(_mm256_fmadd_pd(x, _mm256_set1_pd(EXP_LOG2E), shift), shift);
+		const __m256d r = _mm256_fnmadd_pd(k, _mm256_set1_pd(EXP_LN2_LOW), _mm256_fnmadd_pd(k, _mm256_set1_pd(EXP_LN2_HIGH), x));
+
+		__m256d polynomial = _mm256_set1_pd(EXP_TAYLOR_COEFFICIENTS[Degree]);
+		for (unsigned n = Degree; n-- > 0; ) {
+			polynomial = _mm256_fmadd_pd(polynomial, r, _mm256_set1_pd(EXP_TAYLOR_COEFFICIENTS[n]));
+		}
+
+		const __m128i exponents = _mm256_cvtpd_epi32(k);
+		const __m128i half_exponents = _mm_srai_epi32(exponents, 1);
+		polynomial = _mm256_mul_pd(polynomial, pow2_avx2(half_exponents));
+		return _mm256_mul_pd(polynomial, pow2_avx2(_mm_sub_epi32(exponents, half_exponents)));
+	}
+
+	template <unsigned Degree>
+	LEARNORAN_TARGET("avx2,fma")
+	inline __m256d expm1_avx2(const __m256d x) {
+		// ScalarMath<Degree>::expm1 for 4 non-negative elements
+		__m256d polynomial = _mm256_set1_pd(EXP_TAYLOR_COEFFICIENTS[Degree]);
+		for (unsigned n = Degree; n-- > 1; ) {
+			polynomial = _mm256_fmadd_pd(polynomial, x, _mm256_set1_pd(EXP_TAYLOR_COEFFICIENTS[n]));
+		}
+		polynomial = _mm256_mul_pd(polynomial, x);
+
+		const __m256d large = _mm256_sub_pd(exp_avx2<Degree>(x), _mm256_set1_pd(1.0));
+		return _mm256_blendv_pd(polynomial, large, _mm256_cmp_pd(x, _mm256_set1_pd(EXP_LN2_HIGH / 2), _CMP_GE_OQ));
+	}
+
+	template <Activation A, unsigned Degree>
+	LEARNORAN_TARGET("avx2,fma")
+	inline __m256d activation_avx2(const __m256d x) {
+		const __m256d one = _mm256_set1_pd(1.0);
+		const __m256d sign_mask = _mm256_set1_pd(-0.0);
+
+		switch (A) {
+		case Activation::exp:
+			return exp_avx2<Degree>(x);
+		case Activation::sigmoid:
+			return _mm256_div_pd(one, _mm256_add_pd(one, exp_avx2<Degree>(_mm256_xor_pd(x, sign_mask))));
+		case Activation::sigmoid_prime: {
+			const __m256d e = exp_avx2<Degree>(_mm256_or_pd(x, sign_mask));
+			const __m256d one_plus_e = _mm256_add_pd(one, e);
+			return _mm256_div_pd(e, _mm256_mul_pd(one_plus_e, one_plus_e));
+		}
+		case Activation::tanh: {
+			const __m256d magnitude = _mm256_min_pd(_mm256_set1_pd(TANH_MAX_INPUT), _mm256_andnot_pd(sign_mask, x));
+			const __m256d exp_minus_one = expm1_avx2<Degree>(_mm256_add_pd(magnitude, magnitude));
+			const __m256d result = _mm256_div_pd(exp_minus_one, _mm256_add_pd(exp_minus_one, _mm256_set1_pd(2.0)));
+			return _mm256_or_pd(result, _mm256_and_pd(x, sign_mask));
+		}
+		default:
+			return _mm256_max_pd(_mm256_setzero_pd(), x);
+		}
+	}
+
+	template <Activation A, unsigned Degree>
+	LEARNORAN_TARGET("avx2,fma")
+	inline void activation_kernel_avx2(const double * input, double * output, const std::size_t count) {
+		std::size_t i = 0;
+		for (; i + 4 <= count; i += 4) {
+			_mm256_storeu_pd(output + i, activation_avx2<A, Degree>(_mm256_loadu_pd(input + i)));
+		}
+		if (i < count) {
+			// the last 1 to 3 elements through a masked load and store
+			const __m256i mask = _mm256_cmpgt_epi64(_mm256_set1_epi64x(static_cast<long long>(count - i)), _mm256_setr_epi64x(0, 1, 2, 3));
+			_mm256_maskstore_pd(output + i, mask, activation_avx2<A, Degree>(_mm256_maskload_pd(input + i, mask)));
+		}
+	}
+
+	template <unsigned Degree>
+	LEARNORAN_TARGET("avx512f")
+	inline __m512d exp_avx512(__m512d x) {
+		// ScalarMath<Degree>::exp for 8 elements; scalef computes polynomial * 2^k directly
+		x = _mm512_max_pd(_mm512_set1_pd(EXP_MIN_INPUT), _mm512_min_pd(_mm512_set1_pd(EXP_MAX_INPUT), x));
+		const __m512d shift = _mm512_set1_pd(EXP_ROUNDING_SHIFT);
+		const __m512d k = _mm512_sub_pd(_mm512_fmadd_pd(x, _mm512_set1_pd(EXP_LOG2E), shift), shift);
+		const __m512d r = _mm512_fnmadd_pd(k, _mm512_set1_pd(EXP_LN2_LOW), _mm512_fnmadd_pd(k, _mm512_set1_pd(EXP_LN2_HIGH), x));
+
+		__m512d polynomial = _mm512_set1_pd(EXP_TAYLOR_COEFFICIENTS[Degree]);
+		for (unsigned n = Degree; n-- > 0; ) {
+			polynomial = _mm512_fmadd_pd(polynomial, r, _mm512_set1_pd(EXP_TAYLOR_COEFFICIENTS[n]));
+		}
+		return _mm512_scalef_pd(polynomial, k);
+	}
+
+	template <unsigned Degree>
+	LEARNORAN_TARGET("avx512f")
+	inline __m512d expm1_avx512(const __m512d x) {
+		// ScalarMath<Degree>::expm1 for 8 non-negative elements
+		__m512d polynomial = _mm512_set1_pd(EXP_TAYLOR_COEFFICIENTS[Degree]);
+		for (unsigned n = Degree; n-- > 1; ) {
+			polynomial = _mm512_fmadd_pd(polynomial, x, _mm512_set1_pd(EXP_TAYLOR_COEFFICIENTS[n]));
+		}
+		polynomial = _mm512_mul_pd(polynomial, x);
+
+		const __mmask8 large = _mm512_cmp_pd_mask(x, _mm512_set1_pd(EXP_LN2_HIGH / 2), _CMP_GE_OQ);
+		return _mm512_mask_sub_pd(polynomial, large, exp_avx512<Degree>(x), _mm512_set1_pd(1.0));
+	}
+
+	template <Activation A, unsigned Degree>
+	LEARNORAN_TARGET("avx512f")
+	inline __m512d activation_avx512(const __m512d x) {
+		// the sign bit is handled on the integer view of the lanes, AVX-512F has no floating point logic instructions
+		const __m512d one = _mm512_set1_pd(1.0);
+		const __m512i sign_mask = _mm512_set1_epi64(static_cast<long long>(0x8000000000000000ULL));
+		const __m512i bits = _mm512_castpd_si512(x);
+
+		switch (A) {
+		case Activation::exp:
+			return exp_avx512<Degree>(x);
+		case Activation::sigmoid:
+			return _mm512_div_pd(one, _mm512_add_pd(one, exp_avx512<Degree>(_mm512_castsi512_pd(_mm512_xor_si512(bits, sign_mask)))));
+		case Activation::sigmoid_prime: {
+			const __m512d e = exp_avx512<Degree>(_mm512_castsi512_pd(_mm512_or_si512(bits, sign_mask)));
+			const __m512d one_plus_e = _mm512_add_pd(one, e);
+			return _mm512_div_pd(e, _mm512_mul_pd(one_plus_e, one_plus_e));
+		}
+		case Activation::tanh: {
+			const __m512d magnitude = _mm512_min_pd(_mm512_set1_pd(TANH_MAX_INPUT), _mm512_castsi512_pd(_mm512_andnot_si512(sign_mask, bits)));
+			const __m512d exp_minus_one = expm1_avx512<Degree>(_mm512_add_pd(magnitude, magnitude));
+			const __m512d result = _mm512_div_pd(exp_minus_one, _mm512_add_pd(exp_minus_one, _mm512_set1_pd(2.0)));
+			return _mm512_castsi512_pd(_mm512_or_si512(_mm512_castpd_si512(result), _mm512_and_si512(bits, sign_mask)));
+		}
+		default:
+			return _mm512_max_pd(_mm512_setzero_pd(), x);
+		}
+	}
+
+	template <Activation A, unsigned Degree>
+	LEARNORAN_TARGET("avx512f")
+	inline void activation_kernel_avx512(const double * input, double * output, const std::size_t count) {
+		std::size_t i = 0;
+		for (; i + 8 <= count; i += 8) {
+			_mm512_storeu_pd(output + i, activation_avx512<A, Degree>(_mm512_loadu_pd(input + i)));
+		}
+		if (i < count) {
+			const __mmask8 mask = static_cast<__mmask8>((1u << (count - i)) - 1);
+			_mm512_mask_storeu_pd(output + i, mask, activation_avx512<A, Degree>(_mm512_maskz_loadu_pd(mask, input + i)));
+		}
+	}
+#endif
+
+	// MARK: Kernels
+
+	template <Activation A, unsigned Degree>
+	inline void activation_kernel_generic(const double * input, double * output, const std::size_t count) {
+		for (std::size_t i = 0; i < count; i++) {
+			output[i] = scalar_activation<A, Degree>(input[i]);
+		}
+	}
+
+	template <Activation A, unsigned Degree>
+	inline GemmElementwise resolve_activation_kernel() {
+		// Returns:
+		//   the widest kernel the host supports; the exact tier (Degree 0) stays with the C library, except for relu,
+		//   which is exact in every kernel
+#ifdef LEARNORAN_X86
+		const bool vectorized = Degree > 0 || A == Activation::relu;
+		if (vectorized && cpu_features().avx512) {
+			return &activation_kernel_avx512<A, Degree>;
+		}
+		if (vectorized && cpu_features().avx2) {
+			return &activation_kernel_avx2<A, Degree>;
+		}
+#endif
+		return &activation_kernel_generic<A, Degree>;
+	}
+
+	template <Activation A>
+	inline GemmElementwise resolve_activation_kernel(const ActivationAccuracy accuracy) {
+		switch (accuracy) {
+		case ActivationAccuracy::accurate:
+			return resolve_activation_kernel<A, ExpDegree<ActivationAccuracy::accurate>::value>();
+		case ActivationAccuracy::fast:
+			return resolve_activation_kernel<A, ExpDegree<ActivationAccuracy::fast>::value>();
+		default:
+			return resolve_activation_kernel<A, 0>();
+		}
+	}
+
+	inline GemmElementwise resolve_activation_kernel(const Activation activation, const ActivationAccuracy accuracy = ActivationAccuracy::exact) {
+		// Returns:
+		//   the array kernel of <activation> in the <accuracy> tier for this host, e.g. for a GemmEpilogue or for
+		//   callers that would otherwise dispatch on every call
+		switch (activation) {
+		case Activation::exp:
+			return resolve_activation_kernel<Activation::exp>(accuracy);
+		case Activation::sigmoid:
+			return resolve_activation_kernel<Activation::sigmoid>(accuracy);
+		case Activation::sigmoid_prime:
+			return resolve_activation_kernel<Activation::sigmoid_prime>(accuracy);
+		case Activation::tanh:
+			return resolve_activation_kernel<Activation::tanh>(accuracy);
+		default:
+			return resolve_activation_kernel<Activation::relu>(accuracy);
+		}
+	}
+
+	template <Activation A, unsigned Degree>
+	inline void activation_kernel(const double * input, double * output, const std::size_t count) {
+		resolve_activation_kernel<A, Degree>()(input, output, count);
+	}
+
+	template <Activation A>
+	inline void activation_kernel(const double * input, double * output, const std::size_t count, const ActivationAccuracy accuracy) {
+		resolve_activation_kernel<A>(accuracy)(input, output, count);
+	}
+
+	inline void activation_kernel(const Activation activation, const double * input, double * output, const std::size_t count,
+		const ActivationAccuracy accuracy = ActivationAccuracy::exact) {
+		// output[i] = activation(input[i]) for i < count
+		// Args:
+		// - input, output: arrays of <count> elements, which may be the same array
+		// - accuracy: see the table at the top of this file
+		resolve_activation_kernel(activation, accuracy)(input, output, count);
+	}
+
+	inline Matrix<double> & apply_activation(Matrix<double> & matrix, const Activation activation, const ActivationAccuracy accuracy = ActivationAccuracy::exact) {
+		// applies the activation to every element in place, one row at a time
+		// Returns:
+		//   matrix
+		const Shape shape = matrix.get_shape();
+		for (unsigned row = 0; row < shape.rows; row++) {
+			double * const elements = matrix.data() + row * matrix.get_pitch();
+			activation_kernel(activation, elements, elements, shape.cols, accuracy);
+		}
+		return matrix;
+	}
+}
+
+#endif
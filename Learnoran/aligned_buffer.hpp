@@ -0,0 +1,158 @@
+#ifndef _ALIGNED_BUFFER_HPP
+#define _ALIGNED_BUFFER_HPP
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <algorithm>
+#include <utility>
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+#include "span.hpp"
+
+namespace Learnoran {
+	const std::size_t CACHE_LINE_SIZE = 64;
+
+	inline void * aligned_allocate(const std::size_t bytes, const std::size_t alignment = CACHE_LINE_SIZE) {
+		if (bytes == 0) {
+			return nullptr;
+		}
+#ifdef _WIN32
+		void * memory = _aligned_malloc(bytes, alignment);
+#else
+		void * memory = nullptr;
+		if (posix_memalign(&memory, alignment, bytes) != 0) {
+			memory = nullptr;
+		}
+#endif
+		if (memory == nullptr) {
+			throw std::bad_alloc();
+		}
+		return memory;
+	}
+
+	inline void aligned_free(void * memory) {
+#ifdef _WIN32
+		_aligned_free(memory);
+#else
+		std::free(memory);
+#endif
+	}
+
+	inline std::size_t aligned_element_count(const std::size_t count, const std::size_t element_size, const std::size_t alignment = CACHE_LINE_SIZE) {
+		// rounds <count> up so that count * element_size is a multiple of <alignment>; used to pad columns and rows
+		// so that every one of them starts on its own aligned boundary
+		std::size_t granularity = 1;
+		while ((granularity * element_size) % alignment != 0) {
+			granularity++;
+		}
+		return (count + granularity - 1) / granularity * granularity;
+	}
+
+	template <typename T>
+	class AlignedBuffer {
+		// Owning, cache line aligned array of default constructed elements. Unlike std::vector the buffer never grows,
+		// which keeps pointers and spans into it valid for its whole lifetime
+	public:
+		AlignedBuffer() : elements(nullptr), count(0) { }
+
+		explicit AlignedBuffer(const std::size_t count) : elements(nullptr), count(0) {
+			allocate(count);
+		}
+
+		AlignedBuffer(const std::size_t count, const T & value) : elements(nullptr), count(0) {
+			allocate(count);
+			std::fill(elements, elements + count, value);
+		}
+
+		AlignedBuffer(const AlignedBuffer & rhs) : elements(nullptr), count(0) {
+			allocate(rhs.count);
+			std::copy(rhs.elements, rhs.elements + rhs.count, elements);
+		}
+
+		AlignedBuffer(AlignedBuffer && rhs) : elements(rhs.elements), count(rhs.count) {
+			rhs.elements = nullptr;
+			rhs.count = 0;
+		}
+
+		~AlignedBuffer() {
+			release();
+		}
+
+		AlignedBuffer & operator=(AlignedBuffer rhs) {
+			std::swap(elements, rhs.elements);
+			std::swap(count, rhs.count);
+
+			return *this;
+		}
+
+		T & operator[](const std::size_t index) {
+			return elements[index];
+		}
+
+		const T & operator[](const std::size_t index) const {
+			return elements[index];
+		}
+
+		T * data() {
+			return elements;
+		}
+
+		const T * data() const {
+			return elements;
+		}
+
+		std::size_t size() const {
+			return count;
+		}
+
+		Span<T> span() {
+			return Span<T>(elements, count);
+		}
+
+		Span<const T> span() const {
+			return Span<const T>(elements, count);
+		}
+	private:
+		void allocate(const std::size_t element_count) {
+			elements = static_cast<T *>(aligned_allocate(element_count * sizeof(T), std::max(CACHE_LINE_SIZE, alignof(T))));
+
+			std::size_t constructed = 0;
+			try {
+				for (; constructed < element_count; constructed++) {
+					new (elements + constructed) T();
+				}
+			}
+			catch (...) {
+				destroy(constructed);
+				aligned_free(elements);
+				elements = nullptr;
+				throw;
+			}
+			count = element_count;
+		}
+
+		void destroy(const std::size_t constructed) {
+			for (std::size_t i = 0; i < constructed; i++) {
+				elements[i].~T();
+			}
+		}
+
+		void release() {
+			if (elements != nullptr) {
+				destroy(count);
+				aligned_free(elements);
+			}
+			elements = nullptr;
+			count = 0;
+		}
+
+		T * elements;
+		std::size_t count;
+	};
+}
+
+#endif
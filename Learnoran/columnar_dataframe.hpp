@@ -0,0 +1,155 @@
+#ifndef _COLUMNAR_DATAFRAME_HPP
+#define _COLUMNAR_DATAFRAME_HPP
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <iostream> // std::cout, for debugging purposes only
+
+#include "lo_exception.hpp"
+#include "dataframe.hpp"
+#include "aligned_buffer.hpp"
+#include "span.hpp"
+
+namespace Learnoran {
+	template <typename T>
+	class ColumnarDataframe {
+		// Structure-of-arrays counterpart of Dataframe. Every feature column and the labels column is a contiguous,
+		// cache line aligned run of <pitch> elements inside a single allocation, column j starting at j * pitch.
+		// Copies share the storage; rows and columns are handed out as spans without copying any element.
+	public:
+		// Constructors
+
+		ColumnarDataframe() : rows(0), feature_columns(0), pitch(0), base(nullptr) { }
+
+		ColumnarDataframe(const std::vector<std::string> & csv_header, const std::size_t rows)
+			: columns(csv_header), schema(std::make_shared<DataframeSchema>(csv_header)), rows(rows), feature_columns(csv_header.size() - 1), pitch(aligned_element_count(rows, sizeof(T))) {
+			// allocates an uninitialized (default constructed) frame to be filled through the mutable accessors
+			std::shared_ptr<AlignedBuffer<T>> buffer = std::make_shared<AlignedBuffer<T>>(pitch * (feature_columns + 1));
+			base = buffer->data();
+			storage = std::shared_ptr<const void>(buffer, base);
+		}
+
+		explicit ColumnarDataframe(const Dataframe<T> & dataframe)
+			: ColumnarDataframe(dataframe.get_headers(), dataframe.shape().rows) {
+			// transposes a row-major Dataframe
+			for (std::size_t row = 0; row < rows; row++) {
+				const RowView<T> feature_row = dataframe.get_row_view(row);
+				for (std::size_t column = 0; column < feature_columns; column++) {
+					base[column * pitch + row] = feature_row[column];
+				}
+				base[feature_columns * pitch + row] = dataframe.get_row_label(row);
+			}
+		}
+
+		ColumnarDataframe(std::shared_ptr<const void> storage, const T * columns_base, const std::size_t pitch, const std::size_t rows, const std::vector<std::string> & csv_header)
+			: columns(csv_header), schema(std::make_shared<DataframeSchema>(csv_header)), rows(rows), feature_columns(csv_header.size() - 1), pitch(pitch), base(const_cast<T *>(columns_base)), storage(storage) {
+			// wraps externally owned column storage, e.g. a memory mapped file; <storage> keeps it alive
+		}
+
+		// Accessors
+
+		DataframeShape shape() const {
+			return DataframeShape(rows, feature_columns + 1);
+		}
+
+		std::size_t get_pitch() const {
+			// distance, in elements, between the starts of two consecutive columns
+			return pitch;
+		}
+
+		Span<const T> get_column(const std::size_t column) const {
+			assert(column < feature_columns);
+			return Span<const T>(base + column * pitch, rows);
+		}
+
+		Span<const T> get_labels() const {
+			return Span<const T>(base + feature_columns * pitch, rows);
+		}
+
+		const T * get_feature_data() const {
+			// first element of the first feature column; column j starts at get_feature_data() + j * get_pitch()
+			return base;
+		}
+
+		StridedSpan<const T> get_row_feature(const std::size_t row) const {
+			assert(row < rows);
+			return StridedSpan<const T>(base + row, feature_columns, pitch);
+		}
+
+		RowView<T> get_row_view(const std::size_t row) const {
+			assert(row < rows);
+			return RowView<T>(base + row, feature_columns, pitch, schema.get());
+		}
+
+		const DataframeSchema & get_schema() const {
+			return *schema;
+		}
+
+		const T & get_row_label(const std::size_t row) const {
+			return base[feature_columns * pitch + row];
+		}
+
+		// Mutable accessors, intended for filling a freshly allocated frame; copies of this frame share the storage
+
+		Span<T> get_mutable_column(const std::size_t column) {
+			assert(column < feature_columns);
+			return Span<T>(base + column * pitch, rows);
+		}
+
+		Span<T> get_mutable_labels() {
+			return Span<T>(base + feature_columns * pitch, rows);
+		}
+
+		std::vector<std::string> get_headers() const {
+			return columns;
+		}
+
+		std::vector<std::string> get_feature_headers() const {
+			return std::vector<std::string>(columns.begin(), columns.end() - 1);
+		}
+
+		std::string get_label_header() const {
+			return columns[columns.size() - 1];
+		}
+
+		Dataframe<T> to_dataframe() const {
+			std::vector<std::vector<T>> features(rows, std::vector<T>(feature_columns));
+			std::vector<T> labels(rows);
+
+			for (std::size_t row = 0; row < rows; row++) {
+				for (std::size_t column = 0; column < feature_columns; column++) {
+					features[row][column] = base[column * pitch + row];
+				}
+				labels[row] = get_row_label(row);
+			}
+
+			return Dataframe<T>(features, labels, columns);
+		}
+
+		void print_interval(const std::size_t lower_index, const std::size_t higher_index) const {
+			for (std::size_t i = 0; i < columns.size(); i++) {
+				std::cout << columns[i] << '\t';
+			}
+			std::cout << '\n';
+
+			for (std::size_t row = lower_index; row < higher_index; row++) {
+				for (std::size_t column = 0; column < feature_columns; column++) {
+					std::cout << base[column * pitch + row] << '\t';
+				}
+				std::cout << get_row_label(row) << '\n';
+			}
+		}
+	private:
+		std::vector<std::string> columns;
+		std::shared_ptr<const DataframeSchema> schema;
+		std::size_t rows;
+		std::size_t feature_columns;
+		std::size_t pitch;
+
+		T * base;
+		std::shared_ptr<const void> storage;
+	};
+}
+
+#endif
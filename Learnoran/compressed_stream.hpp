@@ -0,0 +1,349 @@
+#ifndef _COMPRESSED_STREAM_HPP
+#define _COMPRESSED_STREAM_HPP
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <istream>
+#include <fstream>
+#include <streambuf>
+
+#ifdef LEARNORAN_USE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef LEARNORAN_USE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "lo_exception.hpp"
+
+/*
+Transparent streaming decompression of .gz and .zst inputs.
+A decoder thread reads the compressed file and pushes decompressed blocks into a bounded buffer which the parsing thread
+drains through a std::streambuf, so decoding overlaps parsing and no decompressed temporary is ever written.
+
+gzip support requires zlib and is enabled by defining LEARNORAN_USE_ZLIB (link with -lz); zstd support requires libzstd
+and is enabled by defining LEARNORAN_USE_ZSTD (link with -lzstd).
+*/
+
+namespace Learnoran {
+	class BoundedBlockBuffer {
+		// Single producer, single consumer queue of at most <capacity> blocks
+	public:
+		explicit BoundedBlockBuffer(const std::size_t capacity) : capacity(capacity), closed(false), cancelled(false) { }
+
+		bool push(std::vector<char> && block) {
+			// blocks while the buffer is full; returns false if the consumer cancelled, in which case the producer should stop
+			std::unique_lock<std::mutex> lock(mutex);
+			not_full.wait(lock, [this]() { return blocks.size() < capacity || cancelled; });
+			if (cancelled) {
+				return false;
+			}
+			blocks.push_back(std::move(block));
+			not_empty.notify_one();
+			return true;
+		}
+
+		bool pop(std::vector<char> & block) {
+			// blocks while the buffer is empty; returns false once the producer closed the buffer and it is drained
+			// Throws:
+			//   the exception the producer closed the buffer with, if any, after the preceding blocks are drained
+			std::unique_lock<std::mutex> lock(mutex);
+			not_empty.wait(lock, [this]() { return !blocks.empty() || closed; });
+			if (blocks.empty()) {
+				if (error) {
+					std::rethrow_exception(error);
+				}
+				return false;
+			}
+			block = std::move(blocks.front());
+			blocks.pop_front();
+			not_full.notify_one();
+			return true;
+		}
+
+		void close(std::exception_ptr producer_error = nullptr) {
+			std::lock_guard<std::mutex> lock(mutex);
+			closed = true;
+			error = producer_error;
+			not_empty.notify_all();
+		}
+
+		void cancel() {
+			std::lock_guard<std::mutex> lock(mutex);
+			cancelled = true;
+			not_full.notify_all();
+		}
+	private:
+		const std::size_t capacity;
+		std::deque<std::vector<char>> blocks;
+		bool closed;
+		bool cancelled;
+		std::exception_ptr error;
+
+		std::mutex mutex;
+		std::condition_variable not_empty;
+		std::condition_variable not_full;
+	};
+
+	class BlockDecoder {
+		// Decompresses an input file block by block; implementations are only instantiated by the decoder thread
+	public:
+		virtual ~BlockDecoder() { }
+
+		// Returns:
+		//   the number of decompressed bytes written to <output>, 0 once the input is exhausted
+		virtual std::size_t decode(std::istream & compressed, char * output, const std::size_t capacity) = 0;
+	};
+
+#ifdef LEARNORAN_USE_ZLIB
+	class GzipDecoder : public BlockDecoder {
+	public:
+		GzipDecoder() : input(INPUT_BLOCK_SIZE), started(false), finished(false) {
+			stream.zalloc = Z_NULL;
+			stream.zfree = Z_NULL;
+			stream.opaque = Z_NULL;
+			stream.next_in = Z_NULL;
+			stream.avail_in = 0;
+			// 15 window bits + 16: expect a gzip header
+			if (inflateInit2(&stream, 15 + 16) != Z_OK) {
+				throw DecompressionException();
+			}
+		}
+
+		~GzipDecoder() {
+			inflateEnd(&stream);
+		}
+
+		std::size_t decode(std::istream & compressed, char * output, const std::size_t capacity) override {
+			stream.next_out = reinterpret_cast<Bytef *>(output);
+			stream.avail_out = static_cast<uInt>(capacity);
+
+			while (stream.avail_out > 0 && !finished) {
+				if (stream.avail_in == 0) {
+					compressed.read(input.data(), input.size());
+					stream.next_in = reinterpret_cast<Bytef *>(input.data());
+					stream.avail_in = static_cast<uInt>(compressed.gcount());
+					if (stream.avail_in == 0) {
+						// the file ended within a gzip member
+						if (started) {
+							throw DecompressionException();
+						}
+						break;
+					}
+					started = true;
+				}
+
+				const int status = inflate(&stream, Z_NO_FLUSH);
+				if (status == Z_STREAM_END) {
+					// concatenated gzip members (e.g. from parallel compressors) continue with the next member
+					if (stream.avail_in > 0 || compressed.peek() != std::char_traits<char>::eof()) {
+						inflateReset(&stream);
+					}
+					else {
+						finished = true;
+					}
+				}
+				else if (status != Z_OK && status != Z_BUF_ERROR) {
+					throw DecompressionException();
+				}
+			}
+
+			return capacity - stream.avail_out;
+		}
+	private:
+		static const std::size_t INPUT_BLOCK_SIZE = 1 << 16;
+
+		z_stream stream;
+		std::vector<char> input;
+		bool started;
+		bool finished;
+	};
+#endif
+
+#ifdef LEARNORAN_USE_ZSTD
+	class ZstdDecoder : public BlockDecoder {
+	public:
+		ZstdDecoder() : context(ZSTD_createDStream()), input(ZSTD_DStreamInSize()), frame_complete(true) {
+			if (context == nullptr) {
+				throw DecompressionException();
+			}
+			ZSTD_initDStream(context);
+			buffer.src = input.data();
+			buffer.size = 0;
+			buffer.pos = 0;
+		}
+
+		~ZstdDecoder() {
+			ZSTD_freeDStream(context);
+		}
+
+		std::size_t decode(std::istream & compressed, char * output, const std::size_t capacity) override {
+			ZSTD_outBuffer output_buffer = { output, capacity, 0 };
+
+			while (output_buffer.pos < output_buffer.size) {
+				if (buffer.pos == buffer.size) {
+					compressed.read(input.data(), input.size());
+					buffer.size = static_cast<std::size_t>(compressed.gcount());
+					buffer.pos = 0;
+					if (buffer.size == 0) {
+						// the file ended within a zstd frame
+						if (!frame_complete) {
+							throw DecompressionException();
+						}
+						break;
+					}
+				}
+
+				const std::size_t hint = ZSTD_decompressStream(context, &output_buffer, &buffer);
+				if (ZSTD_isError(hint)) {
+					throw DecompressionException();
+				}
+				frame_complete = hint == 0;
+			}
+
+			return output_buffer.pos;
+		}
+	private:
+		ZSTD_DStream * context;
+		std::vector<char> input;
+		ZSTD_inBuffer buffer;
+		bool frame_complete;
+	};
+#endif
+
+	class DecompressingStreambuf : public std::streambuf {
+		// Read-only streambuf over the decompressed content of a file, decoded ahead by a dedicated thread. Seeking is
+		// only supported to the current position and, before anything was read, to the beginning
+	public:
+		DecompressingStreambuf(const std::string & filename, std::unique_ptr<BlockDecoder> decoder)
+			: buffer(BUFFERED_BLOCKS), consumed(0) {
+			// Throws:
+			// - CannotOpenFileException: if the file cannot be opened
+			std::shared_ptr<std::ifstream> compressed = std::make_shared<std::ifstream>(filename, std::ios::binary);
+			if (!compressed->is_open()) {
+				throw CannotOpenFileException();
+			}
+
+			std::shared_ptr<BlockDecoder> shared_decoder(std::move(decoder));
+			BoundedBlockBuffer & blocks = buffer;
+			decoder_thread = std::thread([compressed, shared_decoder, &blocks]() {
+				try {
+					for (;;) {
+						std::vector<char> block(BLOCK_SIZE);
+						const std::size_t decoded = shared_decoder->decode(*compressed, block.data(), block.size());
+						if (decoded == 0) {
+							break;
+						}
+						block.resize(decoded);
+						if (!blocks.push(std::move(block))) {
+							break;
+						}
+					}
+					blocks.close();
+				}
+				catch (...) {
+					blocks.close(std::current_exception());
+				}
+			});
+		}
+
+		~DecompressingStreambuf() {
+			buffer.cancel();
+			decoder_thread.join();
+		}
+	protected:
+		int_type underflow() override {
+			if (gptr() < egptr()) {
+				return traits_type::to_int_type(*gptr());
+			}
+
+			consumed += current.size();
+			if (!buffer.pop(current)) {
+				current.clear();
+				return traits_type::eof();
+			}
+			setg(current.data(), current.data(), current.data() + current.size());
+			return traits_type::to_int_type(*gptr());
+		}
+
+		pos_type seekoff(off_type offset, std::ios_base::seekdir direction, std::ios_base::openmode which) override {
+			const std::streamoff position = static_cast<std::streamoff>(consumed) + (gptr() - eback());
+			if (offset == 0 && direction == std::ios_base::cur) {
+				return pos_type(position);
+			}
+			if (direction == std::ios_base::beg) {
+				return seekpos(pos_type(offset), which);
+			}
+			return pos_type(off_type(-1));
+		}
+
+		pos_type seekpos(pos_type position, std::ios_base::openmode) override {
+			const std::streamoff current_position = static_cast<std::streamoff>(consumed) + (gptr() - eback());
+			return static_cast<std::streamoff>(position) == current_position ? position : pos_type(off_type(-1));
+		}
+	private:
+		static const std::size_t BLOCK_SIZE = 1 << 18;
+		static const std::size_t BUFFERED_BLOCKS = 8;
+
+		BoundedBlockBuffer buffer;
+		std::vector<char> current;
+		std::size_t consumed; // bytes of the blocks preceding <current>
+		std::thread decoder_thread;
+	};
+
+	class DecompressingInputStream : public std::istream {
+	public:
+		DecompressingInputStream(const std::string & filename, std::unique_ptr<BlockDecoder> decoder)
+			: std::istream(nullptr), streambuf(filename, std::move(decoder)) {
+			rdbuf(&streambuf);
+			// decoder errors reach the reader instead of looking like the end of the file
+			exceptions(std::ios::badbit);
+		}
+	private:
+		DecompressingStreambuf streambuf;
+	};
+
+	inline bool has_extension(const std::string & filename, const std::string & extension) {
+		return filename.size() >= extension.size() && filename.compare(filename.size() - extension.size(), extension.size(), extension) == 0;
+	}
+
+	inline bool is_compressed_file(const std::string & filename) {
+		return has_extension(filename, ".gz") || has_extension(filename, ".zst");
+	}
+
+	inline std::unique_ptr<std::istream> open_input_stream(const std::string & filename) {
+		// Returns:
+		//   a stream over the (decompressed, for .gz and .zst files) content of the file
+		// Throws:
+		// - CannotOpenFileException: if the file cannot be opened
+		// - UnsupportedCompressionException: if the file is compressed with a format this build does not support
+		if (has_extension(filename, ".gz")) {
+#ifdef LEARNORAN_USE_ZLIB
+			return std::unique_ptr<std::istream>(new DecompressingInputStream(filename, std::unique_ptr<BlockDecoder>(new GzipDecoder())));
+#else
+			throw UnsupportedCompressionException();
+#endif
+		}
+		if (has_extension(filename, ".zst")) {
+#ifdef LEARNORAN_USE_ZSTD
+			return std::unique_ptr<std::istream>(new DecompressingInputStream(filename, std::unique_ptr<BlockDecoder>(new ZstdDecoder())));
+#else
+			throw UnsupportedCompressionException();
+#endif
+		}
+
+		std::unique_ptr<std::ifstream> stream(new std::ifstream(filename));
+		if (!stream->is_open()) {
+			throw CannotOpenFileException();
+		}
+		return std::unique_ptr<std::istream>(stream.release());
+	}
+}
+
+#endif
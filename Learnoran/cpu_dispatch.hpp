@@ -0,0 +1,67 @@
+#ifndef _CPU_DISPATCH_HPP
+#define _CPU_DISPATCH_HPP
+
+/*
+Runtime detection of the SIMD instruction sets of the host, for kernels that are compiled for several instruction sets
+and pick one at run time. Functions using instructions beyond the baseline of the build are marked with
+LEARNORAN_TARGET, which lets GCC and Clang emit them without compiling the whole program for that instruction set;
+MSVC accepts the intrinsics without it.
+*/
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define LEARNORAN_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define LEARNORAN_TARGET(isa) __attribute__((target(isa)))
+#else
+#define LEARNORAN_TARGET(isa)
+#endif
+
+namespace Learnoran {
+	struct CpuFeatures {
+		bool avx2; // AVX2 and FMA3
+		bool avx512; // AVX-512 Foundation
+		bool avx512bw; // AVX-512 Byte and Word instructions
+	};
+
+	inline CpuFeatures detect_cpu_features() {
+		CpuFeatures features = { false, false, false };
+#if defined(LEARNORAN_X86) && defined(_MSC_VER)
+		int registers[4];
+		__cpuid(registers, 0);
+		const int max_leaf = registers[0];
+		if (max_leaf < 7) {
+			return features;
+		}
+
+		__cpuid(registers, 1);
+		const bool fma = (registers[2] & (1 << 12)) != 0;
+		const bool os_saves_ymm = (registers[2] & (1 << 27)) != 0 && (_xgetbv(0) & 0x6) == 0x6;
+		const bool os_saves_zmm = os_saves_ymm && (_xgetbv(0) & 0xe6) == 0xe6;
+
+		__cpuidex(registers, 7, 0);
+		features.avx2 = fma && os_saves_ymm && (registers[1] & (1 << 5)) != 0;
+		features.avx512 = features.avx2 && os_saves_zmm && (registers[1] & (1 << 16)) != 0;
+		features.avx512bw = features.avx512 && (registers[1] & (1 << 30)) != 0;
+#elif defined(LEARNORAN_X86) && (defined(__GNUC__) || defined(__clang__))
+		__builtin_cpu_init();
+		features.avx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+		features.avx512 = features.avx2 && __builtin_cpu_supports("avx512f");
+		features.avx512bw = features.avx512 && __builtin_cpu_supports("avx512bw");
+#endif
+		return features;
+	}
+
+	inline const CpuFeatures & cpu_features() {
+		// detected once, on first use
+		static const CpuFeatures features = detect_cpu_features();
+		return features;
+	}
+}
+
+#endif
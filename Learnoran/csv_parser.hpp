@@ -0,0 +1,235 @@
+#ifndef _CSV_PARSER_HPP
+#define _CSV_PARSER_HPP
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#ifndef _SEQUENTIAL
+#include <omp.h>
+#endif
+
+#include "columnar_dataframe.hpp"
+
+/*
+Parallel CSV parsing straight into the column buffers of a ColumnarDataframe.
+The input (typically a MappedFile) is split into newline aligned chunks. A first parallel pass counts the rows of every
+chunk, which fixes the row each chunk starts at; after a single allocation of the dataframe a second parallel pass parses
+the chunks into their rows. Numbers are parsed without allocating, see parse_double.
+*/
+
+namespace Learnoran {
+	inline bool csv_is_digit(const char character) {
+		return character >= '0' && character <= '9';
+	}
+
+	inline const char * parse_double_fallback(const char * field_begin, const char * field_end, double & value) {
+		// strtod on a NUL terminated copy of the field, for the inputs the fast path does not handle (inf, nan, very
+		// long mantissas, large exponents); like strtod, unparsable fields read as 0
+		char buffer[128];
+		const std::size_t length = static_cast<std::size_t>(field_end - field_begin) < sizeof(buffer) - 1 ? field_end - field_begin : sizeof(buffer) - 1;
+		std::memcpy(buffer, field_begin, length);
+		buffer[length] = '\0';
+
+		value = std::strtod(buffer, nullptr);
+		return field_end;
+	}
+
+	inline const char * parse_double(const char * const begin, const char * const end, const char delimiter, double & value) {
+		// Parses the field starting at <begin> and ending at the next <delimiter> or at <end>.
+		// Decimal numbers whose significant digits fit into 53 bits and whose decimal exponent is at most 22 in
+		// magnitude are converted with a single, correctly rounded multiplication or division by an exact power of ten;
+		// everything else falls back to strtod
+		// Returns:
+		//   the end of the field, i.e. the position of the delimiter or <end>
+		static const double powers_of_ten[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+			1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+		const char * cursor = begin;
+		bool negative = false;
+		if (cursor < end && (*cursor == '-' || *cursor == '+')) {
+			negative = *cursor == '-';
+			cursor++;
+		}
+
+		std::uint64_t mantissa = 0;
+		int significant_digits = 0;
+		int exponent = 0;
+		bool any_digit = false;
+
+		for (; cursor < end && csv_is_digit(*cursor); cursor++) {
+			any_digit = true;
+			if (significant_digits < 19) {
+				mantissa = mantissa * 10 + (*cursor - '0');
+				significant_digits += mantissa != 0;
+			}
+			else {
+				exponent++;
+			}
+		}
+		if (cursor < end && *cursor == '.') {
+			for (cursor++; cursor < end && csv_is_digit(*cursor); cursor++) {
+				any_digit = true;
+				if (significant_digits < 19) {
+					mantissa = mantissa * 10 + (*cursor - '0');
+					significant_digits += mantissa != 0;
+					exponent--;
+				}
+			}
+		}
+		if (any_digit && cursor < end && (*cursor == 'e' || *cursor == 'E')) {
+			const char * exponent_cursor = cursor + 1;
+			bool negative_exponent = false;
+			if (exponent_cursor < end && (*exponent_cursor == '-' || *exponent_cursor == '+')) {
+				negative_exponent = *exponent_cursor == '-';
+				exponent_cursor++;
+			}
+
+			int explicit_exponent = 0;
+			bool any_exponent_digit = false;
+			for (; exponent_cursor < end && csv_is_digit(*exponent_cursor); exponent_cursor++) {
+				any_exponent_digit = true;
+				explicit_exponent = explicit_exponent < 10000 ? explicit_exponent * 10 + (*exponent_cursor - '0') : explicit_exponent;
+			}
+			if (any_exponent_digit) {
+				exponent += negative_exponent ? -explicit_exponent : explicit_exponent;
+				cursor = exponent_cursor;
+			}
+		}
+
+		const bool field_ends_here = cursor == end || *cursor == delimiter;
+		if (!any_digit || !field_ends_here || mantissa > (std::uint64_t(1) << 53) || exponent < -22 || exponent > 22) {
+			const char * field_end = cursor;
+			while (field_end < end && *field_end != delimiter) {
+				field_end++;
+			}
+			return parse_double_fallback(begin, field_end, value);
+		}
+
+		double magnitude = static_cast<double>(mantissa);
+		magnitude = exponent < 0 ? magnitude / powers_of_ten[-exponent] : magnitude * powers_of_ten[exponent];
+		value = negative ? -magnitude : magnitude;
+
+		return cursor;
+	}
+
+	inline const char * csv_line_end(const char * const begin, const char * const end) {
+		// Returns:
+		//   the position of the newline terminating the line that starts at <begin>, or <end>
+		const void * newline = std::memchr(begin, '\n', end - begin);
+		return newline != nullptr ? static_cast<const char *>(newline) : end;
+	}
+
+	inline const char * csv_content_end(const char * const begin, const char * line_end) {
+		// strips the carriage return of CRLF line endings
+		return line_end > begin && line_end[-1] == '\r' ? line_end - 1 : line_end;
+	}
+
+	inline std::vector<std::string> parse_csv_header_line(const char * const begin, const char * const end, const char delimiter) {
+		std::vector<std::string> columns;
+		const char * field_begin = begin;
+		for (const char * cursor = begin; cursor <= end; cursor++) {
+			if (cursor == end || *cursor == delimiter) {
+				columns.push_back(std::string(field_begin, cursor));
+				field_begin = cursor + 1;
+			}
+		}
+		return columns;
+	}
+
+	inline ColumnarDataframe<double> parse_csv_columnar(const char * const data, const std::size_t size, const char delimiter = ',') {
+		// Args:
+		// - data, size: the whole CSV text, the first line of which is the header; the last column holds the labels
+		// - delimiter: the delimiter separating the fields of a line
+		// Returns:
+		//   the parsed dataset; empty lines are skipped and missing trailing fields read as 0
+		// Throws:
+		// - EmptyDataframeException: if the input has no header
+		const char * const end = data + size;
+		const char * const header_end = csv_line_end(data, end);
+		const std::vector<std::string> csv_header = parse_csv_header_line(data, csv_content_end(data, header_end), delimiter);
+		if (size == 0 || csv_header.size() < 2) {
+			throw EmptyDataframeException();
+		}
+
+		const char * const body = header_end < end ? header_end + 1 : end;
+		const std::size_t body_size = end - body;
+
+#ifndef _SEQUENTIAL
+		const std::size_t requested_chunks = static_cast<std::size_t>(omp_get_max_threads()) * 4;
+#else
+		const std::size_t requested_chunks = 1;
+#endif
+		// chunk boundaries are moved forward to the start of the next line
+		std::vector<const char *> boundaries(1, body);
+		for (std::size_t chunk = 1; chunk < requested_chunks; chunk++) {
+			const char * boundary = body + body_size * chunk / requested_chunks;
+			if (boundary <= boundaries.back()) {
+				continue;
+			}
+			if (boundary[-1] != '\n') {
+				boundary = csv_line_end(boundary, end);
+				boundary = boundary < end ? boundary + 1 : end;
+			}
+			if (boundary > boundaries.back() && boundary < end) {
+				boundaries.push_back(boundary);
+			}
+		}
+		boundaries.push_back(end);
+		const int chunk_count = static_cast<int>(boundaries.size() - 1);
+
+		// 1 - count the rows of every chunk
+		std::vector<std::size_t> chunk_rows(chunk_count + 1, 0);
+#ifndef _SEQUENTIAL
+#pragma omp parallel for schedule(dynamic)
+#endif
+		for (int chunk = 0; chunk < chunk_count; chunk++) {
+			std::size_t rows = 0;
+			for (const char * line = boundaries[chunk]; line < boundaries[chunk + 1];) {
+				const char * const line_end = csv_line_end(line, boundaries[chunk + 1]);
+				rows += csv_content_end(line, line_end) > line;
+				line = line_end + 1;
+			}
+			chunk_rows[chunk + 1] = rows;
+		}
+		for (int chunk = 0; chunk < chunk_count; chunk++) {
+			chunk_rows[chunk + 1] += chunk_rows[chunk];
+		}
+
+		// 2 - parse every chunk into its rows of the preallocated columns
+		ColumnarDataframe<double> dataframe(csv_header, chunk_rows[chunk_count]);
+		const std::size_t column_count = csv_header.size();
+		const std::size_t pitch = dataframe.get_pitch();
+		double * const columns_base = dataframe.get_mutable_column(0).data();
+
+#ifndef _SEQUENTIAL
+#pragma omp parallel for schedule(dynamic)
+#endif
+		for (int chunk = 0; chunk < chunk_count; chunk++) {
+			std::size_t row = chunk_rows[chunk];
+			for (const char * line = boundaries[chunk]; line < boundaries[chunk + 1];) {
+				const char * const line_end = csv_line_end(line, boundaries[chunk + 1]);
+				const char * const content_end = csv_content_end(line, line_end);
+
+				if (content_end > line) {
+					const char * cursor = line;
+					for (std::size_t column = 0; column < column_count; column++) {
+						double value = 0.0;
+						if (cursor <= content_end) {
+							cursor = parse_double(cursor, content_end, delimiter, value) + 1;
+						}
+						columns_base[column * pitch + row] = value;
+					}
+					row++;
+				}
+				line = line_end + 1;
+			}
+		}
+
+		return dataframe;
+	}
+}
+
+#endif
@@ -6,8 +6,13 @@
 #include <string>
 #include <iostream> // std::std::cout, for debugging purposes only
 #include <unordered_map>
+#include <memory>
+#include <atomic>
+#include <cassert>
+#include <algorithm>
 
 #include "lo_exception.hpp"
+#include "random.hpp"
 
 namespace Learnoran {
 	struct DataframeShape {
@@ -17,73 +22,246 @@ namespace Learnoran {
 		size_t columns;
 	};
 
+	class DataframeSchema {
+		// Column names of a dataframe together with a name to index lookup that is built once and shared by every row
+		// view of the frame. Each schema carries a process-wide unique id so that consumers can cache work resolved
+		// against it (e.g. compiled models) without holding on to the schema itself
+	public:
+		DataframeSchema(const std::vector<std::string> & csv_header)
+			: feature_symbols(csv_header.begin(), csv_header.end() - 1), label_symbol(csv_header.back()), id(next_id()) {
+			for (std::size_t column = 0; column < feature_symbols.size(); column++) {
+				column_indices.insert({ feature_symbols[column], column });
+			}
+		}
+
+		std::size_t index_of(const std::string & symbol) const {
+			// Throws:
+			// - MissingColumnException: if the schema has no feature column named <symbol>
+			std::unordered_map<std::string, std::size_t>::const_iterator find_result = column_indices.find(symbol);
+			if (find_result == column_indices.cend()) {
+				throw MissingColumnException();
+			}
+			return find_result->second;
+		}
+
+		std::vector<std::size_t> resolve(const std::vector<std::string> & symbols) const {
+			// Returns:
+			//   the feature column index of each symbol, in the order of <symbols>
+			std::vector<std::size_t> indices(symbols.size());
+			for (std::size_t i = 0; i < symbols.size(); i++) {
+				indices[i] = index_of(symbols[i]);
+			}
+			return indices;
+		}
+
+		const std::vector<std::string> & get_feature_symbols() const {
+			return feature_symbols;
+		}
+
+		const std::string & get_label_symbol() const {
+			return label_symbol;
+		}
+
+		std::size_t get_id() const {
+			return id;
+		}
+	private:
+		static std::size_t next_id() {
+			static std::atomic<std::size_t> counter(0);
+			return ++counter;
+		}
+
+		std::vector<std::string> feature_symbols;
+		std::string label_symbol;
+		std::unordered_map<std::string, std::size_t> column_indices;
+		std::size_t id;
+	};
+
+	template <typename T>
+	class RowView {
+		// Non-owning view over the feature values of one dataframe row. Values are <stride> elements apart, which
+		// covers row-major (stride 1) and columnar (stride = column pitch) storage alike. An optional column map
+		// redirects logical column j to physical column column_map[j], e.g. to present the row in a model's order.
+		// A view is only valid as long as the dataframe it was taken from
+	public:
+		RowView(const T * values, const std::size_t count, const std::size_t stride, const DataframeSchema * schema, const std::size_t * column_map = nullptr)
+			: values(values), count(count), stride(stride), schema(schema), column_map(column_map) { }
+
+		const T & operator[](const std::size_t column) const {
+			assert(column < count);
+			return values[(column_map == nullptr ? column : column_map[column]) * stride];
+		}
+
+		const T & operator[](const std::string & symbol) const {
+			return (*this)[get_schema().index_of(symbol)];
+		}
+
+		std::size_t size() const {
+			return count;
+		}
+
+		bool is_contiguous() const {
+			return stride == 1 && column_map == nullptr;
+		}
+
+		const T * data() const {
+			// only meaningful for contiguous views
+			return values;
+		}
+
+		const DataframeSchema & get_schema() const {
+			assert(schema != nullptr);
+			return *schema;
+		}
+
+		std::vector<std::size_t> resolve(const std::vector<std::string> & symbols) const {
+			// Returns:
+			//   physical column indices for <symbols>, suitable for reorder()
+			std::vector<std::size_t> indices = get_schema().resolve(symbols);
+			if (column_map != nullptr) {
+				for (std::size_t & index : indices) {
+					index = column_map[index];
+				}
+			}
+			return indices;
+		}
+
+		RowView reorder(const std::vector<std::size_t> & physical_columns) const {
+			// Returns:
+			//   a view of the same row whose column j is physical column physical_columns[j]; the vector must outlive
+			//   the returned view, which carries no schema
+			return RowView(values, physical_columns.size(), stride, nullptr, physical_columns.data());
+		}
+
+		std::unordered_map<std::string, T> to_map() const {
+			// materializes the row in the legacy symbol keyed form; copies every value
+			std::unordered_map<std::string, T> feature_row;
+			const std::vector<std::string> & symbols = get_schema().get_feature_symbols();
+			for (std::size_t column = 0; column < count; column++) {
+				feature_row.insert({ symbols[column], (*this)[column] });
+			}
+			return feature_row;
+		}
+	private:
+		const T * values;
+		std::size_t count;
+		std::size_t stride;
+		const DataframeSchema * schema;
+		const std::size_t * column_map;
+	};
+
+	class SchemaBinding {
+		// Remembers where a fixed, ordered list of symbols lives in the most recently seen schema, so that a model
+		// consuming RowViews resolves its input symbols once per schema instead of once per row
+	public:
+		SchemaBinding() : schema_id(0) { }
+
+		template <typename T>
+		RowView<T> bind(const RowView<T> & row, const std::vector<std::string> & symbols) {
+			// Returns:
+			//   <row> presented in the order of <symbols>; valid until the next bind() with a different schema
+			// Throws:
+			// - MissingColumnException: if the row lacks any of <symbols>
+			if (schema_id != row.get_schema().get_id()) {
+				order = row.resolve(symbols);
+				schema_id = row.get_schema().get_id();
+			}
+			return row.reorder(order);
+		}
+
+		void reset() {
+			schema_id = 0;
+		}
+	private:
+		std::size_t schema_id; // 0 never names a schema
+		std::vector<std::size_t> order;
+	};
+
 	template <typename T>
 	class Dataframe {
+		// Immutable table of feature rows and labels. The rows live in reference counted storage shared by every copy
+		// and by every view obtained through slice, take, select, train_test_split and k_fold; a view only records
+		// which stored rows (a range, possibly wrapping around, over the storage or over a shared index list) and
+		// which feature columns it exposes, so copying or partitioning a dataframe never copies its data
 	public:
 		// Constructors
 		Dataframe(std::pair<std::vector<std::vector<T>>, std::vector<T>> dataset, std::vector<std::string> csv_header)
-			: features(dataset.first), labels(dataset.second), columns(csv_header) {}
+			: Dataframe(std::move(dataset.first), std::move(dataset.second), std::move(csv_header)) { }
 
 		Dataframe(std::vector<std::vector<T>> features, std::vector<T> labels, std::vector<std::string> csv_header)
-			: features(features), labels(labels), columns(csv_header) { }
-
-		Dataframe(const Dataframe<T> & rhs) {
-			features = rhs.features;
-			labels = rhs.labels;
-			columns = rhs.columns;
+			: storage(std::make_shared<Storage>(std::move(features), std::move(labels))), row_begin(0), columns(csv_header), schema(std::make_shared<DataframeSchema>(csv_header)) {
+			row_count = storage->labels.size();
 		}
 
-		Dataframe(const Dataframe<T> && rhs) {
-			features = rhs.features;
-			labels = rhs.labels;
-			columns = rhs.columns;
-		}
 		// Accessors
 		DataframeShape shape() const {
 			// Returns:
-			//   A std::pair <# rows, # columns>
-			try {
-				return DataframeShape(features.size(), features[0].size() + 1);
-			}
-			catch (DataframeException & exc) {
-				std::cout << exc.what();
-			}
+			//   the number of rows and columns (features and the label) exposed by this dataframe
+			return DataframeShape(row_count, columns.size());
+		}
+
+		bool is_view() const {
+			// Returns:
+			//   false if this dataframe exposes its storage as a whole and in stored order
+			return row_index != nullptr || row_begin != 0 || row_count != storage->labels.size() || column_map != nullptr;
 		}
 
 		const std::vector<T> & get_labels() const {
-			return labels;
+			// Throws:
+			// - DataframeViewException: if this dataframe is a view, see materialize()
+			if (is_view()) {
+				throw DataframeViewException();
+			}
+			return storage->labels;
 		}
 
 		const std::vector<std::vector<T>> & get_features() const {
-			return features;
+			// Throws:
+			// - DataframeViewException: if this dataframe is a view, see materialize()
+			if (is_view()) {
+				throw DataframeViewException();
+			}
+			return storage->features;
 		}
 
 		std::unordered_map<std::string, T> get_row_feature(const unsigned index) const {
-			const std::vector<T> & values = features[index];
+			const std::vector<T> & values = storage->features[physical_row(index)];
 			std::unordered_map<std::string, T> feature_row;
 
-			for (unsigned short index = 0; index < values.size(); index++) {
-				feature_row.insert({ columns[index], values[index] });
+			for (unsigned short column = 0; column < columns.size() - 1; column++) {
+				feature_row.insert({ columns[column], values[physical_column(column)] });
 			}
 			return feature_row;
 		}
 
+		RowView<T> get_row_view(const unsigned index) const {
+			// zero-copy alternative to get_row_feature, see RowView
+			return RowView<T>(storage->features[physical_row(index)].data(), columns.size() - 1, 1, schema.get(), column_map != nullptr ? column_map->data() : nullptr);
+		}
+
+		const DataframeSchema & get_schema() const {
+			return *schema;
+		}
+
 		const T & get_row_label(const unsigned index) const {
-			return labels[index];
+			return storage->labels[physical_row(index)];
 		}
 
 		const std::vector<T> & get_row_feature_array(const unsigned index) const {
-			return features[index];
+			// the stored row; not available on views that select a subset of the columns, use get_row_view instead
+			assert(column_map == nullptr);
+			return storage->features[physical_row(index)];
 		}
 
 		void print_interval(unsigned lower_index, unsigned higher_index) const {
 			print_header();
 
 			for (unsigned i = lower_index; i < higher_index; i++) {
+				const RowView<T> row = get_row_view(i);
 				for (unsigned j = 0; j < columns.size() - 1; j++) {
-					std::cout << features[i][j] << '\t';
+					std::cout << row[j] << '\t';
 				}
-				std::cout << labels[i] << '\n';
+				std::cout << get_row_label(i) << '\n';
 			}
 		}
 
@@ -98,7 +276,114 @@ namespace Learnoran {
 		std::string get_label_header() const {
 			return columns[columns.size() - 1];
 		}
+
+		// Views
+
+		Dataframe slice(const std::size_t begin, const std::size_t end) const {
+			// Returns:
+			//   a view of the rows [begin, end) of this dataframe
+			assert(begin <= end && end <= row_count);
+			Dataframe view(*this);
+			view.row_begin = wrap(row_begin + begin);
+			view.row_count = end - begin;
+			return view;
+		}
+
+		Dataframe take(const std::vector<std::size_t> & rows) const {
+			// Returns:
+			//   a view of the given rows of this dataframe, in the given order; only the row indices are stored
+			std::shared_ptr<std::vector<std::size_t>> index = std::make_shared<std::vector<std::size_t>>(rows.size());
+			for (std::size_t row = 0; row < rows.size(); row++) {
+				(*index)[row] = physical_row(rows[row]);
+			}
+
+			Dataframe view(*this);
+			view.row_index = index;
+			view.row_begin = 0;
+			view.row_count = rows.size();
+			return view;
+		}
+
+		Dataframe select(const std::vector<std::string> & feature_symbols) const {
+			// Returns:
+			//   a view exposing only the given feature columns, in the given order, followed by the label
+			// Throws:
+			// - MissingColumnException: if any of <feature_symbols> is not a feature column of this dataframe
+			std::shared_ptr<std::vector<std::size_t>> selected_columns = std::make_shared<std::vector<std::size_t>>(feature_symbols.size());
+			for (std::size_t column = 0; column < feature_symbols.size(); column++) {
+				(*selected_columns)[column] = physical_column(schema->index_of(feature_symbols[column]));
+			}
+
+			std::vector<std::string> view_columns(feature_symbols);
+			view_columns.push_back(get_label_header());
+
+			Dataframe view(*this);
+			view.column_map = selected_columns;
+			view.columns = view_columns;
+			view.schema = std::make_shared<DataframeSchema>(view_columns);
+			return view;
+		}
+
+		std::pair<Dataframe, Dataframe> train_test_split(const double test_fraction, const bool shuffle = true, const unsigned seed = 0) const {
+			// Args:
+			// - test_fraction: share of the rows assigned to the test set
+			// - shuffle: if true, rows are assigned in a random order determined by <seed>, otherwise the last rows form the test set
+			// Returns:
+			//   a <train, test> pair of views; at most one shared row index (for the shuffled order) is allocated
+			assert(test_fraction >= 0.0 && test_fraction <= 1.0);
+			const Dataframe ordered = ordered_rows(shuffle, seed);
+			const std::size_t test_rows = static_cast<std::size_t>(test_fraction * row_count + 0.5);
+
+			return std::make_pair(ordered.slice(0, row_count - test_rows), ordered.slice(row_count - test_rows, row_count));
+		}
+
+		std::vector<std::pair<Dataframe, Dataframe>> k_fold(const unsigned folds, const bool shuffle = true, const unsigned seed = 0) const {
+			// Returns:
+			//   <train, test> views for each of the <folds> partitions; the training view of a fold is the rest of the
+			//   rows, expressed as a single range wrapping around the end of the fold's test rows
+			assert(folds > 1 && folds <= row_count);
+			const Dataframe ordered = ordered_rows(shuffle, seed);
+
+			std::vector<std::pair<Dataframe, Dataframe>> partitions;
+			partitions.reserve(folds);
+			for (unsigned fold = 0; fold < folds; fold++) {
+				const std::size_t test_begin = row_count * fold / folds;
+				const std::size_t test_end = row_count * (fold + 1) / folds;
+
+				Dataframe train(ordered);
+				train.row_begin = wrap(ordered.row_begin + test_end, ordered.source_rows());
+				train.row_count = row_count - (test_end - test_begin);
+
+				partitions.push_back(std::make_pair(train, ordered.slice(test_begin, test_end)));
+			}
+
+			return partitions;
+		}
+
+		Dataframe materialize() const {
+			// Returns:
+			//   a dataframe owning a copy of the rows and columns exposed by this view
+			std::vector<std::vector<T>> features(row_count, std::vector<T>(columns.size() - 1));
+			std::vector<T> labels(row_count);
+
+			for (std::size_t row = 0; row < row_count; row++) {
+				const RowView<T> values = get_row_view(row);
+				for (std::size_t column = 0; column < values.size(); column++) {
+					features[row][column] = values[column];
+				}
+				labels[row] = get_row_label(row);
+			}
+
+			return Dataframe(std::move(features), std::move(labels), columns);
+		}
 	private:
+		struct Storage {
+			Storage(std::vector<std::vector<T>> && features, std::vector<T> && labels) : features(std::move(features)), labels(std::move(labels)) { }
+
+			const std::vector<std::vector<T>> features;
+			const std::vector<T> labels;
+		};
+
 		void print_header() const {
 			for (unsigned short i = 0; i < columns.size(); i++) {
 				std::cout << columns[i] << '\t';
@@ -106,9 +391,57 @@ namespace Learnoran {
 			std::cout << '\n';
 		}
 
-		std::vector<std::vector<T>> features;
-		std::vector<T> labels;
+		std::size_t source_rows() const {
+			// length of the sequence the row range of this view is taken from
+			return row_index != nullptr ? row_index->size() : storage->labels.size();
+		}
+
+		std::size_t wrap(const std::size_t position) const {
+			return wrap(position, source_rows());
+		}
+
+		static std::size_t wrap(const std::size_t position, const std::size_t length) {
+			return position >= length ? position - length : position;
+		}
+
+		std::size_t physical_row(const std::size_t row) const {
+			assert(row < row_count);
+			const std::size_t position = wrap(row_begin + row);
+			return row_index != nullptr ? (*row_index)[position] : position;
+		}
+
+		std::size_t physical_column(const std::size_t column) const {
+			return column_map != nullptr ? (*column_map)[column] : column;
+		}
+
+		Dataframe ordered_rows(const bool shuffle, const unsigned seed) const {
+			// Returns:
+			//   a view of the same rows whose range covers its whole source, optionally in shuffled order, so that
+			//   partitions of it can wrap around
+			if (!shuffle && row_count == source_rows()) {
+				return *this;
+			}
+
+			std::vector<std::size_t> rows(row_count);
+			for (std::size_t row = 0; row < row_count; row++) {
+				rows[row] = row;
+			}
+			if (shuffle) {
+				Philox4x32 generator(seed);
+				shuffle_range(rows.begin(), rows.end(), generator);
+			}
+
+			return take(rows);
+		}
+
+		std::shared_ptr<const Storage> storage;
+		std::shared_ptr<const std::vector<std::size_t>> row_index; // nullptr: the range is taken over the stored rows
+		std::size_t row_begin;
+		std::size_t row_count;
+		std::shared_ptr<const std::vector<std::size_t>> column_map; // nullptr: every stored feature column, in order
+
 		std::vector<std::string> columns;
+		std::shared_ptr<const DataframeSchema> schema;
 	};
 }
 
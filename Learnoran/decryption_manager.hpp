@@ -47,7 +47,7 @@ namespace Learnoran {
 #pragma omp parallel for
 #endif
 			for (int row = 0; row < shape.rows; row++) {
-				const std::vector<EncryptedNumber> & feature_row = df.get_row_feature_array(row);
+				const RowView<EncryptedNumber> feature_row = df.get_row_view(row);
 				const size_t feature_columns = shape.columns - 1;
 				decrypted_features[row].resize(feature_columns);
 
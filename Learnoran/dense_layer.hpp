@@ -0,0 +1,72 @@
+#ifndef _DENSE_LAYER_HPP
+#define _DENSE_LAYER_HPP
+
+#include <cassert>
+#include <algorithm>
+
+#include "matrix.hpp"
+#include "gemm.hpp"
+
+namespace Learnoran {
+	// Fully connected layer kernels. The product, bias and activation of a forward pass are a single GEMM whose epilogue
+	// (see GemmEpilogue) finishes every tile of the layer while it is in L1, instead of separate passes reading back the
+	// whole layer. The element functions come from resolve_activation_kernel in activation.hpp
+
+	const std::size_t DENSE_LAYER_CHUNK = 512; // elements of activation derivative computed at a time, on the stack
+
+	inline void apply_derivative(const double * outputs, const GemmElementwise derivative, double * gradients, const std::size_t count) {
+		// gradients[i] *= derivative(outputs[i]) for i < count, one chunk at a time so that the factors never leave L1
+		alignas(CACHE_LINE_SIZE) double factors[DENSE_LAYER_CHUNK];
+		for (std::size_t first = 0; first < count; first += DENSE_LAYER_CHUNK) {
+			const std::size_t chunk = std::min(DENSE_LAYER_CHUNK, count - first);
+			derivative(outputs + first, factors, chunk);
+			for (std::size_t i = 0; i < chunk; i++) {
+				gradients[first + i] *= factors[i];
+			}
+		}
+	}
+
+	inline void dense_layer_forward(const MatrixView<const double> & inputs, const MatrixView<const double> & weights, const double bias,
+		const GemmElementwise activation, const MatrixView<double> & outputs) {
+		// outputs = activation(inputs * weights + bias)
+		// Args:
+		// - inputs: one row per sample, one column per neuron of the source layer
+		// - weights: (source neurons) x (layer neurons)
+		// - activation: none if null, e.g. for an output layer
+		// - outputs: one row per sample, one column per neuron of the layer; its rows must be contiguous
+		const GemmEpilogue epilogue = GemmEpilogue::dense(bias, activation);
+		gemm(1.0, inputs, weights, 0.0, outputs, GemmKernel::automatic, &epilogue);
+	}
+
+	inline void dense_layer_forward(const MatrixView<const double> & inputs, const GemmPackedMatrix & weights, const double bias,
+		const GemmElementwise activation, const MatrixView<double> & outputs) {
+		// Same as above with prepacked weights
+		assert(inputs.get_shape().cols == weights.get_rows() && outputs.get_shape().cols == weights.get_cols());
+		assert(inputs.get_shape().rows == outputs.get_shape().rows && outputs.get_col_stride() == 1);
+
+		const GemmEpilogue epilogue = GemmEpilogue::dense(bias, activation);
+		gemm(inputs.get_shape().rows, 1.0, inputs.data(), inputs.get_row_stride(), inputs.get_col_stride(), weights, 0.0, outputs.data(), outputs.get_row_stride(), &epilogue);
+	}
+
+	inline void dense_layer_backward(const MatrixView<const double> & next_gradients, const MatrixView<const double> & next_weights,
+		const MatrixView<const double> & outputs, const GemmElementwise derivative, const MatrixView<double> & gradients) {
+		// gradients = (next_gradients * next_weights^T) .* derivative(outputs), the gradients of a hidden layer. Unlike
+		// the activation, the derivative does not depend on the product, and is applied row by row after it: over
+		// whole rows, the derivative kernel runs on long vectors instead of the few elements of a tile
+		// Args:
+		// - next_gradients: the gradients of the next layer, one row per sample
+		// - next_weights: the connections from this layer to the next one
+		// - outputs: the outputs of this layer, one row per sample
+		// - gradients: one row per sample, one column per neuron of this layer; its rows must be contiguous
+		const Shape shape = gradients.get_shape();
+		assert(outputs.get_shape().rows == shape.rows && outputs.get_shape().cols == shape.cols);
+		assert(outputs.get_col_stride() == 1 && gradients.get_col_stride() == 1);
+
+		gemm(1.0, next_gradients, next_weights.transpose(), 0.0, gradients);
+		for (unsigned row = 0; row < shape.rows; row++) {
+			apply_derivative(outputs.data() + row * outputs.get_row_stride(), derivative, gradients.data() + row * gradients.get_row_stride(), shape.cols);
+		}
+	}
+}
+
+#endif
@@ -34,6 +34,7 @@ namespace Learnoran {
 		EncryptedNumber & operator=(const EncryptedNumber rhs) {
 			this->ciphertext = rhs.ciphertext;
 			this->evaluator = rhs.evaluator;
+			this->encoder = rhs.encoder;
 			return *this;
 		}
 
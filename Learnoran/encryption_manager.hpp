@@ -7,6 +7,7 @@
 
 #include "encrypted_number.hpp"
 #include "dataframe.hpp"
+#include "columnar_dataframe.hpp"
 #include "seal_parameters.hpp"
 
 /*
@@ -88,7 +89,7 @@ namespace Learnoran {
 #pragma omp parallel for
 #endif
 			for (int row = 0; row < shape.rows; row++) {
-				const std::vector<double> & feature_row = df.get_row_feature_array(row);
+				const RowView<double> feature_row = df.get_row_view(row);
 				const size_t feature_columns = shape.columns - 1;
 				encrypted_features[row].resize(feature_columns);
 
@@ -104,6 +105,28 @@ namespace Learnoran {
 			return encrypted_df;
 		}
 	
+		ColumnarDataframe<EncryptedNumber> encrypt_dataframe(const ColumnarDataframe<double> & df) const {
+			// encrypts column by column straight into the aligned column buffers of the result
+			const DataframeShape shape = df.shape();
+			const size_t feature_columns = shape.columns - 1;
+
+			ColumnarDataframe<EncryptedNumber> encrypted_df(df.get_headers(), shape.rows);
+
+			for (unsigned col = 0; col <= feature_columns; col++) {
+				const Span<const double> plain_column = col < feature_columns ? df.get_column(col) : df.get_labels();
+				const Span<EncryptedNumber> encrypted_column = col < feature_columns ? encrypted_df.get_mutable_column(col) : encrypted_df.get_mutable_labels();
+
+#ifndef _SEQUENTIAL
+#pragma omp parallel for
+#endif
+				for (int row = 0; row < static_cast<int>(shape.rows); row++) {
+					encrypted_column[row] = encrypt(plain_column[row]);
+				}
+			}
+
+			return encrypted_df;
+		}
+
 		EncryptedNumber get_zero() const {
 			seal::Plaintext zero_value = encoder->encode(0.0);
 			seal::Ciphertext encrypted_zero;
@@ -112,6 +135,11 @@ namespace Learnoran {
 			return EncryptedNumber(encrypted_zero, evaluator, encoder);
 		}
 
+		EncryptedNumber wrap(const seal::Ciphertext & ciphertext) const {
+			// a ciphertext loaded from storage, e.g. a .lomf file, that was encrypted under the keys of this manager
+			return EncryptedNumber(ciphertext, evaluator, encoder);
+		}
+
 		seal::SecretKey get_secret_key() const {
 			return secret_key; 
 		}
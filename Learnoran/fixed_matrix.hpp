@@ -0,0 +1,296 @@
+#ifndef _FIXED_MATRIX_HPP
+#define _FIXED_MATRIX_HPP
+
+#include <vector>
+#include <iostream>
+#include <assert.h>
+#include <initializer_list>
+
+#include "matrix.hpp"
+
+/*
+Matrices whose shape is part of their type.
+A FixedMatrix<T, R, C> keeps its R * C elements inline (on the stack, or inside the object that owns it), so creating
+one never allocates, and multiplying matrices of incompatible shapes does not compile. Every kernel below is unrolled
+at compile time through FixedUnroll: the loop counters become constants, which lets the compiler keep small matrices
+in registers. Meant for small layers; for large matrices use Matrix, whose products go through the packed GEMM.
+*/
+
+// MARK: Unrolling
+
+template <unsigned Begin, unsigned Count>
+struct FixedUnroll {
+	// calls function(Begin), ..., function(Begin + Count - 1); splitting the range in halves keeps the template
+	// recursion depth logarithmic in Count
+	template <typename Function>
+	static void apply(const Function & function) {
+		FixedUnroll<Begin, Count / 2>::apply(function);
+		FixedUnroll<Begin + Count / 2, Count - Count / 2>::apply(function);
+	}
+};
+
+template <unsigned Begin>
+struct FixedUnroll<Begin, 1> {
+	template <typename Function>
+	static void apply(const Function & function) {
+		function(Begin);
+	}
+};
+
+template <unsigned Begin>
+struct FixedUnroll<Begin, 0> {
+	template <typename Function>
+	static void apply(const Function &) { }
+};
+
+// MARK: FixedMatrix
+
+template <typename T, unsigned R, unsigned C>
+class FixedMatrix {
+	// Row-major R x C matrix stored inline, without padding
+	static_assert(R > 0 && C > 0, "FixedMatrix dimensions must be positive");
+public:
+	typedef T value_type;
+	static const unsigned row_count = R;
+	static const unsigned col_count = C;
+
+	// CONSTRUCTORS
+	FixedMatrix() : elements() { } // zero-initialized
+
+	FixedMatrix(std::initializer_list<std::initializer_list<T>> values) : elements() {
+		// Args:
+		// - values: rows of the matrix, i.e. { { 1, 2 }, { 3, 4 } }
+		assert(values.size() == R);
+
+		unsigned row = 0;
+		for (const std::initializer_list<T> & row_values : values) {
+			assert(row_values.size() == C);
+
+			unsigned col = 0;
+			for (const T & value : row_values) {
+				elements[row * C + col++] = value;
+			}
+			row++;
+		}
+	}
+
+	explicit FixedMatrix(const Matrix<T> & matrix) : elements() {
+		// copies a dynamic matrix of the same shape
+		assert(matrix.get_shape().rows == R && matrix.get_shape().cols == C);
+
+		for (unsigned row = 0; row < R; row++) {
+			for (unsigned col = 0; col < C; col++) {
+				elements[row * C + col] = matrix(row, col);
+			}
+		}
+	}
+
+	Shape get_shape() const {
+		return Shape(R, C);
+	}
+
+	T * data() {
+		return elements;
+	}
+
+	const T * data() const {
+		return elements;
+	}
+
+	Matrix<T> to_matrix() const {
+		Matrix<T> matrix(R, C);
+		for (unsigned row = 0; row < R; row++) {
+			for (unsigned col = 0; col < C; col++) {
+				matrix(row, col) = elements[row * C + col];
+			}
+		}
+		return matrix;
+	}
+
+	void print(std::ostream & flux) const {
+		for (unsigned row = 0; row < R; row++) {
+			for (unsigned col = 0; col < C; col++) {
+				flux << elements[row * C + col] << ' ';
+			}
+			flux << '\n';
+		}
+	}
+
+	// GETTER AND SETTER OPERATORS
+	T & operator()(const unsigned row, const unsigned col) {
+		assert(row < R && col < C);
+		return elements[row * C + col];
+	}
+
+	const T & operator()(const unsigned row, const unsigned col) const {
+		assert(row < R && col < C);
+		return elements[row * C + col];
+	}
+
+	// LOGIC OPERATORS
+	bool operator==(const FixedMatrix & rhs) const {
+		for (unsigned i = 0; i < R * C; i++) {
+			if (elements[i] != rhs.elements[i]) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// PRODUCTS
+	template <unsigned K>
+	void dot_into(const FixedMatrix<T, C, K> & rhs, FixedMatrix<T, R, K> & destination) const {
+		// destination = this * rhs; every element is summed in the same order as the textbook inner product
+		assert(static_cast<const void *>(&destination) != this && static_cast<const void *>(&destination) != &rhs);
+
+		const T * const lhs_elements = elements;
+		const T * const rhs_elements = rhs.data();
+		T * const destination_elements = destination.data();
+
+		FixedUnroll<0, R * K>::apply([=](const unsigned index) {
+			const unsigned row = index / K;
+			const unsigned col = index % K;
+
+			T sum = T();
+			FixedUnroll<0, C>::apply([&](const unsigned i) {
+				sum += lhs_elements[row * C + i] * rhs_elements[i * K + col];
+			});
+			destination_elements[index] = sum;
+		});
+	}
+
+	template <unsigned K>
+	FixedMatrix<T, R, K> dot(const FixedMatrix<T, C, K> & rhs) const {
+		FixedMatrix<T, R, K> result;
+		dot_into(rhs, result);
+		return result;
+	}
+
+	FixedMatrix<T, C, R> transpose() const {
+		FixedMatrix<T, C, R> result;
+		T * const result_elements = result.data();
+		const T * const source = elements;
+
+		FixedUnroll<0, R * C>::apply([=](const unsigned index) {
+			result_elements[(index % C) * R + index / C] = source[index];
+		});
+		return result;
+	}
+
+	// ELEMENT-WISE OPERATIONS
+	FixedMatrix & map_inplace(T(*function)(T)) {
+		return map_inplace<T(*)(T)>(function);
+	}
+
+	template <typename Function>
+	FixedMatrix & map_inplace(Function function) {
+		// Function: any callable taking and returning T, e.g. a lambda or an ActivationFunction
+		T * const destination = elements;
+		FixedUnroll<0, R * C>::apply([&](const unsigned index) {
+			destination[index] = function(destination[index]);
+		});
+		return *this;
+	}
+
+	FixedMatrix & map_inplace(T(*function)(T, T), const T param) {
+		T * const destination = elements;
+		FixedUnroll<0, R * C>::apply([=](const unsigned index) {
+			destination[index] = (*function)(destination[index], param);
+		});
+		return *this;
+	}
+
+	FixedMatrix map(T(*function)(T)) const {
+		FixedMatrix result(*this);
+		return result.map_inplace(function);
+	}
+
+	FixedMatrix map(T(*function)(T, T), const T param) const {
+		FixedMatrix result(*this);
+		return result.map_inplace(function, param);
+	}
+
+	template <typename Function>
+	FixedMatrix map(Function function) const {
+		FixedMatrix result(*this);
+		return result.map_inplace(function);
+	}
+
+	FixedMatrix & operator+=(const FixedMatrix & rhs) {
+		return update<MatrixAddition>(rhs);
+	}
+
+	FixedMatrix & operator-=(const FixedMatrix & rhs) {
+		return update<MatrixSubtraction>(rhs);
+	}
+
+	FixedMatrix & operator*=(const FixedMatrix & rhs) {
+		// hadamard product
+		return update<MatrixMultiplication>(rhs);
+	}
+
+	FixedMatrix & operator*=(const double scalar) {
+		T * const destination = elements;
+		FixedUnroll<0, R * C>::apply([=](const unsigned index) {
+			destination[index] *= scalar;
+		});
+		return *this;
+	}
+
+	FixedMatrix & axpy(const T alpha, const FixedMatrix & x) {
+		// this += alpha * x
+		T * const destination = elements;
+		const T * const source = x.elements;
+		FixedUnroll<0, R * C>::apply([=](const unsigned index) {
+			destination[index] += alpha * source[index];
+		});
+		return *this;
+	}
+
+	// ARITHMETIC OPERATORS
+	FixedMatrix operator+(const FixedMatrix & rhs) const {
+		FixedMatrix result(*this);
+		return result += rhs;
+	}
+
+	FixedMatrix operator-(const FixedMatrix & rhs) const {
+		FixedMatrix result(*this);
+		return result -= rhs;
+	}
+
+	FixedMatrix operator*(const FixedMatrix & rhs) const {
+		// hadamard product
+		FixedMatrix result(*this);
+		return result *= rhs;
+	}
+
+	FixedMatrix operator*(const double scalar) const {
+		FixedMatrix result(*this);
+		return result *= scalar;
+	}
+private:
+	template <typename Operation>
+	FixedMatrix & update(const FixedMatrix & rhs) {
+		T * const destination = elements;
+		const T * const source = rhs.elements;
+		FixedUnroll<0, R * C>::apply([=](const unsigned index) {
+			destination[index] = Operation::apply(destination[index], source[index]);
+		});
+		return *this;
+	}
+
+	T elements[R * C];
+};
+
+template <typename T, unsigned R, unsigned C>
+const unsigned FixedMatrix<T, R, C>::row_count;
+
+template <typename T, unsigned R, unsigned C>
+const unsigned FixedMatrix<T, R, C>::col_count;
+
+template <typename T, unsigned R, unsigned C>
+FixedMatrix<T, R, C> operator*(const double scalar, const FixedMatrix<T, R, C> & matrix) {
+	return matrix * scalar;
+}
+
+#endif
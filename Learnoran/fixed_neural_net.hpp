@@ -0,0 +1,355 @@
+#ifndef _FIXED_NEURAL_NET_HPP
+#define _FIXED_NEURAL_NET_HPP
+
+#include <vector>
+#include <iostream>
+#include <algorithm>
+#include <unordered_map>
+#include <string>
+
+#include "lo_exception.hpp"
+#include "predictor.hpp"
+#include "fixed_matrix.hpp"
+#include "math_util.hpp"
+#include "activation.hpp"
+#include "dataframe.hpp"
+#include "columnar_dataframe.hpp"
+#include "decryption_manager.hpp"
+#include "lomf.hpp"
+
+namespace Learnoran {
+	// MARK: Layers
+
+	template <unsigned Inputs, unsigned Neurons>
+	void load_connections(FixedMatrix<double, Inputs, Neurons> & connections, const MatrixView<const double> & stored) {
+		// Throws:
+		// - InvalidFileFormatException: if <stored> is not an Inputs x Neurons matrix
+		if (stored.get_shape().rows != Inputs || stored.get_shape().cols != Neurons) {
+			throw InvalidFileFormatException();
+		}
+		for (unsigned row = 0; row < Inputs; row++) {
+			for (unsigned col = 0; col < Neurons; col++) {
+				connections(row, col) = stored(row, col);
+			}
+		}
+	}
+
+	template <unsigned... Sizes>
+	struct FixedLayerStack;
+
+	template <unsigned Inputs, unsigned Neurons, unsigned Next, unsigned... Rest>
+	struct FixedLayerStack<Inputs, Neurons, Next, Rest...> {
+		// A hidden layer of <Neurons> sigmoid neurons fed by <Inputs> values, followed by the remaining layers
+		typedef FixedLayerStack<Neurons, Next, Rest...> next_type;
+		static const unsigned outputs = next_type::outputs;
+
+		FixedLayerStack() : bias(snd_random()) {
+			connections.map_inplace(snd_random);
+		}
+
+		const FixedMatrix<double, 1, outputs> & forward(const FixedMatrix<double, 1, Inputs> & input) {
+			input.dot_into(connections, activations);
+			activations.map_inplace(&apply_bias, bias);
+			activation_kernel<Activation::sigmoid, ExpDegree<ActivationAccuracy::accurate>::value>(activations.data(), activations.data(), Neurons);
+			return next.forward(activations);
+		}
+
+		void compute_gradients(const FixedMatrix<double, 1, outputs> & target) {
+			// gradient = (next layer gradient * transposed outgoing connections) .* sigmoid'(layer outputs)
+			next.compute_gradients(target);
+			next.gradients.dot_into(next.connections.transpose(), gradients);
+			gradients *= activations.map(ActivationFunction<Activation::sigmoid_prime>());
+		}
+
+		void update(const FixedMatrix<double, 1, Inputs> & input, const double learning_rate) {
+			// connections += learning_rate * input^T * gradients; the next layer is updated after its gradients were
+			// used above, so every layer sees the weights of the same step
+			connections.axpy(learning_rate, input.transpose().dot(gradients));
+			next.update(activations, learning_rate);
+		}
+
+		void save(LomfWriter & writer, std::vector<double> & biases) const {
+			// adds the connections of this and the next layers to <writer>, and their biases to <biases>
+			writer.add_block(LomfRole::weights, MatrixView<const double>(connections.data(), Inputs, Neurons, Neurons));
+			biases.push_back(bias);
+			next.save(writer, biases);
+		}
+
+		void load(const MatrixView<const double> * const stored_connections, const double * const stored_biases) {
+			// Args:
+			// - stored_connections, stored_biases: those of this layer, followed by those of the next layers
+			// Throws:
+			// - InvalidFileFormatException: if the connections of this layer are of another shape
+			load_connections(connections, *stored_connections);
+			bias = *stored_biases;
+			next.load(stored_connections + 1, stored_biases + 1);
+		}
+
+		static double apply_bias(const double x, const double bias) {
+			return x + bias;
+		}
+
+		FixedMatrix<double, Inputs, Neurons> connections;
+		double bias;
+		FixedMatrix<double, 1, Neurons> activations;
+		FixedMatrix<double, 1, Neurons> gradients;
+		next_type next;
+	};
+
+	template <unsigned Inputs, unsigned Neurons>
+	struct FixedLayerStack<Inputs, Neurons> {
+		// The output layer: linear neurons fed by <Inputs> values
+		static const unsigned outputs = Neurons;
+
+		FixedLayerStack() : bias(snd_random()) {
+			connections.map_inplace(snd_random);
+		}
+
+		const FixedMatrix<double, 1, outputs> & forward(const FixedMatrix<double, 1, Inputs> & input) {
+			input.dot_into(connections, activations);
+			return activations.map_inplace(&apply_bias, bias);
+		}
+
+		void compute_gradients(const FixedMatrix<double, 1, outputs> & target) {
+			gradients = (target - activations) * activations.map(ActivationFunction<Activation::sigmoid_prime>());
+		}
+
+		void update(const FixedMatrix<double, 1, Inputs> & input, const double learning_rate) {
+			connections.axpy(learning_rate, input.transpose().dot(gradients));
+		}
+
+		void save(LomfWriter & writer, std::vector<double> & biases) const {
+			writer.add_block(LomfRole::weights, MatrixView<const double>(connections.data(), Inputs, Neurons, Neurons));
+			biases.push_back(bias);
+		}
+
+		void load(const MatrixView<const double> * const stored_connections, const double * const stored_biases) {
+			load_connections(connections, *stored_connections);
+			bias = *stored_biases;
+		}
+
+		static double apply_bias(const double x, const double bias) {
+			return x + bias;
+		}
+
+		FixedMatrix<double, Inputs, Neurons> connections;
+		double bias;
+		FixedMatrix<double, 1, Neurons> activations;
+		FixedMatrix<double, 1, Neurons> gradients;
+	};
+
+	template <unsigned First, unsigned... Rest>
+	struct FirstLayerSize {
+		static const unsigned value = First;
+	};
+
+	// MARK: FixedNeuralNetwork
+
+	template <unsigned... LayerSizes>
+	class FixedNeuralNetwork : public Predictor {
+		// NeuralNetwork with the topology fixed at compile time, i.e. FixedNeuralNetwork<14, 6, 1>: every layer, gradient
+		// and connection matrix is a FixedMatrix stored inside the network, so training and inference never allocate
+		// and run fully unrolled kernels. Trains and predicts like NeuralNetwork.
+		static_assert(sizeof...(LayerSizes) >= 2, "a network needs an input and an output layer");
+	public:
+		static const unsigned input_count = FirstLayerSize<LayerSizes...>::value;
+		static const unsigned output_count = FixedLayerStack<LayerSizes...>::outputs;
+		static_assert(output_count == 1, "currently only regression networks (a single output neuron) are supported");
+
+		typedef FixedMatrix<double, 1, input_count> input_type;
+
+		FixedNeuralNetwork(std::ostream & info_stream, const std::vector<std::string> & feature_symbols, bool descriptive_info_output = false)
+			: input_layer_symbols(feature_symbols), info_stream(info_stream), descriptive_info_output(descriptive_info_output) {
+			// Args:
+			// - feature_symbols: identifiers for the input layer neurons in an ordered sequence, as in NeuralNetwork::add_layer
+			assert(feature_symbols.size() == input_count);
+		}
+
+		double predict(const input_type & inputs) {
+			// the allocation-free path: inputs already ordered as the input layer
+			return layers.forward(inputs)(0, 0);
+		}
+
+		double predict(const std::unordered_map<std::string, double> & inputs) override {
+			fill_input_layer(inputs);
+			return predict(input_layer);
+		}
+
+		EncryptedNumber predict(const std::unordered_map<std::string, EncryptedNumber> &, const DecryptionManager *) override {
+			// Throws:
+			// - UnsupportedOperationException: fixed-size networks only run on plaintext
+			throw UnsupportedOperationException();
+		}
+
+		double predict(const RowView<double> & inputs) override {
+			fill_input_layer(input_binding.bind(inputs, input_layer_symbols));
+			return predict(input_layer);
+		}
+
+		EncryptedNumber predict(const RowView<EncryptedNumber> &, const DecryptionManager *) override {
+			// Throws:
+			// - UnsupportedOperationException: fixed-size networks only run on plaintext
+			throw UnsupportedOperationException();
+		}
+
+		void fit(const Dataframe<double> & dataframe, const unsigned short epochs, const double learning_rate) override {
+			// Applies stochastic gradient descent with MSE loss, one row at a time
+			const unsigned rows = dataframe.shape().rows;
+
+			for (unsigned epoch = 0; epoch < epochs; epoch++) {
+				for (unsigned i = 0; i < rows; i++) {
+					back_propagation(dataframe.get_row_view(i), dataframe.get_row_label(i), learning_rate);
+				}
+
+				if (epoch % 10 == 0) {
+					output_error(epoch, epochs, compute_mean_square_error(dataframe, 100));
+				}
+			}
+
+			output_error(epochs, epochs, compute_mean_square_error(dataframe, 100));
+		}
+
+		void fit(const ColumnarDataframe<double> & dataframe, const unsigned short epochs, const double learning_rate) {
+			// Same as above, reading every feature row in place as a strided span over the columns
+			const unsigned rows = dataframe.shape().rows;
+
+			for (unsigned epoch = 0; epoch < epochs; epoch++) {
+				for (unsigned i = 0; i < rows; i++) {
+					back_propagation(dataframe.get_row_feature(i), dataframe.get_row_label(i), learning_rate);
+				}
+
+				if (epoch % 10 == 0) {
+					output_error(epoch, epochs, compute_mean_square_error(dataframe, 100));
+				}
+			}
+
+			output_error(epochs, epochs, compute_mean_square_error(dataframe, 100));
+		}
+
+		void fit(const Dataframe<EncryptedNumber> &, const unsigned short, const double, const DecryptionManager *) override {
+			// Throws:
+			// - UnsupportedOperationException: fixed-size networks only run on plaintext
+			throw UnsupportedOperationException();
+		}
+
+		double compute_mean_square_error(const Dataframe<double> & dataframe, const unsigned num_rows) override {
+			double average_mse = 0.0;
+			const unsigned total_rows = std::min(dataframe.shape().rows, num_rows);
+
+			for (unsigned row = 0; row < total_rows; row++) {
+				fill_input_layer(dataframe.get_row_view(row));
+				average_mse += mse(predict(input_layer), dataframe.get_row_label(row));
+			}
+
+			average_mse /= total_rows;
+			return average_mse;
+		}
+
+		double compute_mean_square_error(const ColumnarDataframe<double> & dataframe, const unsigned num_rows) {
+			double average_mse = 0.0;
+			const unsigned total_rows = std::min(dataframe.shape().rows, num_rows);
+
+			for (unsigned row = 0; row < total_rows; row++) {
+				fill_input_layer(dataframe.get_row_feature(row));
+				average_mse += mse(predict(input_layer), dataframe.get_row_label(row));
+			}
+
+			average_mse /= total_rows;
+			return average_mse;
+		}
+
+		EncryptedNumber compute_mean_square_error(const Dataframe<EncryptedNumber> &, const unsigned) override {
+			// Throws:
+			// - UnsupportedOperationException: fixed-size networks only run on plaintext
+			throw UnsupportedOperationException();
+		}
+
+		void save(const std::string & filename) const {
+			// Stores the parameters in the .lomf format of NeuralNetwork::save, so that NeuralNetwork::load and
+			// load_inference_model read the file as well
+			// Throws:
+			// - CannotOpenFileException: if the file cannot be created
+			LomfWriter writer(LomfModel::neural_network, static_cast<std::uint32_t>(ActivationAccuracy::accurate));
+			writer.add_symbols(input_layer_symbols);
+			std::vector<double> biases;
+			layers.save(writer, biases);
+			biases.push_back(0.0); // the output layer has no outgoing connections
+			writer.add_block(LomfRole::biases, biases);
+			writer.write(filename);
+		}
+
+		void load(const std::string & filename) {
+			// Replaces the parameters with those of a network of the same topology stored by save or NeuralNetwork::save.
+			// The hidden layers keep the accurate sigmoid whatever the tier of the stored network
+			// Throws:
+			// - CannotOpenFileException: if the file cannot be opened
+			// - InvalidFileFormatException: if the file is not a valid .lomf file of a network of this topology
+			const LomfFile file(filename);
+			std::vector<MatrixView<const double>> stored_connections;
+			std::vector<double> stored_biases;
+			ActivationAccuracy accuracy;
+			read_lomf_network(file, stored_connections, stored_biases, accuracy);
+			if (stored_connections.size() != sizeof...(LayerSizes) - 1) {
+				throw InvalidFileFormatException();
+			}
+
+			layers.load(stored_connections.data(), stored_biases.data());
+			input_layer_symbols = file.get_symbols();
+			input_binding.reset();
+		}
+	private:
+		void output_error(const unsigned epoch, const unsigned total_epochs, const double error) {
+			if (descriptive_info_output) {
+				info_stream << "Epoch " << epoch << '/' << total_epochs << " - MSE for first 100 rows: " << error << '\n';
+			}
+			else {
+				info_stream << epoch << ' ' << error << '\n';
+			}
+		}
+
+		void fill_input_layer(const std::unordered_map<std::string, double> & inputs) {
+			assert(inputs.size() == input_count);
+
+			for (unsigned i = 0; i < input_count; i++) {
+				const std::string & variable_symbol = input_layer_symbols.at(i);
+				input_layer(0, i) = inputs.find(variable_symbol)->second;
+			}
+		}
+
+		template <typename Row>
+		void fill_input_layer(const Row & inputs) {
+			// Row: any indexable sequence of the input values with size(), e.g. RowView or StridedSpan
+			assert(inputs.size() == input_count);
+
+			for (unsigned i = 0; i < input_count; i++) {
+				input_layer(0, i) = inputs[i];
+			}
+		}
+
+		template <typename Row>
+		void back_propagation(const Row & feature_row, const double target, const double learning_rate) {
+			// updates model parameters for a single data point, as NeuralNetwork::back_propagation
+			fill_input_layer(feature_row);
+			layers.forward(input_layer);
+
+			layers.compute_gradients(FixedMatrix<double, 1, output_count>({ { target } }));
+			layers.update(input_layer, learning_rate);
+		}
+
+		// loss functions
+		double mse(const double real, const double prediction) {
+			const double error = real - prediction;
+			return 0.5 * error * error;
+		}
+
+		FixedLayerStack<LayerSizes...> layers;
+		input_type input_layer;
+		std::vector<std::string> input_layer_symbols;
+		SchemaBinding input_binding; // resolves input_layer_symbols against the schema of RowViews passed to predict
+
+		std::ostream & info_stream;
+		const bool descriptive_info_output;
+	};
+}
+
+#endif
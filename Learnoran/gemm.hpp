@@ -0,0 +1,518 @@
+#ifndef _GEMM_HPP
+#define _GEMM_HPP
+
+#include <cstddef>
+#include <algorithm>
+#include <assert.h>
+
+#ifndef _SEQUENTIAL
+#include <omp.h>
+#endif
+
+#include "aligned_buffer.hpp"
+#include "cpu_dispatch.hpp"
+
+/*
+General matrix multiplication C = alpha * A * B + beta * C on doubles, organized like the BLIS/GotoBLAS algorithm:
+
+	for every NC wide column block of B and C
+		for every KC deep slice of the shared dimension
+			pack the KC x NC block of B into NR wide row panels (shared by all threads)
+			for every MC high row block of A (in parallel)
+				pack the MC x KC block of A into MR high column panels (per thread)
+				for every NR wide panel of B, for every MR high panel of A
+					microkernel: MR x NR tile of C += A panel * B panel, accumulated in registers
+
+The packed panels are read sequentially by the microkernel and the blocks are sized to stay in cache (an A panel and a
+B panel in L1, the A block in L2). Packing also absorbs any strides of A and B, so transposed views cost nothing extra.
+The microkernel is picked at run time among an AVX-512 (12 x 16), an AVX2 (6 x 8) and a portable (4 x 4) kernel.
+*/
+
+namespace Learnoran {
+	enum class GemmKernel { automatic, generic, avx2, avx512 };
+
+	const std::size_t GEMM_MC = 96; // a multiple of the MR of every kernel
+	const std::size_t GEMM_KC = 256;
+	const std::size_t GEMM_NC = 4096; // a multiple of the NR of every kernel
+	const std::size_t GEMM_MAX_MR = 12;
+	const std::size_t GEMM_MAX_NR = 16;
+	const std::size_t GEMM_PARALLEL_THRESHOLD = 1 << 18; // m * n * k below which the product runs on the calling thread
+
+	// Computes the product of a packed MR x k panel of A and a packed k x NR panel of B into <tile>, row-major with NR
+	// elements per row
+	typedef void(*GemmMicrokernel)(const std::size_t k, const double * a, const double * b, double * tile);
+
+	struct GemmKernelInfo {
+		GemmMicrokernel microkernel;
+		std::size_t mr;
+		std::size_t nr;
+	};
+
+	// MARK: Microkernels
+
+	inline void gemm_microkernel_generic(const std::size_t k, const double * a, const double * b, double * tile) {
+		double accumulators[4][4] = { };
+		for (std::size_t p = 0; p < k; p++, a += 4, b += 4) {
+			for (std::size_t i = 0; i < 4; i++) {
+				for (std::size_t j = 0; j < 4; j++) {
+					accumulators[i][j] += a[i] * b[j];
+				}
+			}
+		}
+
+		for (std::size_t i = 0; i < 4; i++) {
+			for (std::size_t j = 0; j < 4; j++) {
+				tile[i * 4 + j] = accumulators[i][j];
+			}
+		}
+	}
+
+#ifdef LEARNORAN_X86
+	LEARNORAN_TARGET("avx2,fma")
+	inline void gemm_microkernel_avx2(const std::size_t k, const double * a, const double * b, double * tile) {
+		// 6 x 8 tile in 12 ymm accumulators
+		__m256d c00 = _mm256_setzero_pd(), c01 = _mm256_setzero_pd(), c10 = _mm256_setzero_pd(), c11 = _mm256_setzero_pd();
+		__m256d c20 = _mm256_setzero_pd(), c21 = _mm256_setzero_pd(), c30 = _mm256_setzero_pd(), c31 = _mm256_setzero_pd();
+		__m256d c40 = _mm256_setzero_pd(), c41 = _mm256_setzero_pd(), c50 = _mm256_setzero_pd(), c51 = _mm256_setzero_pd();
+
+		for (std::size_t p = 0; p < k; p++, a += 6, b += 8) {
+			const __m256d b0 = _mm256_loadu_pd(b);
+			const __m256d b1 = _mm256_loadu_pd(b + 4);
+			__m256d a_element;
+
+			a_element = _mm256_broadcast_sd(a);
+			c00 = _mm256_fmadd_pd(a_element, b0, c00);
+			c01 = _mm256_fmadd_pd(a_element, b1, c01);
+			a_element = _mm256_broadcast_sd(a + 1);
+			c10 = _mm256_fmadd_pd(a_element, b0, c10);
+			c11 = _mm256_fmadd_pd(a_element, b1, c11);
+			a_element = _mm256_broadcast_sd(a + 2);
+			c20 = _mm256_fmadd_pd(a_element, b0, c20);
+			c21 = _mm256_fmadd_pd(a_element, b1, c21);
+			a_element = _mm256_broadcast_sd(a + 3);
+			c30 = _mm256_fmadd_pd(a_element, b0, c30);
+			c31 = _mm256_fmadd_pd(a_element, b1, c31);
+			a_element = _mm256_broadcast_sd(a + 4);
+			c40 = _mm256_fmadd_pd(a_element, b0, c40);
+			c41 = _mm256_fmadd_pd(a_element, b1, c41);
+			a_element = _mm256_broadcast_sd(a + 5);
+			c50 = _mm256_fmadd_pd(a_element, b0, c50);
+			c51 = _mm256_fmadd_pd(a_element, b1, c51);
+		}
+
+		_mm256_storeu_pd(tile, c00); _mm256_storeu_pd(tile + 4, c01);
+		_mm256_storeu_pd(tile + 8, c10); _mm256_storeu_pd(tile + 12, c11);
+		_mm256_storeu_pd(tile + 16, c20); _mm256_storeu_pd(tile + 20, c21);
+		_mm256_storeu_pd(tile + 24, c30); _mm256_storeu_pd(tile + 28, c31);
+		_mm256_storeu_pd(tile + 32, c40); _mm256_storeu_pd(tile + 36, c41);
+		_mm256_storeu_pd(tile + 40, c50); _mm256_storeu_pd(tile + 44, c51);
+	}
+
+	LEARNORAN_TARGET("avx512f")
+	inline void gemm_microkernel_avx512(const std::size_t k, const double * a, const double * b, double * tile) {
+		// 12 x 16 tile in 24 zmm accumulators; the rows are spelled out so that no compiler keeps them in memory
+#define LEARNORAN_AVX512_ROW(i) \
+		__m512d c##i##0 = _mm512_setzero_pd(), c##i##1 = _mm512_setzero_pd();
+		LEARNORAN_AVX512_ROW(0) LEARNORAN_AVX512_ROW(1) LEARNORAN_AVX512_ROW(2) LEARNORAN_AVX512_ROW(3)
+		LEARNORAN_AVX512_ROW(4) LEARNORAN_AVX512_ROW(5) LEARNORAN_AVX512_ROW(6) LEARNORAN_AVX512_ROW(7)
+		LEARNORAN_AVX512_ROW(8) LEARNORAN_AVX512_ROW(9) LEARNORAN_AVX512_ROW(10) LEARNORAN_AVX512_ROW(11)
+#undef LEARNORAN_AVX512_ROW
+
+		for (std::size_t p = 0; p < k; p++, a += 12, b += 16) {
+			const __m512d b0 = _mm512_loadu_pd(b);
+			const __m512d b1 = _mm512_loadu_pd(b + 8);
+			__m512d a_element;
+#define LEARNORAN_AVX512_ROW(i) \
+			a_element = _mm512_set1_pd(a[i]); \
+			c##i##0 = _mm512_fmadd_pd(a_element, b0, c##i##0); \
+			c##i##1 = _mm512_fmadd_pd(a_element, b1, c##i##1);
+			LEARNORAN_AVX512_ROW(0) LEARNORAN_AVX512_ROW(1) LEARNORAN_AVX512_ROW(2) LEARNORAN_AVX512_ROW(3)
+			LEARNORAN_AVX512_ROW(4) LEARNORAN_AVX512_ROW(5) LEARNORAN_AVX512_ROW(6) LEARNORAN_AVX512_ROW(7)
+			LEARNORAN_AVX512_ROW(8) LEARNORAN_AVX512_ROW(9) LEARNORAN_AVX512_ROW(10) LEARNORAN_AVX512_ROW(11)
+#undef LEARNORAN_AVX512_ROW
+		}
+
+#define LEARNORAN_AVX512_ROW(i) \
+		_mm512_storeu_pd(tile + i * 16, c##i##0); \
+		_mm512_storeu_pd(tile + i * 16 + 8, c##i##1);
+		LEARNORAN_AVX512_ROW(0) LEARNORAN_AVX512_ROW(1) LEARNORAN_AVX512_ROW(2) LEARNORAN_AVX512_ROW(3)
+		LEARNORAN_AVX512_ROW(4) LEARNORAN_AVX512_ROW(5) LEARNORAN_AVX512_ROW(6) LEARNORAN_AVX512_ROW(7)
+		LEARNORAN_AVX512_ROW(8) LEARNORAN_AVX512_ROW(9) LEARNORAN_AVX512_ROW(10) LEARNORAN_AVX512_ROW(11)
+#undef LEARNORAN_AVX512_ROW
+	}
+#endif
+
+	inline bool gemm_kernel_supported(const GemmKernel kernel) {
+		switch (kernel) {
+		case GemmKernel::automatic:
+		case GemmKernel::generic:
+			return true;
+#ifdef LEARNORAN_X86
+		case GemmKernel::avx2:
+			return cpu_features().avx2;
+		case GemmKernel::avx512:
+			return cpu_features().avx512;
+#endif
+		default:
+			return false;
+		}
+	}
+
+	inline GemmKernelInfo gemm_kernel_info(const GemmKernel kernel) {
+		// Args:
+		// - kernel: the microkernel to use, which must be supported by the host; automatic picks the widest supported one
+		assert(gemm_kernel_supported(kernel));
+
+		GemmKernelInfo generic = { &gemm_microkernel_generic, 4, 4 };
+#ifdef LEARNORAN_X86
+		GemmKernelInfo avx2 = { &gemm_microkernel_avx2, 6, 8 };
+		GemmKernelInfo avx512 = { &gemm_microkernel_avx512, 12, 16 };
+
+		if (kernel == GemmKernel::avx512 || (kernel == GemmKernel::automatic && cpu_features().avx512)) {
+			return avx512;
+		}
+		if (kernel == GemmKernel::avx2 || (kernel == GemmKernel::automatic && cpu_features().avx2)) {
+			return avx2;
+		}
+#endif
+		return generic;
+	}
+
+	// MARK: Packing
+
+	inline double * gemm_workspace(const std::size_t slot, const std::size_t count) {
+		// per thread packing buffers that only ever grow, so that repeated products do not allocate
+		static thread_local AlignedBuffer<double> workspaces[2];
+		if (workspaces[slot].size() < count) {
+			workspaces[slot] = AlignedBuffer<double>(count);
+		}
+		return workspaces[slot].data();
+	}
+
+	inline void gemm_pack_a(const std::size_t mc, const std::size_t kc, const double * a, const std::size_t row_stride, const std::size_t col_stride, const std::size_t mr, double * packed) {
+		// packs an mc x kc block of A into column major panels of <mr> rows; the rows past mc are zero
+		for (std::size_t panel = 0; panel < mc; panel += mr) {
+			const std::size_t rows = std::min(mr, mc - panel);
+			for (std::size_t p = 0; p < kc; p++) {
+				const double * const source = a + panel * row_stride + p * col_stride;
+				std::size_t i = 0;
+				for (; i < rows; i++) {
+					*packed++ = source[i * row_stride];
+				}
+				for (; i < mr; i++) {
+					*packed++ = 0.0;
+				}
+			}
+		}
+	}
+
+	inline void gemm_pack_b(const std::size_t kc, const std::size_t nc, const double * b, const std::size_t row_stride, const std::size_t col_stride, const std::size_t nr, double * packed) {
+		// packs a kc x nc block of B into row major panels of <nr> columns; the columns past nc are zero
+		for (std::size_t panel = 0; panel < nc; panel += nr) {
+			const std::size_t cols = std::min(nr, nc - panel);
+			for (std::size_t p = 0; p < kc; p++) {
+				const double * const source = b + p * row_stride + panel * col_stride;
+				if (col_stride == 1 && cols == nr) {
+					std::copy(source, source + nr, packed);
+					packed += nr;
+					continue;
+				}
+
+				std::size_t j = 0;
+				for (; j < cols; j++) {
+					*packed++ = source[j * col_stride];
+				}
+				for (; j < nr; j++) {
+					*packed++ = 0.0;
+				}
+			}
+		}
+	}
+
+	inline void gemm_store_tile(const double * tile, const std::size_t nr, const std::size_t rows, const std::size_t cols, const double alpha, const double beta, double * c, const std::size_t ldc) {
+		// C tile = alpha * tile + beta * C tile; C is not read if beta is 0, so it may hold anything, NaN included
+		for (std::size_t i = 0; i < rows; i++) {
+			double * const destination = c + i * ldc;
+			const double * const source = tile + i * nr;
+			if (beta == 0.0) {
+				for (std::size_t j = 0; j < cols; j++) {
+					destination[j] = alpha * source[j];
+				}
+			}
+			else {
+				for (std::size_t j = 0; j < cols; j++) {
+					destination[j] = alpha * source[j] + beta * destination[j];
+				}
+			}
+		}
+	}
+
+	// MARK: Epilogues
+
+	// output[i] = f(input[i]) for i < count, input and output possibly being the same array; see activation.hpp
+	typedef void(*GemmElementwise)(const double * input, double * output, const std::size_t count);
+
+	struct GemmEpilogue {
+		// Elementwise work that gemm applies to each tile of C as soon as the tile is final, while it is still in L1,
+		// instead of in separate passes over the whole of C:
+		//   C = activation(C + bias)
+		// e.g. the bias and sigmoid of a dense layer
+		GemmEpilogue() : bias(0.0), activation(nullptr) { }
+
+		static GemmEpilogue dense(const double bias, const GemmElementwise activation) {
+			// no activation if null
+			GemmEpilogue epilogue;
+			epilogue.bias = bias;
+			epilogue.activation = activation;
+			return epilogue;
+		}
+
+		double bias;
+		GemmElementwise activation;
+	};
+
+	inline void gemm_apply_epilogue(const GemmEpilogue & epilogue, double * c, const std::size_t count) {
+		// applies <epilogue> to the <count> elements at <c>
+		const double bias = epilogue.bias; // a local, which the stores to <c> cannot alias
+		if (bias != 0.0) {
+			for (std::size_t j = 0; j < count; j++) {
+				c[j] += bias;
+			}
+		}
+		if (epilogue.activation != nullptr) {
+			epilogue.activation(c, c, count);
+		}
+	}
+
+	inline void gemm_finish_tile(double * tile, const std::size_t nr, const std::size_t rows, const std::size_t cols, const double alpha, const double beta,
+		double * c, const std::size_t ldc, const GemmEpilogue & epilogue) {
+		// gemm_store_tile followed by <epilogue>: the bias is added as the tile is scaled, then the activation reads each
+		// row of the tile, which is in L1, and writes the final values to C. Without an activation the scaled values go
+		// to C directly
+		const double bias = epilogue.bias; // a local, which the stores to C cannot alias
+		const bool activated = epilogue.activation != nullptr;
+		for (std::size_t i = 0; i < rows; i++) {
+			double * const destination = activated ? tile + i * nr : c + i * ldc;
+			const double * const source = tile + i * nr;
+			const double * const previous = c + i * ldc;
+			if (beta == 0.0) {
+				for (std::size_t j = 0; j < cols; j++) {
+					destination[j] = alpha * source[j] + bias;
+				}
+			}
+			else {
+				for (std::size_t j = 0; j < cols; j++) {
+					destination[j] = alpha * source[j] + beta * previous[j] + bias;
+				}
+			}
+		}
+		if (activated) {
+			// a second pass, so that the vector loads of the activation do not wait on the stores above
+			for (std::size_t i = 0; i < rows; i++) {
+				epilogue.activation(tile + i * nr, c + i * ldc, cols);
+			}
+		}
+	}
+
+	// MARK: GEMM
+
+	inline bool gemm_scale_only(const std::size_t m, const std::size_t n, const std::size_t k, const double alpha, const double beta, double * c, const std::size_t c_row_stride, const GemmEpilogue * epilogue) {
+		// C = beta * C, then the epilogue, when the product vanishes; returns false if there is a product to compute
+		if (m == 0 || n == 0) {
+			return true;
+		}
+		if (k == 0 || alpha == 0.0) {
+			for (std::size_t i = 0; i < m; i++) {
+				for (std::size_t j = 0; j < n; j++) {
+					c[i * c_row_stride + j] = beta == 0.0 ? 0.0 : beta * c[i * c_row_stride + j];
+				}
+				if (epilogue != nullptr) {
+					gemm_apply_epilogue(*epilogue, c + i * c_row_stride, n);
+				}
+			}
+			return true;
+		}
+		return false;
+	}
+
+	inline bool gemm_parallel(const std::size_t m, const std::size_t n, const std::size_t k) {
+#ifndef _SEQUENTIAL
+		// inside a parallel region (e.g. one thread per shard of a batch) the nested team would be a single thread anyway
+		return static_cast<double>(m) * n * k >= GEMM_PARALLEL_THRESHOLD && omp_get_max_threads() > 1 && !omp_in_parallel();
+#else
+		return false;
+#endif
+	}
+
+	inline std::size_t gemm_row_block(const std::size_t m, const std::size_t mr, const bool parallel) {
+#ifndef _SEQUENTIAL
+		const std::size_t threads = parallel ? static_cast<std::size_t>(omp_get_max_threads()) : 1;
+#else
+		const std::size_t threads = 1;
+#endif
+		// with several threads, short matrices are cut into smaller row blocks so that every thread gets one
+		const std::size_t rows_per_thread = (m + threads - 1) / threads;
+		return std::min(GEMM_MC, std::max(mr, (rows_per_thread + mr - 1) / mr * mr));
+	}
+
+	inline void gemm_macrokernel(const GemmKernelInfo & info, const std::size_t m, const std::size_t nc, const std::size_t kc, const double alpha,
+		const double * a, const std::size_t a_row_stride, const std::size_t a_col_stride, const double * packed_b,
+		const double beta, double * c, const std::size_t c_row_stride, const std::size_t mc, const bool parallel, const GemmEpilogue * epilogue) {
+		// C (m x nc) = alpha * A (m x kc) * B + beta * C, B being a kc x nc block packed by gemm_pack_b; <epilogue>, if
+		// any, finishes every tile, see gemm_finish_tile
+		const std::size_t mr = info.mr;
+		const std::size_t nr = info.nr;
+		const int row_blocks = static_cast<int>((m + mc - 1) / mc);
+
+#ifndef _SEQUENTIAL
+#pragma omp parallel for schedule(dynamic) if(parallel)
+#endif
+		for (int block = 0; block < row_blocks; block++) {
+			const std::size_t ic = block * mc;
+			const std::size_t rows = std::min(mc, m - ic);
+			const std::size_t padded_rows = (rows + mr - 1) / mr * mr;
+
+			double * const packed_a = gemm_workspace(1, padded_rows * kc);
+			gemm_pack_a(rows, kc, a + ic * a_row_stride, a_row_stride, a_col_stride, mr, packed_a);
+
+			alignas(CACHE_LINE_SIZE) double tile[GEMM_MAX_MR * GEMM_MAX_NR];
+			for (std::size_t jr = 0; jr < nc; jr += nr) {
+				const double * const b_panel = packed_b + jr * kc;
+				for (std::size_t ir = 0; ir < rows; ir += mr) {
+					info.microkernel(kc, packed_a + ir * kc, b_panel, tile);
+					const std::size_t tile_rows = std::min(mr, rows - ir);
+					const std::size_t tile_cols = std::min(nr, nc - jr);
+					double * const c_tile = c + (ic + ir) * c_row_stride + jr;
+
+					if (epilogue != nullptr) {
+						gemm_finish_tile(tile, nr, tile_rows, tile_cols, alpha, beta, c_tile, c_row_stride, *epilogue);
+					}
+					else {
+						gemm_store_tile(tile, nr, tile_rows, tile_cols, alpha, beta, c_tile, c_row_stride);
+					}
+				}
+			}
+		}
+	}
+
+	inline void gemm(const std::size_t m, const std::size_t n, const std::size_t k, const double alpha,
+		const double * a, const std::size_t a_row_stride, const std::size_t a_col_stride,
+		const double * b, const std::size_t b_row_stride, const std::size_t b_col_stride,
+		const double beta, double * c, const std::size_t c_row_stride, const GemmKernel kernel = GemmKernel::automatic, const GemmEpilogue * epilogue = nullptr) {
+		// C = alpha * A * B + beta * C
+		// Args:
+		// - m, n, k: A is m x k, B is k x n and C is m x n
+		// - a, a_row_stride, a_col_stride: element (i, p) of A is a[i * a_row_stride + p * a_col_stride]; swapping the
+		// strides multiplies by the transpose
+		// - b, b_row_stride, b_col_stride: the same for B
+		// - c, c_row_stride: C is row-major, element (i, j) is c[i * c_row_stride + j]. If beta is 0, C is not read
+		// - kernel: the microkernel to use, see GemmKernel
+		// - epilogue: applied to C after the product, see GemmEpilogue
+		if (gemm_scale_only(m, n, k, alpha, beta, c, c_row_stride, epilogue)) {
+			return;
+		}
+
+		const GemmKernelInfo info = gemm_kernel_info(kernel);
+		const std::size_t nr = info.nr;
+		const bool parallel = gemm_parallel(m, n, k);
+		const std::size_t mc = gemm_row_block(m, info.mr, parallel);
+
+		for (std::size_t jc = 0; jc < n; jc += GEMM_NC) {
+			const std::size_t nc = std::min(GEMM_NC, n - jc);
+			const std::size_t padded_nc = (nc + nr - 1) / nr * nr;
+
+			for (std::size_t pc = 0; pc < k; pc += GEMM_KC) {
+				const std::size_t kc = std::min(GEMM_KC, k - pc);
+				// C is scaled by beta once, along with the first slice; later slices accumulate
+				const double slice_beta = pc == 0 ? beta : 1.0;
+
+				double * const packed_b = gemm_workspace(0, kc * padded_nc);
+				gemm_pack_b(kc, nc, b + pc * b_row_stride + jc * b_col_stride, b_row_stride, b_col_stride, nr, packed_b);
+
+				// the epilogue waits for the last slice, which completes C
+				gemm_macrokernel(info, m, nc, kc, alpha, a + pc * a_col_stride, a_row_stride, a_col_stride, packed_b, slice_beta, c + jc, c_row_stride, mc, parallel,
+					pc + kc == k ? epilogue : nullptr);
+			}
+		}
+	}
+
+	// MARK: Packed operands
+
+	class GemmPackedMatrix {
+		// A k x n right hand side packed once, block by block, into the panels the microkernel reads, for products that
+		// reuse the same B many times (e.g. the weights of a trained network): gemm then skips packing B on every call.
+		// Block (jc, pc), the KC x NC block starting at row pc and column jc, starts at element jc * k + pc * padded_nc
+	public:
+		GemmPackedMatrix() : rows(0), cols(0) {
+			info = gemm_kernel_info(GemmKernel::generic);
+		}
+
+		GemmPackedMatrix(const std::size_t k, const std::size_t n, const double * b, const std::size_t row_stride, const std::size_t col_stride, const GemmKernel kernel = GemmKernel::automatic)
+			: rows(k), cols(n) {
+			// Args:
+			// - k, n, b, row_stride, col_stride: element (p, j) of B is b[p * row_stride + j * col_stride], as in gemm
+			// - kernel: the microkernel the products will use
+			info = gemm_kernel_info(kernel);
+			const std::size_t nr = info.nr;
+			panels = AlignedBuffer<double>((n + nr - 1) / nr * nr * k);
+
+			for (std::size_t jc = 0; jc < n; jc += GEMM_NC) {
+				const std::size_t nc = std::min(GEMM_NC, n - jc);
+				for (std::size_t pc = 0; pc < k; pc += GEMM_KC) {
+					gemm_pack_b(std::min(GEMM_KC, k - pc), nc, b + pc * row_stride + jc * col_stride, row_stride, col_stride, nr, panels.data() + block_offset(jc, pc));
+				}
+			}
+		}
+
+		std::size_t get_rows() const {
+			return rows;
+		}
+
+		std::size_t get_cols() const {
+			return cols;
+		}
+
+		const GemmKernelInfo & get_kernel_info() const {
+			return info;
+		}
+
+		const double * block(const std::size_t jc, const std::size_t pc) const {
+			return panels.data() + block_offset(jc, pc);
+		}
+	private:
+		std::size_t block_offset(const std::size_t jc, const std::size_t pc) const {
+			const std::size_t nc = std::min(GEMM_NC, cols - jc);
+			return jc * rows + pc * ((nc + info.nr - 1) / info.nr * info.nr);
+		}
+
+		std::size_t rows;
+		std::size_t cols;
+		GemmKernelInfo info;
+		AlignedBuffer<double> panels;
+	};
+
+	inline void gemm(const std::size_t m, const double alpha, const double * a, const std::size_t a_row_stride, const std::size_t a_col_stride,
+		const GemmPackedMatrix & b, const double beta, double * c, const std::size_t c_row_stride, const GemmEpilogue * epilogue = nullptr) {
+		// C = alpha * A * B + beta * C with a prepacked B; A is m x b.get_rows(), the other arguments are as above
+		const std::size_t n = b.get_cols();
+		const std::size_t k = b.get_rows();
+		if (gemm_scale_only(m, n, k, alpha, beta, c, c_row_stride, epilogue)) {
+			return;
+		}
+
+		const GemmKernelInfo & info = b.get_kernel_info();
+		const bool parallel = gemm_parallel(m, n, k);
+		const std::size_t mc = gemm_row_block(m, info.mr, parallel);
+
+		for (std::size_t jc = 0; jc < n; jc += GEMM_NC) {
+			const std::size_t nc = std::min(GEMM_NC, n - jc);
+			for (std::size_t pc = 0; pc < k; pc += GEMM_KC) {
+				const std::size_t kc = std::min(GEMM_KC, k - pc);
+				gemm_macrokernel(info, m, nc, kc, alpha, a + pc * a_col_stride, a_row_stride, a_col_stride, b.block(jc, pc), pc == 0 ? beta : 1.0, c + jc, c_row_stride, mc, parallel,
+					pc + kc == k ? epilogue : nullptr);
+			}
+		}
+	}
+}
+
+#endif
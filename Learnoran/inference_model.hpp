@@ -0,0 +1,268 @@
+#ifndef _INFERENCE_MODEL_HPP
+#define _INFERENCE_MODEL_HPP
+
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cassert>
+
+#include "lo_exception.hpp"
+#include "matrix.hpp"
+#include "span.hpp"
+#include "aligned_buffer.hpp"
+#include "activation.hpp"
+#include "dense_layer.hpp"
+#include "dataframe.hpp"
+
+namespace Learnoran {
+	const unsigned INFERENCE_BLOCK_ROWS = 256; // rows propagated together by a batched predict
+
+	class InferenceArena {
+		// Scratch memory for InferenceModel and QuantizedModel forward passes: layer buffers that grow to the largest
+		// block served and are then reused, so that steady state inference does not allocate, and the column order of
+		// the last schema seen. An arena may be shared by any number of models but must not be used by two threads at once
+	public:
+		InferenceArena() : model_id(0) { }
+	private:
+		friend class InferenceModel;
+		friend class QuantizedModel;
+
+		double * buffer(const unsigned slot, const std::size_t count) {
+			if (buffers[slot].size() < count) {
+				buffers[slot] = AlignedBuffer<double>(count);
+			}
+			return buffers[slot].data();
+		}
+
+		std::int8_t * quantized_buffer(const unsigned slot, const std::size_t count) {
+			if (quantized_buffers[slot].size() < count) {
+				quantized_buffers[slot] = AlignedBuffer<std::int8_t>(count);
+			}
+			return quantized_buffers[slot].data();
+		}
+
+		std::int32_t * sum_buffer(const std::size_t count) {
+			if (sums.size() < count) {
+				sums = AlignedBuffer<std::int32_t>(count);
+			}
+			return sums.data();
+		}
+
+		static InferenceArena & thread_arena() {
+			static thread_local InferenceArena arena;
+			return arena;
+		}
+
+		static std::size_t next_model_id() {
+			// unique across every kind of model sharing arenas
+			static std::atomic<std::size_t> counter(0);
+			return ++counter;
+		}
+
+		template <typename T>
+		RowView<T> bind(const std::size_t model, const RowView<T> & row, const std::vector<std::string> & symbols) {
+			// the binding depends on the symbols of the model as much as on the schema of the row
+			if (model_id != model) {
+				binding.reset();
+				model_id = model;
+			}
+			return binding.bind(row, symbols);
+		}
+
+		AlignedBuffer<double> buffers[2];
+		AlignedBuffer<std::int8_t> quantized_buffers[2]; // the quantized layers of a QuantizedModel
+		AlignedBuffer<std::int32_t> sums; // the integer dot products of one row
+		std::size_t model_id; // the model the binding was resolved for, 0 if none
+		SchemaBinding binding;
+	};
+
+	class InferenceModel {
+		// Immutable snapshot of a trained NeuralNetwork for serving predictions, see NeuralNetwork::freeze. The weights
+		// are packed once into the panels the GEMM microkernel reads, and every member function is const and writes
+		// only to an InferenceArena, either passed by the caller or private to the calling thread. One instance can
+		// therefore serve any number of threads concurrently without locking
+	public:
+		InferenceModel(const std::vector<MatrixView<const double>> & connections, const std::vector<double> & biases, const std::vector<std::string> & input_symbols, const ActivationAccuracy accuracy)
+			: input_symbols(input_symbols), biases(biases), hidden_activation(resolve_activation_kernel(Activation::sigmoid, accuracy)), max_width(0), id(InferenceArena::next_model_id()) {
+			// Args:
+			// - connections: the weights between consecutive layers, layer i to layer i + 1 being
+			// (width of i) x (width of i + 1)
+			// - biases: biases[i] is added to layer i + 1
+			// - input_symbols: the feature symbol of every input neuron, in order
+			// - accuracy: the tier of the sigmoid applied to the hidden layers
+			// The weights are packed from the views, which need not outlive the model: they may e.g. point into a mapped
+			// .lomf file, see load_inference_model
+			assert(!connections.empty() && biases.size() >= connections.size());
+			assert(connections.front().get_shape().rows == input_symbols.size());
+
+			widths.push_back(connections.front().get_shape().rows);
+			for (const MatrixView<const double> & weights : connections) {
+				const Shape shape = weights.get_shape();
+				assert(shape.rows == widths.back());
+
+				layers.push_back(GemmPackedMatrix(shape.rows, shape.cols, weights.data(), weights.get_row_stride(), weights.get_col_stride()));
+				widths.push_back(shape.cols);
+			}
+			for (const unsigned width : widths) {
+				max_width = std::max(max_width, width);
+			}
+			// the rows of the layer buffers start on cache line boundaries
+			pitch = aligned_element_count(max_width, sizeof(double));
+		}
+
+		InferenceModel(const std::vector<Matrix<double>> & connections, const std::vector<double> & biases, const std::vector<std::string> & input_symbols, const ActivationAccuracy accuracy)
+			: InferenceModel(views_of(connections), biases, input_symbols, accuracy) { }
+
+		unsigned input_size() const {
+			return widths.front();
+		}
+
+		const std::vector<std::string> & get_input_symbols() const {
+			return input_symbols;
+		}
+
+		// MARK: Single rows
+
+		double predict(const Span<const double> features, InferenceArena & arena) const {
+			// Args:
+			// - features: the value of every input neuron, in the order of get_input_symbols()
+			// Returns:
+			//   the value of the first output neuron
+			assert(features.size() == input_size());
+			double * const inputs = arena.buffer(0, pitch);
+			std::copy(features.begin(), features.end(), inputs);
+
+			return propagate(1, arena)[0];
+		}
+
+		double predict(const RowView<double> & features, InferenceArena & arena) const {
+			// Throws:
+			// - MissingColumnException: if the row lacks any of the input symbols
+			const RowView<double> ordered = arena.bind(id, features, input_symbols);
+			double * const inputs = arena.buffer(0, pitch);
+			for (unsigned i = 0; i < input_size(); i++) {
+				inputs[i] = ordered[i];
+			}
+
+			return propagate(1, arena)[0];
+		}
+
+		double predict(const std::unordered_map<std::string, double> & features, InferenceArena & arena) const {
+			// Throws:
+			// - MissingColumnException: if <features> lacks any of the input symbols
+			double * const inputs = arena.buffer(0, pitch);
+			for (unsigned i = 0; i < input_size(); i++) {
+				std::unordered_map<std::string, double>::const_iterator feature = features.find(input_symbols[i]);
+				if (feature == features.cend()) {
+					throw MissingColumnException();
+				}
+				inputs[i] = feature->second;
+			}
+
+			return propagate(1, arena)[0];
+		}
+
+		template <typename Features>
+		double predict(const Features & features) const {
+			// any of the above with the arena of the calling thread
+			return predict(features, InferenceArena::thread_arena());
+		}
+
+		// MARK: Batches
+
+		void predict(const Span<const RowView<double>> rows, const Span<double> predictions, InferenceArena & arena) const {
+			// Batched counterpart of predict(const RowView<double> &, InferenceArena &): the rows are propagated
+			// INFERENCE_BLOCK_ROWS at a time, every layer of a block being a single matrix product
+			// Args:
+			// - predictions: receives the prediction of every row, in order
+			// Throws:
+			// - MissingColumnException: if a row lacks any of the input symbols
+			assert(predictions.size() == rows.size());
+			for (std::size_t first_row = 0; first_row < rows.size(); first_row += INFERENCE_BLOCK_ROWS) {
+				const unsigned block_rows = static_cast<unsigned>(std::min<std::size_t>(INFERENCE_BLOCK_ROWS, rows.size() - first_row));
+				double * const inputs = arena.buffer(0, block_rows * pitch);
+
+				for (unsigned row = 0; row < block_rows; row++) {
+					const RowView<double> ordered = arena.bind(id, rows[first_row + row], input_symbols);
+					for (unsigned i = 0; i < input_size(); i++) {
+						inputs[row * pitch + i] = ordered[i];
+					}
+				}
+
+				store_predictions(propagate(block_rows, arena), block_rows, predictions.data() + first_row);
+			}
+		}
+
+		void predict(const MatrixView<const double> & features, const Span<double> predictions, InferenceArena & arena) const {
+			// Args:
+			// - features: one row per prediction, the columns in the order of get_input_symbols()
+			// - predictions: receives the prediction of every row, in order
+			assert(features.get_shape().cols == input_size() && predictions.size() == features.get_shape().rows);
+			const unsigned rows = features.get_shape().rows;
+
+			for (unsigned first_row = 0; first_row < rows; first_row += INFERENCE_BLOCK_ROWS) {
+				const unsigned block_rows = std::min(INFERENCE_BLOCK_ROWS, rows - first_row);
+				double * const inputs = arena.buffer(0, block_rows * pitch);
+
+				for (unsigned row = 0; row < block_rows; row++) {
+					for (unsigned i = 0; i < input_size(); i++) {
+						inputs[row * pitch + i] = features(first_row + row, i);
+					}
+				}
+
+				store_predictions(propagate(block_rows, arena), block_rows, predictions.data() + first_row);
+			}
+		}
+
+		template <typename Batch>
+		void predict(const Batch & batch, const Span<double> predictions) const {
+			// any of the above with the arena of the calling thread
+			predict(batch, predictions, InferenceArena::thread_arena());
+		}
+	private:
+		static std::vector<MatrixView<const double>> views_of(const std::vector<Matrix<double>> & matrices) {
+			std::vector<MatrixView<const double>> views;
+			for (const Matrix<double> & matrix : matrices) {
+				views.push_back(matrix.view());
+			}
+			return views;
+		}
+
+		const double * propagate(const unsigned rows, InferenceArena & arena) const {
+			// propagates the <rows> input rows in the first buffer of <arena> through every layer
+			// Returns:
+			//   the output layer, one row of <pitch> elements per input row
+			const double * source = arena.buffer(0, rows * pitch);
+			for (unsigned layer = 0; layer < layers.size(); layer++) {
+				// the two buffers alternate as source and destination; growing the destination leaves the source intact
+				double * const destination = arena.buffer((layer + 1) % 2, rows * pitch);
+				const bool hidden = layer + 1 < layers.size();
+
+				dense_layer_forward(MatrixView<const double>(source, rows, widths[layer], pitch), layers[layer], biases[layer], hidden ? hidden_activation : nullptr,
+					MatrixView<double>(destination, rows, widths[layer + 1], pitch));
+				source = destination;
+			}
+			return source;
+		}
+
+		void store_predictions(const double * outputs, const unsigned rows, double * predictions) const {
+			for (unsigned row = 0; row < rows; row++) {
+				predictions[row] = outputs[row * pitch];
+			}
+		}
+
+		std::vector<GemmPackedMatrix> layers; // the incoming weights of every layer but the input layer
+		std::vector<unsigned> widths; // of every layer, the input layer included
+		std::vector<std::string> input_symbols;
+		std::vector<double> biases;
+		GemmElementwise hidden_activation; // the sigmoid of the accuracy tier of the network
+		unsigned max_width;
+		std::size_t pitch; // elements per row of the layer buffers
+		std::size_t id; // tells the models sharing an arena apart, see InferenceArena::bind
+	};
+}
+
+#endif
@@ -0,0 +1,268 @@
+#ifndef _INT8_GEMM_HPP
+#define _INT8_GEMM_HPP
+
+/*
+Integer kernels of quantized inference, see QuantizedModel. A real number x is stored as the int8
+q = round((x - center) / scale), clamped to [-127, 127]; the kernels multiply the int8 values as they are, and the
+caller accounts for the centers, e.g. in the bias. The weights of a layer are stored transposed, one row of int8 per
+output channel, and every row of weights and of inputs is padded with zeros to a multiple of INT8_GEMM_DEPTH_STEP, so
+the kernels never handle a partial step.
+
+The kernels compute blocks of up to INT8_GEMM_ROWS input rows by INT8_GEMM_CHANNELS channels, so that every weight
+loaded serves several rows. The AVX2 and AVX-512BW kernels sign extend 16 or 32 int8 at a time to int16 and multiply
+them with vpmaddwd, which adds adjacent products into int32 lanes. A product is at most 127 * 127, so the int32
+accumulators cannot overflow for depths below 2^31 / 127^2, about 133000 inputs per neuron. The results are exact, so
+every kernel returns the same integers.
+*/
+
+#include <cstddef>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+#include <cassert>
+
+#include "cpu_dispatch.hpp"
+
+namespace Learnoran {
+	const std::size_t INT8_GEMM_DEPTH_STEP = 32; // inputs per padded weight row; keeps every row 32 byte aligned
+	const unsigned INT8_GEMM_CHANNELS = 4; // output channels computed together; the channels are padded to a multiple of it
+	const unsigned INT8_GEMM_ROWS = 4; // input rows computed together at most
+	const int INT8_MAX_LEVEL = 127;
+
+	inline std::int8_t quantize_value(const double value, const double inverse_scale) {
+		// Returns:
+		//   value / scale rounded half away from zero and clamped to [-127, 127]
+		const double scaled = std::min(std::max(value * inverse_scale, -static_cast<double>(INT8_MAX_LEVEL)), static_cast<double>(INT8_MAX_LEVEL));
+		return static_cast<std::int8_t>(static_cast<int>(scaled + std::copysign(0.5, scaled)));
+	}
+
+	inline void quantize_row_generic(const double * values, const double * centers, const double * inverse_scales, std::int8_t * quantized, const std::size_t count) {
+		for (std::size_t i = 0; i < count; i++) {
+			quantized[i] = quantize_value(values[i] - centers[i], inverse_scales[i]);
+		}
+	}
+
+#ifdef LEARNORAN_X86
+	// GCC does not vectorize the clamp of quantize_value without -ffast-math; these round exactly like it
+
+	LEARNORAN_TARGET("avx2")
+	inline __m128i quantize_avx2(const double * values, const double * centers, const double * inverse_scales) {
+		// Returns:
+		//   4 quantized values as int32
+		const __m256d limit = _mm256_set1_pd(INT8_MAX_LEVEL);
+		const __m256d sign = _mm256_set1_pd(-0.0);
+		__m256d scaled = _mm256_mul_pd(_mm256_sub_pd(_mm256_loadu_pd(values), _mm256_loadu_pd(centers)), _mm256_loadu_pd(inverse_scales));
+		scaled = _mm256_min_pd(_mm256_max_pd(scaled, _mm256_xor_pd(limit, sign)), limit);
+		const __m256d half = _mm256_or_pd(_mm256_and_pd(scaled, sign), _mm256_set1_pd(0.5));
+		return _mm256_cvttpd_epi32(_mm256_add_pd(scaled, half));
+	}
+
+	LEARNORAN_TARGET("avx2")
+	inline void quantize_row_avx2(const double * values, const double * centers, const double * inverse_scales, std::int8_t * quantized, const std::size_t count) {
+		std::size_t i = 0;
+		for (; i + 16 <= count; i += 16) {
+			// the values are within [-127, 127], so the saturating packs only narrow them
+			const __m128i low = _mm_packs_epi32(quantize_avx2(values + i, centers + i, inverse_scales + i), quantize_avx2(values + i + 4, centers + i + 4, inverse_scales + i + 4));
+			const __m128i high = _mm_packs_epi32(quantize_avx2(values + i + 8, centers + i + 8, inverse_scales + i + 8), quantize_avx2(values + i + 12, centers + i + 12, inverse_scales + i + 12));
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(quantized + i), _mm_packs_epi16(low, high));
+		}
+		quantize_row_generic(values + i, centers + i, inverse_scales + i, quantized + i, count - i);
+	}
+
+	LEARNORAN_TARGET("avx512f")
+	inline __m256i quantize_avx512(const double * values, const double * centers, const double * inverse_scales) {
+		// Returns:
+		//   8 quantized values as int32
+		const __m512d limit = _mm512_set1_pd(INT8_MAX_LEVEL);
+		const __m512i sign = _mm512_set1_epi64(static_cast<long long>(0x8000000000000000ULL));
+		__m512d scaled = _mm512_mul_pd(_mm512_sub_pd(_mm512_loadu_pd(values), _mm512_loadu_pd(centers)), _mm512_loadu_pd(inverse_scales));
+		scaled = _mm512_min_pd(_mm512_max_pd(scaled, _mm512_sub_pd(_mm512_setzero_pd(), limit)), limit);
+		const __m512i half = _mm512_or_si512(_mm512_and_si512(_mm512_castpd_si512(scaled), sign), _mm512_castpd_si512(_mm512_set1_pd(0.5)));
+		return _mm512_cvttpd_epi32(_mm512_add_pd(scaled, _mm512_castsi512_pd(half)));
+	}
+
+	LEARNORAN_TARGET("avx512f")
+	inline void quantize_row_avx512(const double * values, const double * centers, const double * inverse_scales, std::int8_t * quantized, const std::size_t count) {
+		std::size_t i = 0;
+		for (; i + 16 <= count; i += 16) {
+			const __m512i sixteen = _mm512_inserti64x4(_mm512_castsi256_si512(quantize_avx512(values + i, centers + i, inverse_scales + i)),
+				quantize_avx512(values + i + 8, centers + i + 8, inverse_scales + i + 8), 1);
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(quantized + i), _mm512_cvtepi32_epi8(sixteen));
+		}
+		quantize_row_generic(values + i, centers + i, inverse_scales + i, quantized + i, count - i);
+	}
+#endif
+
+	inline void quantize_row(const double * values, const double * centers, const double * inverse_scales, std::int8_t * quantized, const std::size_t count) {
+		// quantizes every value around its own center with its own scale, given as its inverse
+#ifdef LEARNORAN_X86
+		if (cpu_features().avx512) {
+			quantize_row_avx512(values, centers, inverse_scales, quantized, count);
+			return;
+		}
+		if (cpu_features().avx2) {
+			quantize_row_avx2(values, centers, inverse_scales, quantized, count);
+			return;
+		}
+#endif
+		quantize_row_generic(values, centers, inverse_scales, quantized, count);
+	}
+
+	// MARK: Blocks of up to INT8_GEMM_ROWS input rows by INT8_GEMM_CHANNELS weight rows
+
+	inline void int8_block_generic(const unsigned rows, const std::int8_t * inputs, const std::size_t input_pitch, const std::int8_t * weights, const std::size_t depth,
+		std::int32_t * sums, const std::size_t sum_pitch) {
+		// Args:
+		// - inputs: <rows> rows of <depth> elements, <input_pitch> apart
+		// - weights: INT8_GEMM_CHANNELS consecutive rows of <depth> elements
+		// - sums: receives the dot product of every input row with every weight row, a row of INT8_GEMM_CHANNELS
+		// sums per input row, <sum_pitch> apart
+		for (unsigned row = 0; row < rows; row++) {
+			for (unsigned channel = 0; channel < INT8_GEMM_CHANNELS; channel++) {
+				const std::int8_t * x = inputs + row * input_pitch;
+				const std::int8_t * w = weights + channel * depth;
+				std::int32_t sum = 0;
+				for (std::size_t k = 0; k < depth; k++) {
+					sum += static_cast<std::int32_t>(x[k]) * w[k];
+				}
+				sums[row * sum_pitch + channel] = sum;
+			}
+		}
+	}
+
+#ifdef LEARNORAN_X86
+	LEARNORAN_TARGET("avx2")
+	inline void int8_store_sums_avx2(const __m256i * accumulators, std::int32_t * sums) {
+		// three horizontal additions leave the four sums, each split over the two 128 bit halves
+		const __m256i pairs = _mm256_hadd_epi32(_mm256_hadd_epi32(accumulators[0], accumulators[1]), _mm256_hadd_epi32(accumulators[2], accumulators[3]));
+		const __m128i totals = _mm_add_epi32(_mm256_castsi256_si128(pairs), _mm256_extracti128_si256(pairs, 1));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(sums), totals);
+	}
+
+	template <unsigned Rows>
+	LEARNORAN_TARGET("avx2")
+	inline void int8_block_avx2(const std::int8_t * inputs, const std::size_t input_pitch, const std::int8_t * weights, const std::size_t depth,
+		std::int32_t * sums, const std::size_t sum_pitch) {
+		// every weight is widened once and used for <Rows> input rows
+		__m256i accumulators[Rows][INT8_GEMM_CHANNELS];
+		for (unsigned row = 0; row < Rows; row++) {
+			for (unsigned channel = 0; channel < INT8_GEMM_CHANNELS; channel++) {
+				accumulators[row][channel] = _mm256_setzero_si256();
+			}
+		}
+
+		for (std::size_t k = 0; k < depth; k += 16) {
+			__m256i x[Rows];
+			for (unsigned row = 0; row < Rows; row++) {
+				x[row] = _mm256_cvtepi8_epi16(_mm_load_si128(reinterpret_cast<const __m128i *>(inputs + row * input_pitch + k)));
+			}
+			for (unsigned channel = 0; channel < INT8_GEMM_CHANNELS; channel++) {
+				const __m256i w = _mm256_cvtepi8_epi16(_mm_load_si128(reinterpret_cast<const __m128i *>(weights + channel * depth + k)));
+				for (unsigned row = 0; row < Rows; row++) {
+					accumulators[row][channel] = _mm256_add_epi32(accumulators[row][channel], _mm256_madd_epi16(x[row], w));
+				}
+			}
+		}
+
+		for (unsigned row = 0; row < Rows; row++) {
+			int8_store_sums_avx2(accumulators[row], sums + row * sum_pitch);
+		}
+	}
+
+	LEARNORAN_TARGET("avx2")
+	inline void int8_block_avx2(const unsigned rows, const std::int8_t * inputs, const std::size_t input_pitch, const std::int8_t * weights, const std::size_t depth,
+		std::int32_t * sums, const std::size_t sum_pitch) {
+		// pairs of rows: four would need more than the 16 ymm registers
+		unsigned row = 0;
+		for (; row + 2 <= rows; row += 2) {
+			int8_block_avx2<2>(inputs + row * input_pitch, input_pitch, weights, depth, sums + row * sum_pitch, sum_pitch);
+		}
+		if (row < rows) {
+			int8_block_avx2<1>(inputs + row * input_pitch, input_pitch, weights, depth, sums + row * sum_pitch, sum_pitch);
+		}
+	}
+
+	template <unsigned Rows>
+	LEARNORAN_TARGET("avx512f,avx512bw")
+	inline void int8_block_avx512(const std::int8_t * inputs, const std::size_t input_pitch, const std::int8_t * weights, const std::size_t depth,
+		std::int32_t * sums, const std::size_t sum_pitch) {
+		// 32 int8 per step; 4 rows by 4 channels take 16 of the 32 zmm registers as accumulators
+		__m512i accumulators[Rows][INT8_GEMM_CHANNELS];
+		for (unsigned row = 0; row < Rows; row++) {
+			for (unsigned channel = 0; channel < INT8_GEMM_CHANNELS; channel++) {
+				accumulators[row][channel] = _mm512_setzero_si512();
+			}
+		}
+
+		for (std::size_t k = 0; k < depth; k += 32) {
+			__m512i x[Rows];
+			for (unsigned row = 0; row < Rows; row++) {
+				x[row] = _mm512_cvtepi8_epi16(_mm256_load_si256(reinterpret_cast<const __m256i *>(inputs + row * input_pitch + k)));
+			}
+			for (unsigned channel = 0; channel < INT8_GEMM_CHANNELS; channel++) {
+				const __m512i w = _mm512_cvtepi8_epi16(_mm256_load_si256(reinterpret_cast<const __m256i *>(weights + channel * depth + k)));
+				for (unsigned row = 0; row < Rows; row++) {
+					accumulators[row][channel] = _mm512_add_epi32(accumulators[row][channel], _mm512_madd_epi16(x[row], w));
+				}
+			}
+		}
+
+		for (unsigned row = 0; row < Rows; row++) {
+			__m256i halves[INT8_GEMM_CHANNELS];
+			for (unsigned channel = 0; channel < INT8_GEMM_CHANNELS; channel++) {
+				halves[channel] = _mm256_add_epi32(_mm512_castsi512_si256(accumulators[row][channel]), _mm512_extracti64x4_epi64(accumulators[row][channel], 1));
+			}
+			int8_store_sums_avx2(halves, sums + row * sum_pitch);
+		}
+	}
+
+	LEARNORAN_TARGET("avx512f,avx512bw")
+	inline void int8_block_avx512(const unsigned rows, const std::int8_t * inputs, const std::size_t input_pitch, const std::int8_t * weights, const std::size_t depth,
+		std::int32_t * sums, const std::size_t sum_pitch) {
+		switch (rows) {
+		case 4:
+			int8_block_avx512<4>(inputs, input_pitch, weights, depth, sums, sum_pitch);
+			break;
+		case 3:
+			int8_block_avx512<3>(inputs, input_pitch, weights, depth, sums, sum_pitch);
+			break;
+		case 2:
+			int8_block_avx512<2>(inputs, input_pitch, weights, depth, sums, sum_pitch);
+			break;
+		default:
+			int8_block_avx512<1>(inputs, input_pitch, weights, depth, sums, sum_pitch);
+			break;
+		}
+	}
+#endif
+
+	typedef void (*Int8BlockKernel)(const unsigned, const std::int8_t *, const std::size_t, const std::int8_t *, const std::size_t, std::int32_t *, const std::size_t);
+
+	inline Int8BlockKernel resolve_int8_block_kernel() {
+#ifdef LEARNORAN_X86
+		if (cpu_features().avx512bw) {
+			return int8_block_avx512;
+		}
+		if (cpu_features().avx2) {
+			return int8_block_avx2;
+		}
+#endif
+		return int8_block_generic;
+	}
+
+	inline void int8_gemm(const Int8BlockKernel kernel, const unsigned rows, const std::int8_t * inputs, const std::size_t input_pitch, const std::int8_t * weights,
+		const std::size_t depth, const unsigned channels, std::int32_t * sums, const std::size_t sum_pitch) {
+		// sums = inputs * weights^T
+		// Args:
+		// - inputs: at most INT8_GEMM_ROWS rows of <depth> elements, <input_pitch> apart; <depth> and <input_pitch> are
+		// multiples of INT8_GEMM_DEPTH_STEP and the rows 32 byte aligned
+		// - weights: <channels> rows of <depth> elements, <channels> a multiple of INT8_GEMM_CHANNELS
+		// - sums: receives a row of <channels> dot products per input row, <sum_pitch> apart
+		assert(rows <= INT8_GEMM_ROWS);
+		for (unsigned channel = 0; channel < channels; channel += INT8_GEMM_CHANNELS) {
+			kernel(rows, inputs, input_pitch, weights + channel * depth, depth, sums + channel, sum_pitch);
+		}
+	}
+}
+
+#endif
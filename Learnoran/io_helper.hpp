@@ -12,8 +12,18 @@
 #include <cassert>
 #include <xutility>
 #include <cmath>
+#include <algorithm>
+#include <memory>
 
 #include "lo_exception.hpp"
+#include "dataframe.hpp"
+#include "columnar_dataframe.hpp"
+#include "sparse_dataframe.hpp"
+#include "lodf.hpp"
+#include "mapped_file.hpp"
+#include "csv_parser.hpp"
+#include "random.hpp"
+#include "compressed_stream.hpp"
 
 namespace Learnoran {
 	class IOhelper {
@@ -21,13 +31,13 @@ namespace Learnoran {
 		IOhelper() { }
 
 		void open_file(char const * filename) {
-			if (stream.is_open()) {
-				stream.close();
-			}
-			stream.open(filename);
-			if (!stream.is_open()) {
-				throw CannotOpenFileException();
-			}
+			// Opens the file to read from; .gz and .zst files are decompressed on the fly, see compressed_stream.hpp
+			// Throws:
+			// - CannotOpenFileException: if the file cannot be opened
+			// - UnsupportedCompressionException: if the file is compressed and this build lacks support for the format
+			stream.reset();
+			stream = open_input_stream(filename);
+			this->filename = filename;
 		}
 
 		std::vector<std::string> get_csv_header() const {
@@ -35,44 +45,168 @@ namespace Learnoran {
 		}
 
 		std::pair < std::pair<std::vector<std::vector<double>>, std::vector<double>>, std::pair<std::vector<std::vector<double>>, std::vector<double>> > 
-			read_csv_train_test_split(const double training_percentage, const unsigned row_count = UNKNOWN, const char delimiter = ',') {
+			read_csv_train_test_split(const double training_percentage, const unsigned row_count = UNKNOWN, const char delimiter = ',', const unsigned seed = 0, const bool stratified = false) {
+			// Reads the labelled CSV file exactly once, assigning every row to the training or the test set as it is parsed
+			// Args:
+			// - training_percentage: share of the rows assigned to the training set
+			// - row_count: number of rows in the dataset, if known. Given the row count, exactly ceil(row_count * training_percentage)
+			// rows are drawn for training (selection sampling); otherwise every row is drawn independently (Bernoulli sampling)
+			// - delimiter: the delimiter to seperate fields in the supplied CSV file
+			// - seed: seed of the random assignment; the same seed reproduces the same split
+			// - stratified: if set, rows are assigned after the read such that every STRATUM_SIZE consecutive rows in label order
+			// are split in the requested proportion, which keeps the label quantiles of both sets balanced
+			// Returns:
+			//   A std::pair of the training and the test set, each in the format returned by read_csv
 			assert(training_percentage <= 1.0 && training_percentage >= 0.0);
 
-			double total_rows;
-			if (row_count == UNKNOWN) {
-				total_rows = count_lines();
+			std::pair<std::vector<std::vector<double>>, std::vector<double>> train_set, test_set;
+			Philox4x32 generator(seed);
+
+			parse_csv_header(delimiter);
+			const std::size_t feature_columns = csv_header.size() - 1;
+
+			const std::size_t expected_training_rows = static_cast<std::size_t>(std::ceil(row_count * training_percentage));
+			if (row_count != UNKNOWN) {
+				train_set.first.reserve(expected_training_rows);
+				train_set.second.reserve(expected_training_rows);
+				test_set.first.reserve(row_count - expected_training_rows);
+				test_set.second.reserve(row_count - expected_training_rows);
+			}
+
+			std::string line_buffer;
+			std::size_t rows_seen = 0;
+			std::vector<double> features(feature_columns);
+			double label;
+
+			while (std::getline(input(), line_buffer)) {
+				if (!parse_row(line_buffer, delimiter, features, label)) {
+					continue;
+				}
+
+				bool training_row;
+				if (stratified) {
+					// assigned once the whole file is read
+					training_row = true;
+				}
+				else if (row_count != UNKNOWN && rows_seen < row_count) {
+					// selection sampling: draw the remaining training rows among the remaining rows
+					const std::size_t rows_left = row_count - rows_seen;
+					const std::size_t training_rows_left = expected_training_rows - std::min(expected_training_rows, train_set.second.size());
+					training_row = generator.uniform() * rows_left < training_rows_left;
+				}
+				else {
+					training_row = generator.uniform() < training_percentage;
+				}
+
+				std::pair<std::vector<std::vector<double>>, std::vector<double>> & destination = training_row ? train_set : test_set;
+				destination.first.push_back(features);
+				destination.second.push_back(label);
+				rows_seen++;
+			}
+
+			if (stratified) {
+				test_set = stratified_split(train_set, training_percentage, generator);
 			}
-			unsigned training_rows = std::ceil(total_rows * training_percentage);
-			
-			std::pair<std::vector<std::vector<double>>, std::vector<double>> train_set = read_csv_general(training_rows, delimiter);
-			std::pair<std::vector<std::vector<double>>, std::vector<double>> test_set = read_csv_general(total_rows - training_rows);
-		
+
 			return std::make_pair(train_set, test_set);
 		}
 
 		std::pair<std::vector<std::vector<double>>, std::vector<double>> read_csv(const unsigned row_count = UNKNOWN, const char delimiter = ',', bool data_contains_labels = true) {
 			return read_csv_general(row_count, delimiter, data_contains_labels);
 		}
+
+		ColumnarDataframe<double> read_csv_columnar(const char delimiter = ',') {
+			// Reads the labelled CSV file opened by open_file into a ColumnarDataframe. The file is memory mapped and
+			// parsed in parallel, newline aligned chunks straight into the preallocated columns, see csv_parser.hpp.
+			// Compressed files are decompressed into memory first, the parallel parse runs once the whole text is available
+			// Throws:
+			// - CannotOpenFileException: if no file was opened or it cannot be mapped
+			// - EmptyDataframeException: if the file has no header
+			// - DecompressionException: if a compressed file is corrupt
+			if (is_compressed_file(filename)) {
+				const std::vector<char> text = read_remaining();
+				const ColumnarDataframe<double> dataframe = parse_csv_columnar(text.data(), text.size(), delimiter);
+				csv_header = dataframe.get_headers();
+
+				return dataframe;
+			}
+
+			const MappedFile file(filename);
+			const ColumnarDataframe<double> dataframe = parse_csv_columnar(file.data(), file.size(), delimiter);
+			csv_header = dataframe.get_headers();
+
+			return dataframe;
+		}
+
+		SparseDataframe<double> read_csv_sparse(const char delimiter = ',') {
+			// Reads the labelled CSV file opened by open_file into a SparseDataframe, keeping only the nonzero feature
+			// values; rows are parsed one at a time, so the dense table is never held in memory
+			// Throws:
+			// - CannotOpenFileException: if no file was opened
+			// - EmptyDataframeException: if the file has no header
+			parse_csv_header(delimiter);
+			const std::size_t feature_columns = csv_header.size() - 1;
+
+			std::vector<std::size_t> row_offsets(1, 0);
+			std::vector<unsigned> column_indices;
+			std::vector<double> values;
+			std::vector<double> labels;
+
+			std::string line_buffer;
+			std::vector<double> features(feature_columns);
+			double label;
+
+			while (std::getline(input(), line_buffer)) {
+				if (!parse_row(line_buffer, delimiter, features, label)) {
+					continue;
+				}
+
+				for (std::size_t column = 0; column < feature_columns; column++) {
+					if (features[column] != 0.0) {
+						column_indices.push_back(static_cast<unsigned>(column));
+						values.push_back(features[column]);
+					}
+				}
+				row_offsets.push_back(values.size());
+				labels.push_back(label);
+			}
+
+			const unsigned rows = static_cast<unsigned>(labels.size());
+			CsrMatrix<double> feature_rows(rows, static_cast<unsigned>(feature_columns), std::move(row_offsets), std::move(column_indices), std::move(values));
+			return SparseDataframe<double>(std::move(feature_rows), std::move(labels), csv_header);
+		}
+
+		void convert_csv_to_lodf(char const * csv_filename, char const * lodf_filename, const char delimiter = ',', const bool with_statistics = true) {
+			// Parses a labelled CSV dataset once and stores it in the memory mappable .lodf format, see lodf.hpp
+			// Throws:
+			// - CannotOpenFileException: if either of the files cannot be opened
+			open_file(csv_filename);
+			write_lodf(lodf_filename, read_csv_columnar(delimiter), with_statistics);
+		}
 	
 		seal::SecretKey read_secret_key(const char * const filename) {
-			stream.close();
-			stream.open(filename, std::ios::binary);
-			if (!stream.is_open()) {
+			std::ifstream key_stream(filename, std::ios::binary);
+			if (!key_stream.is_open()) {
 				throw CannotOpenFileException();
 			}
 
 			seal::SecretKey secret_key;
-			secret_key.unsafe_load(stream);
+			secret_key.unsafe_load(key_stream);
 
 			return secret_key;
 		}
 	protected:
 		void parse_csv_header(const char delimiter = ',') {
+			// Throws:
+			// - CannotOpenFileException: if no file was opened or it cannot be opened again, see rewind
+			// - EmptyDataframeException: if the file has no header
 			std::vector<std::string> columns;
 
-			stream.seekg(0);
+			rewind();
 			std::string first_line;
-			std::getline(stream, first_line);
+			if (!std::getline(input(), first_line)) {
+				throw EmptyDataframeException();
+			}
 			std::istringstream line_stream(first_line);
 
 			std::string column;
@@ -115,7 +249,39 @@ namespace Learnoran {
 			}
 		}
 
-		std::fstream stream;
+		std::istream & input() {
+			// Throws:
+			// - CannotOpenFileException: if no file was opened
+			if (!stream) {
+				throw CannotOpenFileException();
+			}
+			return *stream;
+		}
+
+		void rewind() {
+			// Moves back to the start of the opened file. Compressed streams only rewind if nothing was read from them
+			// yet, so once they have been read the file is opened again
+			// Throws:
+			// - CannotOpenFileException: if no file was opened or it cannot be opened again
+			input().clear();
+			if (!input().seekg(0)) {
+				stream = open_input_stream(filename);
+			}
+		}
+
+		std::vector<char> read_remaining() {
+			// reads the whole opened file, see rewind
+			rewind();
+			std::vector<char> text;
+			char block[1 << 16];
+			while (input().read(block, sizeof(block)) || input().gcount() > 0) {
+				text.insert(text.end(), block, block + input().gcount());
+			}
+			return text;
+		}
+
+		std::unique_ptr<std::istream> stream;
+		std::string filename;
 		std::vector<std::string> csv_header;
 
 	private:
@@ -151,14 +317,14 @@ namespace Learnoran {
 
 			// To avoid unnecessary branching, pick one of static and dynamic reading functions and apply it in a loop
 			if (row_count == UNKNOWN) {
-				while (std::getline(stream, line_buffer)) {
+				while (std::getline(input(), line_buffer)) {
 					std::istringstream line_stream(line_buffer);
 					dynamic_row_append(features, labels, line_stream, delimiter, data_contains_labels);
 					row_counter++;
 				}
 			}
 			else {
-				while (std::getline(stream, line_buffer)) {
+				while (std::getline(input(), line_buffer)) {
 					std::istringstream line_stream(line_buffer);
 					static_row_append(features, labels, line_stream, row_counter, delimiter, data_contains_labels);
 					row_counter++;
@@ -177,8 +343,60 @@ namespace Learnoran {
 			return std::make_pair(features, labels);
 		}
 	
-		unsigned count_lines() {
-			return std::count(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>(), '\n');
+		bool parse_row(const std::string & line, const char delimiter, std::vector<double> & features, double & label) const {
+			// parses a labelled line into <features> and <label> without allocating; returns false for empty lines
+			const char * cursor = line.data();
+			const char * const line_end = csv_content_end(cursor, cursor + line.size());
+			if (line_end == cursor) {
+				return false;
+			}
+
+			for (std::size_t column = 0; column <= features.size(); column++) {
+				double value = 0.0;
+				if (cursor <= line_end) {
+					cursor = parse_double(cursor, line_end, delimiter, value) + 1;
+				}
+				(column < features.size() ? features[column] : label) = value;
+			}
+			return true;
+		}
+
+		static const std::size_t STRATUM_SIZE = 10;
+
+		std::pair<std::vector<std::vector<double>>, std::vector<double>> stratified_split(std::pair<std::vector<std::vector<double>>, std::vector<double>> & dataset, const double training_percentage, Philox4x32 & generator) const {
+			// Keeps the training rows of <dataset> in place and returns the test rows. Rows are visited in label order,
+			// STRATUM_SIZE at a time in random order within a stratum, and a row is used for training while the running
+			// share of training rows is below <training_percentage>
+			const std::size_t rows = dataset.second.size();
+			std::vector<std::size_t> order(rows);
+			for (std::size_t row = 0; row < rows; row++) {
+				order[row] = row;
+			}
+			std::stable_sort(order.begin(), order.end(), [&dataset](const std::size_t lhs, const std::size_t rhs) {
+				return dataset.second[lhs] < dataset.second[rhs];
+			});
+			for (std::size_t stratum = 0; stratum < rows; stratum += STRATUM_SIZE) {
+				shuffle_range(order.begin() + stratum, order.begin() + std::min(rows, stratum + STRATUM_SIZE), generator);
+			}
+
+			std::vector<bool> training_row(rows, false);
+			std::size_t training_rows = 0;
+			for (std::size_t visited = 0; visited < rows; visited++) {
+				if (training_rows < std::ceil((visited + 1) * training_percentage)) {
+					training_row[order[visited]] = true;
+					training_rows++;
+				}
+			}
+
+			std::pair<std::vector<std::vector<double>>, std::vector<double>> train_set, test_set;
+			for (std::size_t row = 0; row < rows; row++) {
+				std::pair<std::vector<std::vector<double>>, std::vector<double>> & destination = training_row[row] ? train_set : test_set;
+				destination.first.push_back(std::move(dataset.first[row]));
+				destination.second.push_back(dataset.second[row]);
+			}
+
+			dataset = std::move(train_set);
+			return test_set;
 		}
 	};
 }
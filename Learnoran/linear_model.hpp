@@ -3,7 +3,6 @@
 
 //#define _SEQUENTIAL
 
-#include <random>
 #include <string>
 #include <vector>
 #include <unordered_map>
@@ -15,8 +14,12 @@
 #include "predictor.hpp"
 #include "polynomial.hpp"
 #include "dataframe.hpp"
+#include "columnar_dataframe.hpp"
+#include "sparse_dataframe.hpp"
 #include "encrypted_number.hpp"
 #include "encryption_manager.hpp"
+#include "optimizer.hpp"
+#include "lomf.hpp"
 
 namespace Learnoran {
 	class LinearModel : public Predictor {
@@ -36,12 +39,27 @@ namespace Learnoran {
 			encrypted_model.set_constant_term(encryption_manager->encrypt(plain_const_term.second.coefficient), plain_const_term.first);
 
 			encrypted_zero = encryption_manager->encrypt(0.0);
+			invalidate_compiled_models();
 		}
 
 		// MARK: FIT (i.e. training)
 
+		void set_optimizer(const Optimizer & optimizer) {
+			// Args:
+			// - optimizer: the update rule of plaintext training, plain gradient descent by default; its state starts
+			// afresh with every fit. Encrypted training always uses plain gradient descent
+			this->optimizer = optimizer;
+		}
+
+		void set_seed(const std::uint64_t seed) {
+			// Args:
+			// - seed: the seed of the generator drawing the initial coefficients of the next fit; every model starts
+			// from seed 0, so two fits on the same data give the same model
+			generator = Philox4x32(seed);
+		}
+
 		void fit(const Dataframe<double> & dataframe, const unsigned short epochs, const double learning_rate) override  {
-			initialize_plaintext_model(dataframe);
+			initialize_plaintext_model(dataframe.get_feature_headers());
 
 			for (unsigned short epoch = 0; epoch < epochs; epoch++) {
 				mse_batch_gd(dataframe, learning_rate);
@@ -61,6 +79,30 @@ namespace Learnoran {
 			}
 		}
 
+		void fit(const ColumnarDataframe<double> & dataframe, const unsigned short epochs, const double learning_rate) {
+			initialize_plaintext_model(dataframe.get_feature_headers());
+
+			for (unsigned short epoch = 0; epoch < epochs; epoch++) {
+				mse_batch_gd(dataframe, learning_rate);
+				if (epoch % 10 == 0) {
+					std::cout << "Epoch " << epoch << "/" << epochs << " - MSE for first 100 rows: " << compute_mean_square_error(dataframe, 100) << std::endl;
+				}
+			}
+			std::cout << "Epoch " << epochs << "/" << epochs << " - MSE for first 100 rows: " << compute_mean_square_error(dataframe, 100) << std::endl;
+		}
+
+		void fit(const SparseDataframe<double> & dataframe, const unsigned short epochs, const double learning_rate) {
+			initialize_plaintext_model(dataframe.get_feature_headers());
+
+			for (unsigned short epoch = 0; epoch < epochs; epoch++) {
+				mse_batch_gd(dataframe, learning_rate);
+				if (epoch % 10 == 0) {
+					std::cout << "Epoch " << epoch << "/" << epochs << " - MSE for first 100 rows: " << compute_mean_square_error(dataframe, 100) << std::endl;
+				}
+			}
+			std::cout << "Epoch " << epochs << "/" << epochs << " - MSE for first 100 rows: " << compute_mean_square_error(dataframe, 100) << std::endl;
+		}
+
 		// MARK: PREDICTION
 
 		double predict(const std::unordered_map<std::string, double> & features) override {
@@ -71,6 +113,19 @@ namespace Learnoran {
 			return encrypted_model(features, encrypted_zero, dec_man);
 		}
 
+		double predict(const RowView<double> & features) override {
+			return compiled_plaintext_model_for(features.get_schema())(features, 0.0);
+		}
+
+		EncryptedNumber predict(const RowView<EncryptedNumber> & features, const DecryptionManager * dec_man = nullptr) override {
+			return compiled_encrypted_model_for(features.get_schema())(features, encrypted_zero, encrypted_model.get_tracer_sink(), dec_man);
+		}
+
+		double predict(const SparseRowView<double> & features) {
+			// visits only the nonzero features of the row
+			return compiled_plaintext_model_for(features.get_schema()).evaluate_sparse(features, 0.0);
+		}
+
 		double predict(const std::initializer_list<std::pair<std::string, double>> features)     {
 			std::unordered_map<std::string, double> feature_map;
 
@@ -81,17 +136,120 @@ namespace Learnoran {
 			return predict(feature_map);
 		}
 
+		// MARK: INSTRUMENTATION
+
+		const DefaultPolynomialTrace & get_encrypted_trace() const {
+			// per-term latency and noise budget records, empty unless LEARNORAN_TRACE_POLYNOMIAL is defined
+			return encrypted_model.get_tracer();
+		}
+
+		// MARK: PERSISTENCE
+
+		void save(const std::string & filename) const {
+			// Stores the model in the .lomf format, see lomf.hpp. The symbols are those of the terms followed by that of
+			// the constant term; the blocks are the exponents of the terms, then the coefficients of the plaintext and of
+			// the encrypted model in symbol order, for either model that is set
+			// Throws:
+			// - CannotOpenFileException: if the file cannot be created
+			// - InvalidFileFormatException: if the plaintext and the encrypted model have different terms
+			const bool has_plaintext_model = !plaintext_model.get_terms().empty();
+			std::vector<std::string> symbols;
+			std::vector<double> exponents;
+			if (has_plaintext_model) {
+				list_terms(plaintext_model, symbols, exponents);
+			}
+			else {
+				list_terms(encrypted_model, symbols, exponents);
+			}
+
+			LomfWriter writer(LomfModel::linear);
+			writer.add_symbols(symbols);
+			writer.add_block(LomfRole::exponents, exponents);
+
+			const std::vector<double> plaintext_coefficients = stored_coefficients(plaintext_model, symbols, exponents);
+			if (has_plaintext_model) {
+				writer.add_block(LomfRole::coefficients, plaintext_coefficients);
+			}
+			if (!encrypted_model.get_terms().empty()) {
+				writer.add_block(LomfRole::encrypted_coefficients, stored_coefficients(encrypted_model, symbols, exponents));
+			}
+			writer.write(filename);
+		}
+
+		void load(const std::string & filename) {
+			// Replaces the model with the one stored by save. Encrypted coefficients are only loaded by a model with an
+			// encryption manager, which must hold the keys they were encrypted under
+			// Throws:
+			// - CannotOpenFileException: if the file cannot be opened
+			// - InvalidFileFormatException: if the file is not a valid .lomf file of a linear model
+			// - MissingEncryptionManagerException: if the file holds only encrypted coefficients and the model has no
+			//   encryption manager to load them
+			const LomfFile file(filename);
+			const std::vector<std::string> & symbols = file.get_symbols();
+			if (file.get_model() != LomfModel::linear) {
+				throw InvalidFileFormatException();
+			}
+			if (!file.has(LomfRole::coefficients) && file.has(LomfRole::encrypted_coefficients) && !encryption_manager) {
+				throw MissingEncryptionManagerException();
+			}
+			const std::vector<double> exponents = file.vector(LomfRole::exponents);
+
+			plaintext_model = Polynomial<double>();
+			encrypted_model = Polynomial<EncryptedNumber>();
+			if (file.has(LomfRole::coefficients)) {
+				restore_terms(plaintext_model, symbols, exponents, file.vector(LomfRole::coefficients));
+			}
+			if (file.has(LomfRole::encrypted_coefficients) && encryption_manager) {
+				restore_terms(encrypted_model, symbols, exponents, file.ciphertexts(LomfRole::encrypted_coefficients, *encryption_manager));
+				encrypted_zero = encryption_manager->encrypt(0.0);
+			}
+			invalidate_compiled_models();
+		}
+
 		// MARK: MODEL ACCURACY ASSESSMENT
 
 		double compute_mean_square_error(const Dataframe<double> & dataframe, const unsigned num_rows) override {
 			DataframeShape shape = dataframe.shape();
 			double loss = 0.0;
 
+			const CompiledPolynomial<double> compiled_model = plaintext_model.compile(dataframe.get_feature_headers());
+
 			for (unsigned row = 0; row < shape.rows; row++) {
 				const double real_value = dataframe.get_row_label(row);
-				std::unordered_map<std::string, double> row_features = dataframe.get_row_feature(row);
 
-				const double model_error = plaintext_model(row_features) - real_value;
+				const double model_error = compiled_model(dataframe.get_row_view(row), 0.0) - real_value;
+				loss += model_error * model_error;
+			}
+			loss *= 1.0 / (shape.rows);
+
+			return loss;
+		}
+
+		double compute_mean_square_error(const ColumnarDataframe<double> & dataframe, const unsigned num_rows) {
+			const DataframeShape shape = dataframe.shape();
+			std::vector<double> predictions(shape.rows);
+
+			const CompiledPolynomial<double> compiled_model = plaintext_model.compile(dataframe.get_feature_headers());
+			compiled_model.evaluate_columns(dataframe.get_feature_data(), dataframe.get_pitch(), shape.rows, predictions.data());
+
+			const Span<const double> labels = dataframe.get_labels();
+			double loss = 0.0;
+			for (unsigned row = 0; row < shape.rows; row++) {
+				const double model_error = predictions[row] - labels[row];
+				loss += model_error * model_error;
+			}
+			loss *= 1.0 / (shape.rows);
+
+			return loss;
+		}
+
+		double compute_mean_square_error(const SparseDataframe<double> & dataframe, const unsigned num_rows) {
+			const DataframeShape shape = dataframe.shape();
+			const CompiledPolynomial<double> compiled_model = plaintext_model.compile(dataframe.get_feature_headers());
+
+			double loss = 0.0;
+			for (unsigned row = 0; row < shape.rows; row++) {
+				const double model_error = compiled_model.evaluate_sparse(dataframe.get_row_view(row), 0.0) - dataframe.get_row_label(row);
 				loss += model_error * model_error;
 			}
 			loss *= 1.0 / (shape.rows);
@@ -103,11 +261,12 @@ namespace Learnoran {
 			DataframeShape shape = dataframe.shape();
 			EncryptedNumber loss = encrypted_zero;
 
+			const CompiledPolynomial<EncryptedNumber> compiled_model = encrypted_model.compile(dataframe.get_feature_headers());
+
 			for (unsigned row = 0; row < shape.rows; row++) {
-				const EncryptedNumber real_value = dataframe.get_row_label(row);
-				std::unordered_map<std::string, EncryptedNumber> row_features = dataframe.get_row_feature(row);
+				const EncryptedNumber & real_value = dataframe.get_row_label(row);
 
-				EncryptedNumber model_error = encrypted_model(row_features, encrypted_zero) - real_value;
+				EncryptedNumber model_error = compiled_model(dataframe.get_row_view(row), encrypted_zero) - real_value;
 				loss += model_error * model_error;
 			}
 			loss *= 1.0 / (shape.rows);
@@ -126,12 +285,90 @@ namespace Learnoran {
 
 		std::shared_ptr<EncryptionManager> encryption_manager;
 
+		Optimizer optimizer;
+		Philox4x32 generator; // draws the initial coefficients
+		std::unordered_map<std::string, std::size_t> optimizer_slots; // the slot of every term of the plaintext model
+
+		// models compiled against the schema of the RowViews last passed to predict; a schema id of 0 marks them stale
+		CompiledPolynomial<double> compiled_plaintext_model;
+		CompiledPolynomial<EncryptedNumber> compiled_encrypted_model;
+		std::size_t compiled_plaintext_schema = 0;
+		std::size_t compiled_encrypted_schema = 0;
+
 		// MARK: LINEAR_MODEL PRIVATE MEMBER FUNCTION DECLERATIONS (and definitions)
 
-		static double random_standard_normal() {
-			std::mt19937 generator;
-			std::normal_distribution<double> sn_distribution(0, 1);
-			return sn_distribution(generator);
+		const CompiledPolynomial<double> & compiled_plaintext_model_for(const DataframeSchema & schema) {
+			if (compiled_plaintext_schema != schema.get_id()) {
+				compiled_plaintext_model = plaintext_model.compile(schema.get_feature_symbols());
+				compiled_plaintext_schema = schema.get_id();
+			}
+			return compiled_plaintext_model;
+		}
+
+		const CompiledPolynomial<EncryptedNumber> & compiled_encrypted_model_for(const DataframeSchema & schema) {
+			if (compiled_encrypted_schema != schema.get_id()) {
+				compiled_encrypted_model = encrypted_model.compile(schema.get_feature_symbols());
+				compiled_encrypted_schema = schema.get_id();
+			}
+			return compiled_encrypted_model;
+		}
+
+		void invalidate_compiled_models() {
+			// must be called whenever a coefficient of either model changes
+			compiled_plaintext_schema = 0;
+			compiled_encrypted_schema = 0;
+		}
+
+		template <typename T>
+		static void list_terms(const Polynomial<T> & model, std::vector<std::string> & symbols, std::vector<double> & exponents) {
+			// the order of the terms in a .lomf file, the constant term last
+			for (const std::pair<const std::string, PolynomialTerm<T>> & term : model.get_terms()) {
+				symbols.push_back(term.first);
+				exponents.push_back(term.second.exponent);
+			}
+			symbols.push_back(model.get_constant_term().first);
+		}
+
+		template <typename T>
+		static std::vector<T> stored_coefficients(const Polynomial<T> & model, const std::vector<std::string> & symbols, const std::vector<double> & exponents) {
+			// the coefficients of <model> in the order of list_terms, empty for an unset model
+			// Throws:
+			// - InvalidFileFormatException: if the terms of <model> are not those of <symbols> and <exponents>, e.g. the
+			//   plaintext and the encrypted model were trained on different features
+			std::vector<T> coefficients;
+			const std::unordered_map<std::string, PolynomialTerm<T>> & terms = model.get_terms();
+			if (terms.empty()) {
+				return coefficients;
+			}
+			if (terms.size() + 1 != symbols.size() || model.get_constant_term().first != symbols.back()) {
+				throw InvalidFileFormatException();
+			}
+			for (std::size_t term = 0; term + 1 < symbols.size(); term++) {
+				typename std::unordered_map<std::string, PolynomialTerm<T>>::const_iterator find_result = terms.find(symbols[term]);
+				if (find_result == terms.cend() || find_result->second.exponent != exponents[term]) {
+					throw InvalidFileFormatException();
+				}
+				coefficients.push_back(find_result->second.coefficient);
+			}
+			coefficients.push_back(model.get_constant_term().second.coefficient);
+			return coefficients;
+		}
+
+		template <typename T>
+		static void restore_terms(Polynomial<T> & model, const std::vector<std::string> & symbols, const std::vector<double> & exponents, const std::vector<T> & coefficients) {
+			// Throws:
+			// - InvalidFileFormatException: if the coefficients do not match the symbols
+			if (symbols.empty() || exponents.size() + 1 != symbols.size() || coefficients.size() != symbols.size()) {
+				throw InvalidFileFormatException();
+			}
+			for (std::size_t term = 0; term < exponents.size(); term++) {
+				model.add_term(coefficients[term], symbols[term], static_cast<unsigned>(exponents[term]));
+			}
+			model.set_constant_term(coefficients.back(), symbols.back());
+		}
+
+		double random_standard_normal() {
+			return generator.normal();
 		}
 
 		bool symbol_exists(const std::vector<std::string> variable_symbols, const std::string search_symbol) const {
@@ -156,18 +393,34 @@ namespace Learnoran {
 
 			// pre-compute the encrypted zero as it is used multiple times along the class methods
 			this->encrypted_zero = encryption_manager->encrypt(0.0);
+			invalidate_compiled_models();
 		}
 
-		void initialize_plaintext_model(const Dataframe<double> & dataframe) {
+		void initialize_plaintext_model(const std::vector<std::string> & variable_symbols) {
 			// construct a linear polynomial with random coefficients from the standard normal distribution
-			const std::vector<std::string> variable_symbols = dataframe.get_feature_headers();
-
 			for (const std::string & variable : variable_symbols) {
 				plaintext_model.add_term(random_standard_normal(), variable, 1);
 			}
 
 			// add the bias term
 			plaintext_model.set_constant_term(random_standard_normal(), "bias");
+			invalidate_compiled_models();
+
+			optimizer_slots.clear();
+			for (const std::pair<const std::string, PolynomialTerm<double>> & term : plaintext_model.get_terms()) {
+				optimizer_slots.insert(std::make_pair(term.first, optimizer_slots.size()));
+			}
+			optimizer.reset(optimizer_slots.size());
+		}
+
+		double optimized_parameter(const std::string & parameter, const double derivative, const double learning_rate) {
+			// Returns:
+			//   the value of <parameter> after a step of the optimizer along <derivative>. The parameters are updated
+			//   one at a time, each with the derivative of the model left by the previous update, so the optimizer
+			//   sees runs of a single slot
+			double value = plaintext_model[parameter];
+			optimizer.update(optimizer_slots.at(parameter), &value, &derivative, 1, learning_rate);
+			return value;
 		}
 
 		void print_model_coefficients(std::ostream & os) {
@@ -185,8 +438,10 @@ namespace Learnoran {
 
 		void mse_batch_gd(const Dataframe<double> & dataframe, const double learning_rate) {
 			// applies gradient descent to MSE cost function
+			optimizer.next_step();
 
 			DataframeShape shape = dataframe.shape();
+			const std::vector<std::string> feature_headers = dataframe.get_feature_headers();
 
 			// go over each parameter and optimize them one by one
 			for (std::pair<std::string, PolynomialTerm<double>> term : plaintext_model.get_terms()) {
@@ -194,15 +449,18 @@ namespace Learnoran {
 
 				double derivative_cost_function = 0.0;
 
+				// the model changes after every parameter update, so it is recompiled per parameter; compiling is
+				// linear in the number of terms while the evaluation below is linear in rows * terms
+				const CompiledPolynomial<double> compiled_model = plaintext_model.compile(feature_headers);
+
 				// evaluate and reduce-sum the non-constant linear polynomial terms
 #ifndef _SEQUENTIAL
 #pragma omp parallel for
 #endif
 				for (int row = 0; row < shape.rows; row++) {
 					const double & real_value = dataframe.get_row_label(row);
-					const std::unordered_map<std::string, double> & row_features = dataframe.get_row_feature(row);
 
-					const double model_prediction = plaintext_model(row_features);
+					const double model_prediction = compiled_model(dataframe.get_row_view(row), 0.0);
 					const double model_error = model_prediction - real_value;
 
 					double inner_derivative = 1.0;
@@ -223,33 +481,112 @@ namespace Learnoran {
 				// evaluate and add the constant term of the polynomial
 				derivative_cost_function += plaintext_model.get_constant_term().second.coefficient;
 
-				const double & current_parameter_value = plaintext_model[current_parameter];
-				const double & parameter_new_value = current_parameter_value - (derivative_cost_function * learning_rate);
+				plaintext_model[current_parameter] = optimized_parameter(current_parameter, derivative_cost_function, learning_rate);
+			}
+			invalidate_compiled_models();
+		}
+
+		void mse_batch_gd(const ColumnarDataframe<double> & dataframe, const double learning_rate) {
+			// columnar counterpart of the above; predictions for all rows are computed column by column
+			optimizer.next_step();
+			const DataframeShape shape = dataframe.shape();
+			const std::vector<std::string> feature_headers = dataframe.get_feature_headers();
+			const Span<const double> labels = dataframe.get_labels();
+			std::vector<double> predictions(shape.rows);
+
+			// go over each parameter and optimize them one by one
+			for (std::pair<std::string, PolynomialTerm<double>> term : plaintext_model.get_terms()) {
+				const std::string current_parameter = term.first;
+
+				const CompiledPolynomial<double> compiled_model = plaintext_model.compile(feature_headers);
+				compiled_model.evaluate_columns(dataframe.get_feature_data(), dataframe.get_pitch(), shape.rows, predictions.data());
+
+				double derivative_cost_function = 0.0;
+				for (unsigned row = 0; row < shape.rows; row++) {
+					derivative_cost_function += predictions[row] - labels[row];
+				}
+				derivative_cost_function *= 1.0 / shape.rows;
+
+				// evaluate and add the constant term of the polynomial
+				derivative_cost_function += plaintext_model.get_constant_term().second.coefficient;
+
+				plaintext_model[current_parameter] = optimized_parameter(current_parameter, derivative_cost_function, learning_rate);
+			}
+			invalidate_compiled_models();
+		}
+
+		void mse_batch_gd(const SparseDataframe<double> & dataframe, const double learning_rate) {
+			// sparse counterpart of the above. The derivative only depends on the sum of the prediction errors, which is
+			// computed once from the rows and then kept up to date: changing the coefficient of a feature moves the
+			// prediction of every row by the change times the feature value, which is zero outside the nonzeros of its
+			// column. An epoch therefore costs O(nonzeros + terms) instead of O(terms * rows * features)
+			optimizer.next_step();
+			const DataframeShape shape = dataframe.shape();
+			const DataframeSchema & schema = dataframe.get_schema();
+			const CscMatrix<double> & feature_columns = dataframe.get_columns();
+			const Span<const double> labels = dataframe.get_labels();
+
+			const CompiledPolynomial<double> compiled_model = plaintext_model.compile(dataframe.get_feature_headers());
+			double error_sum = 0.0;
+			for (unsigned row = 0; row < shape.rows; row++) {
+				error_sum += compiled_model.evaluate_sparse(dataframe.get_row_view(row), 0.0) - labels[row];
+			}
+
+			// go over each parameter and optimize them one by one
+			for (std::pair<std::string, PolynomialTerm<double>> term : plaintext_model.get_terms()) {
+				const std::string current_parameter = term.first;
+
+				double derivative_cost_function = error_sum / shape.rows;
+
+				// evaluate and add the constant term of the polynomial
+				derivative_cost_function += plaintext_model.get_constant_term().second.coefficient;
+
+				const double current_parameter_value = plaintext_model[current_parameter];
+				const double parameter_new_value = optimized_parameter(current_parameter, derivative_cost_function, learning_rate);
 
 				plaintext_model[current_parameter] = parameter_new_value;
+
+				// account for the update in the predictions of the rows the parameter's feature is nonzero in
+				const unsigned exponent = term.second.exponent;
+				double feature_sum = 0.0;
+				if (exponent == 0) {
+					feature_sum = shape.rows;
+				}
+				else {
+					const SparseVectorView<const double> column = feature_columns.col(static_cast<unsigned>(schema.index_of(current_parameter)));
+					for (std::size_t nonzero = 0; nonzero < column.nonzeros(); nonzero++) {
+						feature_sum += raise_power(column.value(nonzero), exponent);
+					}
+				}
+				error_sum += (parameter_new_value - current_parameter_value) * feature_sum;
 			}
+			invalidate_compiled_models();
 		}
 
 		void mse_batch_gd(const Dataframe<EncryptedNumber> & dataframe, const double learning_rate, const DecryptionManager * dec_man = nullptr) {
 			// applies gradient descent to MSE cost function
 
 			DataframeShape shape = dataframe.shape();
+			const std::vector<std::string> feature_headers = dataframe.get_feature_headers();
+			DefaultPolynomialTrace & tracer = encrypted_model.get_tracer_sink();
 
 			// go over each parameter and optimize them one by one
 			for (std::pair<std::string, PolynomialTerm<EncryptedNumber>> term : encrypted_model.get_terms()) {
 				const std::string current_parameter = term.first;
 
 				EncryptedNumber derivative_cost_function = encryption_manager->encrypt(0.0);
-				
+
+				// rows are read in place through row views, the model is recompiled after every parameter update
+				const CompiledPolynomial<EncryptedNumber> compiled_model = encrypted_model.compile(feature_headers);
+
 				// evaluate and reduce-sum the non-constant linear polynomial terms
 #ifndef _SEQUENTIAL
 #pragma omp parallel for
 #endif
 				for (int row = 0; row < shape.rows; row++) {
 					const EncryptedNumber & real_value = dataframe.get_row_label(row);
-					const std::unordered_map<std::string, EncryptedNumber> & row_features = dataframe.get_row_feature(row);
 
-					const EncryptedNumber model_prediction = encrypted_model(row_features, encryption_manager->encrypt(0.0), dec_man);
+					const EncryptedNumber model_prediction = compiled_model(dataframe.get_row_view(row), encrypted_zero, tracer, dec_man);
 					const EncryptedNumber model_error = model_prediction - real_value;
 
 					EncryptedNumber inner_derivative = encryption_manager->encrypt(1.0);
@@ -276,6 +613,7 @@ namespace Learnoran {
 				encrypted_model[current_parameter] = parameter_new_value;
 				std::cout << "Model parameter " << current_parameter << " updated" << std::endl;
 			}
+			invalidate_compiled_models();
 		}
 	};
 }
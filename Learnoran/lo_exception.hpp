@@ -22,6 +22,16 @@ public:
 	EmptyDataframeException() : DataframeException("Dataframe was empty") { }
 };
 
+class MissingColumnException : public DataframeException {
+public:
+	MissingColumnException() : DataframeException("Dataframe has no column with the requested name") { }
+};
+
+class DataframeViewException : public DataframeException {
+public:
+	DataframeViewException() : DataframeException("Operation is not available on dataframe views, materialize the view first") { }
+};
+
 // MARK: IO Exceptions
 
 class IOexception : public LearnoranException {
@@ -34,6 +44,21 @@ public:
 	CannotOpenFileException() : IOexception("Cannot open the provided file") { }
 };
 
+class InvalidFileFormatException : public IOexception {
+public:
+	InvalidFileFormatException() : IOexception("The provided file is malformed or of an unsupported format version") { }
+};
+
+class UnsupportedCompressionException : public IOexception {
+public:
+	UnsupportedCompressionException() : IOexception("The provided file is compressed with a format this build does not support") { }
+};
+
+class DecompressionException : public IOexception {
+public:
+	DecompressionException() : IOexception("The provided file could not be decompressed, it is corrupt or truncated") { }
+};
+
 // MARK: Polynomial Exceptions
 
 class PolynomialException : public LearnoranException {
@@ -51,4 +76,16 @@ public:
 	InvalidVariableException() : PolynomialException("Provided variable does not exists in the polynomial") { }
 };
 
+// MARK: Model Exceptions
+
+class UnsupportedOperationException : public LearnoranException {
+public:
+	UnsupportedOperationException() : LearnoranException("The model does not support this operation, e.g. on encrypted data") { }
+};
+
+class MissingEncryptionManagerException : public LearnoranException {
+public:
+	MissingEncryptionManagerException() : LearnoranException("The model has no encryption manager to work on encrypted data") { }
+};
+
 #endif
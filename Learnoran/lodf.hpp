@@ -0,0 +1,226 @@
+#ifndef _LODF_HPP
+#define _LODF_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <memory>
+
+#include "lo_exception.hpp"
+#include "columnar_dataframe.hpp"
+#include "aligned_buffer.hpp"
+#include "mapped_file.hpp"
+
+/*
+.lodf (Learnoran dataframe) is a columnar binary format for plaintext datasets that is loaded by memory mapping the file
+and handing its column blocks out as a ColumnarDataframe, without parsing or copying. All integers are little-endian.
+
+	LodfHeader                      40 bytes
+	column names                    per column: uint32 byte length, then the name bytes; the label column is last
+	padding to 8 bytes
+	LodfColumnStatistics[columns]   only if the LODF_HAS_STATISTICS flag is set
+	padding to 64 bytes             (data_offset)
+	column blocks                   column j holds <pitch> float64 values starting at data_offset + j * pitch * 8,
+	                                the first <rows> of which are data; pitch keeps every block 64-byte aligned
+*/
+
+namespace Learnoran {
+	const char LODF_MAGIC[4] = { 'L', 'O', 'D', 'F' };
+	const std::uint32_t LODF_VERSION = 1;
+	const std::uint32_t LODF_HAS_STATISTICS = 1;
+
+	struct LodfHeader {
+		char magic[4];
+		std::uint32_t version;
+		std::uint64_t rows;
+		std::uint64_t pitch; // elements per column block
+		std::uint32_t columns; // feature columns and the label column
+		std::uint32_t flags;
+		std::uint64_t data_offset; // byte offset of the first column block
+	};
+
+	struct LodfColumnStatistics {
+		double minimum;
+		double maximum;
+		double mean;
+	};
+
+	inline bool host_is_little_endian() {
+		const std::uint16_t probe = 1;
+		char first_byte;
+		std::memcpy(&first_byte, &probe, 1);
+		return first_byte == 1;
+	}
+
+	inline std::uint64_t lodf_align(const std::uint64_t offset, const std::uint64_t alignment) {
+		return (offset + alignment - 1) / alignment * alignment;
+	}
+
+	inline void write_lodf(const std::string & filename, const ColumnarDataframe<double> & dataframe, const bool with_statistics = true) {
+		// Args:
+		// - filename: path of the .lodf file to create or overwrite
+		// - dataframe: the dataset to store
+		// - with_statistics: if set, per column minimum, maximum and mean values are stored along with the data
+		// Throws:
+		// - CannotOpenFileException: if the file cannot be created
+		// - InvalidFileFormatException: on big-endian hosts
+		if (!host_is_little_endian()) {
+			throw InvalidFileFormatException();
+		}
+
+		std::ofstream stream(filename, std::ios::binary | std::ios::trunc);
+		if (!stream.is_open()) {
+			throw CannotOpenFileException();
+		}
+
+		const std::vector<std::string> headers = dataframe.get_headers();
+		const std::size_t rows = dataframe.shape().rows;
+		const std::size_t feature_columns = headers.size() - 1;
+
+		std::vector<Span<const double>> column_data;
+		for (std::size_t column = 0; column < feature_columns; column++) {
+			column_data.push_back(dataframe.get_column(column));
+		}
+		column_data.push_back(dataframe.get_labels());
+
+		std::uint64_t names_size = 0;
+		for (const std::string & header : headers) {
+			names_size += sizeof(std::uint32_t) + header.size();
+		}
+		const std::uint64_t statistics_offset = lodf_align(sizeof(LodfHeader) + names_size, 8);
+		const std::uint64_t statistics_size = with_statistics ? headers.size() * sizeof(LodfColumnStatistics) : 0;
+
+		LodfHeader header;
+		std::memcpy(header.magic, LODF_MAGIC, sizeof(header.magic));
+		header.version = LODF_VERSION;
+		header.rows = rows;
+		header.pitch = aligned_element_count(rows, sizeof(double));
+		header.columns = static_cast<std::uint32_t>(headers.size());
+		header.flags = with_statistics ? LODF_HAS_STATISTICS : 0;
+		header.data_offset = lodf_align(statistics_offset + statistics_size, CACHE_LINE_SIZE);
+
+		stream.write(reinterpret_cast<const char *>(&header), sizeof(header));
+		for (const std::string & name : headers) {
+			const std::uint32_t name_length = static_cast<std::uint32_t>(name.size());
+			stream.write(reinterpret_cast<const char *>(&name_length), sizeof(name_length));
+			stream.write(name.data(), name.size());
+		}
+
+		const std::vector<char> padding(CACHE_LINE_SIZE, 0);
+		stream.write(padding.data(), statistics_offset - sizeof(LodfHeader) - names_size);
+
+		if (with_statistics) {
+			for (const Span<const double> & column : column_data) {
+				LodfColumnStatistics statistics = { 0.0, 0.0, 0.0 };
+				if (!column.empty()) {
+					statistics.minimum = statistics.maximum = column[0];
+					for (const double value : column) {
+						statistics.minimum = value < statistics.minimum ? value : statistics.minimum;
+						statistics.maximum = value > statistics.maximum ? value : statistics.maximum;
+						statistics.mean += value;
+					}
+					statistics.mean /= column.size();
+				}
+				stream.write(reinterpret_cast<const char *>(&statistics), sizeof(statistics));
+			}
+		}
+		stream.write(padding.data(), header.data_offset - statistics_offset - statistics_size);
+
+		const std::vector<double> block_padding(header.pitch - rows, 0.0);
+		for (const Span<const double> & column : column_data) {
+			stream.write(reinterpret_cast<const char *>(column.data()), rows * sizeof(double));
+			stream.write(reinterpret_cast<const char *>(block_padding.data()), block_padding.size() * sizeof(double));
+		}
+
+		if (!stream) {
+			throw CannotOpenFileException();
+		}
+	}
+
+	class LodfFile {
+		// A memory mapped .lodf file. The dataframe handed out references the mapping directly and keeps it alive,
+		// so it remains valid after the LodfFile itself is destroyed
+	public:
+		explicit LodfFile(const std::string & filename) {
+			// Throws:
+			// - CannotOpenFileException: if the file cannot be opened or mapped
+			// - InvalidFileFormatException: if the file is not a valid .lodf file of a supported version
+			if (!host_is_little_endian()) {
+				throw InvalidFileFormatException();
+			}
+
+			std::shared_ptr<MappedFile> file = std::make_shared<MappedFile>(filename);
+			const char * const bytes = file->data();
+			const std::uint64_t file_size = file->size();
+
+			LodfHeader header;
+			if (file_size < sizeof(header)) {
+				throw InvalidFileFormatException();
+			}
+			std::memcpy(&header, bytes, sizeof(header));
+			if (std::memcmp(header.magic, LODF_MAGIC, sizeof(header.magic)) != 0 || header.version != LODF_VERSION || header.columns == 0
+				|| header.pitch < header.rows || header.data_offset % CACHE_LINE_SIZE != 0) {
+				throw InvalidFileFormatException();
+			}
+
+			std::uint64_t offset = sizeof(header);
+			std::vector<std::string> headers;
+			for (std::uint32_t column = 0; column < header.columns; column++) {
+				std::uint32_t name_length;
+				if (offset + sizeof(name_length) > file_size) {
+					throw InvalidFileFormatException();
+				}
+				std::memcpy(&name_length, bytes + offset, sizeof(name_length));
+				offset += sizeof(name_length);
+
+				if (offset + name_length > file_size) {
+					throw InvalidFileFormatException();
+				}
+				headers.push_back(std::string(bytes + offset, name_length));
+				offset += name_length;
+			}
+
+			if (header.flags & LODF_HAS_STATISTICS) {
+				offset = lodf_align(offset, 8);
+				statistics.resize(header.columns);
+				if (offset + statistics.size() * sizeof(LodfColumnStatistics) > header.data_offset) {
+					throw InvalidFileFormatException();
+				}
+				std::memcpy(statistics.data(), bytes + offset, statistics.size() * sizeof(LodfColumnStatistics));
+			}
+
+			if (header.data_offset < offset || header.data_offset + header.columns * header.pitch * sizeof(double) > file_size) {
+				throw InvalidFileFormatException();
+			}
+
+			const double * const columns_base = reinterpret_cast<const double *>(bytes + header.data_offset);
+			dataframe = ColumnarDataframe<double>(file, columns_base, header.pitch, header.rows, headers);
+		}
+
+		const ColumnarDataframe<double> & get_dataframe() const {
+			return dataframe;
+		}
+
+		bool has_statistics() const {
+			return !statistics.empty();
+		}
+
+		const LodfColumnStatistics & get_statistics(const std::size_t column) const {
+			// Args:
+			// - column: index of the column in get_dataframe().get_headers() order, the label column being the last one
+			assert(has_statistics() && column < statistics.size());
+			return statistics[column];
+		}
+	private:
+		ColumnarDataframe<double> dataframe;
+		std::vector<LodfColumnStatistics> statistics;
+	};
+
+	inline ColumnarDataframe<double> load_lodf(const std::string & filename) {
+		return LodfFile(filename).get_dataframe();
+	}
+}
+
+#endif
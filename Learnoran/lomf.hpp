@@ -0,0 +1,426 @@
+#ifndef _LOMF_HPP
+#define _LOMF_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <streambuf>
+#include <memory>
+
+#include "lo_exception.hpp"
+#include "matrix.hpp"
+#include "aligned_buffer.hpp"
+#include "mapped_file.hpp"
+#include "lodf.hpp"
+#include "activation.hpp"
+#include "inference_model.hpp"
+#include "encrypted_number.hpp"
+#include "encryption_manager.hpp"
+
+/*
+.lomf (Learnoran model file) is a versioned binary format for the parameters of a trained model. Like .lodf files they
+are loaded by memory mapping: the plaintext parameters are read in place from aligned blocks, nothing is parsed. All
+integers are little-endian.
+
+	LomfHeader                      32 bytes
+	symbols                         per symbol: uint32 byte length, then the symbol bytes
+	padding to 8 bytes
+	LomfBlock[blocks]
+	padding to 64 bytes
+	blocks                          every block starts on a 64-byte boundary. A float64 block holds <rows> rows of
+	                                <pitch> values, the first <cols> of which are data, so every row is 64-byte aligned
+	                                as in a Matrix. A ciphertext block holds <rows> seal::Ciphertext::save records
+
+What the symbols, the parameters and the blocks mean depends on the kind of the model, see the save member function of
+LinearModel, PolynomialModel and NeuralNetwork.
+*/
+
+namespace Learnoran {
+	const char LOMF_MAGIC[4] = { 'L', 'O', 'M', 'F' };
+	const std::uint32_t LOMF_VERSION = 1;
+
+	enum class LomfModel : std::uint32_t {
+		linear = 1,
+		polynomial = 2,
+		neural_network = 3
+	};
+
+	enum class LomfBlockType : std::uint32_t {
+		float64 = 1,
+		ciphertexts = 2
+	};
+
+	enum class LomfRole : std::uint32_t {
+		coefficients = 1, // plaintext model coefficients
+		encrypted_coefficients = 2, // the same, encrypted
+		exponents = 3, // of the terms of a linear model
+		weights = 4, // the connections of one layer of a network, one block per layer in order
+		biases = 5 // of every layer of a network
+	};
+
+	struct LomfHeader {
+		char magic[4];
+		std::uint32_t version;
+		std::uint32_t model; // LomfModel
+		std::uint32_t symbol_count;
+		std::uint32_t block_count;
+		std::uint32_t reserved;
+		std::uint32_t parameters[2]; // model specific, e.g. the degree of a polynomial model
+	};
+
+	struct LomfBlock {
+		std::uint32_t role; // LomfRole
+		std::uint32_t type; // LomfBlockType
+		std::uint64_t rows;
+		std::uint64_t cols;
+		std::uint64_t pitch; // elements per row of a float64 block, 0 for ciphertexts
+		std::uint64_t offset; // from the beginning of the file
+		std::uint64_t size; // in bytes
+	};
+
+	class LomfWriter {
+		// Collects the symbols and the blocks of a model, then lays the file out in a single pass. Plaintext blocks are
+		// referenced, not copied: the matrices they view must outlive the call to write
+	public:
+		LomfWriter(const LomfModel model, const std::uint32_t first_parameter = 0, const std::uint32_t second_parameter = 0) : model(model) {
+			parameters[0] = first_parameter;
+			parameters[1] = second_parameter;
+		}
+
+		void add_symbols(const std::vector<std::string> & symbols) {
+			this->symbols.insert(this->symbols.end(), symbols.begin(), symbols.end());
+		}
+
+		void add_block(const LomfRole role, const MatrixView<const double> & values) {
+			assert(values.get_shape().cols == 0 || values.get_row_stride() >= values.get_shape().cols);
+			PendingBlock block = { role, LomfBlockType::float64, values, std::string() };
+			blocks.push_back(block);
+		}
+
+		void add_block(const LomfRole role, const std::vector<double> & values) {
+			add_block(role, MatrixView<const double>(values.data(), 1, static_cast<unsigned>(values.size()), values.size()));
+		}
+
+		void add_block(const LomfRole role, const std::vector<EncryptedNumber> & values) {
+			std::ostringstream records(std::ios::binary);
+			for (const EncryptedNumber & value : values) {
+				value.ciphertext.save(records);
+			}
+			PendingBlock block = { role, LomfBlockType::ciphertexts, MatrixView<const double>(nullptr, static_cast<unsigned>(values.size()), 0, 0), records.str() };
+			blocks.push_back(block);
+		}
+
+		void write(const std::string & filename) const {
+			// Throws:
+			// - CannotOpenFileException: if the file cannot be created
+			// - InvalidFileFormatException: on big-endian hosts
+			if (!host_is_little_endian()) {
+				throw InvalidFileFormatException();
+			}
+
+			std::ofstream stream(filename, std::ios::binary | std::ios::trunc);
+			if (!stream.is_open()) {
+				throw CannotOpenFileException();
+			}
+
+			std::uint64_t symbols_size = 0;
+			for (const std::string & symbol : symbols) {
+				symbols_size += sizeof(std::uint32_t) + symbol.size();
+			}
+			const std::uint64_t table_offset = lodf_align(sizeof(LomfHeader) + symbols_size, 8);
+
+			std::vector<LomfBlock> table;
+			std::uint64_t offset = lodf_align(table_offset + blocks.size() * sizeof(LomfBlock), CACHE_LINE_SIZE);
+			for (const PendingBlock & pending : blocks) {
+				const Shape shape = pending.values.get_shape();
+				LomfBlock block;
+				block.role = static_cast<std::uint32_t>(pending.role);
+				block.type = static_cast<std::uint32_t>(pending.type);
+				block.rows = shape.rows;
+				block.cols = shape.cols;
+				block.pitch = pending.type == LomfBlockType::float64 ? aligned_element_count(shape.cols, sizeof(double)) : 0;
+				block.offset = offset;
+				block.size = pending.type == LomfBlockType::float64 ? block.rows * block.pitch * sizeof(double) : pending.records.size();
+				table.push_back(block);
+				offset = lodf_align(offset + block.size, CACHE_LINE_SIZE);
+			}
+
+			LomfHeader header;
+			std::memcpy(header.magic, LOMF_MAGIC, sizeof(header.magic));
+			header.version = LOMF_VERSION;
+			header.model = static_cast<std::uint32_t>(model);
+			header.symbol_count = static_cast<std::uint32_t>(symbols.size());
+			header.block_count = static_cast<std::uint32_t>(blocks.size());
+			header.reserved = 0;
+			header.parameters[0] = parameters[0];
+			header.parameters[1] = parameters[1];
+
+			stream.write(reinterpret_cast<const char *>(&header), sizeof(header));
+			for (const std::string & symbol : symbols) {
+				const std::uint32_t symbol_length = static_cast<std::uint32_t>(symbol.size());
+				stream.write(reinterpret_cast<const char *>(&symbol_length), sizeof(symbol_length));
+				stream.write(symbol.data(), symbol.size());
+			}
+			std::uint64_t position = sizeof(LomfHeader) + symbols_size;
+			pad(stream, position, table_offset);
+
+			if (!table.empty()) {
+				stream.write(reinterpret_cast<const char *>(table.data()), table.size() * sizeof(LomfBlock));
+			}
+			position = table_offset + table.size() * sizeof(LomfBlock);
+
+			std::vector<double> row;
+			for (std::size_t block = 0; block < blocks.size(); block++) {
+				pad(stream, position, table[block].offset);
+				const PendingBlock & pending = blocks[block];
+
+				if (pending.type == LomfBlockType::float64) {
+					row.assign(table[block].pitch, 0.0);
+					for (unsigned block_row = 0; block_row < table[block].rows; block_row++) {
+						for (unsigned col = 0; col < table[block].cols; col++) {
+							row[col] = pending.values(block_row, col);
+						}
+						stream.write(reinterpret_cast<const char *>(row.data()), row.size() * sizeof(double));
+					}
+				}
+				else {
+					stream.write(pending.records.data(), pending.records.size());
+				}
+				position += table[block].size;
+			}
+
+			if (!stream) {
+				throw CannotOpenFileException();
+			}
+		}
+	private:
+		struct PendingBlock {
+			LomfRole role;
+			LomfBlockType type;
+			MatrixView<const double> values; // the shape of the block, and the values of a float64 block
+			std::string records; // the serialized ciphertexts of a ciphertext block
+		};
+
+		static void pad(std::ofstream & stream, std::uint64_t & position, const std::uint64_t target) {
+			const std::vector<char> padding(static_cast<std::size_t>(target - position), 0);
+			stream.write(padding.data(), padding.size());
+			position = target;
+		}
+
+		LomfModel model;
+		std::uint32_t parameters[2];
+		std::vector<std::string> symbols;
+		std::vector<PendingBlock> blocks;
+	};
+
+	class LomfFile {
+		// A memory mapped .lomf file. The file is validated when opened; the plaintext blocks are then handed out as
+		// views into the mapping, which stay valid as long as the LomfFile does
+	public:
+		explicit LomfFile(const std::string & filename) : file(std::make_shared<MappedFile>(filename)) {
+			// Throws:
+			// - CannotOpenFileException: if the file cannot be opened or mapped
+			// - InvalidFileFormatException: if the file is not a valid .lomf file of a supported version
+			if (!host_is_little_endian()) {
+				throw InvalidFileFormatException();
+			}
+
+			const char * const bytes = file->data();
+			const std::uint64_t file_size = file->size();
+			if (file_size < sizeof(header)) {
+				throw InvalidFileFormatException();
+			}
+			std::memcpy(&header, bytes, sizeof(header));
+			if (std::memcmp(header.magic, LOMF_MAGIC, sizeof(header.magic)) != 0 || header.version != LOMF_VERSION) {
+				throw InvalidFileFormatException();
+			}
+
+			std::uint64_t offset = sizeof(header);
+			for (std::uint32_t symbol = 0; symbol < header.symbol_count; symbol++) {
+				std::uint32_t symbol_length;
+				if (offset + sizeof(symbol_length) > file_size) {
+					throw InvalidFileFormatException();
+				}
+				std::memcpy(&symbol_length, bytes + offset, sizeof(symbol_length));
+				offset += sizeof(symbol_length);
+
+				if (offset + symbol_length > file_size) {
+					throw InvalidFileFormatException();
+				}
+				symbols.push_back(std::string(bytes + offset, symbol_length));
+				offset += symbol_length;
+			}
+
+			offset = lodf_align(offset, 8);
+			if (offset + static_cast<std::uint64_t>(header.block_count) * sizeof(LomfBlock) > file_size) {
+				throw InvalidFileFormatException();
+			}
+			blocks.resize(header.block_count);
+			if (!blocks.empty()) {
+				std::memcpy(blocks.data(), bytes + offset, blocks.size() * sizeof(LomfBlock));
+			}
+
+			for (const LomfBlock & block : blocks) {
+				bool valid = block.offset % CACHE_LINE_SIZE == 0 && block.offset <= file_size && block.size <= file_size - block.offset;
+				if (block.type == static_cast<std::uint32_t>(LomfBlockType::float64)) {
+					valid = valid && block.pitch >= block.cols && block.rows <= UINT32_MAX && block.cols <= UINT32_MAX
+						&& (block.pitch == 0 || block.rows <= block.size / sizeof(double) / block.pitch)
+						&& block.size == block.rows * block.pitch * sizeof(double);
+				}
+				else if (block.type != static_cast<std::uint32_t>(LomfBlockType::ciphertexts)) {
+					valid = false;
+				}
+				if (!valid) {
+					throw InvalidFileFormatException();
+				}
+			}
+		}
+
+		LomfModel get_model() const {
+			return static_cast<LomfModel>(header.model);
+		}
+
+		std::uint32_t get_parameter(const unsigned index) const {
+			assert(index < 2);
+			return header.parameters[index];
+		}
+
+		const std::vector<std::string> & get_symbols() const {
+			return symbols;
+		}
+
+		std::size_t count(const LomfRole role) const {
+			std::size_t blocks_of_role = 0;
+			for (const LomfBlock & block : blocks) {
+				blocks_of_role += block.role == static_cast<std::uint32_t>(role) ? 1 : 0;
+			}
+			return blocks_of_role;
+		}
+
+		bool has(const LomfRole role) const {
+			return count(role) > 0;
+		}
+
+		MatrixView<const double> values(const LomfRole role, const std::size_t index = 0) const {
+			// Args:
+			// - index: picks among the blocks of <role>, in file order
+			// Returns:
+			//   the float64 block, in place in the mapping
+			// Throws:
+			// - InvalidFileFormatException: if there is no such float64 block
+			const LomfBlock & block = find(role, index, LomfBlockType::float64);
+			return MatrixView<const double>(reinterpret_cast<const double *>(file->data() + block.offset), static_cast<unsigned>(block.rows),
+				static_cast<unsigned>(block.cols), static_cast<std::size_t>(block.pitch));
+		}
+
+		std::vector<double> vector(const LomfRole role, const std::size_t index = 0) const {
+			// a single row float64 block, copied
+			// Throws:
+			// - InvalidFileFormatException: if there is no such block or it has more than one row
+			const MatrixView<const double> block = values(role, index);
+			if (block.get_shape().rows != 1) {
+				throw InvalidFileFormatException();
+			}
+			return std::vector<double>(block.data(), block.data() + block.get_shape().cols);
+		}
+
+		std::vector<EncryptedNumber> ciphertexts(const LomfRole role, const EncryptionManager & encryption_manager, const std::size_t index = 0) const {
+			// Args:
+			// - encryption_manager: must hold the keys the ciphertexts were encrypted under
+			// Throws:
+			// - InvalidFileFormatException: if there is no such ciphertext block or it is truncated
+			const LomfBlock & block = find(role, index, LomfBlockType::ciphertexts);
+			MemoryStreambuf records(file->data() + block.offset, static_cast<std::size_t>(block.size));
+			std::istream stream(&records);
+
+			std::vector<EncryptedNumber> values;
+			values.reserve(static_cast<std::size_t>(block.rows));
+			for (std::uint64_t row = 0; row < block.rows; row++) {
+				seal::Ciphertext ciphertext;
+				ciphertext.load(stream);
+				if (!stream) {
+					throw InvalidFileFormatException();
+				}
+				values.push_back(encryption_manager.wrap(ciphertext));
+			}
+			return values;
+		}
+	private:
+		class MemoryStreambuf : public std::streambuf {
+			// reads the records of a ciphertext block in place
+		public:
+			MemoryStreambuf(const char * begin, const std::size_t size) {
+				char * const base = const_cast<char *>(begin);
+				setg(base, base, base + size);
+			}
+		};
+
+		const LomfBlock & find(const LomfRole role, std::size_t index, const LomfBlockType type) const {
+			for (const LomfBlock & block : blocks) {
+				if (block.role == static_cast<std::uint32_t>(role) && index-- == 0) {
+					if (block.type != static_cast<std::uint32_t>(type)) {
+						throw InvalidFileFormatException();
+					}
+					return block;
+				}
+			}
+			throw InvalidFileFormatException();
+		}
+
+		std::shared_ptr<MappedFile> file;
+		LomfHeader header;
+		std::vector<std::string> symbols;
+		std::vector<LomfBlock> blocks;
+	};
+
+	// MARK: Networks
+
+	inline void read_lomf_network(const LomfFile & file, std::vector<MatrixView<const double>> & connections, std::vector<double> & biases, ActivationAccuracy & accuracy) {
+		// Reads a network stored by NeuralNetwork::save
+		// Args:
+		// - connections: receives the weights of every layer, in place in the mapping of <file>
+		// - biases: receives the bias of every layer, the input layer included
+		// - accuracy: receives the tier of the sigmoid of the hidden layers
+		// Throws:
+		// - InvalidFileFormatException: if the file does not hold a network or its layers do not fit together
+		if (file.get_model() != LomfModel::neural_network || file.get_parameter(0) > static_cast<std::uint32_t>(ActivationAccuracy::fast)) {
+			throw InvalidFileFormatException();
+		}
+		accuracy = static_cast<ActivationAccuracy>(file.get_parameter(0));
+
+		connections.clear();
+		std::size_t width = file.get_symbols().size();
+		for (std::size_t layer = 0; layer < file.count(LomfRole::weights); layer++) {
+			connections.push_back(file.values(LomfRole::weights, layer));
+			if (connections.back().get_shape().rows != width || connections.back().get_shape().cols == 0) {
+				throw InvalidFileFormatException();
+			}
+			width = connections.back().get_shape().cols;
+		}
+
+		biases = file.vector(LomfRole::biases);
+		if (connections.empty() || biases.size() != connections.size() + 1) {
+			throw InvalidFileFormatException();
+		}
+	}
+
+	inline InferenceModel load_inference_model(const std::string & filename) {
+		// Maps a network stored by NeuralNetwork::save and packs its weights straight from the mapping into an
+		// InferenceModel, without constructing the network
+		// Throws:
+		// - CannotOpenFileException: if the file cannot be opened or mapped
+		// - InvalidFileFormatException: if the file is not a valid .lomf file of a network
+		const LomfFile file(filename);
+		std::vector<MatrixView<const double>> connections;
+		std::vector<double> biases;
+		ActivationAccuracy accuracy;
+		read_lomf_network(file, connections, biases, accuracy);
+
+		return InferenceModel(connections, biases, file.get_symbols(), accuracy);
+	}
+}
+
+#endif
@@ -1,11 +1,15 @@
 #include <iostream>
 #include <string>
-#include <random>
 #include <vector>
 #include <chrono>
 #include <memory>
 #include <stdexcept>
 #include <exception>
+#include <sstream>
+
+#ifndef _SEQUENTIAL
+#include <omp.h>
+#endif
 
 #include "lo_exception.hpp"
 #include "polynomial.hpp"
@@ -16,6 +20,7 @@
 
 #include "linear_model.hpp"
 #include "neural_net.hpp"
+#include "fixed_neural_net.hpp"
 
 #define TRAIN_ENCRYPTED
 //#define TRAIN_PLAIN_PREDICT_ENCRYPTED
@@ -39,11 +44,8 @@ const double black = 396.9;
 const double lstat = 4.98;
 
 int random_number() {
-	static random_device rd;
-	static mt19937 mt(rd());
-	static uniform_int_distribution<int> dist(1, 1000);
-
-	return dist(mt);
+	// in [1, 1000], the same sequence on every run
+	return static_cast<int>(thread_generator().below(1000)) + 1;
 }
 
 template <typename T>
@@ -137,18 +139,507 @@ void multiplication_benchmark() {
 	cout << "Average multiplication time for " << benchmark_size << " multiplications: " << average_time << " ms" << endl;
 }
 
-Dataframe<double> read_dataset(const std::string & csv_file, unsigned num_rows = 0) {
-	std::pair < std::vector< std::vector<double>>, std::vector<double>> dataset;
+void csv_read_benchmark(const std::string & csv_file) {
+	// compares the line based CSV reader with the memory mapped, parallel columnar reader
+	const double megabytes = MappedFile(csv_file).size() / (1024.0 * 1024.0);
 	IOhelper reader;
+
 	reader.open_file(csv_file.c_str());
+	chrono::high_resolution_clock::time_point begin = chrono::high_resolution_clock::now();
+	const std::pair<std::vector<std::vector<double>>, std::vector<double>> dataset = reader.read_csv();
+	chrono::high_resolution_clock::time_point end = chrono::high_resolution_clock::now();
+	const double line_reader_seconds = chrono::duration_cast<chrono::microseconds>(end - begin).count() / 1e6;
 
-	dataset = reader.read_csv(num_rows);
+	reader.open_file(csv_file.c_str());
+	begin = chrono::high_resolution_clock::now();
+	const ColumnarDataframe<double> columnar = reader.read_csv_columnar();
+	end = chrono::high_resolution_clock::now();
+	const double columnar_reader_seconds = chrono::duration_cast<chrono::microseconds>(end - begin).count() / 1e6;
 
-	Dataframe<double> dataframe(dataset, reader.get_csv_header());
-	return dataframe;
+	cout << "Read " << dataset.second.size() << " rows (" << megabytes << " MB)" << endl
+		<< "line reader: " << line_reader_seconds << " s, " << megabytes / line_reader_seconds << " MB/s" << endl
+		<< "columnar reader: " << columnar_reader_seconds << " s, " << megabytes / columnar_reader_seconds << " MB/s" << endl;
 }
 
-Dataframe<EncryptedNumber> * read_enc_dataset(const std::string & csv_file, shared_ptr<EncryptionManager> enc_manager, unsigned num_rows = 0) {
+vector<vector<double>> naive_dot(const vector<vector<double>> & lhs, const vector<vector<double>> & rhs) {
+	// the former Matrix::dot: one inner product per result element, walking rhs column-wise across its row vectors
+	vector<vector<double>> result(lhs.size(), vector<double>(rhs[0].size()));
+	for (unsigned row = 0; row < lhs.size(); row++) {
+		for (unsigned rhs_col = 0; rhs_col < rhs[0].size(); rhs_col++) {
+			double result_element = 0.0;
+			for (unsigned i = 0; i < rhs.size(); i++) {
+				result_element += lhs[row][i] * rhs[i][rhs_col];
+			}
+			result[row][rhs_col] = result_element;
+		}
+	}
+	return result;
+}
+
+void gemm_benchmark() {
+	// multiplies a (rows x rows) matrix by a (rows x cols) one, from the size of a small network layer up to 4096 x 4096;
+	// the naive product is skipped where it would take minutes
+	const unsigned sizes[][2] = { { 14, 6 }, { 64, 64 }, { 256, 128 }, { 1024, 1024 }, { 4096, 4096 } };
+	const double naive_flop_limit = 4e9;
+
+	cout << "GEMM kernel: " << (cpu_features().avx512 ? "AVX-512" : cpu_features().avx2 ? "AVX2" : "generic") << endl;
+	for (const unsigned * size : sizes) {
+		const unsigned rows = size[0];
+		const unsigned cols = size[1];
+		const double flops = 2.0 * rows * rows * cols;
+		// small products are repeated to get measurable times
+		const unsigned repetitions = static_cast<unsigned>(std::max(1.0, 1e8 / flops));
+
+		Matrix<double> lhs(rows, rows), rhs(rows, cols);
+		for (unsigned row = 0; row < rows; row++) {
+			for (unsigned col = 0; col < rows; col++) {
+				lhs(row, col) = random_number() / 1000.0;
+			}
+			for (unsigned col = 0; col < cols; col++) {
+				rhs(row, col) = random_number() / 1000.0;
+			}
+		}
+
+		chrono::high_resolution_clock::time_point begin = chrono::high_resolution_clock::now();
+		for (unsigned repetition = 0; repetition < repetitions; repetition++) {
+			lhs.dot(rhs);
+		}
+		chrono::high_resolution_clock::time_point end = chrono::high_resolution_clock::now();
+		const double gemm_seconds = chrono::duration_cast<chrono::nanoseconds>(end - begin).count() / 1e9 / repetitions;
+
+		cout << rows << 'x' << rows << " * " << rows << 'x' << cols << ": gemm " << gemm_seconds * 1e3 << " ms (" << flops / gemm_seconds / 1e9 << " GFLOP/s)";
+		if (flops <= naive_flop_limit) {
+			const vector<vector<double>> lhs_array = lhs.get_vector(), rhs_array = rhs.get_vector();
+			begin = chrono::high_resolution_clock::now();
+			for (unsigned repetition = 0; repetition < repetitions; repetition++) {
+				naive_dot(lhs_array, rhs_array);
+			}
+			end = chrono::high_resolution_clock::now();
+			const double naive_seconds = chrono::duration_cast<chrono::nanoseconds>(end - begin).count() / 1e9 / repetitions;
+
+			cout << ", naive " << naive_seconds * 1e3 << " ms (" << flops / naive_seconds / 1e9 << " GFLOP/s), speedup " << naive_seconds / gemm_seconds << 'x';
+		}
+		cout << endl;
+	}
+}
+
+void activation_benchmark() {
+	// times every activation kernel in each accuracy tier over 64K elements, with the largest relative error of the
+	// approximate tiers against the exact one, and the former function pointer map for comparison
+	const char * const names[] = { "exp", "sigmoid", "sigmoid'", "tanh", "relu" };
+	const Activation activations[] = { Activation::exp, Activation::sigmoid, Activation::sigmoid_prime, Activation::tanh, Activation::relu };
+	const ActivationAccuracy tiers[] = { ActivationAccuracy::exact, ActivationAccuracy::accurate, ActivationAccuracy::fast };
+	const unsigned count = 1 << 16;
+	const unsigned repetitions = 200;
+
+	vector<double> input(count), exact(count), output(count);
+	for (unsigned i = 0; i < count; i++) {
+		input[i] = (random_number() - 500.5) / 25.0; // (-20, 20)
+	}
+
+	cout << "Activation kernels: " << (cpu_features().avx512 ? "AVX-512" : cpu_features().avx2 ? "AVX2" : "generic") << ", ns per element" << endl;
+	for (unsigned a = 0; a < 5; a++) {
+		activation_kernel(activations[a], input.data(), exact.data(), count, ActivationAccuracy::exact);
+		cout << names[a] << ':';
+
+		double exact_nanoseconds = 0.0;
+		for (const ActivationAccuracy tier : tiers) {
+			chrono::high_resolution_clock::time_point begin = chrono::high_resolution_clock::now();
+			for (unsigned repetition = 0; repetition < repetitions; repetition++) {
+				activation_kernel(activations[a], input.data(), output.data(), count, tier);
+			}
+			chrono::high_resolution_clock::time_point end = chrono::high_resolution_clock::now();
+			const double nanoseconds = chrono::duration_cast<chrono::nanoseconds>(end - begin).count() / static_cast<double>(repetitions) / count;
+
+			double max_error = 0.0;
+			for (unsigned i = 0; i < count; i++) {
+				if (exact[i] != 0.0) {
+					max_error = std::max(max_error, std::abs(output[i] - exact[i]) / std::abs(exact[i]));
+				}
+			}
+
+			if (tier == ActivationAccuracy::exact) {
+				exact_nanoseconds = nanoseconds;
+				cout << " exact " << nanoseconds;
+			}
+			else {
+				cout << (tier == ActivationAccuracy::accurate ? ", accurate " : ", fast ") << nanoseconds << " (" << exact_nanoseconds / nanoseconds << "x, max error " << max_error << ')';
+			}
+		}
+		cout << endl;
+	}
+
+	Matrix<double> layer(1, count);
+	std::copy(input.begin(), input.end(), layer.data());
+	chrono::high_resolution_clock::time_point begin = chrono::high_resolution_clock::now();
+	for (unsigned repetition = 0; repetition < repetitions; repetition++) {
+		Matrix<double> activated = layer.map(sigmoid);
+	}
+	chrono::high_resolution_clock::time_point end = chrono::high_resolution_clock::now();
+	cout << "Matrix::map(sigmoid) with a function pointer: " << chrono::duration_cast<chrono::nanoseconds>(end - begin).count() / static_cast<double>(repetitions) / count << endl;
+}
+
+void dense_layer_benchmark() {
+	// a batch of 256 rows through hidden layers up to 4096 neurons wide: the fused kernels of dense_layer.hpp against the
+	// separate passes the network used before, i.e. a GEMM followed by a pass adding the bias and applying the sigmoid,
+	// or by a pass multiplying by sigmoid'
+	const unsigned shapes[][2] = { { 14, 1024 }, { 14, 4096 }, { 64, 1024 }, { 64, 4096 }, { 256, 1024 }, { 1024, 256 } };
+	const unsigned batch = 256;
+	const unsigned repetitions = 20;
+	const double bias = 0.1;
+	const GemmElementwise sigmoid_kernel = resolve_activation_kernel(Activation::sigmoid, ActivationAccuracy::accurate);
+	const GemmElementwise derivative_kernel = resolve_activation_kernel(Activation::sigmoid_prime, ActivationAccuracy::accurate);
+	const ActivationFunction<Activation::sigmoid_prime> derivative;
+
+	cout << "Dense layers of " << batch << " rows, ms per pass" << endl;
+	for (const unsigned * shape : shapes) {
+		const unsigned inputs = shape[0];
+		const unsigned width = shape[1];
+
+		Matrix<double> source(batch, inputs), weights(inputs, width), outputs(batch, width), next_gradients(batch, width), gradients(batch, inputs);
+		for (unsigned row = 0; row < batch; row++) {
+			for (unsigned col = 0; col < inputs; col++) {
+				source(row, col) = random_number() / 1000.0;
+			}
+			for (unsigned col = 0; col < width; col++) {
+				next_gradients(row, col) = random_number() / 1000.0 - 0.5;
+			}
+		}
+		for (unsigned row = 0; row < inputs; row++) {
+			for (unsigned col = 0; col < width; col++) {
+				weights(row, col) = (random_number() / 1000.0 - 0.5) / inputs;
+			}
+		}
+
+		chrono::high_resolution_clock::time_point begin = chrono::high_resolution_clock::now();
+		for (unsigned repetition = 0; repetition < repetitions; repetition++) {
+			gemm(1.0, source.view(), weights.view(), 0.0, outputs.view());
+			for (unsigned row = 0; row < batch; row++) {
+				double * const values = outputs.data() + row * outputs.get_pitch();
+				for (unsigned col = 0; col < width; col++) {
+					values[col] += bias;
+				}
+				sigmoid_kernel(values, values, width);
+			}
+		}
+		chrono::high_resolution_clock::time_point end = chrono::high_resolution_clock::now();
+		const double separate_forward = chrono::duration_cast<chrono::nanoseconds>(end - begin).count() / 1e6 / repetitions;
+
+		begin = chrono::high_resolution_clock::now();
+		for (unsigned repetition = 0; repetition < repetitions; repetition++) {
+			dense_layer_forward(source.view(), weights.view(), bias, sigmoid_kernel, outputs.view());
+		}
+		end = chrono::high_resolution_clock::now();
+		const double fused_forward = chrono::duration_cast<chrono::nanoseconds>(end - begin).count() / 1e6 / repetitions;
+
+		// back propagation into the source layer, taking <source> for its outputs
+		begin = chrono::high_resolution_clock::now();
+		for (unsigned repetition = 0; repetition < repetitions; repetition++) {
+			gemm(1.0, next_gradients.view(), weights.view().transpose(), 0.0, gradients.view());
+			for (unsigned row = 0; row < batch; row++) {
+				for (unsigned col = 0; col < inputs; col++) {
+					gradients(row, col) *= derivative(source(row, col));
+				}
+			}
+		}
+		end = chrono::high_resolution_clock::now();
+		const double separate_backward = chrono::duration_cast<chrono::nanoseconds>(end - begin).count() / 1e6 / repetitions;
+
+		begin = chrono::high_resolution_clock::now();
+		for (unsigned repetition = 0; repetition < repetitions; repetition++) {
+			dense_layer_backward(next_gradients.view(), weights.view(), source.view(), derivative_kernel, gradients.view());
+		}
+		end = chrono::high_resolution_clock::now();
+		const double fused_backward = chrono::duration_cast<chrono::nanoseconds>(end - begin).count() / 1e6 / repetitions;
+
+		cout << inputs << " -> " << width << ": forward " << separate_forward << " separate, " << fused_forward << " fused (" << separate_forward / fused_forward
+			<< "x); backward " << separate_backward << " separate, " << fused_backward << " fused (" << separate_backward / fused_backward << "x)" << endl;
+	}
+}
+
+void parallel_training_benchmark(const Dataframe<double> & df) {
+	// strong scaling of mini-batch NeuralNetwork training: the same network and batches are trained with 1 to 32
+	// threads; the thread count changes how the batch gradients are summed, so the predictions differ in the last bits
+	const unsigned thread_counts[] = { 1, 2, 4, 8, 16, 32 };
+	const unsigned hidden_width = 256;
+	const unsigned epochs = 5;
+	const unsigned batch_size = 256;
+	std::ostringstream training_log;
+
+	const std::vector<std::string> headers = df.get_feature_headers();
+	NeuralNetwork initial(training_log);
+	initial.add_layer(df.shape().columns - 1, &headers);
+	initial.add_layer(hidden_width);
+	initial.add_layer(hidden_width);
+	initial.add_layer(1);
+
+#ifndef _SEQUENTIAL
+	const int max_threads = omp_get_max_threads();
+#endif
+	double single_thread_seconds = 0.0;
+	cout << "Mini-batch training, " << df.shape().rows << " rows, " << hidden_width << 'x' << hidden_width << " hidden layers, batches of " << batch_size << endl;
+	for (const unsigned threads : thread_counts) {
+#ifndef _SEQUENTIAL
+		omp_set_num_threads(threads);
+#else
+		if (threads > 1) {
+			break;
+		}
+#endif
+		NeuralNetwork nn(initial);
+		nn.set_batch_size(batch_size);
+
+		chrono::high_resolution_clock::time_point begin = chrono::high_resolution_clock::now();
+		nn.fit(df, epochs, 0.00001);
+		chrono::high_resolution_clock::time_point end = chrono::high_resolution_clock::now();
+		const double seconds = chrono::duration_cast<chrono::nanoseconds>(end - begin).count() / 1e9;
+
+		if (threads == 1) {
+			single_thread_seconds = seconds;
+		}
+		cout << threads << " threads: " << seconds / epochs * 1e3 << " ms per epoch, speedup " << single_thread_seconds / seconds << "x, efficiency "
+			<< single_thread_seconds / seconds / threads * 100 << "%, prediction " << nn.predict(df.get_row_view(0)) << endl;
+	}
+#ifndef _SEQUENTIAL
+	omp_set_num_threads(max_threads);
+#endif
+}
+
+void inference_benchmark(const Dataframe<double> & df) {
+	// per row latency of NeuralNetwork::predict against a frozen InferenceModel, one row at a time and in batches
+	const unsigned hidden_widths[] = { 6, 64, 256 };
+	const unsigned repetitions = 20;
+	const unsigned rows = df.shape().rows;
+	std::ostringstream training_log;
+
+	std::vector<RowView<double>> row_views;
+	for (unsigned row = 0; row < rows; row++) {
+		row_views.push_back(df.get_row_view(row));
+	}
+	std::vector<double> predictions(rows);
+
+	const std::vector<std::string> headers = df.get_feature_headers();
+	cout << "Inference over " << rows << " rows, us per row" << endl;
+	for (const unsigned width : hidden_widths) {
+		NeuralNetwork nn(training_log);
+		nn.add_layer(df.shape().columns - 1, &headers);
+		nn.add_layer(width);
+		nn.add_layer(width);
+		nn.add_layer(1);
+		const InferenceModel model = nn.freeze();
+
+		double checksum = 0.0;
+		chrono::high_resolution_clock::time_point begin = chrono::high_resolution_clock::now();
+		for (unsigned repetition = 0; repetition < repetitions; repetition++) {
+			for (unsigned row = 0; row < rows; row++) {
+				checksum += nn.predict(row_views[row]);
+			}
+		}
+		chrono::high_resolution_clock::time_point end = chrono::high_resolution_clock::now();
+		const double network_microseconds = chrono::duration_cast<chrono::nanoseconds>(end - begin).count() / 1e3 / repetitions / rows;
+
+		begin = chrono::high_resolution_clock::now();
+		for (unsigned repetition = 0; repetition < repetitions; repetition++) {
+			for (unsigned row = 0; row < rows; row++) {
+				checksum += model.predict(row_views[row]);
+			}
+		}
+		end = chrono::high_resolution_clock::now();
+		const double frozen_microseconds = chrono::duration_cast<chrono::nanoseconds>(end - begin).count() / 1e3 / repetitions / rows;
+
+		begin = chrono::high_resolution_clock::now();
+		for (unsigned repetition = 0; repetition < repetitions; repetition++) {
+			model.predict(Span<const RowView<double>>(row_views.data(), rows), Span<double>(predictions.data(), rows));
+		}
+		end = chrono::high_resolution_clock::now();
+		const double batched_microseconds = chrono::duration_cast<chrono::nanoseconds>(end - begin).count() / 1e3 / repetitions / rows;
+
+		cout << width << " wide hidden layers: NeuralNetwork " << network_microseconds << ", InferenceModel " << frozen_microseconds << " ("
+			<< network_microseconds / frozen_microseconds << "x), batched " << batched_microseconds << " (" << network_microseconds / batched_microseconds
+			<< "x), checksum " << checksum << endl;
+	}
+}
+
+void optimizer_benchmark(const Dataframe<double> & df) {
+	// epochs each optimizer needs to bring the 14-6-1 network of plain_neural_network_test, and the linear regressor,
+	// to the training error plain gradient descent reaches in 1000 epochs at the learning rate used above
+	const unsigned baseline_epochs = 1000;
+	const unsigned max_epochs = 1000;
+	const double baseline_rate = 0.00001;
+	const char * const names[] = { "momentum", "nesterov", "rmsprop", "adam" };
+	const Optimizer optimizers[] = { Optimizer::momentum(), Optimizer::nesterov(), Optimizer::rmsprop(), Optimizer::adam() };
+	const double network_rates[] = { 0.00001, 0.00001, 0.001, 0.001 };
+	const double linear_rates[] = { 0.00001, 0.00001, 0.01, 0.01 };
+	const unsigned rows = df.shape().rows;
+	std::ostringstream training_log;
+
+	const std::vector<std::string> headers = df.get_feature_headers();
+	NeuralNetwork initial(training_log);
+	initial.add_layer(df.shape().columns - 1, &headers);
+	initial.add_layer(6);
+	initial.add_layer(1);
+
+	NeuralNetwork baseline(initial);
+	for (unsigned epoch = 0; epoch < baseline_epochs; epoch++) {
+		baseline.fit(df, 1, baseline_rate);
+	}
+	const double network_target = baseline.compute_mean_square_error(df, rows);
+
+	cout << "Network: gradient descent reaches an error of " << network_target << " in " << baseline_epochs << " epochs" << endl;
+	for (unsigned i = 0; i < 4; i++) {
+		NeuralNetwork nn(initial);
+		nn.set_optimizer(optimizers[i]);
+
+		unsigned epochs = 0;
+		double error = nn.compute_mean_square_error(df, rows);
+		while (error > network_target && epochs < max_epochs) {
+			nn.fit(df, 1, network_rates[i]);
+			error = nn.compute_mean_square_error(df, rows);
+			epochs++;
+		}
+		cout << names[i] << " (learning rate " << network_rates[i] << "): ";
+		if (error <= network_target) {
+			cout << epochs << " epochs (" << static_cast<double>(baseline_epochs) / epochs << "x fewer)" << endl;
+		}
+		else {
+			cout << "error " << error << " after " << max_epochs << " epochs" << endl;
+		}
+	}
+
+	// LinearModel::fit starts from the initial coefficients every time, so the error is sampled by fitting anew
+	LinearModel baseline_regressor;
+	baseline_regressor.fit(df, baseline_epochs, baseline_rate);
+	const double linear_target = baseline_regressor.compute_mean_square_error(df, rows);
+
+	cout << "Linear regressor: gradient descent reaches an error of " << linear_target << " in " << baseline_epochs << " epochs" << endl;
+	for (unsigned i = 0; i < 4; i++) {
+		unsigned low = 1, high = max_epochs + 1;
+		while (low < high) {
+			// the first epoch count reaching the target, assuming the error only falls from there on
+			const unsigned epochs = (low + high) / 2;
+			LinearModel regressor;
+			regressor.set_optimizer(optimizers[i]);
+			regressor.fit(df, epochs, linear_rates[i]);
+			if (regressor.compute_mean_square_error(df, rows) <= linear_target) {
+				high = epochs;
+			}
+			else {
+				low = epochs + 1;
+			}
+		}
+		cout << names[i] << " (learning rate " << linear_rates[i] << "): ";
+		if (low <= max_epochs) {
+			cout << low << " epochs (" << static_cast<double>(baseline_epochs) / low << "x fewer)" << endl;
+		}
+		else {
+			cout << "target not reached in " << max_epochs << " epochs" << endl;
+		}
+	}
+}
+
+void quantization_benchmark(const Dataframe<double> & df, const std::string & test_csv) {
+	// accuracy and per row latency of the int8 QuantizedModel against the double precision InferenceModel, on the
+	// unlabelled rows of <test_csv>; the networks are trained on <df> with Adam and calibrated on it
+	const unsigned hidden_widths[] = { 6, 64, 256 };
+	const unsigned epochs = 20;
+	const unsigned repetitions = 20;
+	std::ostringstream training_log;
+
+	IOhelper reader;
+	reader.open_file(test_csv.c_str());
+	std::pair<std::vector<std::vector<double>>, std::vector<double>> test_set = reader.read_csv(0, ',', false);
+	std::vector<std::string> test_header = reader.get_csv_header();
+	const unsigned rows = static_cast<unsigned>(test_set.first.size());
+	test_set.second.assign(rows, 0.0);
+	test_header.push_back("label");
+	const Dataframe<double> test_df(test_set, test_header);
+
+	std::vector<RowView<double>> row_views;
+	for (unsigned row = 0; row < rows; row++) {
+		row_views.push_back(test_df.get_row_view(row));
+	}
+	std::vector<double> float_predictions(rows), quantized_predictions(rows);
+
+	const std::vector<std::string> headers = df.get_feature_headers();
+	cout << "Quantized inference over the " << rows << " rows of " << test_csv << ", us per row" << endl;
+	for (const unsigned width : hidden_widths) {
+		NeuralNetwork nn(training_log);
+		nn.add_layer(df.shape().columns - 1, &headers);
+		nn.add_layer(width);
+		nn.add_layer(width);
+		nn.add_layer(1);
+		nn.set_optimizer(Optimizer::adam());
+		nn.fit(df, epochs, 0.001);
+
+		const InferenceModel model = nn.freeze();
+		const QuantizedModel quantized = nn.quantize(df);
+
+		model.predict(Span<const RowView<double>>(row_views.data(), rows), Span<double>(float_predictions.data(), rows));
+		quantized.predict(Span<const RowView<double>>(row_views.data(), rows), Span<double>(quantized_predictions.data(), rows));
+		double max_error = 0.0, squared_error = 0.0, squared_prediction = 0.0;
+		for (unsigned row = 0; row < rows; row++) {
+			const double error = quantized_predictions[row] - float_predictions[row];
+			max_error = std::max(max_error, std::abs(error));
+			squared_error += error * error;
+			squared_prediction += float_predictions[row] * float_predictions[row];
+		}
+
+		double checksum = 0.0;
+		chrono::high_resolution_clock::time_point begin = chrono::high_resolution_clock::now();
+		for (unsigned repetition = 0; repetition < repetitions; repetition++) {
+			for (unsigned row = 0; row < rows; row++) {
+				checksum += model.predict(row_views[row]);
+			}
+		}
+		chrono::high_resolution_clock::time_point end = chrono::high_resolution_clock::now();
+		const double float_microseconds = chrono::duration_cast<chrono::nanoseconds>(end - begin).count() / 1e3 / repetitions / rows;
+
+		begin = chrono::high_resolution_clock::now();
+		for (unsigned repetition = 0; repetition < repetitions; repetition++) {
+			for (unsigned row = 0; row < rows; row++) {
+				checksum += quantized.predict(row_views[row]);
+			}
+		}
+		end = chrono::high_resolution_clock::now();
+		const double quantized_microseconds = chrono::duration_cast<chrono::nanoseconds>(end - begin).count() / 1e3 / repetitions / rows;
+
+		begin = chrono::high_resolution_clock::now();
+		for (unsigned repetition = 0; repetition < repetitions; repetition++) {
+			model.predict(Span<const RowView<double>>(row_views.data(), rows), Span<double>(float_predictions.data(), rows));
+		}
+		end = chrono::high_resolution_clock::now();
+		const double float_batched_microseconds = chrono::duration_cast<chrono::nanoseconds>(end - begin).count() / 1e3 / repetitions / rows;
+
+		begin = chrono::high_resolution_clock::now();
+		for (unsigned repetition = 0; repetition < repetitions; repetition++) {
+			quantized.predict(Span<const RowView<double>>(row_views.data(), rows), Span<double>(quantized_predictions.data(), rows));
+		}
+		end = chrono::high_resolution_clock::now();
+		const double quantized_batched_microseconds = chrono::duration_cast<chrono::nanoseconds>(end - begin).count() / 1e3 / repetitions / rows;
+
+		cout << width << " wide hidden layers: relative RMS error " << std::sqrt(squared_error / squared_prediction) << ", max error " << max_error
+			<< "; single rows " << float_microseconds << " -> " << quantized_microseconds << " (" << float_microseconds / quantized_microseconds
+			<< "x), batched " << float_batched_microseconds << " -> " << quantized_batched_microseconds << " ("
+			<< float_batched_microseconds / quantized_batched_microseconds << "x), checksum " << checksum << endl;
+	}
+}
+
+bool is_lodf_file(const std::string & filename) {
+	const std::string extension = ".lodf";
+	return filename.size() >= extension.size() && filename.compare(filename.size() - extension.size(), extension.size(), extension) == 0;
+}
+
+Dataframe<double> read_dataset(const std::string & csv_file, unsigned num_rows = 0) {
+	if (is_lodf_file(csv_file)) {
+		// memory mapped binary dataset, see lodf.hpp
+		chrono::high_resolution_clock::time_point begin = chrono::high_resolution_clock::now();
+		const ColumnarDataframe<double> columnar = load_lodf(csv_file);
+		chrono::high_resolution_clock::time_point end = chrono::high_resolution_clock::now();
+
+		cout << "Dataset mapped in " << chrono::duration_cast<chrono::microseconds>(end - begin).count() << " us" << endl;
+		return columnar.to_dataframe();
+	}
+
 	std::pair < std::vector< std::vector<double>>, std::vector<double>> dataset;
 	IOhelper reader;
 	reader.open_file(csv_file.c_str());
@@ -156,6 +647,11 @@ Dataframe<EncryptedNumber> * read_enc_dataset(const std::string & csv_file, shar
 	dataset = reader.read_csv(num_rows);
 
 	Dataframe<double> dataframe(dataset, reader.get_csv_header());
+	return dataframe;
+}
+
+Dataframe<EncryptedNumber> * read_enc_dataset(const std::string & csv_file, shared_ptr<EncryptionManager> enc_manager, unsigned num_rows = 0) {
+	Dataframe<double> dataframe = read_dataset(csv_file, num_rows);
 	Dataframe<EncryptedNumber> * enc_df = encrypt_dataframe(dataframe, enc_manager);
 	return enc_df;
 }
@@ -163,9 +659,28 @@ Dataframe<EncryptedNumber> * read_enc_dataset(const std::string & csv_file, shar
 double plain_neural_network_test(const Dataframe<double> & df, const unordered_map<string, double> test_features) {
 	NeuralNetwork nn(std::cout, true);
 
-	nn.add_layer(14, &df.get_feature_headers());
-	nn.add_layer(6);
-	nn.add_layer(1);
+	try {
+		// the network trained by a previous run, see lomf.hpp; delete the file to train afresh
+		nn.load("neural_network.lomf");
+	}
+	catch (const CannotOpenFileException &) {
+		const std::vector<std::string> headers = df.get_feature_headers();
+		nn.add_layer(14, &headers);
+		nn.add_layer(6);
+		nn.add_layer(1);
+
+		train_plaintext_model(nn, df, 1000, 0.00001);
+		nn.save("neural_network.lomf");
+	}
+
+	double prediction = nn.predict(test_features);
+
+	return prediction;
+}
+
+double plain_fixed_neural_network_test(const Dataframe<double> & df, const unordered_map<string, double> test_features) {
+	// same topology as plain_neural_network_test, fixed at compile time
+	FixedNeuralNetwork<14, 6, 1> nn(std::cout, df.get_feature_headers(), true);
 
 	train_plaintext_model(nn, df, 1000, 0.00001);
 
@@ -174,10 +689,21 @@ double plain_neural_network_test(const Dataframe<double> & df, const unordered_m
 	return prediction;
 }
 
+void fit_linear_regressor(LinearModel & regressor, const Dataframe<double> & df) {
+	try {
+		// the regressor trained by a previous run, see lomf.hpp; delete the file to train afresh
+		regressor.load("linear_regressor.lomf");
+	}
+	catch (const CannotOpenFileException &) {
+		regressor.fit(df, 1000, 0.00001);
+		regressor.save("linear_regressor.lomf");
+	}
+}
+
 double plain_linear_regressor_test(const Dataframe<double> & df, const unordered_map<string, double> test_features) {
 	LinearModel regressor;
 
-	regressor.fit(df, 1000, 0.00001);
+	fit_linear_regressor(regressor, df);
 
 	double prediction = regressor.predict(test_features);
 
@@ -190,6 +716,7 @@ EncryptedNumber encrypted_linear_regressor_test(const Dataframe<EncryptedNumber>
 	regressor.fit(df, 3, 0.00001, dec_manager);
 
 	EncryptedNumber prediction = regressor.predict(test_features, dec_manager);
+	regressor.get_encrypted_trace().print(cout);
 
 	return prediction;
 }
@@ -197,7 +724,7 @@ EncryptedNumber encrypted_linear_regressor_test(const Dataframe<EncryptedNumber>
 EncryptedNumber encrypted_linear_regressor_pred_test(const Dataframe<double> & df, const unordered_map<string, EncryptedNumber> test_features, shared_ptr<EncryptionManager> enc_manager, const DecryptionManager * dec_manager) {
 	LinearModel regressor;
 
-	regressor.fit(df, 1000, 0.00001);
+	fit_linear_regressor(regressor, df);
 	regressor.encrypt_model(enc_manager);
 
 	EncryptedNumber prediction = regressor.predict(test_features, dec_manager);
@@ -254,6 +781,8 @@ int main() {
 		// 2 - Model runs
 		cout << "neural network prediction result: " << plain_neural_network_test(df, plaintext_features) << endl;
 
+		cout << "fixed-size neural network prediction result: " << plain_fixed_neural_network_test(df, plaintext_features) << endl;
+
 		cout << "linear regressor prediction result: " << plain_linear_regressor_test(df, plaintext_features) << endl;
 
 		cout << "Training a linear model with encrypted features..." << endl;
@@ -0,0 +1,123 @@
+#ifndef _MAPPED_FILE_HPP
+#define _MAPPED_FILE_HPP
+
+#include <cstddef>
+#include <string>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+// <sys/stat.h> is avoided on purpose, it declares names such as lstat in the global namespace
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "lo_exception.hpp"
+
+namespace Learnoran {
+	class MappedFile {
+		// Read-only memory mapping of a whole file. The mapping lives as long as the object; the pages are loaded
+		// lazily by the operating system, so opening even a large file costs a few system calls
+	public:
+		explicit MappedFile(const std::string & filename) : address(nullptr), length(0) {
+			// Throws:
+			// - CannotOpenFileException: if the file cannot be opened or mapped
+#ifdef _WIN32
+			file_handle = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+			mapping_handle = nullptr;
+			if (file_handle == INVALID_HANDLE_VALUE) {
+				throw CannotOpenFileException();
+			}
+
+			LARGE_INTEGER file_size;
+			if (!GetFileSizeEx(file_handle, &file_size)) {
+				release();
+				throw CannotOpenFileException();
+			}
+			length = static_cast<std::size_t>(file_size.QuadPart);
+
+			if (length > 0) {
+				mapping_handle = CreateFileMappingA(file_handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+				address = mapping_handle != nullptr ? MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, 0) : nullptr;
+				if (address == nullptr) {
+					release();
+					throw CannotOpenFileException();
+				}
+			}
+#else
+			const int descriptor = open(filename.c_str(), O_RDONLY);
+			if (descriptor < 0) {
+				throw CannotOpenFileException();
+			}
+
+			const off_t file_size = lseek(descriptor, 0, SEEK_END);
+			if (file_size < 0) {
+				close(descriptor);
+				throw CannotOpenFileException();
+			}
+			length = static_cast<std::size_t>(file_size);
+
+			if (length > 0) {
+				address = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, descriptor, 0);
+				if (address == MAP_FAILED) {
+					address = nullptr;
+					close(descriptor);
+					throw CannotOpenFileException();
+				}
+			}
+			// the mapping stays valid after the descriptor is closed
+			close(descriptor);
+#endif
+		}
+
+		MappedFile(const MappedFile &) = delete;
+		MappedFile & operator=(const MappedFile &) = delete;
+
+		~MappedFile() {
+			release();
+		}
+
+		const char * data() const {
+			return static_cast<const char *>(address);
+		}
+
+		std::size_t size() const {
+			return length;
+		}
+	private:
+		void release() {
+#ifdef _WIN32
+			if (address != nullptr) {
+				UnmapViewOfFile(address);
+			}
+			if (mapping_handle != nullptr) {
+				CloseHandle(mapping_handle);
+			}
+			if (file_handle != INVALID_HANDLE_VALUE) {
+				CloseHandle(file_handle);
+			}
+			mapping_handle = nullptr;
+			file_handle = INVALID_HANDLE_VALUE;
+#else
+			if (address != nullptr) {
+				munmap(address, length);
+			}
+#endif
+			address = nullptr;
+			length = 0;
+		}
+
+		void * address;
+		std::size_t length;
+#ifdef _WIN32
+		HANDLE file_handle;
+		HANDLE mapping_handle;
+#endif
+	};
+}
+
+#endif
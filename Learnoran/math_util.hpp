@@ -1,33 +1,28 @@
 #ifndef _MATH_UTIL_HPP
 #define _MATH_UTIL_HPP
 
-#include <random>
+#include <cmath>
 
-namespace Learnoran {
-	double snd_random() {
-		std::random_device rd{ };
-		std::mt19937 gen{ rd() };
-
-		std::normal_distribution<double> snd(0, 1);
+#include "random.hpp"
 
-		return snd(gen);
+namespace Learnoran {
+	inline double snd_random() {
+		// a standard normal value from the generator of the calling thread, see thread_generator
+		return thread_generator().normal();
 	}
 
-	double snd_random(double x) {
-		std::random_device rd{ };
-		std::mt19937 gen{ rd() };
-
-		std::normal_distribution<double> snd(0, 1);
-
-		return snd(gen);
+	inline double snd_random(double x) {
+		return thread_generator().normal();
 	}
 
-	double sigmoid(double x) {
-		return 1 / (1 + exp(-x));
+	inline double sigmoid(double x) {
+		return 1 / (1 + std::exp(-x));
 	}
 
-	double sigmoid_prime(double x) {
-		return exp(-x) / (std::pow(1 + exp(-x), 2));
+	inline double sigmoid_prime(double x) {
+		// e / (1 + e)^2 with a single e = exp(-|x|); sigmoid' is even, and |x| keeps e from overflowing
+		const double e = std::exp(-std::fabs(x));
+		return e / ((1 + e) * (1 + e));
 	}
 }
 
@@ -6,6 +6,11 @@
 #include <assert.h>
 #include <sstream>
 #include <utility>
+#include <cstddef>
+#include <type_traits>
+
+#include "aligned_buffer.hpp"
+#include "gemm.hpp"
 
 struct Shape {
 	Shape(unsigned rows, unsigned cols) : rows(rows), cols(cols) { }
@@ -14,88 +19,526 @@ struct Shape {
 	unsigned cols;
 };
 
+// MARK: Expressions
+
+/*
+Lazy element-wise Matrix expressions.
+Element-wise operators, scalar operators and map do not compute anything; they return small expression objects that
+describe the computation. Assigning an expression to a Matrix (or constructing one from it) evaluates the whole chain in
+a single loop over the destination, so that e.g.
+
+	layer = previous.dot(weights).map(&apply_bias, bias).map(sigmoid);
+
+allocates nothing beyond the product and touches every element once. map takes function pointers as well as any other
+callable, e.g. a lambda or an ActivationFunction (see activation.hpp), which the compiler can inline into the loop;
+function pointers stay the only option for overloaded functions. Every element of an expression only depends on
+the elements at the same position of its operands, so assigning an expression to one of its own operands is safe.
+
+Operands that are named matrices are referenced, temporaries are moved into the expression; an expression stored in a
+variable therefore never refers to a destroyed temporary, but it does refer to the named matrices it was built from.
+*/
+
 template <typename T>
-class Matrix {
+class Matrix;
+
+template <typename Derived>
+class MatrixExpression;
+
+template <typename E>
+struct is_matrix_expression : std::is_base_of<MatrixExpression<typename std::decay<E>::type>, typename std::decay<E>::type> { };
+
+template <typename E>
+struct is_matrix : std::false_type { };
+
+template <typename T>
+struct is_matrix<Matrix<T>> : std::true_type { };
+
+template <typename E>
+struct expression_operand {
+	// how an expression stores an operand passed as E&&: named matrices by reference, everything else by value
+	typedef typename std::decay<E>::type decayed;
+	typedef typename std::conditional<is_matrix<decayed>::value && std::is_lvalue_reference<E>::value, const decayed &, decayed>::type type;
+};
+
+template <typename Operand, typename Function>
+class MatrixMapExpression;
+
+template <typename Operand, typename Function, typename Parameter>
+class MatrixBoundMapExpression;
+
+template <typename Derived>
+class MatrixExpression {
+	// CRTP base of Matrix and of every expression node. Derived provides value_type, get_shape() and
+	// operator()(row, col) returning the element by value
+public:
+	const Derived & derived() const {
+		return static_cast<const Derived &>(*this);
+	}
+
+	template <typename T>
+	MatrixMapExpression<Derived, T(*)(T)> map(T(*function)(T)) const & {
+		return MatrixMapExpression<Derived, T(*)(T)>(derived(), function);
+	}
+
+	template <typename T>
+	MatrixMapExpression<Derived, T(*)(T)> map(T(*function)(T)) && {
+		return MatrixMapExpression<Derived, T(*)(T)>(std::move(static_cast<Derived &>(*this)), function);
+	}
+
+	template <typename Function>
+	MatrixMapExpression<Derived, Function> map(Function function) const & {
+		return MatrixMapExpression<Derived, Function>(derived(), function);
+	}
+
+	template <typename Function>
+	MatrixMapExpression<Derived, Function> map(Function function) && {
+		return MatrixMapExpression<Derived, Function>(std::move(static_cast<Derived &>(*this)), function);
+	}
+
+	template <typename T>
+	MatrixBoundMapExpression<Derived, T(*)(T, T), T> map(T(*function)(T, T), T param) const & {
+		return MatrixBoundMapExpression<Derived, T(*)(T, T), T>(derived(), function, param);
+	}
+
+	template <typename T>
+	MatrixBoundMapExpression<Derived, T(*)(T, T), T> map(T(*function)(T, T), T param) && {
+		return MatrixBoundMapExpression<Derived, T(*)(T, T), T>(std::move(static_cast<Derived &>(*this)), function, param);
+	}
+};
+
+template <typename Operand, typename Function>
+class MatrixMapExpression : public MatrixExpression<MatrixMapExpression<Operand, Function>> {
+	// function(element)
+	typedef typename std::decay<Operand>::type operand_type;
+public:
+	typedef typename operand_type::value_type value_type;
+
+	template <typename Argument>
+	MatrixMapExpression(Argument && operand, Function function) : operand(std::forward<Argument>(operand)), function(function) { }
+
+	Shape get_shape() const {
+		return operand.get_shape();
+	}
+
+	value_type operator()(const unsigned row, const unsigned col) const {
+		return function(operand(row, col));
+	}
+private:
+	Operand operand;
+	Function function;
+};
+
+template <typename Operand, typename Function, typename Parameter>
+class MatrixBoundMapExpression : public MatrixExpression<MatrixBoundMapExpression<Operand, Function, Parameter>> {
+	// function(element, parameter)
+	typedef typename std::decay<Operand>::type operand_type;
+public:
+	typedef typename operand_type::value_type value_type;
+
+	template <typename Argument>
+	MatrixBoundMapExpression(Argument && operand, Function function, const Parameter param) : operand(std::forward<Argument>(operand)), function(function), param(param) { }
+
+	Shape get_shape() const {
+		return operand.get_shape();
+	}
+
+	value_type operator()(const unsigned row, const unsigned col) const {
+		return function(operand(row, col), param);
+	}
+private:
+	Operand operand;
+	Function function;
+	Parameter param;
+};
+
+template <typename Lhs, typename Rhs, typename Operation>
+class MatrixBinaryExpression : public MatrixExpression<MatrixBinaryExpression<Lhs, Rhs, Operation>> {
+	// Operation::apply(lhs element, rhs element)
+	typedef typename std::decay<Lhs>::type lhs_type;
 public:
+	typedef typename lhs_type::value_type value_type;
+
+	template <typename LhsArgument, typename RhsArgument>
+	MatrixBinaryExpression(LhsArgument && lhs, RhsArgument && rhs) : lhs(std::forward<LhsArgument>(lhs)), rhs(std::forward<RhsArgument>(rhs)) {
+		assert(this->lhs.get_shape().rows == this->rhs.get_shape().rows && this->lhs.get_shape().cols == this->rhs.get_shape().cols);
+	}
+
+	Shape get_shape() const {
+		return lhs.get_shape();
+	}
+
+	value_type operator()(const unsigned row, const unsigned col) const {
+		return Operation::apply(lhs(row, col), rhs(row, col));
+	}
+private:
+	Lhs lhs;
+	Rhs rhs;
+};
+
+template <typename Operand, typename Operation>
+class MatrixScalarExpression : public MatrixExpression<MatrixScalarExpression<Operand, Operation>> {
+	// Operation::apply(element, scalar)
+	typedef typename std::decay<Operand>::type operand_type;
+public:
+	typedef typename operand_type::value_type value_type;
+
+	template <typename Argument>
+	MatrixScalarExpression(Argument && operand, const double scalar) : operand(std::forward<Argument>(operand)), scalar(scalar) { }
+
+	Shape get_shape() const {
+		return operand.get_shape();
+	}
+
+	value_type operator()(const unsigned row, const unsigned col) const {
+		return Operation::apply(operand(row, col), scalar);
+	}
+private:
+	Operand operand;
+	double scalar;
+};
+
+struct MatrixAddition {
+	template <typename T, typename U>
+	static T apply(const T & lhs, const U & rhs) {
+		return lhs + rhs;
+	}
+};
+
+struct MatrixSubtraction {
+	template <typename T, typename U>
+	static T apply(const T & lhs, const U & rhs) {
+		return lhs - rhs;
+	}
+};
+
+struct MatrixMultiplication {
+	template <typename T, typename U>
+	static T apply(const T & lhs, const U & rhs) {
+		return lhs * rhs;
+	}
+};
+
+struct MatrixDivision {
+	template <typename T, typename U>
+	static T apply(const T & lhs, const U & rhs) {
+		return lhs / rhs;
+	}
+};
+
+// MARK: Expression operators
+
+template <typename Lhs, typename Rhs, typename Operation>
+using binary_expression = MatrixBinaryExpression<typename expression_operand<Lhs>::type, typename expression_operand<Rhs>::type, Operation>;
+
+template <typename Operand, typename Operation>
+using scalar_expression = MatrixScalarExpression<typename expression_operand<Operand>::type, Operation>;
+
+template <typename Lhs, typename Rhs>
+using enable_if_matrix_expressions = typename std::enable_if<is_matrix_expression<Lhs>::value && is_matrix_expression<Rhs>::value, int>::type;
+
+template <typename Operand>
+using enable_if_matrix_expression = typename std::enable_if<is_matrix_expression<Operand>::value, int>::type;
+
+// Addition
+template <typename Lhs, typename Rhs, enable_if_matrix_expressions<Lhs, Rhs> = 0>
+binary_expression<Lhs, Rhs, MatrixAddition> operator+(Lhs && lhs, Rhs && rhs) {
+	return binary_expression<Lhs, Rhs, MatrixAddition>(std::forward<Lhs>(lhs), std::forward<Rhs>(rhs));
+}
+
+// Subtraction
+template <typename Lhs, typename Rhs, enable_if_matrix_expressions<Lhs, Rhs> = 0>
+binary_expression<Lhs, Rhs, MatrixSubtraction> operator-(Lhs && lhs, Rhs && rhs) {
+	return binary_expression<Lhs, Rhs, MatrixSubtraction>(std::forward<Lhs>(lhs), std::forward<Rhs>(rhs));
+}
+
+// Hadamard product
+template <typename Lhs, typename Rhs, enable_if_matrix_expressions<Lhs, Rhs> = 0>
+binary_expression<Lhs, Rhs, MatrixMultiplication> operator*(Lhs && lhs, Rhs && rhs) {
+	return binary_expression<Lhs, Rhs, MatrixMultiplication>(std::forward<Lhs>(lhs), std::forward<Rhs>(rhs));
+}
+
+// Scalar multiplication
+template <typename Operand, enable_if_matrix_expression<Operand> = 0>
+scalar_expression<Operand, MatrixMultiplication> operator*(Operand && operand, const double scalar) {
+	return scalar_expression<Operand, MatrixMultiplication>(std::forward<Operand>(operand), scalar);
+}
+
+template <typename Operand, enable_if_matrix_expression<Operand> = 0>
+scalar_expression<Operand, MatrixMultiplication> operator*(const double scalar, Operand && operand) {
+	return scalar_expression<Operand, MatrixMultiplication>(std::forward<Operand>(operand), scalar);
+}
+
+// Scalar division
+template <typename Operand, enable_if_matrix_expression<Operand> = 0>
+scalar_expression<Operand, MatrixDivision> operator/(Operand && operand, const double scalar) {
+	return scalar_expression<Operand, MatrixDivision>(std::forward<Operand>(operand), scalar);
+}
+
+// Scalar addition and subtraction
+template <typename Operand, enable_if_matrix_expression<Operand> = 0>
+scalar_expression<Operand, MatrixAddition> operator+(Operand && operand, const double scalar) {
+	return scalar_expression<Operand, MatrixAddition>(std::forward<Operand>(operand), scalar);
+}
+
+template <typename Operand, enable_if_matrix_expression<Operand> = 0>
+scalar_expression<Operand, MatrixSubtraction> operator-(Operand && operand, const double scalar) {
+	return scalar_expression<Operand, MatrixSubtraction>(std::forward<Operand>(operand), scalar);
+}
+
+// MARK: Views
+
+template <typename T>
+class VectorView {
+	// Non-owning view of a matrix row or column, <stride> elements apart. Views remain valid as long as the matrix
+	// they were taken from is neither destroyed, moved into, nor copy assigned a matrix of a different shape
+public:
+	VectorView(T * elements, const unsigned count, const std::size_t stride) : elements(elements), count(count), stride(stride) { }
+
+	template <typename U, typename = typename std::enable_if<std::is_convertible<U *, T *>::value>::type>
+	VectorView(const VectorView<U> & rhs) : elements(rhs.data()), count(rhs.size()), stride(rhs.get_stride()) { }
+
+	T & operator[](const unsigned index) const {
+		return elements[index * stride];
+	}
+
+	unsigned size() const {
+		return count;
+	}
+
+	std::size_t get_stride() const {
+		return stride;
+	}
+
+	bool is_contiguous() const {
+		return stride == 1 || count <= 1;
+	}
+
+	T * data() const {
+		return elements;
+	}
+
+	operator std::vector<typename std::remove_const<T>::type>() const {
+		// copies the viewed elements, which keeps code that stores a row as a std::vector compiling
+		std::vector<typename std::remove_const<T>::type> copy(count);
+		for (unsigned i = 0; i < count; i++) {
+			copy[i] = elements[i * stride];
+		}
+		return copy;
+	}
+private:
+	T * elements;
+	unsigned count;
+	std::size_t stride;
+};
+
+template <typename T>
+class MatrixView {
+	// Non-owning, strided view of a (sub)matrix; element (row, col) lives at data[row * row_stride + col * col_stride].
+	// Transposing a view swaps its strides, nothing is copied
+public:
+	MatrixView(T * elements, const unsigned rows, const unsigned cols, const std::size_t row_stride, const std::size_t col_stride = 1)
+		: elements(elements), rows(rows), cols(cols), row_stride(row_stride), col_stride(col_stride) { }
+
+	template <typename U, typename = typename std::enable_if<std::is_convertible<U *, T *>::value>::type>
+	MatrixView(const MatrixView<U> & rhs)
+		: elements(rhs.data()), rows(rhs.get_shape().rows), cols(rhs.get_shape().cols), row_stride(rhs.get_row_stride()), col_stride(rhs.get_col_stride()) { }
+
+	Shape get_shape() const {
+		return Shape(rows, cols);
+	}
+
+	T & operator()(const unsigned row, const unsigned col) const {
+		return elements[row * row_stride + col * col_stride];
+	}
+
+	VectorView<T> operator[](const unsigned row) const {
+		return this->row(row);
+	}
+
+	VectorView<T> row(const unsigned row) const {
+		assert(row < rows);
+		return VectorView<T>(elements + row * row_stride, cols, col_stride);
+	}
+
+	VectorView<T> col(const unsigned col) const {
+		assert(col < cols);
+		return VectorView<T>(elements + col * col_stride, rows, row_stride);
+	}
+
+	MatrixView submatrix(const unsigned first_row, const unsigned first_col, const unsigned row_count, const unsigned col_count) const {
+		assert(first_row + row_count <= rows && first_col + col_count <= cols);
+		return MatrixView(elements + first_row * row_stride + first_col * col_stride, row_count, col_count, row_stride, col_stride);
+	}
+
+	MatrixView transpose() const {
+		return MatrixView(elements, cols, rows, col_stride, row_stride);
+	}
+
+	T * data() const {
+		return elements;
+	}
+
+	std::size_t get_row_stride() const {
+		return row_stride;
+	}
+
+	std::size_t get_col_stride() const {
+		return col_stride;
+	}
+private:
+	T * elements;
+	unsigned rows;
+	unsigned cols;
+	std::size_t row_stride;
+	std::size_t col_stride;
+};
+
+// MARK: Matrix
+
+template <typename T>
+class Matrix : public MatrixExpression<Matrix<T>> {
+	// Row-major matrix in a single cache line aligned buffer. Every row starts on its own aligned boundary: rows are
+	// get_pitch() elements apart, the elements past <cols> are padding
+public:
+	typedef T value_type;
+
 	// CONSTRUCTORS
 	Matrix();
 	Matrix(const unsigned rows, const unsigned cols);
 	Matrix(const std::vector<std::vector<T>> & matrix_array);
-	Matrix(const Matrix && rhs); // move
+	explicit Matrix(const MatrixView<const T> & view); // copies the viewed elements
+	Matrix(Matrix && rhs); // move
 	Matrix(const Matrix & rhs); // copy
+	template <typename E>
+	Matrix(const MatrixExpression<E> & expression); // evaluates the expression
 
 	Shape get_shape() const;
 
+	std::size_t get_pitch() const; // elements between the starts of consecutive rows
+
+	T * data();
+	const T * data() const;
+
 	std::vector<std::vector<T>> get_vector() const;
 
 	std::vector<T> get_1d_vector() const;
 
-	std::vector<T> get_col(const unsigned col) const;
+	std::vector<T> get_col(const unsigned col) const; // copies, see col() for a view
+
+	// VIEWS
+	MatrixView<T> view();
+	MatrixView<const T> view() const;
+	VectorView<T> row(const unsigned row);
+	VectorView<const T> row(const unsigned row) const;
+	VectorView<T> col(const unsigned col);
+	VectorView<const T> col(const unsigned col) const;
+	MatrixView<T> submatrix(const unsigned first_row, const unsigned first_col, const unsigned row_count, const unsigned col_count);
+	MatrixView<const T> submatrix(const unsigned first_row, const unsigned first_col, const unsigned row_count, const unsigned col_count) const;
 
 	void print(std::ostream & flux) const; // pretty print the matrix
 
-	Matrix map(T(*function)(T)) const; // apply a function to every element
+	// apply a function to every element, lazily; see MARK: Expressions
+	MatrixMapExpression<const Matrix &, T(*)(T)> map(T(*function)(T)) const &;
+	MatrixMapExpression<Matrix, T(*)(T)> map(T(*function)(T)) &&;
+	template <typename Function>
+	MatrixMapExpression<const Matrix &, Function> map(Function function) const &; // any callable taking and returning T
+	template <typename Function>
+	MatrixMapExpression<Matrix, Function> map(Function function) &&;
 
-	Matrix map(T(*function)(T, T), T param) const;
+	MatrixBoundMapExpression<const Matrix &, T(*)(T, T), T> map(T(*function)(T, T), T param) const &;
+	MatrixBoundMapExpression<Matrix, T(*)(T, T), T> map(T(*function)(T, T), T param) &&;
 
 	Matrix transpose() const;
 
-	Matrix dot(Matrix const & rhs); // dot multiplication
+	Matrix dot(Matrix const & rhs) const; // dot multiplication
+
+	void dot_into(Matrix const & rhs, Matrix & destination) const; // destination = this * rhs, reusing its storage
+
+	// IN-PLACE OPERATIONS: element-wise, so the argument may refer to this matrix
+	template <typename E>
+	Matrix & operator+=(const MatrixExpression<E> & rhs);
+	template <typename E>
+	Matrix & operator-=(const MatrixExpression<E> & rhs);
+	template <typename E>
+	Matrix & operator*=(const MatrixExpression<E> & rhs); // hadamard product
+	Matrix & operator*=(const double scalar);
+	template <typename E>
+	Matrix & axpy(const T alpha, const MatrixExpression<E> & x); // this += alpha * x
+
+	Matrix & map_inplace(T(*function)(T));
+	Matrix & map_inplace(T(*function)(T, T), T param);
+	template <typename Function>
+	Matrix & map_inplace(Function function);
 
 	// GETTER AND SETTER OPERATORS
 	Matrix & operator=(Matrix const & rhs);
-	std::vector<T> & operator[](const unsigned row);
-	std::vector<T> operator[](const unsigned row) const;
+	Matrix & operator=(Matrix && rhs);
+	template <typename E>
+	Matrix & operator=(const MatrixExpression<E> & expression); // evaluates the expression in a single pass
+	VectorView<T> operator[](const unsigned row);
+	VectorView<const T> operator[](const unsigned row) const;
+	T & operator()(const unsigned row, const unsigned col);
+	const T & operator()(const unsigned row, const unsigned col) const;
 
 	// LOGIC OPERATORS
-	bool operator==(Matrix const & rhs);
+	bool operator==(Matrix const & rhs) const;
 
-	// ARITHMETIC OPERATORS
-	Matrix operator*(const double scalar); // scalar multiplication
-	Matrix operator*(Matrix const & rhs); // hadamard product
-	Matrix operator+(Matrix const & rhs); // addition
-	Matrix operator-(Matrix const & rhs); // subtraction
+	// ARITHMETIC OPERATORS: see MARK: Expression operators
 
 private:
-	std::vector<std::vector<T>> matrix_array;
-	unsigned cols;
+	template <typename E>
+	void assign(const E & expression);
+
+	template <typename Operation, typename E>
+	void update(const E & expression);
+
+	Learnoran::AlignedBuffer<T> elements;
 	unsigned rows;
+	unsigned cols;
+	std::size_t pitch;
 };
 
 template <typename T>
-std::vector<T> Matrix<T>::get_col(const unsigned col) const {
-	std::vector<T> column(rows);
-	
-	for (unsigned i = 0; i < rows; i++) {
-		column[i] = matrix_array[i][col];
-	}
-
-	return column;
-}
+Matrix<T>::Matrix() : rows(0), cols(0), pitch(0) { }
 
 template <typename T>
-std::vector<T> Matrix<T>::operator[](const unsigned row) const{
-	return matrix_array[row];
+Matrix<T>::Matrix(const unsigned rows, const unsigned cols)
+	: rows(rows), cols(cols), pitch(Learnoran::aligned_element_count(cols, sizeof(T))) {
+	elements = Learnoran::AlignedBuffer<T>(rows * pitch);
 }
 
 template <typename T>
-std::vector<T> Matrix<T>::get_1d_vector() const {
-	assert(cols == 1 || rows == 1);
-
-	unsigned output_size = (cols == 1 ? rows : cols);
+Matrix<T>::Matrix(const std::vector<std::vector<T>> & matrix_array) : Matrix(static_cast<unsigned>(matrix_array.size()), matrix_array.empty() ? 0 : static_cast<unsigned>(matrix_array[0].size())) {
+	assert(matrix_array.size() != 0);
 
-	std::vector<T> col_vector(output_size);
+	for (unsigned row = 0; row < rows; row++) {
+		assert(matrix_array[row].size() == cols);
+		std::copy(matrix_array[row].begin(), matrix_array[row].end(), elements.data() + row * pitch);
+	}
+}
 
-	if (cols == 1) {
-		for (unsigned i = 0; i < rows; i++) {
-			col_vector[i] = matrix_array[i][0];
+template <typename T>
+Matrix<T>::Matrix(const MatrixView<const T> & view) : Matrix(view.get_shape().rows, view.get_shape().cols) {
+	for (unsigned row = 0; row < rows; row++) {
+		for (unsigned col = 0; col < cols; col++) {
+			elements[row * pitch + col] = view(row, col);
 		}
 	}
-	else {
-		col_vector = matrix_array[0];
-	}
+}
+
+template <typename T>
+Matrix<T>::Matrix(Matrix && rhs) : elements(std::move(rhs.elements)), rows(rhs.rows), cols(rhs.cols), pitch(rhs.pitch) {
+	rhs.rows = rhs.cols = 0;
+	rhs.pitch = 0;
+}
+
+template <typename T>
+Matrix<T>::Matrix(const Matrix & rhs) : elements(rhs.elements), rows(rhs.rows), cols(rhs.cols), pitch(rhs.pitch) { }
 
-	return col_vector;
+template <typename T>
+template <typename E>
+Matrix<T>::Matrix(const MatrixExpression<E> & expression) : Matrix(expression.derived().get_shape().rows, expression.derived().get_shape().cols) {
+	assign(expression.derived());
 }
 
 template <typename T>
@@ -104,210 +547,390 @@ Shape Matrix<T>::get_shape() const {
 }
 
 template <typename T>
-std::vector<std::vector<T>> Matrix<T>::get_vector() const {
-	return matrix_array;
+std::size_t Matrix<T>::get_pitch() const {
+	return pitch;
 }
 
 template <typename T>
-std::ostream & operator<<(std::ostream & flux, Matrix<T> const & matrix);
+T * Matrix<T>::data() {
+	return elements.data();
+}
 
 template <typename T>
-Matrix<T>::Matrix() { }
+const T * Matrix<T>::data() const {
+	return elements.data();
+}
 
 template <typename T>
-Matrix<T>::Matrix(const unsigned rows, const unsigned cols) : rows(rows), cols(cols) {
-	matrix_array.resize(rows);
+std::vector<std::vector<T>> Matrix<T>::get_vector() const {
+	std::vector<std::vector<T>> matrix_array(rows);
+
 	for (unsigned row = 0; row < rows; row++) {
-		matrix_array[row].resize(cols);
+		matrix_array[row].assign(elements.data() + row * pitch, elements.data() + row * pitch + cols);
 	}
+
+	return matrix_array;
 }
 
 template <typename T>
-Matrix<T>::Matrix(const std::vector<std::vector<T>> & matrix_array) : rows(matrix_array.size()), cols(matrix_array[0].size()) {
-	assert(matrix_array.size() != 0);
-	this->matrix_array = matrix_array;
+std::vector<T> Matrix<T>::get_1d_vector() const {
+	assert(cols == 1 || rows == 1);
+
+	return cols == 1 ? std::vector<T>(col(0)) : std::vector<T>(row(0));
 }
 
 template <typename T>
-Matrix<T>::Matrix(const Matrix && rhs) : rows(rhs.rows), cols(rhs.cols) {
-	this->matrix_array = rhs.matrix_array;
+std::vector<T> Matrix<T>::get_col(const unsigned col) const {
+	return this->col(col);
 }
 
+// Views
 template <typename T>
-Matrix<T>::Matrix(const Matrix & rhs) : rows(rhs.rows), cols(rhs.cols) {
-	this->matrix_array = rhs.matrix_array;
+MatrixView<T> Matrix<T>::view() {
+	return MatrixView<T>(elements.data(), rows, cols, pitch);
 }
 
-// Scalar multiplication
 template <typename T>
-Matrix<T> Matrix<T>::operator*(const double scalar) {
-	Matrix result(rows, cols);
+MatrixView<const T> Matrix<T>::view() const {
+	return MatrixView<const T>(elements.data(), rows, cols, pitch);
+}
 
-	for (unsigned row = 0; row < rows; row++) {
-		for (unsigned col = 0; col < cols; col++) {
-			result.matrix_array[row][col] = matrix_array[row][col] * scalar;
-		}
-	}
+template <typename T>
+VectorView<T> Matrix<T>::row(const unsigned row) {
+	assert(row < rows);
+	return VectorView<T>(elements.data() + row * pitch, cols, 1);
+}
 
-	return result;
+template <typename T>
+VectorView<const T> Matrix<T>::row(const unsigned row) const {
+	assert(row < rows);
+	return VectorView<const T>(elements.data() + row * pitch, cols, 1);
+}
+
+template <typename T>
+VectorView<T> Matrix<T>::col(const unsigned col) {
+	assert(col < cols);
+	return VectorView<T>(elements.data() + col, rows, pitch);
 }
 
-// Addition
 template <typename T>
-Matrix<T> Matrix<T>::operator+(Matrix<T> const & rhs) {
-	assert(rows == rhs.rows && cols == rhs.cols);
+VectorView<const T> Matrix<T>::col(const unsigned col) const {
+	assert(col < cols);
+	return VectorView<const T>(elements.data() + col, rows, pitch);
+}
 
-	Matrix result(rows, cols);
+template <typename T>
+MatrixView<T> Matrix<T>::submatrix(const unsigned first_row, const unsigned first_col, const unsigned row_count, const unsigned col_count) {
+	return view().submatrix(first_row, first_col, row_count, col_count);
+}
+
+template <typename T>
+MatrixView<const T> Matrix<T>::submatrix(const unsigned first_row, const unsigned first_col, const unsigned row_count, const unsigned col_count) const {
+	return view().submatrix(first_row, first_col, row_count, col_count);
+}
 
+template <typename T>
+std::ostream & operator<<(std::ostream & flux, Matrix<T> const & matrix);
+
+// Dot product
+template <typename T>
+void matrix_product(const Matrix<T> & lhs, const Matrix<T> & rhs, Matrix<T> & result) {
+	// result = lhs * rhs, with <result> zero-initialized
+	const unsigned rows = lhs.get_shape().rows;
+	const unsigned cols = lhs.get_shape().cols;
+	const unsigned rhs_cols = rhs.get_shape().cols;
+
+	// row by row accumulation: every pass streams one contiguous row of rhs into one contiguous row of the result,
+	// summing the products of every result element in the same order as the textbook inner product
 	for (unsigned row = 0; row < rows; row++) {
-		for (unsigned col = 0; col < cols; col++) {
-			result.matrix_array[row][col] = matrix_array[row][col] + rhs.matrix_array[row][col];
+		const T * const lhs_row = lhs.data() + row * lhs.get_pitch();
+		T * const destination = result.data() + row * result.get_pitch();
+
+		for (unsigned i = 0; i < cols; i++) {
+			const T lhs_element = lhs_row[i];
+			const T * const rhs_row = rhs.data() + i * rhs.get_pitch();
+			for (unsigned rhs_col = 0; rhs_col < rhs_cols; rhs_col++) {
+				destination[rhs_col] += lhs_element * rhs_row[rhs_col];
+			}
 		}
 	}
+}
+
+inline void matrix_product(const Matrix<double> & lhs, const Matrix<double> & rhs, Matrix<double> & result) {
+	// packed, vectorized and, for large matrices, parallel; see gemm.hpp
+	Learnoran::gemm(lhs.get_shape().rows, rhs.get_shape().cols, lhs.get_shape().cols, 1.0,
+		lhs.data(), lhs.get_pitch(), 1, rhs.data(), rhs.get_pitch(), 1, 0.0, result.data(), result.get_pitch());
+}
+
+template <typename T>
+Matrix<T> Matrix<T>::dot(Matrix<T> const & rhs) const {
+	assert(cols == rhs.rows);
+
+	Matrix result(rows, rhs.cols);
+	matrix_product(*this, rhs, result);
 
 	return result;
 }
 
-// Subtraction
 template <typename T>
-Matrix<T> Matrix<T>::operator-(Matrix<T> const & rhs) {
-	assert(rows == rhs.rows && cols == rhs.cols);
+void Matrix<T>::dot_into(Matrix<T> const & rhs, Matrix<T> & destination) const {
+	assert(cols == rhs.rows);
+	assert(&destination != this && &destination != &rhs);
+
+	if (destination.rows != rows || destination.cols != rhs.cols) {
+		destination = Matrix(rows, rhs.cols);
+	}
+	else {
+		std::fill(destination.elements.data(), destination.elements.data() + destination.elements.size(), T());
+	}
+	matrix_product(*this, rhs, destination);
+}
 
-	Matrix result(rows, cols);
+// Transpose
+template <typename T>
+Matrix<T> Matrix<T>::transpose() const {
+	return Matrix(view().transpose());
+}
 
+template <typename T>
+void Matrix<T>::print(std::ostream & flux) const {
 	for (unsigned row = 0; row < rows; row++) {
 		for (unsigned col = 0; col < cols; col++) {
-			result.matrix_array[row][col] = matrix_array[row][col] - rhs.matrix_array[row][col];
+			flux << elements[row * pitch + col] << ' ';
 		}
+		flux << '\n';
 	}
+}
 
-	return result;
+template <typename T>
+MatrixMapExpression<const Matrix<T> &, T(*)(T)> Matrix<T>::map(T(*function)(T)) const & {
+	return MatrixMapExpression<const Matrix &, T(*)(T)>(*this, function);
+}
+
+template <typename T>
+MatrixMapExpression<Matrix<T>, T(*)(T)> Matrix<T>::map(T(*function)(T)) && {
+	return MatrixMapExpression<Matrix, T(*)(T)>(std::move(*this), function);
+}
+
+template <typename T>
+template <typename Function>
+MatrixMapExpression<const Matrix<T> &, Function> Matrix<T>::map(Function function) const & {
+	return MatrixMapExpression<const Matrix &, Function>(*this, function);
+}
+
+template <typename T>
+template <typename Function>
+MatrixMapExpression<Matrix<T>, Function> Matrix<T>::map(Function function) && {
+	return MatrixMapExpression<Matrix, Function>(std::move(*this), function);
+}
+
+template <typename T>
+MatrixBoundMapExpression<const Matrix<T> &, T(*)(T, T), T> Matrix<T>::map(T(*function)(T, T), T param) const & {
+	return MatrixBoundMapExpression<const Matrix &, T(*)(T, T), T>(*this, function, param);
+}
+
+template <typename T>
+MatrixBoundMapExpression<Matrix<T>, T(*)(T, T), T> Matrix<T>::map(T(*function)(T, T), T param) && {
+	return MatrixBoundMapExpression<Matrix, T(*)(T, T), T>(std::move(*this), function, param);
 }
 
-// Hadamard product
 template <typename T>
-Matrix<T> Matrix<T>::operator*(Matrix<T> const & rhs) {
-	assert(rows == rhs.rows && cols == rhs.cols);
+std::ostream & operator<<(std::ostream & flux, Matrix<T> const & matrix) {
+	matrix.print(flux);
+	return flux;
+}
 
-	Matrix result(rows, cols);
+template <typename T>
+bool Matrix<T>::operator==(Matrix<T> const & rhs) const {
+	if (rows != rhs.rows || cols != rhs.cols) {
+		return false;
+	}
 
 	for (unsigned row = 0; row < rows; row++) {
 		for (unsigned col = 0; col < cols; col++) {
-			result.matrix_array[row][col] = matrix_array[row][col] * rhs.matrix_array[row][col];
+			if (elements[row * pitch + col] != rhs.elements[row * pitch + col]) {
+				return false;
+			}
 		}
 	}
 
-	return result;
+	return true;
 }
 
-// Dot product
 template <typename T>
-Matrix<T> Matrix<T>::dot(Matrix<T> const & rhs) {
-	assert(cols == rhs.rows);
-
-	Matrix result(rows, rhs.cols);
+Matrix<T> & Matrix<T>::operator=(const Matrix<T> & rhs) {
+	if (this == &rhs) {
+		return *this;
+	}
 
-	for (unsigned row = 0; row < rows; row++) {
-		for (unsigned rhs_col = 0; rhs_col < rhs.cols; rhs_col++) {
+	// matrices of the same shape are copied in place, which keeps views into this matrix valid
+	if (rows == rhs.rows && cols == rhs.cols) {
+		std::copy(rhs.elements.data(), rhs.elements.data() + rhs.elements.size(), elements.data());
+		return *this;
+	}
 
-			T result_element = 0.0;
+	elements = rhs.elements;
+	rows = rhs.rows;
+	cols = rhs.cols;
+	pitch = rhs.pitch;
 
-			for (unsigned i = 0; i < cols; i++) {
-				result_element += matrix_array[row][i] * rhs.matrix_array[i][rhs_col];
-			}
+	return *this;
+}
 
-			result[row][rhs_col] = result_element;
-		}
+template <typename T>
+Matrix<T> & Matrix<T>::operator=(Matrix<T> && rhs) {
+	if (this == &rhs) {
+		return *this;
 	}
 
-	return result;
+	elements = std::move(rhs.elements);
+	rows = rhs.rows;
+	cols = rhs.cols;
+	pitch = rhs.pitch;
+	// like the move constructor, leave <rhs> empty, so that no operation sees its old shape over a released buffer
+	rhs.rows = rhs.cols = 0;
+	rhs.pitch = 0;
+
+	return *this;
 }
 
-// Transpose
 template <typename T>
-Matrix<T> Matrix<T>::transpose() const {
-	Matrix result(cols, rows);
-
-	for (unsigned row = 0; row < rows; row++) {
-		for (unsigned col = 0; col < cols; col++) {
-			result[col][row] = matrix_array[row][col];
-		}
+template <typename E>
+Matrix<T> & Matrix<T>::operator=(const MatrixExpression<E> & expression) {
+	const Shape shape = expression.derived().get_shape();
+	if (shape.rows != rows || shape.cols != cols) {
+		// an expression of another shape cannot refer to this matrix, the storage may be replaced before evaluating it
+		*this = Matrix(shape.rows, shape.cols);
 	}
+	assign(expression.derived());
 
-	return result;
+	return *this;
 }
 
 template <typename T>
-void Matrix<T>::print(std::ostream & flux) const {
+template <typename E>
+void Matrix<T>::assign(const E & expression) {
+	// the single fused loop every expression is evaluated in
 	for (unsigned row = 0; row < rows; row++) {
+		T * const destination = elements.data() + row * pitch;
 		for (unsigned col = 0; col < cols; col++) {
-			flux << matrix_array[row][col] << ' ';
+			destination[col] = expression(row, col);
 		}
-		flux << '\n';
 	}
 }
 
 template <typename T>
-Matrix<T> Matrix<T>::map(T(*function)(T)) const {
-	Matrix result(rows, cols);
+template <typename Operation, typename E>
+void Matrix<T>::update(const E & expression) {
+	// destination = Operation::apply(destination, expression), in a single pass
+	assert(expression.get_shape().rows == rows && expression.get_shape().cols == cols);
 
 	for (unsigned row = 0; row < rows; row++) {
+		T * const destination = elements.data() + row * pitch;
 		for (unsigned col = 0; col < cols; col++) {
-			result.matrix_array[row][col] = (*function)(matrix_array[row][col]);
+			destination[col] = Operation::apply(destination[col], expression(row, col));
 		}
 	}
+}
 
-	return result;
+template <typename T>
+template <typename E>
+Matrix<T> & Matrix<T>::operator+=(const MatrixExpression<E> & rhs) {
+	update<MatrixAddition>(rhs.derived());
+	return *this;
 }
 
 template <typename T>
-Matrix<T> Matrix<T>::map(T(*function)(T, T), T param) const {
-	Matrix result(rows, cols);
+template <typename E>
+Matrix<T> & Matrix<T>::operator-=(const MatrixExpression<E> & rhs) {
+	update<MatrixSubtraction>(rhs.derived());
+	return *this;
+}
+
+template <typename T>
+template <typename E>
+Matrix<T> & Matrix<T>::operator*=(const MatrixExpression<E> & rhs) {
+	update<MatrixMultiplication>(rhs.derived());
+	return *this;
+}
 
+template <typename T>
+Matrix<T> & Matrix<T>::operator*=(const double scalar) {
 	for (unsigned row = 0; row < rows; row++) {
+		T * const destination = elements.data() + row * pitch;
 		for (unsigned col = 0; col < cols; col++) {
-			result.matrix_array[row][col] = (*function)(matrix_array[row][col], param);
+			destination[col] *= scalar;
 		}
 	}
+	return *this;
+}
 
-	return result;
+template <typename T>
+template <typename E>
+Matrix<T> & Matrix<T>::axpy(const T alpha, const MatrixExpression<E> & x) {
+	update<MatrixAddition>(MatrixScalarExpression<const E &, MatrixMultiplication>(x.derived(), alpha));
+	return *this;
 }
 
 template <typename T>
-std::ostream & operator<<(std::ostream & flux, Matrix<T> const & matrix) {
-	matrix.print(flux);
-	return flux;
+Matrix<T> & Matrix<T>::map_inplace(T(*function)(T)) {
+	return map_inplace<T(*)(T)>(function);
 }
 
 template <typename T>
-bool Matrix<T>::operator==(Matrix<T> const & rhs) {
-	if (rows != rhs.rows || cols != rhs.cols) {
-		return false;
+Matrix<T> & Matrix<T>::map_inplace(T(*function)(T, T), T param) {
+	for (unsigned row = 0; row < rows; row++) {
+		T * const destination = elements.data() + row * pitch;
+		for (unsigned col = 0; col < cols; col++) {
+			destination[col] = (*function)(destination[col], param);
+		}
 	}
+	return *this;
+}
 
+template <typename T>
+template <typename Function>
+Matrix<T> & Matrix<T>::map_inplace(Function function) {
 	for (unsigned row = 0; row < rows; row++) {
+		T * const destination = elements.data() + row * pitch;
 		for (unsigned col = 0; col < cols; col++) {
-			if (matrix_array[row][col] != rhs.matrix_array[row][col]) {
-				return false;
-			}
+			destination[col] = function(destination[col]);
 		}
 	}
+	return *this;
+}
 
-	return true;
+template <typename T>
+VectorView<T> Matrix<T>::operator[](const unsigned row) {
+	return this->row(row);
 }
 
 template <typename T>
-Matrix<T> & Matrix<T>::operator=(const Matrix<T> & rhs) {
-	matrix_array = rhs.matrix_array;
-	rows = rhs.rows;
-	cols = rhs.cols;
+VectorView<const T> Matrix<T>::operator[](const unsigned row) const {
+	return this->row(row);
+}
 
-	return *this;
+template <typename T>
+T & Matrix<T>::operator()(const unsigned row, const unsigned col) {
+	return elements[row * pitch + col];
 }
 
 template <typename T>
-std::vector<T> & Matrix<T>::operator[](const unsigned row) {
-	return matrix_array[row];
+const T & Matrix<T>::operator()(const unsigned row, const unsigned col) const {
+	return elements[row * pitch + col];
+}
+
+namespace Learnoran {
+	inline void gemm(const double alpha, const MatrixView<const double> & a, const MatrixView<const double> & b, const double beta, const MatrixView<double> & c, const GemmKernel kernel = GemmKernel::automatic,
+		const GemmEpilogue * epilogue = nullptr) {
+		// C = alpha * A * B + beta * C on matrix views, then the epilogue if any; A and B may be strided in either
+		// dimension (e.g. transposed), the rows of C must be contiguous
+		assert(a.get_shape().cols == b.get_shape().rows && a.get_shape().rows == c.get_shape().rows && b.get_shape().cols == c.get_shape().cols);
+		assert(c.get_col_stride() == 1);
+
+		gemm(a.get_shape().rows, b.get_shape().cols, a.get_shape().cols, alpha,
+			a.data(), a.get_row_stride(), a.get_col_stride(), b.data(), b.get_row_stride(), b.get_col_stride(), beta, c.data(), c.get_row_stride(), kernel, epilogue);
+	}
 }
 
-#endif
\ No newline at end of file
+#endif
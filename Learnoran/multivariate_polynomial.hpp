@@ -0,0 +1,418 @@
+#ifndef _MULTIVARIATE_POLYNOMIAL_HPP
+#define _MULTIVARIATE_POLYNOMIAL_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <algorithm>
+#include <cassert>
+
+#include "lo_exception.hpp"
+#include "polynomial.hpp"
+#include "dataframe.hpp"
+
+namespace Learnoran {
+	struct Monomial {
+		// x_0^exponents[0] * x_1^exponents[1] * ... over an ordered list of variables
+		Monomial() { }
+
+		Monomial(std::vector<unsigned> exponents) : exponents(exponents) { }
+
+		unsigned degree() const {
+			unsigned total = 0;
+			for (const unsigned exponent : exponents) {
+				total += exponent;
+			}
+			return total;
+		}
+
+		bool operator==(const Monomial & rhs) const {
+			return exponents == rhs.exponents;
+		}
+
+		bool operator<(const Monomial & rhs) const {
+			return exponents < rhs.exponents;
+		}
+
+		std::vector<unsigned> exponents;
+	};
+
+	template <typename T>
+	struct MonomialTerm {
+		MonomialTerm(T coefficient, Monomial monomial) : coefficient(coefficient), monomial(monomial) { }
+
+		T coefficient;
+		Monomial monomial;
+	};
+
+	class PolynomialFeatures {
+		// Generates every monomial of total degree 1..degree over a set of variables. Monomials are produced in
+		// graded order and each one remembers the lower degree monomial it extends by a single variable, so that
+		// expanding a row costs exactly one multiplication per generated feature
+	public:
+		PolynomialFeatures(const unsigned degree = 2, const bool interaction_only = false)
+			: degree(degree), interaction_only(interaction_only) { }
+
+		void fit(const std::vector<std::string> & variable_symbols) {
+			this->variable_symbols = variable_symbols;
+			monomials.clear();
+			parents.clear();
+			variables.clear();
+
+			const std::size_t variable_count = variable_symbols.size();
+			std::vector<std::size_t> last_variable;
+
+			// degree 1 monomials are the variables themselves
+			for (std::size_t variable = 0; variable < variable_count; variable++) {
+				std::vector<unsigned> exponents(variable_count, 0);
+				exponents[variable] = 1;
+				push_monomial(Monomial(exponents), NO_PARENT, variable);
+				last_variable.push_back(variable);
+			}
+
+			std::size_t previous_begin = 0;
+			for (unsigned current_degree = 2; current_degree <= degree; current_degree++) {
+				const std::size_t previous_end = monomials.size();
+
+				for (std::size_t parent = previous_begin; parent < previous_end; parent++) {
+					// only extend with variables not preceding the parent's last one, so each monomial is generated once
+					const std::size_t first_variable = interaction_only ? last_variable[parent] + 1 : last_variable[parent];
+
+					for (std::size_t variable = first_variable; variable < variable_count; variable++) {
+						Monomial child = monomials[parent];
+						child.exponents[variable]++;
+						push_monomial(child, parent, variable);
+						last_variable.push_back(variable);
+					}
+				}
+				previous_begin = previous_end;
+			}
+		}
+
+		template <typename Row, typename T>
+		void expand(const Row & row, T * output) const {
+			// Args:
+			// - row: values of the fitted variables, in fitting order; a pointer to a contiguous row or a RowView
+			// - output: receives one value per generated monomial, in get_monomials() order
+			for (std::size_t monomial = 0; monomial < monomials.size(); monomial++) {
+				if (parents[monomial] == NO_PARENT) {
+					output[monomial] = row[variables[monomial]];
+				}
+				else {
+					output[monomial] = output[parents[monomial]] * row[variables[monomial]];
+				}
+			}
+		}
+
+		Dataframe<double> transform(const Dataframe<double> & dataframe) const {
+			// Expands the features of a dataframe so that e.g. a LinearModel can fit interaction and higher order terms
+			const DataframeShape shape = dataframe.shape();
+			std::vector<std::vector<double>> expanded(shape.rows, std::vector<double>(monomials.size()));
+
+#ifndef _SEQUENTIAL
+#pragma omp parallel for
+#endif
+			for (int row = 0; row < static_cast<int>(shape.rows); row++) {
+				expand(dataframe.get_row_view(row), expanded[row].data());
+			}
+
+			std::vector<std::string> headers = get_feature_names();
+			headers.push_back(dataframe.get_label_header());
+
+			std::vector<double> labels(shape.rows);
+			for (unsigned row = 0; row < shape.rows; row++) {
+				labels[row] = dataframe.get_row_label(row);
+			}
+
+			return Dataframe<double>(expanded, labels, headers);
+		}
+
+		std::vector<std::string> get_feature_names() const {
+			std::vector<std::string> names;
+			names.reserve(monomials.size());
+
+			for (const Monomial & monomial : monomials) {
+				std::string name;
+				for (std::size_t variable = 0; variable < monomial.exponents.size(); variable++) {
+					if (monomial.exponents[variable] == 0) {
+						continue;
+					}
+					if (!name.empty()) {
+						name += '*';
+					}
+					name += variable_symbols[variable];
+					if (monomial.exponents[variable] > 1) {
+						name += '^' + std::to_string(monomial.exponents[variable]);
+					}
+				}
+				names.push_back(name);
+			}
+
+			return names;
+		}
+
+		const std::vector<Monomial> & get_monomials() const {
+			return monomials;
+		}
+
+		const std::vector<std::string> & get_variable_symbols() const {
+			return variable_symbols;
+		}
+
+		unsigned get_degree() const {
+			return degree;
+		}
+
+		bool is_interaction_only() const {
+			return interaction_only;
+		}
+	private:
+		static const std::size_t NO_PARENT = static_cast<std::size_t>(-1);
+
+		void push_monomial(const Monomial & monomial, const std::size_t parent, const std::size_t variable) {
+			monomials.push_back(monomial);
+			parents.push_back(parent);
+			variables.push_back(variable);
+		}
+
+		unsigned degree;
+		bool interaction_only;
+
+		std::vector<std::string> variable_symbols;
+		std::vector<Monomial> monomials;
+		std::vector<std::size_t> parents; // monomial this one extends, NO_PARENT for degree 1
+		std::vector<std::size_t> variables; // variable multiplied into the parent
+	};
+
+	template <typename T>
+	class HornerPolynomial {
+		// Multivariate Horner form of a MultivariatePolynomial. Terms are factored recursively on one variable at a
+		// time: p = q_0 + x^e_1 * (q_1 + x^(e_2 - e_1) * (q_2 + ...)), where each q_k is again in Horner form over the
+		// remaining variables, so powers and sub-products common to several terms are computed once
+	public:
+		struct Branch {
+			Branch(unsigned exponent, std::size_t child) : exponent(exponent), child(child) { }
+
+			unsigned exponent;
+			std::size_t child;
+		};
+
+		struct Node {
+			// a leaf carries a coefficient; an inner node sums x_variable^exponent * child over its branches
+			bool is_leaf() const {
+				return branches.empty();
+			}
+
+			std::size_t variable;
+			std::size_t coefficient;
+			std::vector<Branch> branches;
+		};
+
+		HornerPolynomial() : root(NO_ROOT) { }
+
+		HornerPolynomial(const std::vector<MonomialTerm<T>> & terms, const std::size_t variable_count) : root(NO_ROOT) {
+			coefficients.reserve(terms.size());
+			for (const MonomialTerm<T> & term : terms) {
+				assert(term.monomial.exponents.size() == variable_count);
+				coefficients.push_back(term.coefficient);
+			}
+
+			if (!terms.empty()) {
+				std::vector<std::size_t> term_indices(terms.size());
+				for (std::size_t term = 0; term < terms.size(); term++) {
+					term_indices[term] = term;
+				}
+				root = build(terms, term_indices, 0, variable_count);
+			}
+		}
+
+		template <typename Row>
+		T operator()(const Row & row, const T & zero) const {
+			// Row: any type indexable by variable position, e.g. a pointer to a contiguous row or a RowView
+			if (root == NO_ROOT) {
+				return zero;
+			}
+			return evaluate(root, row);
+		}
+
+		T operator()(const T * row) const {
+			// only usable with arithmetic types for which T(0) is the additive identity
+			return (*this)(row, T(0));
+		}
+
+		T operator()(const std::vector<T> & row) const {
+			return (*this)(row.data());
+		}
+
+		std::size_t node_count() const {
+			return nodes.size();
+		}
+	private:
+		static const std::size_t NO_ROOT = static_cast<std::size_t>(-1);
+
+		std::size_t build(const std::vector<MonomialTerm<T>> & terms, const std::vector<std::size_t> & term_indices, std::size_t variable, const std::size_t variable_count) {
+			// skip variables that do not appear in any of the remaining terms
+			while (variable < variable_count) {
+				bool appears = false;
+				for (const std::size_t term : term_indices) {
+					if (terms[term].monomial.exponents[variable] > 0) {
+						appears = true;
+						break;
+					}
+				}
+				if (appears) {
+					break;
+				}
+				variable++;
+			}
+
+			Node node;
+			node.variable = variable;
+			node.coefficient = 0;
+
+			if (variable == variable_count) {
+				// MultivariatePolynomial merges equal monomials, so exactly one term is left at this point
+				assert(term_indices.size() == 1);
+				node.coefficient = term_indices[0];
+				nodes.push_back(node);
+				return nodes.size() - 1;
+			}
+
+			std::map<unsigned, std::vector<std::size_t>> exponent_groups;
+			for (const std::size_t term : term_indices) {
+				exponent_groups[terms[term].monomial.exponents[variable]].push_back(term);
+			}
+
+			for (const std::pair<const unsigned, std::vector<std::size_t>> & group : exponent_groups) {
+				node.branches.push_back(Branch(group.first, build(terms, group.second, variable + 1, variable_count)));
+			}
+
+			nodes.push_back(node);
+			return nodes.size() - 1;
+		}
+
+		static T multiply_power(const T & accumulator, const T & base, const unsigned exponent) {
+			if (exponent == 1) {
+				return accumulator * base;
+			}
+			return accumulator * raise_power(base, exponent);
+		}
+
+		template <typename Row>
+		T evaluate(const std::size_t node_index, const Row & row) const {
+			const Node & node = nodes[node_index];
+			if (node.is_leaf()) {
+				return coefficients[node.coefficient];
+			}
+
+			const std::vector<Branch> & branches = node.branches;
+			const T & base = row[node.variable];
+
+			T accumulator = evaluate(branches.back().child, row);
+			for (std::size_t branch = branches.size() - 1; branch-- > 0;) {
+				accumulator = multiply_power(accumulator, base, branches[branch + 1].exponent - branches[branch].exponent);
+				accumulator += evaluate(branches[branch].child, row);
+			}
+
+			if (branches.front().exponent > 0) {
+				accumulator = multiply_power(accumulator, base, branches.front().exponent);
+			}
+
+			return accumulator;
+		}
+
+		std::vector<Node> nodes;
+		std::vector<T> coefficients;
+		std::size_t root;
+	};
+
+	template <typename T>
+	class MultivariatePolynomial {
+		// Sparse polynomial over an ordered list of variables; each term carries a full exponent vector so that
+		// cross terms such as 3 * x^2 * y are representable. The constant term is the all-zero monomial
+	public:
+		MultivariatePolynomial() { }
+
+		MultivariatePolynomial(const std::vector<std::string> & variable_symbols) : variable_symbols(variable_symbols) { }
+
+		// Mutators
+
+		void add_term(const T & coefficient, const Monomial & monomial) {
+			// adds coefficient * monomial, merging it into an existing term with the same monomial
+			assert(monomial.exponents.size() == variable_symbols.size());
+
+			typename std::map<Monomial, std::size_t>::const_iterator find_result = term_index.find(monomial);
+			if (find_result != term_index.cend()) {
+				terms[find_result->second].coefficient += coefficient;
+				return;
+			}
+
+			term_index.insert({ monomial, terms.size() });
+			terms.push_back(MonomialTerm<T>(coefficient, monomial));
+		}
+
+		void add_term(const T & coefficient, const std::vector<unsigned> & exponents) {
+			add_term(coefficient, Monomial(exponents));
+		}
+
+		// Operators
+
+		T & operator[](const Monomial & monomial) {
+			// returns the coefficient of the given monomial
+			typename std::map<Monomial, std::size_t>::const_iterator find_result = term_index.find(monomial);
+
+			if (find_result == term_index.cend()) {
+				throw InvalidVariableException();
+			}
+
+			return terms[find_result->second].coefficient;
+		}
+
+		// Accessors
+
+		MultivariatePolynomial partial_derivative(const std::string & derivative_variable) const {
+			std::vector<std::string>::const_iterator find_result = std::find(variable_symbols.cbegin(), variable_symbols.cend(), derivative_variable);
+			if (find_result == variable_symbols.cend()) {
+				throw InvalidVariableException();
+			}
+
+			return partial_derivative(static_cast<std::size_t>(find_result - variable_symbols.cbegin()));
+		}
+
+		MultivariatePolynomial partial_derivative(const std::size_t variable) const {
+			MultivariatePolynomial derived(variable_symbols);
+
+			for (const MonomialTerm<T> & term : terms) {
+				const unsigned exponent = term.monomial.exponents[variable];
+				if (exponent == 0) {
+					continue;
+				}
+
+				Monomial derived_monomial = term.monomial;
+				derived_monomial.exponents[variable]--;
+				derived.add_term(term.coefficient * static_cast<double>(exponent), derived_monomial);
+			}
+
+			return derived;
+		}
+
+		HornerPolynomial<T> compile_horner() const {
+			return HornerPolynomial<T>(terms, variable_symbols.size());
+		}
+
+		const std::vector<MonomialTerm<T>> & get_terms() const {
+			return terms;
+		}
+
+		const std::vector<std::string> & get_variable_symbols() const {
+			return variable_symbols;
+		}
+	private:
+		std::vector<std::string> variable_symbols;
+		std::vector<MonomialTerm<T>> terms;
+		std::map<Monomial, std::size_t> term_index;
+	};
+}
+
+#endif
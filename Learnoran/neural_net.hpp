@@ -7,19 +7,34 @@
 #include <unordered_map>
 #include <string>
 
+#ifndef _SEQUENTIAL
+#include <omp.h>
+#endif
+
 #include "predictor.hpp"
 #include "matrix.hpp"
+#include "span.hpp"
 #include "math_util.hpp"
+#include "activation.hpp"
+#include "dense_layer.hpp"
+#include "optimizer.hpp"
+#include "inference_model.hpp"
+#include "quantized_model.hpp"
+#include "lomf.hpp"
 #include "dataframe.hpp"
+#include "columnar_dataframe.hpp"
+#include "sparse_dataframe.hpp"
 #include "decryption_manager.hpp"
 
 namespace Learnoran {
 	class NeuralNetwork : public Predictor {
 	public:
 		NeuralNetwork(std::ostream & info_stream, bool descriptive_info_output = false) 
-			: info_stream(info_stream), descriptive_info_output(descriptive_info_output) { }
+			: sparse_input_schema(0), batch_size(1), info_stream(info_stream), descriptive_info_output(descriptive_info_output) {
+			set_activation_accuracy(ActivationAccuracy::accurate);
+		}
 
-		void add_layer(const unsigned neurons, std::vector<std::string> * feature_symbols = nullptr) {
+		void add_layer(const unsigned neurons, const std::vector<std::string> * feature_symbols = nullptr) {
 			// Adds a new layer to the end of the network
 			// Connections to the new layer are initialized with random values
 			// from the standard normal distribution
@@ -31,7 +46,8 @@ namespace Learnoran {
 			if (layers.size() > 0) {
 				const unsigned prev_layer_size = layers.at(layers.size() - 1).get_shape().cols;
 
-				connections.push_back(Matrix<double>(prev_layer_size, neurons).map(snd_random));
+				connections.push_back(Matrix<double>(prev_layer_size, neurons));
+				generator.fill(Distribution::normal, connections.back().view());
 				gradients.push_back(Matrix<double>(1, neurons));
 			}
 			else {
@@ -41,16 +57,131 @@ namespace Learnoran {
 				for (unsigned i = 0; i < feature_symbols->size(); i++) {
 					input_layer_symbols[i] = feature_symbols->at(i);
 				}
+				input_binding.reset();
+				sparse_input_schema = 0;
 			}
 
 			layers.push_back(Matrix<double>(1, neurons));
-			biases.push_back(snd_random());
+			biases.push_back(generator.normal());
+			workspaces.clear(); // reallocated for the new topology by reserve_workspace
+			optimizer_gradients.clear(); // and by prepare_optimizer, which restarts the optimizer
+			optimizer.reset(0);
+		}
+
+		void set_batch_size(const unsigned batch_size) {
+			// Args:
+			// - batch_size: rows per parameter update in fit. With 1, the default, the parameters are updated after
+			// every row. Larger batches propagate <batch_size> rows at once through (batch_size x neurons) layer
+			// matrices and update every connection matrix with a single GEMM on the mean gradient of the batch, so the
+			// learning rate applies to that mean
+			assert(batch_size > 0);
+			this->batch_size = batch_size;
+		}
+
+		void set_optimizer(const Optimizer & optimizer) {
+			// Args:
+			// - optimizer: the update rule of the connections, plain gradient descent by default. Its state is kept
+			// from one fit to the next as long as the topology is unchanged, so training may go on over several calls
+			this->optimizer = optimizer;
+		}
+
+		void set_seed(const std::uint64_t seed) {
+			// Args:
+			// - seed: the seed of the generator drawing the connections and biases of the layers added from here on;
+			// networks start from seed 0, so the same topology always starts from the same parameters
+			generator = Philox4x32(seed);
+		}
+
+		void set_activation_accuracy(const ActivationAccuracy accuracy) {
+			// accuracy tier of the sigmoid applied to the hidden layers, and of its derivative in back propagation, see
+			// activation.hpp; accurate by default
+			activation_accuracy = accuracy;
+			hidden_activation = resolve_activation_kernel(Activation::sigmoid, accuracy);
+			hidden_derivative = resolve_activation_kernel(Activation::sigmoid_prime, accuracy);
+		}
+
+		InferenceModel freeze() const {
+			// Returns:
+			//   an immutable copy of the current parameters that any number of threads can predict with at once, see
+			//   InferenceModel; training the network afterwards does not affect it
+			assert(layers.size() > 1);
+			return InferenceModel(connections, biases, input_layer_symbols, activation_accuracy);
+		}
+
+		QuantizedModel quantize(const Dataframe<double> & calibration) const {
+			// Args:
+			// - calibration: rows representative of the inputs the model will serve, e.g. the training set; the
+			// quantization covers the range of every neuron over them
+			// Returns:
+			//   an int8 copy of the current parameters, see QuantizedModel
+			// Throws:
+			// - EmptyDataframeException: if <calibration> has no rows
+			// - MissingColumnException: if <calibration> lacks any of the input symbols
+			assert(layers.size() > 1);
+			const unsigned rows = calibration.shape().rows;
+			Matrix<double> inputs(rows, static_cast<unsigned>(input_layer_symbols.size()));
+			SchemaBinding binding;
+			for (unsigned row = 0; row < rows; row++) {
+				const RowView<double> ordered = binding.bind(calibration.get_row_view(row), input_layer_symbols);
+				for (unsigned i = 0; i < input_layer_symbols.size(); i++) {
+					inputs(row, i) = ordered[i];
+				}
+			}
+			return QuantizedModel(connections, biases, input_layer_symbols, activation_accuracy, inputs.view());
+		}
+
+		void save(const std::string & filename) const {
+			// Stores the parameters in the .lomf format, see lomf.hpp. The symbols are the input symbols and the parameter
+			// the activation accuracy; the blocks are the connections of every layer in order, then the biases. The
+			// optimizer state is not stored. load_inference_model serves predictions from such a file directly
+			// Throws:
+			// - CannotOpenFileException: if the file cannot be created
+			assert(layers.size() > 1);
+			LomfWriter writer(LomfModel::neural_network, static_cast<std::uint32_t>(activation_accuracy));
+			writer.add_symbols(input_layer_symbols);
+			for (const Matrix<double> & weights : connections) {
+				writer.add_block(LomfRole::weights, weights.view());
+			}
+			writer.add_block(LomfRole::biases, biases);
+			writer.write(filename);
+		}
+
+		void load(const std::string & filename) {
+			// Replaces the topology and the parameters with those stored by save; the optimizer starts afresh
+			// Throws:
+			// - CannotOpenFileException: if the file cannot be opened
+			// - InvalidFileFormatException: if the file is not a valid .lomf file of a network
+			const LomfFile file(filename);
+			std::vector<MatrixView<const double>> stored_connections;
+			std::vector<double> stored_biases;
+			ActivationAccuracy accuracy;
+			read_lomf_network(file, stored_connections, stored_biases, accuracy);
+
+			input_layer_symbols = file.get_symbols();
+			input_binding.reset();
+			sparse_input_schema = 0;
+			biases = stored_biases;
+
+			layers.clear();
+			gradients.clear();
+			connections.clear();
+			layers.push_back(Matrix<double>(1, static_cast<unsigned>(input_layer_symbols.size())));
+			for (const MatrixView<const double> & weights : stored_connections) {
+				connections.push_back(Matrix<double>(weights));
+				gradients.push_back(Matrix<double>(1, weights.get_shape().cols));
+				layers.push_back(Matrix<double>(1, weights.get_shape().cols));
+			}
+
+			workspaces.clear();
+			optimizer_gradients.clear();
+			optimizer.reset(0);
+			set_activation_accuracy(accuracy);
 		}
 
 		double predict(const std::unordered_map<std::string, double> & inputs) override {
 			// NOTE: currently the NN interface only supports regression problems; for which the NN architecture has only one output layer neuron
-			const Matrix<double> outputs = forward_pass(map_to_vector(inputs));
-			return outputs[0][0];
+			compute_forward_pass(map_to_vector(inputs));
+			return layers.back()(0, 0);
 		}
 
 		EncryptedNumber predict(const std::unordered_map<std::string, EncryptedNumber> & inputs, const DecryptionManager * dec_man) override  {
@@ -58,27 +189,39 @@ namespace Learnoran {
 			return EncryptedNumber();
 		}
 
-		void fit(const Dataframe<double> & dataframe, const unsigned short epochs, const double learning_rate) override {
-			// Applies batch gradient descent
-			// currently only supports regression problems (i.e. single output neuron)
-			assert(layers[layers.size() - 1].get_shape().rows == 1);
+		double predict(const RowView<double> & inputs) override {
+			compute_forward_pass(input_binding.bind(inputs, input_layer_symbols));
+			return layers.back()(0, 0);
+		}
 
-			const std::vector<std::vector<double>> & features = dataframe.get_features();
-			const std::vector<double> & labels = dataframe.get_labels();
+		EncryptedNumber predict(const RowView<EncryptedNumber> & inputs, const DecryptionManager * dec_man) override {
+			return predict(inputs.to_map(), dec_man);
+		}
 
-			for (unsigned epoch = 0; epoch < epochs; epoch++) {
-				for (unsigned i = 0; i < features.size(); i++) {
-					back_propagation(features[i], std::vector<double>{labels[i]}, learning_rate);
-				}
+		double predict(const SparseRowView<double> & inputs) {
+			// only the connections of the nonzero inputs are visited
+			compute_forward_pass(inputs);
+			return layers.back()(0, 0);
+		}
 
-				if (epoch % 10 == 0) {
-					double average_mse = compute_mean_square_error(Dataframe<double>(features, labels, input_layer_symbols), 100);
-					output_error(epoch, epochs, average_mse);
-				}
-			}
+		void fit(const Dataframe<double> & dataframe, const unsigned short epochs, const double learning_rate) override {
+			// Applies stochastic or mini-batch gradient descent, see set_batch_size
+			// currently only supports regression problems (i.e. single output neuron)
+			train(dataframe, epochs, learning_rate);
+		}
 
-			double final_average_mse = compute_mean_square_error(Dataframe<double>(features, labels, input_layer_symbols), 100);
-			output_error(epochs, epochs, final_average_mse);
+		void fit(const ColumnarDataframe<double> & dataframe, const unsigned short epochs, const double learning_rate) {
+			// Same as above, reading every feature row in place as a strided span over the columns
+			train(dataframe, epochs, learning_rate);
+		}
+
+		void fit(const SparseDataframe<double> & dataframe, const unsigned short epochs, const double learning_rate) {
+			// Same as above; the input layer is never densified, see compute_forward_pass(const SparseRowView<double> &).
+			// Plain gradient descent trains exactly as on the dense frame. Stateful optimizers update the input connections
+			// lazily: those of the inputs that are zero throughout a step keep their value and state, where dense training
+			// would still move them along the state. An Adam step moves a parameter by at most about
+			// rate * (1 - beta1) / sqrt(1 - beta2), so after s steps no parameter is further than 2s such steps from dense training
+			train(dataframe, epochs, learning_rate);
 		}
 
 		void fit(const Dataframe<EncryptedNumber> & dataframe, const unsigned short epochs, const double learning_rate, const DecryptionManager * dec_man) override {
@@ -86,30 +229,91 @@ namespace Learnoran {
 		}
 
 		double compute_mean_square_error(const Dataframe<double> & dataframe, const unsigned num_rows) override {
-			const std::vector<std::vector<double>> & features = dataframe.get_features();
-			const std::vector<double> & labels = dataframe.get_labels();
-
 			double average_mse = 0.0;
-			unsigned total_rows = std::min(static_cast<unsigned>(features.size()), num_rows);
+			unsigned total_rows = std::min(dataframe.shape().rows, num_rows);
 
 			for (unsigned training_row = 0; training_row < total_rows; training_row++) {
-				compute_forward_pass(features[training_row]);
-				double prediction = layers[layers.size() - 1][0][0];
-				average_mse += mse(prediction, labels[training_row]);
+				compute_forward_pass(dataframe.get_row_view(training_row));
+				double prediction = layers.back()(0, 0);
+				average_mse += mse(prediction, dataframe.get_row_label(training_row));
 			}
 
 			average_mse /= total_rows;
 			return average_mse;
 		}
 	
+		double compute_mean_square_error(const ColumnarDataframe<double> & dataframe, const unsigned num_rows) {
+			double average_mse = 0.0;
+			const unsigned total_rows = std::min(dataframe.shape().rows, num_rows);
+
+			for (unsigned row = 0; row < total_rows; row++) {
+				compute_forward_pass(dataframe.get_row_feature(row));
+				double prediction = layers.back()(0, 0);
+				average_mse += mse(prediction, dataframe.get_row_label(row));
+			}
+
+			average_mse /= total_rows;
+			return average_mse;
+		}
+
+		double compute_mean_square_error(const SparseDataframe<double> & dataframe, const unsigned num_rows) {
+			double average_mse = 0.0;
+			const unsigned total_rows = std::min(dataframe.shape().rows, num_rows);
+
+			for (unsigned row = 0; row < total_rows; row++) {
+				compute_forward_pass(dataframe.get_row_view(row));
+				double prediction = layers.back()(0, 0);
+				average_mse += mse(prediction, dataframe.get_row_label(row));
+			}
+
+			average_mse /= total_rows;
+			return average_mse;
+		}
+
 		EncryptedNumber compute_mean_square_error(const Dataframe<EncryptedNumber> & dataframe, const unsigned num_rows) override {
 			// TODO
 			return EncryptedNumber();
 		}
 	private:
-		Matrix<double> forward_pass(const std::vector<double> & inputs) {
-			compute_forward_pass(inputs);
-			return layers[layers.size() - 1];
+		template <typename Dataset>
+		void train(const Dataset & dataframe, const unsigned short epochs, const double learning_rate) {
+			// MSE loss; reports the error on the first 100 rows every 10 epochs
+			assert(layers[layers.size() - 1].get_shape().rows == 1);
+
+			const unsigned rows = dataframe.shape().rows;
+			prepare_optimizer();
+
+			for (unsigned epoch = 0; epoch < epochs; epoch++) {
+				if (batch_size == 1) {
+					for (unsigned i = 0; i < rows; i++) {
+						const double label = dataframe.get_row_label(i);
+						back_propagation(feature_row(dataframe, i), Span<const double>(&label, 1), learning_rate);
+					}
+				}
+				else {
+					for (unsigned first_row = 0; first_row < rows; first_row += batch_size) {
+						batch_back_propagation(dataframe, first_row, std::min(batch_size, rows - first_row), learning_rate);
+					}
+				}
+
+				if (epoch % 10 == 0) {
+					output_error(epoch, epochs, compute_mean_square_error(dataframe, 100));
+				}
+			}
+
+			output_error(epochs, epochs, compute_mean_square_error(dataframe, 100));
+		}
+
+		static RowView<double> feature_row(const Dataframe<double> & dataframe, const unsigned row) {
+			return dataframe.get_row_view(row);
+		}
+
+		static StridedSpan<const double> feature_row(const ColumnarDataframe<double> & dataframe, const unsigned row) {
+			return dataframe.get_row_feature(row);
+		}
+
+		static SparseRowView<double> feature_row(const SparseDataframe<double> & dataframe, const unsigned row) {
+			return dataframe.get_row_view(row);
 		}
 
 		void output_error(const unsigned epoch, const unsigned total_epochs, const double error) {
@@ -124,35 +328,107 @@ namespace Learnoran {
 		void compute_forward_pass(const std::unordered_map<std::string, double> & inputs) {
 			assert(layers.size() > 1);
 
-			const unsigned num_layers = layers.size();
-
 			// 1 - enter the provided values to the input layer
 			fill_input_layer(inputs);
 
-			// 2 - forward propagate hidden layers (use activation function)
-			for (unsigned i = 0; i < num_layers - 2; i++) {
-				layers.at(i + 1) = layers.at(i).dot(connections.at(i)).map(&apply_bias, biases.at(i)).map(sigmoid);
-			}
-
-			// 3 - compute the output layer outputs
-			layers.at(num_layers - 1) = layers.at(num_layers - 2).dot(connections.at(num_layers - 2)).map(&apply_bias, biases.at(num_layers - 2));
+			// 2 - propagate through the hidden and output layers
+			propagate_layers();
 		}
 
-		void compute_forward_pass(const std::vector<double> & inputs) {
+		template <typename Row>
+		void compute_forward_pass(const Row & inputs) {
+			// Row: any indexable sequence of the input values with size(), e.g. std::vector or StridedSpan
 			assert(layers.size() > 1);
 
-			const unsigned num_layers = layers.size();
-
 			// 1 - enter the provided values to the input layer
 			fill_input_layer(inputs);
 
-			// 2 - forward propagate hidden layers (use activation function)
-			for (unsigned i = 0; i < num_layers - 2; i++) {
-				layers.at(i + 1) = layers.at(i).dot(connections.at(i)).map(&apply_bias, biases.at(i)).map(sigmoid);
+			// 2 - propagate through the hidden and output layers
+			propagate_layers();
+		}
+
+		void compute_forward_pass(const SparseRowView<double> & inputs) {
+			// The input layer is left untouched: the first computed layer is the sum of the outgoing connections of the
+			// nonzero inputs, weighted by their values, so the cost of the first layer is proportional to the nonzeros
+			assert(layers.size() > 1);
+
+			sparse_first_layer(inputs, sparse_input_neurons(inputs.get_schema()), layers[1].data());
+			activate_layer(1);
+
+			propagate_layers(1);
+		}
+
+		void sparse_first_layer(const SparseRowView<double> & inputs, const std::vector<std::size_t> & input_neurons, double * const first_layer) const {
+			// first_layer = the outgoing connections of the nonzero inputs, weighted by their values
+			// <input_neurons>: see sparse_input_neurons
+			const Matrix<double> & input_connections = connections[0];
+			const unsigned neurons = input_connections.get_shape().cols;
+
+			std::fill(first_layer, first_layer + neurons, 0.0);
+			for (std::size_t nonzero = 0; nonzero < inputs.nonzeros(); nonzero++) {
+				const std::size_t neuron = input_neurons[inputs.index(nonzero)];
+				if (neuron == NOT_AN_INPUT) {
+					continue;
+				}
+
+				const double value = inputs.value(nonzero);
+				const double * const weights = input_connections.data() + neuron * input_connections.get_pitch();
+				for (unsigned dest_neuron = 0; dest_neuron < neurons; dest_neuron++) {
+					first_layer[dest_neuron] += value * weights[dest_neuron];
+				}
+			}
+		}
+
+		void propagate_layers(const unsigned first_source_layer = 0) {
+			// Every layer is computed into the matrix it already owns, so a forward pass allocates nothing
+			for (unsigned i = first_source_layer; i < layers.size() - 1; i++) {
+				dense_layer_forward(layers[i].view(), connections[i].view(), biases[i], layer_activation(i + 1), layers[i + 1].view());
+			}
+		}
+
+		GemmElementwise layer_activation(const unsigned layer) const {
+			// the output layer is linear
+			return layer + 1 < layers.size() ? hidden_activation : nullptr;
+		}
+
+		void activate_layer(const unsigned layer) {
+			activate_rows(layers[layer], layer, 1);
+		}
+
+		void activate_rows(Matrix<double> & values, const unsigned layer, const unsigned rows) const {
+			// applies the bias of the incoming connections, and the activation function unless <layer> is the output layer,
+			// to the first <rows> rows of <values>, which hold outputs of <layer>; for the layers not computed by
+			// dense_layer_forward, i.e. the first layer of sparse inputs
+			const double bias = biases[layer - 1];
+			const unsigned neurons = values.get_shape().cols;
+			const GemmElementwise activation = layer_activation(layer);
+
+			for (unsigned row = 0; row < rows; row++) {
+				double * const outputs = values.data() + row * values.get_pitch();
+				for (unsigned neuron = 0; neuron < neurons; neuron++) {
+					outputs[neuron] += bias;
+				}
+				if (activation != nullptr) {
+					activation(outputs, outputs, neurons);
+				}
 			}
+		}
 
-			// 3 - compute the output layer outputs
-			layers.at(num_layers - 1) = layers.at(num_layers - 2).dot(connections.at(num_layers - 2)).map(&apply_bias, biases.at(num_layers - 2));
+		const std::vector<std::size_t> & sparse_input_neurons(const DataframeSchema & schema) {
+			// Returns:
+			//   the input neuron of every feature column of <schema>, NOT_AN_INPUT for columns the network does not use;
+			//   resolved once per schema
+			// Throws:
+			// - MissingColumnException: if the schema lacks any of the input layer symbols
+			if (sparse_input_schema != schema.get_id()) {
+				const std::vector<std::size_t> input_columns = schema.resolve(input_layer_symbols);
+				sparse_input_map.assign(schema.get_feature_symbols().size(), std::size_t(NOT_AN_INPUT)); // a copy, NOT_AN_INPUT has no definition to bind to
+				for (std::size_t neuron = 0; neuron < input_columns.size(); neuron++) {
+					sparse_input_map[input_columns[neuron]] = neuron;
+				}
+				sparse_input_schema = schema.get_id();
+			}
+			return sparse_input_map;
 		}
 
 		std::vector<double> map_to_vector(const std::unordered_map<std::string, double> & map) const {
@@ -181,68 +457,428 @@ namespace Learnoran {
 			for (unsigned i = 0; i < input_layer_symbols.size(); i++) {
 				const std::string & variable_symbol = input_layer_symbols.at(i);
 				const double variable_value = inputs.find(variable_symbol)->second; // TODO: this find could fail in case of supplement of wrong inputs arg - fix later
-				layers[0][0][i] = variable_value;
+				layers[0](0, i) = variable_value;
 			}
 		}
 
-		void fill_input_layer(const std::vector<double> & inputs) {
+		template <typename Row>
+		void fill_input_layer(const Row & inputs) {
 			assert(inputs.size() == layers[0].get_shape().cols);
 			
 			for (unsigned i = 0; i < inputs.size(); i++) {
-				layers[0][0][i] = inputs[i];
+				layers[0](0, i) = inputs[i];
 			}
 		}
 
-		void back_propagation(const std::vector<double> & feature_row, const std::vector<double> target, const double learning_rate) {
+		template <typename Row>
+		void back_propagation(const Row & feature_row, const Span<const double> target, const double learning_rate) {
 			// updates model parameters for a single data point
 			// uses MSE loss
 			// arg <target> is the target values for the output layer
+			// every intermediate result is written into the layer, gradient and connection matrices in place,
+			// so no heap allocation happens once the network is built
 			assert(layers.size() > 1); // backpropagate only if the network is multi-layer
 
-			const std::vector<double> outputs = forward_pass(feature_row).get_1d_vector();
+			compute_forward_pass(feature_row);
+			const VectorView<const double> outputs = layers.back().row(0);
 
 			// The gradients for the output layer is computed differently than for the hidden layers
 			// 1- Compute the gradients for the output layer
 			for (unsigned i = 0; i < outputs.size(); i++) {
-				gradients[gradients.size() - 1][0][i] = (target[i] - outputs[i]) * sigmoid_prime(outputs[i]);
+				gradients.back()(0, i) = (target[i] - outputs[i]) * sigmoid_prime(outputs[i]);
 			}
 
 			// 2- Compute gradients for the hidden layers
+			// gradient of a layer = (next layer gradient * transposed outgoing connections) .* sigmoid'(layer outputs)
 			for (int hid_layer_index = layers.size() - 3; hid_layer_index >= 0; hid_layer_index--) {
-				const std::vector<double> & current_layer = layers[hid_layer_index + 1].get_1d_vector();
+				dense_layer_backward(gradients[hid_layer_index + 1].view(), connections[hid_layer_index + 1].view(), layers[hid_layer_index + 1].view(), hidden_derivative,
+					gradients[hid_layer_index].view());
+			}
 
-				for (unsigned neuron = 0; neuron < current_layer.size(); neuron++) {
-					double derivative = sigmoid_prime(current_layer[neuron]);
+			// 3- Update weights: connections += learning_rate * (source layer)^T * (layer gradients), a rank-1 update
+			if (!optimizer.is_stateless()) {
+				optimize_connections(feature_row, learning_rate);
+				return;
+			}
+			update_input_connections(feature_row, learning_rate);
+			for (unsigned hid_layer = 1; hid_layer < connections.size(); hid_layer++) {
+				const Matrix<double> & source_layer = layers[hid_layer];
+				const Matrix<double> & layer_gradients = gradients[hid_layer];
 
-					const std::vector<double> weights_cur_neuron = connections[hid_layer_index + 1][neuron];
-					double weighted_grad_sum = 0.0;
-					for (unsigned edge = 0; edge < weights_cur_neuron.size(); edge++) {
-						weighted_grad_sum += weights_cur_neuron[edge] * gradients[hid_layer_index + 1][0][edge];
-					}
+				Learnoran::gemm(learning_rate, source_layer.view().transpose(), layer_gradients.view(), 1.0, connections[hid_layer].view());
+			}
+		}
+
+		template <typename Row>
+		void update_input_connections(const Row &, const double learning_rate) {
+			// the input layer holds the row, see fill_input_layer
+			Learnoran::gemm(learning_rate, layers[0].view().transpose(), gradients[0].view(), 1.0, connections[0].view());
+		}
 
-					gradients[hid_layer_index][0][neuron] = derivative * weighted_grad_sum;
+		void update_input_connections(const SparseRowView<double> & inputs, const double learning_rate) {
+			update_sparse_input_connections(inputs, learning_rate, gradients[0].data());
+		}
+
+		void update_sparse_input_connections(const SparseRowView<double> & inputs, const double learning_rate, const double * const layer_gradients) {
+			// a zero input leaves its outgoing connections unchanged, so only the rows of the nonzero inputs are updated
+			const std::vector<std::size_t> & input_neurons = sparse_input_neurons(inputs.get_schema());
+			Matrix<double> & input_connections = connections[0];
+			const unsigned neurons = input_connections.get_shape().cols;
+
+			for (std::size_t nonzero = 0; nonzero < inputs.nonzeros(); nonzero++) {
+				const std::size_t neuron = input_neurons[inputs.index(nonzero)];
+				if (neuron == NOT_AN_INPUT) {
+					continue;
+				}
+
+				const double scale = learning_rate * inputs.value(nonzero);
+				double * const weights = input_connections.data() + neuron * input_connections.get_pitch();
+				for (unsigned dest_neuron = 0; dest_neuron < neurons; dest_neuron++) {
+					weights[dest_neuron] += scale * layer_gradients[dest_neuron];
 				}
 			}
+		}
+
+		// MARK: Mini-batches
 
-			// 3- Compute deltas and update weights
-			for (unsigned hid_layer = 0; hid_layer < connections.size(); hid_layer++) {
-				const Matrix<double> current_connections = connections.at(hid_layer);
-				const unsigned num_source = current_connections.get_shape().rows;
-				const unsigned num_dest = current_connections.get_shape().cols;
+		struct Workspace {
+			// what one thread needs to back propagate its shard of a batch: the outputs and gradients of every layer for
+			// the rows of the shard, and the gradient of every connection matrix summed over them
+			Workspace() : capacity(0) { }
 
-				for (unsigned source_neuron = 0; source_neuron < num_source; source_neuron++) {
-					for (unsigned dest_neuron = 0; dest_neuron < num_dest; dest_neuron++) {
-						const double delta = learning_rate * gradients[hid_layer][0][dest_neuron] * layers[hid_layer][0][source_neuron];
+			std::vector<Matrix<double>> layers;
+			std::vector<Matrix<double>> gradients; // of every layer but the input layer
+			std::vector<Matrix<double>> connection_gradients; // allocated on first use, see back_propagate_shard
+			unsigned capacity; // rows of the layer and gradient matrices
+		};
 
-						// update the weight value
-						connections[hid_layer][source_neuron][dest_neuron] += delta;
+		void reserve_workspace(Workspace & workspace, const unsigned rows) {
+			// sizes <workspace> for <rows> rows of the current topology; allocates only when it has to grow
+			if (workspace.layers.size() == layers.size() && workspace.capacity >= rows) {
+				return;
+			}
+
+			workspace.layers.clear();
+			workspace.gradients.clear();
+			for (unsigned layer = 0; layer < layers.size(); layer++) {
+				workspace.layers.push_back(Matrix<double>(rows, layers[layer].get_shape().cols));
+				if (layer > 0) {
+					workspace.gradients.push_back(Matrix<double>(rows, layers[layer].get_shape().cols));
+				}
+			}
+			workspace.connection_gradients.resize(connections.size());
+			workspace.capacity = rows;
+		}
+
+		static MatrixView<double> batch_rows(Matrix<double> & batch_matrix, const unsigned rows) {
+			// the rows in use, fewer than the capacity for small shards and for the last batch of an epoch
+			return batch_matrix.submatrix(0, 0, rows, batch_matrix.get_shape().cols);
+		}
+
+		static unsigned shard_begin(const unsigned rows, const unsigned shard, const unsigned shards) {
+			// first row of <shard> among the <rows> rows of a batch split into <shards> contiguous shards
+			return static_cast<unsigned>(static_cast<unsigned long long>(rows) * shard / shards);
+		}
+
+		template <typename Dataset>
+		static bool dense_inputs(const Dataset &) {
+			return true;
+		}
+
+		static bool dense_inputs(const SparseDataframe<double> &) {
+			return false;
+		}
+
+		template <typename Dataset>
+		void batch_back_propagation(const Dataset & dataset, const unsigned first_row, const unsigned rows, const double learning_rate) {
+			// back_propagation for the dataset rows [first_row, first_row + rows) at once, along the mean gradient of the
+			// batch. The batch is split into one contiguous shard per thread; every thread back propagates its shard in
+			// its own Workspace, then the connection gradients of the shards are summed by a tree all-reduce: in round
+			// r, shard s adds shard s + 2^r into itself for every s that is a multiple of 2^(r + 1). The additions
+			// happen in the same order whatever the timing of the threads, so training is reproducible for a given
+			// thread count
+			assert(layers.size() > 1);
+
+			prepare_inputs(dataset);
+#ifndef _SEQUENTIAL
+			const unsigned max_shards = std::max(1u, std::min(static_cast<unsigned>(omp_get_max_threads()), rows));
+#else
+			const unsigned max_shards = 1;
+#endif
+			if (workspaces.size() < max_shards) {
+				workspaces.resize(max_shards);
+			}
+
+			const bool reduce_input_gradients = dense_inputs(dataset);
+			unsigned shards = 1;
+#ifndef _SEQUENTIAL
+#pragma omp parallel num_threads(max_shards)
+#endif
+			{
+#ifndef _SEQUENTIAL
+				const unsigned shard = static_cast<unsigned>(omp_get_thread_num());
+#pragma omp single
+				shards = static_cast<unsigned>(omp_get_num_threads()); // the team may be smaller than requested
+#else
+				const unsigned shard = 0;
+#endif
+				const unsigned begin = shard_begin(rows, shard, shards);
+				const unsigned end = shard_begin(rows, shard + 1, shards);
+				Workspace & workspace = workspaces[shard];
+
+				reserve_workspace(workspace, end - begin);
+				back_propagate_shard(dataset, first_row + begin, end - begin, workspace);
+
+				for (unsigned stride = 1; stride < shards; stride *= 2) {
+#ifndef _SEQUENTIAL
+#pragma omp barrier
+#endif
+					if (shard % (2 * stride) == 0 && shard + stride < shards) {
+						const Workspace & partner = workspaces[shard + stride];
+						for (unsigned connection = reduce_input_gradients ? 0 : 1; connection < connections.size(); connection++) {
+							workspace.connection_gradients[connection] += partner.connection_gradients[connection];
+						}
 					}
 				}
 			}
+
+			// Update weights: connections += (learning_rate / rows) * (summed connection gradients)
+			if (!optimizer.is_stateless()) {
+				optimize_batch_connections(dataset, first_row, rows, shards, learning_rate);
+				return;
+			}
+			const double step = learning_rate / rows;
+			update_batch_input_connections(dataset, first_row, rows, shards, step);
+			for (unsigned connection = 1; connection < connections.size(); connection++) {
+				connections[connection].axpy(step, workspaces[0].connection_gradients[connection]);
+			}
+		}
+
+		template <typename Dataset>
+		void back_propagate_shard(const Dataset & dataset, const unsigned first_row, const unsigned rows, Workspace & workspace) const {
+			// fills the layers, gradients and connection gradients of <workspace> for the dataset rows
+			// [first_row, first_row + rows); reads the network parameters only, so shards run concurrently
+			forward_batch(dataset, first_row, rows, workspace);
+
+			// 1- Compute the gradients for the output layer
+			const Matrix<double> & outputs = workspace.layers.back();
+			Matrix<double> & output_gradients = workspace.gradients.back();
+			for (unsigned row = 0; row < rows; row++) {
+				const double target = dataset.get_row_label(first_row + row);
+				for (unsigned i = 0; i < outputs.get_shape().cols; i++) {
+					output_gradients(row, i) = (target - outputs(row, i)) * sigmoid_prime(outputs(row, i));
+				}
+			}
+
+			// 2- Compute gradients for the hidden layers
+			for (int hid_layer_index = layers.size() - 3; hid_layer_index >= 0; hid_layer_index--) {
+				dense_layer_backward(batch_rows(workspace.gradients[hid_layer_index + 1], rows), connections[hid_layer_index + 1].view(),
+					batch_rows(workspace.layers[hid_layer_index + 1], rows), hidden_derivative, batch_rows(workspace.gradients[hid_layer_index], rows));
+			}
+
+			// 3- Sum the connection gradients (source layer)^T * (layer gradients) over the rows; sparse inputs update
+			// their connections row by row instead, see update_batch_input_connections
+			for (unsigned connection = dense_inputs(dataset) ? 0 : 1; connection < connections.size(); connection++) {
+				Matrix<double> & connection_gradients = workspace.connection_gradients[connection];
+				if (connection_gradients.get_shape().rows != connections[connection].get_shape().rows) {
+					connection_gradients = Matrix<double>(connections[connection].get_shape().rows, connections[connection].get_shape().cols);
+				}
+				Learnoran::gemm(1.0, batch_rows(workspace.layers[connection], rows).transpose(), batch_rows(workspace.gradients[connection], rows), 0.0, connection_gradients.view());
+			}
+		}
+
+		template <typename Dataset>
+		void prepare_inputs(const Dataset &) { }
+
+		void prepare_inputs(const SparseDataframe<double> & dataset) {
+			// resolves the schema before the threads read the cached input map concurrently
+			sparse_input_neurons(dataset.get_schema());
 		}
 
-		static double apply_bias(const double x, const double bias) {
-			return x + bias;
+		template <typename Dataset>
+		void forward_batch(const Dataset & dataset, const unsigned first_row, const unsigned rows, Workspace & workspace) const {
+			Matrix<double> & inputs = workspace.layers[0];
+			for (unsigned row = 0; row < rows; row++) {
+				const auto features = feature_row(dataset, first_row + row);
+				assert(features.size() == inputs.get_shape().cols);
+
+				for (unsigned i = 0; i < features.size(); i++) {
+					inputs(row, i) = features[i];
+				}
+			}
+
+			propagate_batch(rows, 0, workspace);
+		}
+
+		void forward_batch(const SparseDataframe<double> & dataset, const unsigned first_row, const unsigned rows, Workspace & workspace) const {
+			// the input layer is left untouched, as in compute_forward_pass(const SparseRowView<double> &); the input map
+			// was resolved by prepare_inputs
+			Matrix<double> & first_layer = workspace.layers[1];
+			for (unsigned row = 0; row < rows; row++) {
+				sparse_first_layer(dataset.get_row_view(first_row + row), sparse_input_map, first_layer.data() + row * first_layer.get_pitch());
+			}
+			activate_rows(first_layer, 1, rows);
+
+			propagate_batch(rows, 1, workspace);
+		}
+
+		void propagate_batch(const unsigned rows, const unsigned first_source_layer, Workspace & workspace) const {
+			for (unsigned i = first_source_layer; i < layers.size() - 1; i++) {
+				dense_layer_forward(batch_rows(workspace.layers[i], rows), connections[i].view(), biases[i], layer_activation(i + 1), batch_rows(workspace.layers[i + 1], rows));
+			}
+		}
+
+		template <typename Dataset>
+		void update_batch_input_connections(const Dataset &, const unsigned, const unsigned, const unsigned, const double step) {
+			// the reduced connection gradients of the input layer are in the first workspace
+			connections[0].axpy(step, workspaces[0].connection_gradients[0]);
+		}
+
+		void update_batch_input_connections(const SparseDataframe<double> & dataset, const unsigned first_row, const unsigned rows, const unsigned shards, const double step) {
+			// only the connections of the nonzero inputs change, row by row, in the order of the rows
+			for (unsigned shard = 0; shard < shards; shard++) {
+				const Matrix<double> & layer_gradients = workspaces[shard].gradients[0];
+				const unsigned begin = shard_begin(rows, shard, shards);
+				const unsigned end = shard_begin(rows, shard + 1, shards);
+
+				for (unsigned row = begin; row < end; row++) {
+					update_sparse_input_connections(dataset.get_row_view(first_row + row), step, layer_gradients.data() + (row - begin) * layer_gradients.get_pitch());
+				}
+			}
+		}
+
+		// MARK: Optimization
+
+		// The connection updates above climb along (target - output), the opposite of the gradient of the loss. With a
+		// stateful optimizer, the gradient of every connection matrix of a step is materialized in
+		// optimizer_gradients, negated, and handed to the optimizer row by row. The connection matrices take
+		// consecutive slots of the optimizer, row after row
+
+		void prepare_optimizer() {
+			// sizes the optimizer for the current topology, keeping its state if the topology is unchanged
+			optimizer_offsets.clear();
+			std::size_t slots = 0;
+			for (const Matrix<double> & weights : connections) {
+				optimizer_offsets.push_back(slots);
+				slots += static_cast<std::size_t>(weights.get_shape().rows) * weights.get_shape().cols;
+			}
+			if (optimizer.size() != slots) {
+				optimizer.reset(slots);
+			}
+
+			if (!optimizer.is_stateless() && optimizer_gradients.size() != connections.size()) {
+				optimizer_gradients.clear();
+				for (const Matrix<double> & weights : connections) {
+					optimizer_gradients.push_back(Matrix<double>(weights.get_shape().rows, weights.get_shape().cols));
+				}
+				input_touched.assign(connections.front().get_shape().rows, 0);
+			}
+		}
+
+		void optimize_row(const unsigned connection, const unsigned row, const double learning_rate) {
+			// one optimizer update of row <row> of connection matrix <connection> along its row of optimizer_gradients
+			Matrix<double> & weights = connections[connection];
+			const unsigned neurons = weights.get_shape().cols;
+			optimizer.update(optimizer_offsets[connection] + static_cast<std::size_t>(row) * neurons, weights.data() + row * weights.get_pitch(),
+				optimizer_gradients[connection].data() + row * optimizer_gradients[connection].get_pitch(), neurons, learning_rate);
+		}
+
+		void optimize_connection(const unsigned connection, const double learning_rate) {
+			for (unsigned row = 0; row < connections[connection].get_shape().rows; row++) {
+				optimize_row(connection, row, learning_rate);
+			}
+		}
+
+		template <typename Row>
+		void optimize_connections(const Row & feature_row, const double learning_rate) {
+			// back_propagation step 3 with the optimizer: gradient of connection i = -(layer i)^T * (gradients of i + 1)
+			optimizer.next_step();
+			optimize_input_connections(feature_row, learning_rate);
+			for (unsigned hid_layer = 1; hid_layer < connections.size(); hid_layer++) {
+				Learnoran::gemm(-1.0, layers[hid_layer].view().transpose(), gradients[hid_layer].view(), 0.0, optimizer_gradients[hid_layer].view());
+				optimize_connection(hid_layer, learning_rate);
+			}
+		}
+
+		template <typename Row>
+		void optimize_input_connections(const Row &, const double learning_rate) {
+			Learnoran::gemm(-1.0, layers[0].view().transpose(), gradients[0].view(), 0.0, optimizer_gradients[0].view());
+			optimize_connection(0, learning_rate);
+		}
+
+		void optimize_input_connections(const SparseRowView<double> & inputs, const double learning_rate) {
+			accumulate_sparse_input_gradients(inputs, -1.0, gradients[0].data());
+			optimize_sparse_input_connections(learning_rate);
+		}
+
+		void accumulate_sparse_input_gradients(const SparseRowView<double> & inputs, const double scale, const double * const layer_gradients) {
+			// adds scale * input * layer_gradients to the optimizer_gradients row of every nonzero input, and marks the row
+			const std::vector<std::size_t> & input_neurons = sparse_input_neurons(inputs.get_schema());
+			Matrix<double> & input_gradients = optimizer_gradients[0];
+			const unsigned neurons = input_gradients.get_shape().cols;
+
+			for (std::size_t nonzero = 0; nonzero < inputs.nonzeros(); nonzero++) {
+				const std::size_t neuron = input_neurons[inputs.index(nonzero)];
+				if (neuron == NOT_AN_INPUT) {
+					continue;
+				}
+				if (!input_touched[neuron]) {
+					input_touched[neuron] = 1;
+					touched_inputs.push_back(static_cast<unsigned>(neuron));
+				}
+
+				const double factor = scale * inputs.value(nonzero);
+				double * const row_gradients = input_gradients.data() + neuron * input_gradients.get_pitch();
+				for (unsigned dest_neuron = 0; dest_neuron < neurons; dest_neuron++) {
+					row_gradients[dest_neuron] += factor * layer_gradients[dest_neuron];
+				}
+			}
+		}
+
+		void optimize_sparse_input_connections(const double learning_rate) {
+			// updates the rows marked by accumulate_sparse_input_gradients only, then clears them for the next step; the
+			// other rows keep their optimizer state, as their gradient is zero
+			Matrix<double> & input_gradients = optimizer_gradients[0];
+			for (const unsigned neuron : touched_inputs) {
+				optimize_row(0, neuron, learning_rate);
+
+				double * const row_gradients = input_gradients.data() + neuron * input_gradients.get_pitch();
+				std::fill(row_gradients, row_gradients + input_gradients.get_shape().cols, 0.0);
+				input_touched[neuron] = 0;
+			}
+			touched_inputs.clear();
+		}
+
+		template <typename Dataset>
+		void optimize_batch_connections(const Dataset & dataset, const unsigned first_row, const unsigned rows, const unsigned shards, const double learning_rate) {
+			// batch_back_propagation's update with the optimizer, along the mean gradient of the batch
+			optimizer.next_step();
+			const double scale = -1.0 / rows;
+			optimize_batch_input_connections(dataset, first_row, rows, shards, scale, learning_rate);
+			for (unsigned connection = 1; connection < connections.size(); connection++) {
+				optimizer_gradients[connection] = scale * workspaces[0].connection_gradients[connection];
+				optimize_connection(connection, learning_rate);
+			}
+		}
+
+		template <typename Dataset>
+		void optimize_batch_input_connections(const Dataset &, const unsigned, const unsigned, const unsigned, const double scale, const double learning_rate) {
+			optimizer_gradients[0] = scale * workspaces[0].connection_gradients[0];
+			optimize_connection(0, learning_rate);
+		}
+
+		void optimize_batch_input_connections(const SparseDataframe<double> & dataset, const unsigned first_row, const unsigned rows, const unsigned shards,
+			const double scale, const double learning_rate) {
+			for (unsigned shard = 0; shard < shards; shard++) {
+				const Matrix<double> & layer_gradients = workspaces[shard].gradients[0];
+				const unsigned begin = shard_begin(rows, shard, shards);
+				const unsigned end = shard_begin(rows, shard + 1, shards);
+
+				for (unsigned row = begin; row < end; row++) {
+					accumulate_sparse_input_gradients(dataset.get_row_view(first_row + row), scale, layer_gradients.data() + (row - begin) * layer_gradients.get_pitch());
+				}
+			}
+			optimize_sparse_input_connections(learning_rate);
 		}
 
 		// loss functions
@@ -256,6 +892,24 @@ namespace Learnoran {
 		std::vector<Matrix<double>> gradients;
 		std::vector<Matrix<double>> connections;
 		std::vector<std::string> input_layer_symbols;
+		SchemaBinding input_binding; // resolves input_layer_symbols against the schema of RowViews passed to predict
+		std::vector<std::size_t> sparse_input_map; // see sparse_input_neurons
+		std::size_t sparse_input_schema; // id of the schema sparse_input_map was resolved against, 0 if none
+		static const std::size_t NOT_AN_INPUT = static_cast<std::size_t>(-1);
+		ActivationAccuracy activation_accuracy;
+		GemmElementwise hidden_activation; // the sigmoid kernel of activation_accuracy
+		GemmElementwise hidden_derivative; // and that of its derivative
+
+		unsigned batch_size;
+		std::vector<Workspace> workspaces; // one per thread, see batch_back_propagation
+
+		Philox4x32 generator; // draws the parameters of new layers
+
+		Optimizer optimizer;
+		std::vector<std::size_t> optimizer_offsets; // the first slot of every connection matrix
+		std::vector<Matrix<double>> optimizer_gradients; // of every connection matrix, for stateful optimizers
+		std::vector<unsigned char> input_touched; // the input neurons with a row in touched_inputs
+		std::vector<unsigned> touched_inputs; // the rows of optimizer_gradients[0] accumulated since the last sparse update
 
 		std::ostream & info_stream;
 		const bool descriptive_info_output;
@@ -0,0 +1,296 @@
+#ifndef _OPTIMIZER_HPP
+#define _OPTIMIZER_HPP
+
+#include <cstddef>
+#include <cmath>
+#include <cassert>
+
+#include "aligned_buffer.hpp"
+#include "cpu_dispatch.hpp"
+
+/*
+Gradient based update rules shared by the predictors: plain gradient descent, momentum, Nesterov momentum, RMSProp and
+Adam. A model lays its parameters out as slots [0, parameters) and hands the optimizer the gradient of a contiguous
+run of them at a time; the state of every slot (velocity, moment estimates) lives in cache line aligned arrays indexed
+by slot, so each update is one pass over a few contiguous arrays.
+
+The kernels are plain loops without dependencies between iterations, which the compiler vectorizes. The square root of
+RMSProp and Adam keeps compilers from doing so (std::sqrt may set errno), so those two have AVX2 and AVX-512 kernels
+picked at run time. They use no fused multiply-adds and IEEE division and square roots are correctly rounded, so every
+kernel gives the same result bit for bit.
+*/
+
+namespace Learnoran {
+	enum class OptimizerMethod {
+		sgd, // p -= rate * g
+		momentum, // v = momentum * v + g; p -= rate * v
+		nesterov, // v = momentum * v + g; p -= rate * (g + momentum * v)
+		rmsprop, // s = decay * s + (1 - decay) * g^2; p -= rate * g / (sqrt(s) + epsilon)
+		adam // m and v as RMSProp's s for g and g^2, bias corrected; p -= rate * m' / (sqrt(v') + epsilon)
+	};
+
+	// MARK: Kernels
+
+	inline void sgd_update(double * parameters, const double * gradients, const std::size_t count, const double rate) {
+		for (std::size_t i = 0; i < count; i++) {
+			parameters[i] -= rate * gradients[i];
+		}
+	}
+
+	inline void momentum_update(double * parameters, const double * gradients, double * velocity, const std::size_t count, const double rate, const double momentum) {
+		for (std::size_t i = 0; i < count; i++) {
+			const double step = momentum * velocity[i] + gradients[i];
+			velocity[i] = step;
+			parameters[i] -= rate * step;
+		}
+	}
+
+	inline void nesterov_update(double * parameters, const double * gradients, double * velocity, const std::size_t count, const double rate, const double momentum) {
+		// the look-ahead form, which needs the gradient at the current parameters only
+		for (std::size_t i = 0; i < count; i++) {
+			const double step = momentum * velocity[i] + gradients[i];
+			velocity[i] = step;
+			parameters[i] -= rate * (gradients[i] + momentum * step);
+		}
+	}
+
+	inline void rmsprop_update_generic(double * parameters, const double * gradients, double * mean_square, const std::size_t count, const double rate,
+		const double decay, const double epsilon) {
+		for (std::size_t i = 0; i < count; i++) {
+			const double gradient = gradients[i];
+			const double average = decay * mean_square[i] + (1.0 - decay) * gradient * gradient;
+			mean_square[i] = average;
+			parameters[i] -= rate * gradient / (std::sqrt(average) + epsilon);
+		}
+	}
+
+	inline void adam_update_generic(double * parameters, const double * gradients, double * mean, double * mean_square, const std::size_t count, const double rate,
+		const double beta1, const double beta2, const double epsilon, const double mean_correction, const double mean_square_correction) {
+		// Args:
+		// - mean_correction, mean_square_correction: 1 / (1 - beta^t) for the current step t, which remove the bias of
+		// the moment estimates towards their zero initial values
+		for (std::size_t i = 0; i < count; i++) {
+			const double gradient = gradients[i];
+			const double first = beta1 * mean[i] + (1.0 - beta1) * gradient;
+			const double second = beta2 * mean_square[i] + (1.0 - beta2) * gradient * gradient;
+			mean[i] = first;
+			mean_square[i] = second;
+			parameters[i] -= rate * (first * mean_correction) / (std::sqrt(second * mean_square_correction) + epsilon);
+		}
+	}
+
+#ifdef LEARNORAN_X86
+	LEARNORAN_TARGET("avx2")
+	inline void rmsprop_update_avx2(double * parameters, const double * gradients, double * mean_square, const std::size_t count, const double rate,
+		const double decay, const double epsilon) {
+		const __m256d rate_vector = _mm256_set1_pd(rate), decay_vector = _mm256_set1_pd(decay), complement = _mm256_set1_pd(1.0 - decay);
+		const __m256d epsilon_vector = _mm256_set1_pd(epsilon);
+		std::size_t i = 0;
+		for (; i + 4 <= count; i += 4) {
+			const __m256d gradient = _mm256_loadu_pd(gradients + i);
+			const __m256d average = _mm256_add_pd(_mm256_mul_pd(decay_vector, _mm256_loadu_pd(mean_square + i)), _mm256_mul_pd(_mm256_mul_pd(complement, gradient), gradient));
+			_mm256_storeu_pd(mean_square + i, average);
+			const __m256d step = _mm256_div_pd(_mm256_mul_pd(rate_vector, gradient), _mm256_add_pd(_mm256_sqrt_pd(average), epsilon_vector));
+			_mm256_storeu_pd(parameters + i, _mm256_sub_pd(_mm256_loadu_pd(parameters + i), step));
+		}
+		rmsprop_update_generic(parameters + i, gradients + i, mean_square + i, count - i, rate, decay, epsilon);
+	}
+
+	LEARNORAN_TARGET("avx2")
+	inline void adam_update_avx2(double * parameters, const double * gradients, double * mean, double * mean_square, const std::size_t count, const double rate,
+		const double beta1, const double beta2, const double epsilon, const double mean_correction, const double mean_square_correction) {
+		const __m256d rate_vector = _mm256_set1_pd(rate), epsilon_vector = _mm256_set1_pd(epsilon);
+		const __m256d beta1_vector = _mm256_set1_pd(beta1), beta1_complement = _mm256_set1_pd(1.0 - beta1);
+		const __m256d beta2_vector = _mm256_set1_pd(beta2), beta2_complement = _mm256_set1_pd(1.0 - beta2);
+		const __m256d mean_factor = _mm256_set1_pd(mean_correction), mean_square_factor = _mm256_set1_pd(mean_square_correction);
+		std::size_t i = 0;
+		for (; i + 4 <= count; i += 4) {
+			const __m256d gradient = _mm256_loadu_pd(gradients + i);
+			const __m256d first = _mm256_add_pd(_mm256_mul_pd(beta1_vector, _mm256_loadu_pd(mean + i)), _mm256_mul_pd(beta1_complement, gradient));
+			const __m256d second = _mm256_add_pd(_mm256_mul_pd(beta2_vector, _mm256_loadu_pd(mean_square + i)), _mm256_mul_pd(_mm256_mul_pd(beta2_complement, gradient), gradient));
+			_mm256_storeu_pd(mean + i, first);
+			_mm256_storeu_pd(mean_square + i, second);
+			const __m256d numerator = _mm256_mul_pd(rate_vector, _mm256_mul_pd(first, mean_factor));
+			const __m256d denominator = _mm256_add_pd(_mm256_sqrt_pd(_mm256_mul_pd(second, mean_square_factor)), epsilon_vector);
+			_mm256_storeu_pd(parameters + i, _mm256_sub_pd(_mm256_loadu_pd(parameters + i), _mm256_div_pd(numerator, denominator)));
+		}
+		adam_update_generic(parameters + i, gradients + i, mean + i, mean_square + i, count - i, rate, beta1, beta2, epsilon, mean_correction, mean_square_correction);
+	}
+
+	LEARNORAN_TARGET("avx512f")
+	inline void rmsprop_update_avx512(double * parameters, const double * gradients, double * mean_square, const std::size_t count, const double rate,
+		const double decay, const double epsilon) {
+		const __m512d rate_vector = _mm512_set1_pd(rate), decay_vector = _mm512_set1_pd(decay), complement = _mm512_set1_pd(1.0 - decay);
+		const __m512d epsilon_vector = _mm512_set1_pd(epsilon);
+		std::size_t i = 0;
+		for (; i + 8 <= count; i += 8) {
+			const __m512d gradient = _mm512_loadu_pd(gradients + i);
+			const __m512d average = _mm512_add_pd(_mm512_mul_pd(decay_vector, _mm512_loadu_pd(mean_square + i)), _mm512_mul_pd(_mm512_mul_pd(complement, gradient), gradient));
+			_mm512_storeu_pd(mean_square + i, average);
+			const __m512d step = _mm512_div_pd(_mm512_mul_pd(rate_vector, gradient), _mm512_add_pd(_mm512_sqrt_pd(average), epsilon_vector));
+			_mm512_storeu_pd(parameters + i, _mm512_sub_pd(_mm512_loadu_pd(parameters + i), step));
+		}
+		rmsprop_update_generic(parameters + i, gradients + i, mean_square + i, count - i, rate, decay, epsilon);
+	}
+
+	LEARNORAN_TARGET("avx512f")
+	inline void adam_update_avx512(double * parameters, const double * gradients, double * mean, double * mean_square, const std::size_t count, const double rate,
+		const double beta1, const double beta2, const double epsilon, const double mean_correction, const double mean_square_correction) {
+		const __m512d rate_vector = _mm512_set1_pd(rate), epsilon_vector = _mm512_set1_pd(epsilon);
+		const __m512d beta1_vector = _mm512_set1_pd(beta1), beta1_complement = _mm512_set1_pd(1.0 - beta1);
+		const __m512d beta2_vector = _mm512_set1_pd(beta2), beta2_complement = _mm512_set1_pd(1.0 - beta2);
+		const __m512d mean_factor = _mm512_set1_pd(mean_correction), mean_square_factor = _mm512_set1_pd(mean_square_correction);
+		std::size_t i = 0;
+		for (; i + 8 <= count; i += 8) {
+			const __m512d gradient = _mm512_loadu_pd(gradients + i);
+			const __m512d first = _mm512_add_pd(_mm512_mul_pd(beta1_vector, _mm512_loadu_pd(mean + i)), _mm512_mul_pd(beta1_complement, gradient));
+			const __m512d second = _mm512_add_pd(_mm512_mul_pd(beta2_vector, _mm512_loadu_pd(mean_square + i)), _mm512_mul_pd(_mm512_mul_pd(beta2_complement, gradient), gradient));
+			_mm512_storeu_pd(mean + i, first);
+			_mm512_storeu_pd(mean_square + i, second);
+			const __m512d numerator = _mm512_mul_pd(rate_vector, _mm512_mul_pd(first, mean_factor));
+			const __m512d denominator = _mm512_add_pd(_mm512_sqrt_pd(_mm512_mul_pd(second, mean_square_factor)), epsilon_vector);
+			_mm512_storeu_pd(parameters + i, _mm512_sub_pd(_mm512_loadu_pd(parameters + i), _mm512_div_pd(numerator, denominator)));
+		}
+		adam_update_generic(parameters + i, gradients + i, mean + i, mean_square + i, count - i, rate, beta1, beta2, epsilon, mean_correction, mean_square_correction);
+	}
+#endif
+
+	inline void rmsprop_update(double * parameters, const double * gradients, double * mean_square, const std::size_t count, const double rate, const double decay,
+		const double epsilon) {
+#ifdef LEARNORAN_X86
+		if (cpu_features().avx512) {
+			rmsprop_update_avx512(parameters, gradients, mean_square, count, rate, decay, epsilon);
+			return;
+		}
+		if (cpu_features().avx2) {
+			rmsprop_update_avx2(parameters, gradients, mean_square, count, rate, decay, epsilon);
+			return;
+		}
+#endif
+		rmsprop_update_generic(parameters, gradients, mean_square, count, rate, decay, epsilon);
+	}
+
+	inline void adam_update(double * parameters, const double * gradients, double * mean, double * mean_square, const std::size_t count, const double rate,
+		const double beta1, const double beta2, const double epsilon, const double mean_correction, const double mean_square_correction) {
+#ifdef LEARNORAN_X86
+		if (cpu_features().avx512) {
+			adam_update_avx512(parameters, gradients, mean, mean_square, count, rate, beta1, beta2, epsilon, mean_correction, mean_square_correction);
+			return;
+		}
+		if (cpu_features().avx2) {
+			adam_update_avx2(parameters, gradients, mean, mean_square, count, rate, beta1, beta2, epsilon, mean_correction, mean_square_correction);
+			return;
+		}
+#endif
+		adam_update_generic(parameters, gradients, mean, mean_square, count, rate, beta1, beta2, epsilon, mean_correction, mean_square_correction);
+	}
+
+	// MARK: Optimizer
+
+	class Optimizer {
+		// An update rule with its hyperparameters and the state of every parameter slot. The learning rate is not part
+		// of it: fit passes its own to every update. Each step of training calls next_step once, then update for every
+		// run of parameters with a gradient in that step; slots left out of a step keep their state unchanged, e.g. the
+		// connections of the zero inputs of a sparse row
+	public:
+		Optimizer() : method(OptimizerMethod::sgd), decay(0.0), beta2(0.0), epsilon(0.0), parameters(0), steps(0), mean_correction(1.0), mean_square_correction(1.0) { }
+
+		static Optimizer sgd() {
+			// plain gradient descent, the default of every predictor
+			return Optimizer();
+		}
+
+		static Optimizer momentum(const double momentum = 0.9) {
+			return Optimizer(OptimizerMethod::momentum, momentum, 0.0, 0.0);
+		}
+
+		static Optimizer nesterov(const double momentum = 0.9) {
+			return Optimizer(OptimizerMethod::nesterov, momentum, 0.0, 0.0);
+		}
+
+		static Optimizer rmsprop(const double decay = 0.9, const double epsilon = 1e-8) {
+			return Optimizer(OptimizerMethod::rmsprop, decay, 0.0, epsilon);
+		}
+
+		static Optimizer adam(const double beta1 = 0.9, const double beta2 = 0.999, const double epsilon = 1e-8) {
+			return Optimizer(OptimizerMethod::adam, beta1, beta2, epsilon);
+		}
+
+		OptimizerMethod get_method() const {
+			return method;
+		}
+
+		bool is_stateless() const {
+			// plain gradient descent needs neither state nor the gradients themselves, so models may keep applying
+			// it in place, e.g. as a scaled GEMM into the weights
+			return method == OptimizerMethod::sgd;
+		}
+
+		std::size_t size() const {
+			// Returns:
+			//   the number of parameter slots the state was last reset for
+			return parameters;
+		}
+
+		void reset(const std::size_t parameters) {
+			// zeroes the state of <parameters> slots and restarts the step count
+			this->parameters = parameters;
+			const std::size_t state_arrays = method == OptimizerMethod::sgd ? 0 : method == OptimizerMethod::adam ? 2 : 1;
+			first_state = AlignedBuffer<double>(state_arrays > 0 ? parameters : 0, 0.0);
+			second_state = AlignedBuffer<double>(state_arrays > 1 ? parameters : 0, 0.0);
+			steps = 0;
+			mean_correction = mean_square_correction = 1.0;
+		}
+
+		void next_step() {
+			steps++;
+			if (method == OptimizerMethod::adam) {
+				mean_correction = 1.0 / (1.0 - std::pow(decay, static_cast<double>(steps)));
+				mean_square_correction = 1.0 / (1.0 - std::pow(beta2, static_cast<double>(steps)));
+			}
+		}
+
+		void update(const std::size_t first_slot, double * values, const double * gradients, const std::size_t count, const double rate) {
+			// values -= the step of the method for the gradient of the loss <gradients>
+			// Args:
+			// - first_slot: the slot of values[0]; values[i] is slot first_slot + i
+			// - values, gradients: <count> parameters and their gradients, which may not overlap
+			// - rate: the learning rate
+			assert(first_slot + count <= parameters);
+			switch (method) {
+			case OptimizerMethod::sgd:
+				sgd_update(values, gradients, count, rate);
+				break;
+			case OptimizerMethod::momentum:
+				momentum_update(values, gradients, first_state.data() + first_slot, count, rate, decay);
+				break;
+			case OptimizerMethod::nesterov:
+				nesterov_update(values, gradients, first_state.data() + first_slot, count, rate, decay);
+				break;
+			case OptimizerMethod::rmsprop:
+				rmsprop_update(values, gradients, first_state.data() + first_slot, count, rate, decay, epsilon);
+				break;
+			case OptimizerMethod::adam:
+				adam_update(values, gradients, first_state.data() + first_slot, second_state.data() + first_slot, count, rate, decay, beta2, epsilon,
+					mean_correction, mean_square_correction);
+				break;
+			}
+		}
+	private:
+		Optimizer(const OptimizerMethod method, const double decay, const double beta2, const double epsilon)
+			: method(method), decay(decay), beta2(beta2), epsilon(epsilon), parameters(0), steps(0), mean_correction(1.0), mean_square_correction(1.0) { }
+
+		OptimizerMethod method;
+		double decay; // the momentum, the decay of RMSProp or beta1 of Adam
+		double beta2;
+		double epsilon;
+
+		std::size_t parameters;
+		AlignedBuffer<double> first_state; // the velocity, the mean square of RMSProp or the mean of Adam, per slot
+		AlignedBuffer<double> second_state; // the mean square of Adam
+		unsigned long long steps;
+		double mean_correction, mean_square_correction; // of Adam for the current step
+	};
+}
+
+#endif
@@ -1,8 +1,6 @@
 #ifndef _POLYNOMIAL_HPP
 #define _POLYNOMIAL_HPP
 
-#define _DEBUG
-
 #include <string>
 #include <algorithm>
 #include <vector>
@@ -10,10 +8,12 @@
 #include <unordered_set>
 #include <cmath>
 #include <ostream>
+#include <cassert>
 
 #include "lo_exception.hpp"
 #include "encrypted_number.hpp"
 #include "decryption_manager.hpp"
+#include "trace_policy.hpp"
 
 namespace Learnoran {
 	template <typename T>
@@ -46,7 +46,235 @@ namespace Learnoran {
 		}
 	};
 
+	inline double raise_power(double base, unsigned exponent) {
+		// square-and-multiply, avoids std::pow for the small integral exponents polynomials use
+		double result = 1.0;
+		while (exponent > 0) {
+			if (exponent & 1U) {
+				result *= base;
+			}
+			base *= base;
+			exponent >>= 1;
+		}
+		return result;
+	}
+
+	inline EncryptedNumber raise_power(const EncryptedNumber & base, const unsigned exponent) {
+		return pow(base, exponent);
+	}
+
 	template <typename T>
+	class CompiledPolynomial {
+		// Evaluation form of a Polynomial whose variable symbols are resolved to column indices of a schema.
+		// Terms live in flat arrays sorted by exponent and column; each ExponentGroup covers a contiguous run
+		// of terms sharing the same exponent so that the common exponent-1 group is a plain multiply-add loop
+	public:
+		struct ExponentGroup {
+			ExponentGroup(unsigned exponent, std::size_t begin, std::size_t end) : exponent(exponent), begin(begin), end(end) { }
+
+			unsigned exponent;
+			std::size_t begin;
+			std::size_t end;
+		};
+
+		CompiledPolynomial() : column_term_offsets(1, 0), has_constant_term(false), schema_size(0) { }
+
+		CompiledPolynomial(std::vector<std::size_t> columns, std::vector<T> coefficients, std::vector<ExponentGroup> groups, const std::size_t schema_size)
+			: columns(columns), coefficients(coefficients), groups(groups), has_constant_term(false), schema_size(schema_size) {
+			index_terms_by_column();
+		}
+
+		void set_constant_term(const T & constant_term) {
+			this->constant_term = constant_term;
+			this->has_constant_term = true;
+		}
+
+		template <typename Row>
+		T operator()(const Row & row, const T & zero) const {
+			// Args:
+			// - row: values laid out in schema order; any type indexable by column, e.g. a pointer to the first value
+			//   of a contiguous row or a RowView
+			// - zero: additive identity of T, used when the polynomial has no constant term
+			// Returns:
+			//   the polynomial evaluated at the given row
+			NoTrace no_trace;
+			return (*this)(row, zero, no_trace, static_cast<const DecryptionManager *>(nullptr));
+		}
+
+		template <typename Row, typename Tracer, typename NoiseOracle>
+		T operator()(const Row & row, const T & zero, Tracer & tracer, const NoiseOracle * noise_oracle) const {
+			// Same as above, reporting every evaluated term to <tracer>; see trace_policy.hpp
+			T result = has_constant_term ? constant_term : zero;
+
+			for (const ExponentGroup & group : groups) {
+				if (group.exponent == 0) {
+					for (std::size_t term = group.begin; term < group.end; term++) {
+						const typename Tracer::TimePoint term_start = Tracer::now();
+						result += coefficients[term];
+						tracer.record_term(term, term_start, result, noise_oracle);
+					}
+				}
+				else if (group.exponent == 1) {
+					for (std::size_t term = group.begin; term < group.end; term++) {
+						const typename Tracer::TimePoint term_start = Tracer::now();
+						result += coefficients[term] * row[columns[term]];
+						tracer.record_term(term, term_start, result, noise_oracle);
+					}
+				}
+				else {
+					for (std::size_t term = group.begin; term < group.end; term++) {
+						const typename Tracer::TimePoint term_start = Tracer::now();
+						result += coefficients[term] * raise_power(row[columns[term]], group.exponent);
+						tracer.record_term(term, term_start, result, noise_oracle);
+					}
+				}
+			}
+
+			return result;
+		}
+
+		T operator()(const T * row) const {
+			// only usable with arithmetic types for which T(0) is the additive identity
+			return (*this)(row, T(0));
+		}
+
+		T operator()(const std::vector<T> & row) const {
+			assert(row.size() >= schema_size);
+			return (*this)(row.data());
+		}
+
+		void evaluate_batch(const T * rows, const std::size_t row_count, const std::size_t row_stride, T * output) const {
+			// Evaluates row_count rows stored back to back, row_stride elements apart, into output[0..row_count)
+#ifndef _SEQUENTIAL
+#pragma omp parallel for
+#endif
+			for (long long row = 0; row < static_cast<long long>(row_count); row++) {
+				output[row] = (*this)(rows + row * row_stride);
+			}
+		}
+
+		std::vector<T> evaluate_batch(const std::vector<std::vector<T>> & rows) const {
+			std::vector<T> output(rows.size());
+
+#ifndef _SEQUENTIAL
+#pragma omp parallel for
+#endif
+			for (long long row = 0; row < static_cast<long long>(rows.size()); row++) {
+				output[row] = (*this)(rows[row]);
+			}
+
+			return output;
+		}
+
+		void evaluate_columns(const T * columns_base, const std::size_t pitch, const std::size_t row_count, T * output) const {
+			// Evaluates row_count rows of a column-major block in which column j starts at columns_base + j * pitch.
+			// The loops run term by term over whole columns so that every inner loop streams contiguous memory
+			std::fill(output, output + row_count, has_constant_term ? constant_term : T(0));
+
+			for (const ExponentGroup & group : groups) {
+				for (std::size_t term = group.begin; term < group.end; term++) {
+					const T coefficient = coefficients[term];
+					const T * column = columns_base + columns[term] * pitch;
+
+					if (group.exponent == 0) {
+						for (std::size_t row = 0; row < row_count; row++) {
+							output[row] += coefficient;
+						}
+					}
+					else if (group.exponent == 1) {
+						for (std::size_t row = 0; row < row_count; row++) {
+							output[row] += coefficient * column[row];
+						}
+					}
+					else {
+						for (std::size_t row = 0; row < row_count; row++) {
+							output[row] += coefficient * raise_power(column[row], group.exponent);
+						}
+					}
+				}
+			}
+		}
+
+		template <typename SparseRow>
+		T evaluate_sparse(const SparseRow & row, const T & zero) const {
+			// Args:
+			// - row: the nonzeros of a row in schema order, e.g. a SparseRowView or a SparseVectorView
+			// - zero: additive identity of T, used when the polynomial has no constant term
+			// Returns:
+			//   the polynomial evaluated at the row; a term over a zero column vanishes, so only the terms of the
+			//   nonzero columns are visited and the cost is proportional to the nonzeros of the row
+			T result = has_constant_term ? constant_term : zero;
+
+			for (const ExponentGroup & group : groups) {
+				if (group.exponent == 0) {
+					for (std::size_t term = group.begin; term < group.end; term++) {
+						result += coefficients[term];
+					}
+				}
+			}
+
+			for (std::size_t nonzero = 0; nonzero < row.nonzeros(); nonzero++) {
+				const std::size_t column = row.index(nonzero);
+				assert(column < schema_size);
+
+				for (std::size_t entry = column_term_offsets[column]; entry < column_term_offsets[column + 1]; entry++) {
+					const std::size_t term = column_terms[entry];
+					const unsigned exponent = term_exponents[term];
+					result += coefficients[term] * (exponent == 1 ? row.value(nonzero) : raise_power(row.value(nonzero), exponent));
+				}
+			}
+
+			return result;
+		}
+
+		const std::vector<ExponentGroup> & get_groups() const {
+			return groups;
+		}
+
+		std::size_t get_schema_size() const {
+			return schema_size;
+		}
+	private:
+		void index_terms_by_column() {
+			// column_terms[column_term_offsets[c] .. column_term_offsets[c + 1]) lists the terms over column c with a
+			// nonzero exponent, for evaluate_sparse
+			term_exponents.assign(columns.size(), 0);
+			column_term_offsets.assign(schema_size + 1, 0);
+			for (const ExponentGroup & group : groups) {
+				for (std::size_t term = group.begin; term < group.end; term++) {
+					term_exponents[term] = group.exponent;
+					if (group.exponent != 0) {
+						column_term_offsets[columns[term] + 1]++;
+					}
+				}
+			}
+			for (std::size_t column = 0; column < schema_size; column++) {
+				column_term_offsets[column + 1] += column_term_offsets[column];
+			}
+
+			column_terms.resize(column_term_offsets[schema_size]);
+			std::vector<std::size_t> next(column_term_offsets.begin(), column_term_offsets.end() - 1);
+			for (std::size_t term = 0; term < columns.size(); term++) {
+				if (term_exponents[term] != 0) {
+					column_terms[next[columns[term]]++] = term;
+				}
+			}
+		}
+
+		std::vector<std::size_t> columns;
+		std::vector<T> coefficients;
+		std::vector<ExponentGroup> groups;
+
+		std::vector<unsigned> term_exponents;
+		std::vector<std::size_t> column_term_offsets;
+		std::vector<std::size_t> column_terms;
+
+		T constant_term;
+		bool has_constant_term;
+		std::size_t schema_size;
+	};
+
+	template <typename T, typename TracePolicy = DefaultPolynomialTrace>
 	class Polynomial {
 	public:
 		Polynomial() {}
@@ -87,10 +315,11 @@ namespace Learnoran {
 			return find_result->second.coefficient;
 		}
 
-		// below function is template-specialized for EncryptedNumber type - DEBUG: DecryptionManager parameter added, delete afterwards
+		// below function is template-specialized for EncryptedNumber type
 		EncryptedNumber operator()(const std::unordered_map<std::string, T> & evaluation_parameters, const EncryptedNumber & encrypted_zero, const DecryptionManager * dec_man = nullptr) const {
 			// Args:
 			// - evaluation_parameters: a std::vector of pairs for which each pair is of the form <value, variable symbol>
+			// - dec_man: only consulted by tracing policies that record the noise budget, see trace_policy.hpp
 			// Returns:
 			//   the polynomial evaluated at given parameters
 			// Throws:
@@ -102,39 +331,15 @@ namespace Learnoran {
 
 			EncryptedNumber result = encrypted_zero;
 
-			int noise_budget = 0;
-			int mid_noise_budget = 0;
-			if (dec_man != nullptr) {
-				noise_budget = dec_man->get_noise_budget_bits(result);
-			}
+			std::size_t term_index = 0;
+			for (std::unordered_map<std::string, PolynomialTerm<EncryptedNumber>>::const_iterator term = terms.cbegin(); term != terms.cend(); term++, term_index++) {
+				const typename TracePolicy::TimePoint term_start = TracePolicy::now();
 
-#ifdef _DEBUG
-			bool decryption_manager_valid = dec_man != nullptr;
-			if (!decryption_manager_valid) {
-				std::cout << "Decryption interface not supplied to polynomial evaluation operator\nnoise budget calculations will not be supported!\n";
-			}
-			else {
-				std::cout << "initial noise budget for result ciphertext: " << noise_budget << std::endl;
-			}
-#endif
-
-			for (std::unordered_map<std::string, PolynomialTerm<EncryptedNumber>>::const_iterator term = terms.cbegin(); term != terms.cend(); term++) {
 				const EncryptedNumber & variable_value = evaluation_parameters.find(term->first)->second;
 				const EncryptedNumber power = pow(variable_value, term->second.exponent);
-				if (dec_man != nullptr) {
-					mid_noise_budget = dec_man->get_noise_budget_bits(power);
-					mid_noise_budget = dec_man->get_noise_budget_bits(term->second.coefficient);
-				}
 				result += term->second.coefficient * power;
-				
-				if (dec_man != nullptr) {
-					noise_budget = dec_man->get_noise_budget_bits(result);
-				}
-#ifdef _DEBUG
-				if (decryption_manager_valid) {
-					std::cout << "mid noise budget for result ciphertext: " << noise_budget << std::endl;
-				}
-#endif
+
+				tracer.record_term(term_index, term_start, result, dec_man);
 			}
 
 			// add the constant term
@@ -159,9 +364,14 @@ namespace Learnoran {
 			}
 
 			double result = 0.0;
-			for (std::unordered_map<std::string, PolynomialTerm<double>>::const_iterator term = terms.cbegin(); term != terms.cend(); term++) {
+			std::size_t term_index = 0;
+			for (std::unordered_map<std::string, PolynomialTerm<double>>::const_iterator term = terms.cbegin(); term != terms.cend(); term++, term_index++) {
+				const typename TracePolicy::TimePoint term_start = TracePolicy::now();
+
 				const double & variable_value = evaluation_parameters.find(term->first)->second;
 				result += std::pow(variable_value, term->second.exponent) * term->second.coefficient;
+
+				tracer.record_term(term_index, term_start);
 			}
 
 			// add the constant term
@@ -174,6 +384,64 @@ namespace Learnoran {
 
 		friend std::ostream & operator<<(std::ostream &, const Polynomial &);
 
+		CompiledPolynomial<T> compile(const std::vector<std::string> & schema) const {
+			// Resolves the variable symbols against an ordered schema once, so that the polynomial can be evaluated
+			// straight from contiguous rows instead of hashing a symbol per term per evaluation
+			// Args:
+			// - schema: variable symbols in the order their values appear within a row
+			// Returns:
+			//   a CompiledPolynomial evaluating this polynomial on rows laid out according to schema
+			// Throws:
+			// - MissingParametersException: if a non-constant term refers to a symbol absent from the schema
+			std::unordered_map<std::string, std::size_t> column_indices;
+			for (std::size_t column = 0; column < schema.size(); column++) {
+				column_indices.insert({ schema[column], column });
+			}
+
+			struct ResolvedTerm {
+				unsigned exponent;
+				std::size_t column;
+				const T * coefficient;
+			};
+
+			std::vector<ResolvedTerm> resolved;
+			resolved.reserve(terms.size());
+			for (typename std::unordered_map<std::string, PolynomialTerm<T>>::const_iterator term = terms.cbegin(); term != terms.cend(); term++) {
+				std::unordered_map<std::string, std::size_t>::const_iterator find_result = column_indices.find(term->first);
+				if (find_result == column_indices.cend() && term->second.exponent != 0) {
+					throw MissingParametersException();
+				}
+
+				const std::size_t column = find_result == column_indices.cend() ? 0 : find_result->second;
+				resolved.push_back({ term->second.exponent, column, &term->second.coefficient });
+			}
+
+			std::sort(resolved.begin(), resolved.end(), [](const ResolvedTerm & lhs, const ResolvedTerm & rhs) {
+				return lhs.exponent != rhs.exponent ? lhs.exponent < rhs.exponent : lhs.column < rhs.column;
+			});
+
+			std::vector<std::size_t> columns;
+			std::vector<T> coefficients;
+			std::vector<typename CompiledPolynomial<T>::ExponentGroup> groups;
+			columns.reserve(resolved.size());
+			coefficients.reserve(resolved.size());
+
+			for (std::size_t term = 0; term < resolved.size(); term++) {
+				if (groups.empty() || groups.back().exponent != resolved[term].exponent) {
+					groups.push_back(typename CompiledPolynomial<T>::ExponentGroup(resolved[term].exponent, term, term));
+				}
+				columns.push_back(resolved[term].column);
+				coefficients.push_back(*resolved[term].coefficient);
+				groups.back().end = term + 1;
+			}
+
+			CompiledPolynomial<T> compiled(columns, coefficients, groups, schema.size());
+			if (this->constant_term_symbol != "") {
+				compiled.set_constant_term(this->constant_term.second.coefficient);
+			}
+			return compiled;
+		}
+
 		// Accessor
 
 		Polynomial partial_derivative(const std::string & derivative_variable) const {
@@ -200,6 +468,16 @@ namespace Learnoran {
 			return constant_term;
 		}
 
+		const TracePolicy & get_tracer() const {
+			return tracer;
+		}
+
+		TracePolicy & get_tracer_sink() const {
+			// the tracer as a destination for evaluations performed on behalf of this polynomial, e.g. by the
+			// CompiledPolynomial obtained from compile()
+			return tracer;
+		}
+
 		std::string constant_term_symbol;
 	private:
 		template <typename K>
@@ -220,6 +498,9 @@ namespace Learnoran {
 
 		typename std::unordered_map<std::string, PolynomialTerm<T>> terms;
 		typename std::pair<std::string, PolynomialTerm<T>> constant_term;
+
+		// evaluation is const, recording into the trace is not part of the observable state
+		mutable TracePolicy tracer;
 	};
 
 	template <typename T>
@@ -0,0 +1,339 @@
+#ifndef _POLYNOMIAL_MODEL_HPP
+#define _POLYNOMIAL_MODEL_HPP
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <iostream> // std::cout, only for debug
+#include <algorithm>
+#include <memory>
+
+#ifndef _SEQUENTIAL
+#include <omp.h>
+#endif
+
+#include "predictor.hpp"
+#include "multivariate_polynomial.hpp"
+#include "dataframe.hpp"
+#include "encrypted_number.hpp"
+#include "encryption_manager.hpp"
+#include "lomf.hpp"
+
+namespace Learnoran {
+	class PolynomialModel : public Predictor {
+		// Polynomial regression over every monomial of the features up to a given degree, including cross terms.
+		// Training expands each row once through PolynomialFeatures; prediction uses the multivariate Horner form
+	public:
+		PolynomialModel(const unsigned degree = 2, std::shared_ptr<EncryptionManager> encryption_manager = nullptr, const bool interaction_only = false)
+			: polynomial_features(degree, interaction_only), encryption_manager(encryption_manager) { }
+
+		void encrypt_model(std::shared_ptr<EncryptionManager> encryption_manager) {
+			// encrypts the plaintext model to obtain an encrypted model
+			this->encryption_manager = encryption_manager;
+
+			encrypted_coefficients.clear();
+			for (const double coefficient : plaintext_coefficients) {
+				encrypted_coefficients.push_back(encryption_manager->encrypt(coefficient));
+			}
+			encrypted_zero = encryption_manager->encrypt(0.0);
+
+			encrypted_model = build_polynomial(encrypted_coefficients).compile_horner();
+		}
+
+		// MARK: FIT (i.e. training)
+
+		void fit(const Dataframe<double> & dataframe, const unsigned short epochs, const double learning_rate) override {
+			polynomial_features.fit(dataframe.get_feature_headers());
+			feature_binding.reset();
+			plaintext_coefficients.assign(polynomial_features.get_monomials().size() + 1, 0.0);
+
+			for (unsigned short epoch = 0; epoch < epochs; epoch++) {
+				mse_batch_gd(dataframe, learning_rate);
+				if (epoch % 10 == 0) {
+					plaintext_model = build_polynomial(plaintext_coefficients).compile_horner();
+					std::cout << "Epoch " << epoch << "/" << epochs << " - MSE for first 100 rows: " << compute_mean_square_error(dataframe, 100) << std::endl;
+				}
+			}
+
+			plaintext_model = build_polynomial(plaintext_coefficients).compile_horner();
+			std::cout << "Epoch " << epochs << "/" << epochs << " - MSE for first 100 rows: " << compute_mean_square_error(dataframe, 100) << std::endl;
+		}
+
+		void fit(const Dataframe<EncryptedNumber> & dataframe, const unsigned short epochs, const double learning_rate, const DecryptionManager * = nullptr) override {
+			// Throws:
+			// - MissingEncryptionManagerException: if the model was built without an encryption manager
+			if (!encryption_manager) {
+				throw MissingEncryptionManagerException();
+			}
+
+			polynomial_features.fit(dataframe.get_feature_headers());
+			feature_binding.reset();
+			encrypted_zero = encryption_manager->encrypt(0.0);
+			encrypted_coefficients.assign(polynomial_features.get_monomials().size() + 1, encrypted_zero);
+
+			for (unsigned short epoch = 0; epoch < epochs; epoch++) {
+				mse_batch_gd(dataframe, learning_rate);
+				std::cout << "epoch " << epoch + 1 << "/" << epochs << " completed" << std::endl;
+			}
+
+			encrypted_model = build_polynomial(encrypted_coefficients).compile_horner();
+		}
+
+		// MARK: PREDICTION
+
+		double predict(const std::unordered_map<std::string, double> & features) override {
+			const std::vector<double> row = order_features(features);
+			return plaintext_model(row.data());
+		}
+
+		EncryptedNumber predict(const std::unordered_map<std::string, EncryptedNumber> & features, const DecryptionManager * = nullptr) override {
+			const std::vector<EncryptedNumber> row = order_features(features);
+			return encrypted_model(row.data(), encrypted_zero);
+		}
+
+		double predict(const RowView<double> & features) override {
+			return plaintext_model(feature_binding.bind(features, polynomial_features.get_variable_symbols()), 0.0);
+		}
+
+		EncryptedNumber predict(const RowView<EncryptedNumber> & features, const DecryptionManager * = nullptr) override {
+			return encrypted_model(feature_binding.bind(features, polynomial_features.get_variable_symbols()), encrypted_zero);
+		}
+
+		// MARK: MODEL ACCURACY ASSESSMENT
+
+		double compute_mean_square_error(const Dataframe<double> & dataframe, const unsigned num_rows) override {
+			const unsigned total_rows = std::min(dataframe.shape().rows, num_rows);
+			double loss = 0.0;
+
+			for (unsigned row = 0; row < total_rows; row++) {
+				const RowView<double> features = feature_binding.bind(dataframe.get_row_view(row), polynomial_features.get_variable_symbols());
+				const double model_error = plaintext_model(features, 0.0) - dataframe.get_row_label(row);
+				loss += model_error * model_error;
+			}
+			loss *= 1.0 / total_rows;
+
+			return loss;
+		}
+
+		EncryptedNumber compute_mean_square_error(const Dataframe<EncryptedNumber> & dataframe, const unsigned num_rows) override {
+			const unsigned total_rows = std::min(dataframe.shape().rows, num_rows);
+			EncryptedNumber loss = encrypted_zero;
+
+			for (unsigned row = 0; row < total_rows; row++) {
+				const RowView<EncryptedNumber> features = feature_binding.bind(dataframe.get_row_view(row), polynomial_features.get_variable_symbols());
+				const EncryptedNumber model_error = encrypted_model(features, encrypted_zero) - dataframe.get_row_label(row);
+				loss += model_error * model_error;
+			}
+			loss *= 1.0 / total_rows;
+
+			return loss;
+		}
+
+		// MARK: PERSISTENCE
+
+		void save(const std::string & filename) const {
+			// Stores the model in the .lomf format, see lomf.hpp. The symbols are the variables, the parameters the
+			// degree and the interaction_only flag; the blocks are the coefficients of the plaintext and of the encrypted
+			// model in get_features().get_monomials() order, the bias last, for either model that is set
+			// Throws:
+			// - CannotOpenFileException: if the file cannot be created
+			LomfWriter writer(LomfModel::polynomial, polynomial_features.get_degree(), polynomial_features.is_interaction_only() ? 1 : 0);
+			writer.add_symbols(polynomial_features.get_variable_symbols());
+			if (!plaintext_coefficients.empty()) {
+				writer.add_block(LomfRole::coefficients, plaintext_coefficients);
+			}
+			if (!encrypted_coefficients.empty()) {
+				writer.add_block(LomfRole::encrypted_coefficients, encrypted_coefficients);
+			}
+			writer.write(filename);
+		}
+
+		void load(const std::string & filename) {
+			// Replaces the model with the one stored by save. Encrypted coefficients are only loaded by a model with an
+			// encryption manager, which must hold the keys they were encrypted under
+			// Throws:
+			// - CannotOpenFileException: if the file cannot be opened
+			// - InvalidFileFormatException: if the file is not a valid .lomf file of a polynomial model
+			// - MissingEncryptionManagerException: if the file holds only encrypted coefficients and the model has no
+			//   encryption manager to load them
+			const LomfFile file(filename);
+			if (file.get_model() != LomfModel::polynomial) {
+				throw InvalidFileFormatException();
+			}
+			if (!file.has(LomfRole::coefficients) && file.has(LomfRole::encrypted_coefficients) && !encryption_manager) {
+				throw MissingEncryptionManagerException();
+			}
+
+			polynomial_features = PolynomialFeatures(file.get_parameter(0), file.get_parameter(1) != 0);
+			polynomial_features.fit(file.get_symbols());
+			feature_binding.reset();
+			const std::size_t coefficient_count = polynomial_features.get_monomials().size() + 1;
+
+			plaintext_coefficients.clear();
+			if (file.has(LomfRole::coefficients)) {
+				plaintext_coefficients = file.vector(LomfRole::coefficients);
+				if (plaintext_coefficients.size() != coefficient_count) {
+					throw InvalidFileFormatException();
+				}
+				plaintext_model = build_polynomial(plaintext_coefficients).compile_horner();
+			}
+
+			encrypted_coefficients.clear();
+			if (file.has(LomfRole::encrypted_coefficients) && encryption_manager) {
+				encrypted_coefficients = file.ciphertexts(LomfRole::encrypted_coefficients, *encryption_manager);
+				if (encrypted_coefficients.size() != coefficient_count) {
+					throw InvalidFileFormatException();
+				}
+				encrypted_zero = encryption_manager->encrypt(0.0);
+				encrypted_model = build_polynomial(encrypted_coefficients).compile_horner();
+			}
+		}
+
+		// MARK: MODEL INSPECTION
+
+		MultivariatePolynomial<double> get_plaintext_polynomial() const {
+			return build_polynomial(plaintext_coefficients);
+		}
+
+		const PolynomialFeatures & get_features() const {
+			return polynomial_features;
+		}
+	private:
+		// MARK: POLYNOMIAL_MODEL MEMBERS
+
+		PolynomialFeatures polynomial_features;
+
+		// coefficient i belongs to monomial i of <polynomial_features>, the last coefficient is the bias
+		std::vector<double> plaintext_coefficients;
+		std::vector<EncryptedNumber> encrypted_coefficients;
+
+		HornerPolynomial<double> plaintext_model;
+		HornerPolynomial<EncryptedNumber> encrypted_model;
+
+		EncryptedNumber encrypted_zero;
+
+		std::shared_ptr<EncryptionManager> encryption_manager;
+
+		// resolves the variable symbols against the schema of RowViews passed to predict
+		SchemaBinding feature_binding;
+
+		// MARK: POLYNOMIAL_MODEL PRIVATE MEMBER FUNCTIONS
+
+		template <typename T>
+		MultivariatePolynomial<T> build_polynomial(const std::vector<T> & coefficients) const {
+			const std::vector<Monomial> & monomials = polynomial_features.get_monomials();
+			const std::vector<std::string> & variable_symbols = polynomial_features.get_variable_symbols();
+
+			MultivariatePolynomial<T> polynomial(variable_symbols);
+			for (std::size_t monomial = 0; monomial < monomials.size(); monomial++) {
+				polynomial.add_term(coefficients[monomial], monomials[monomial]);
+			}
+			polynomial.add_term(coefficients.back(), Monomial(std::vector<unsigned>(variable_symbols.size(), 0)));
+
+			return polynomial;
+		}
+
+		template <typename T>
+		std::vector<T> order_features(const std::unordered_map<std::string, T> & feature_map) const {
+			const std::vector<std::string> & variable_symbols = polynomial_features.get_variable_symbols();
+			std::vector<T> row;
+			row.reserve(variable_symbols.size());
+
+			for (const std::string & symbol : variable_symbols) {
+				typename std::unordered_map<std::string, T>::const_iterator find_result = feature_map.find(symbol);
+				if (find_result == feature_map.cend()) {
+					throw MissingParametersException();
+				}
+				row.push_back(find_result->second);
+			}
+
+			return row;
+		}
+
+		void mse_batch_gd(const Dataframe<double> & dataframe, const double learning_rate) {
+			// applies one step of batch gradient descent on the MSE cost function
+			// d(MSE)/d(c_k) = 1/N * sum over rows of (prediction - label) * monomial_k(row)
+			const std::vector<double> gradient = mse_gradient(dataframe, plaintext_coefficients, 0.0);
+
+			const double step = learning_rate / dataframe.shape().rows;
+			for (std::size_t coefficient = 0; coefficient < gradient.size(); coefficient++) {
+				plaintext_coefficients[coefficient] -= step * gradient[coefficient];
+			}
+		}
+
+		void mse_batch_gd(const Dataframe<EncryptedNumber> & dataframe, const double learning_rate) {
+			// homomorphic counterpart of the plaintext step above
+			const std::vector<EncryptedNumber> gradient = mse_gradient(dataframe, encrypted_coefficients, encrypted_zero);
+
+			const double step = learning_rate / dataframe.shape().rows;
+			for (std::size_t coefficient = 0; coefficient < gradient.size(); coefficient++) {
+				encrypted_coefficients[coefficient] = encrypted_coefficients[coefficient] - gradient[coefficient] * step;
+			}
+		}
+
+		template <typename T>
+		std::vector<T> mse_gradient(const Dataframe<T> & dataframe, const std::vector<T> & coefficients, const T & zero) const {
+			// sum over the rows of (prediction - label) * monomial_k(row) for every coefficient k, the bias last. The
+			// rows are split into one contiguous shard per thread and the shard gradients are summed by a tree
+			// all-reduce as in NeuralNetwork::batch_back_propagation, so the sum, and hence the fitted model, does not
+			// depend on the timing of the threads
+			const unsigned rows = dataframe.shape().rows;
+			const std::size_t monomial_count = polynomial_features.get_monomials().size();
+#ifndef _SEQUENTIAL
+			const unsigned max_shards = std::max(1u, std::min(static_cast<unsigned>(omp_get_max_threads()), rows));
+#else
+			const unsigned max_shards = 1;
+#endif
+			std::vector<std::vector<T>> shard_gradients(max_shards, std::vector<T>(monomial_count + 1, zero));
+
+			unsigned shards = 1;
+#ifndef _SEQUENTIAL
+#pragma omp parallel num_threads(max_shards)
+#endif
+			{
+#ifndef _SEQUENTIAL
+				const unsigned shard = static_cast<unsigned>(omp_get_thread_num());
+#pragma omp single
+				shards = static_cast<unsigned>(omp_get_num_threads()); // the team may be smaller than requested
+#else
+				const unsigned shard = 0;
+#endif
+				const unsigned begin = static_cast<unsigned>(static_cast<unsigned long long>(rows) * shard / shards);
+				const unsigned end = static_cast<unsigned>(static_cast<unsigned long long>(rows) * (shard + 1) / shards);
+				std::vector<T> & gradient = shard_gradients[shard];
+				std::vector<T> monomial_values(monomial_count);
+
+				for (unsigned row = begin; row < end; row++) {
+					polynomial_features.expand(dataframe.get_row_view(row), monomial_values.data());
+
+					T prediction = coefficients[monomial_count];
+					for (std::size_t monomial = 0; monomial < monomial_count; monomial++) {
+						prediction += coefficients[monomial] * monomial_values[monomial];
+					}
+
+					const T model_error = prediction - dataframe.get_row_label(row);
+					for (std::size_t monomial = 0; monomial < monomial_count; monomial++) {
+						gradient[monomial] += model_error * monomial_values[monomial];
+					}
+					gradient[monomial_count] += model_error;
+				}
+
+				for (unsigned stride = 1; stride < shards; stride *= 2) {
+#ifndef _SEQUENTIAL
+#pragma omp barrier
+#endif
+					if (shard % (2 * stride) == 0 && shard + stride < shards) {
+						const std::vector<T> & partner = shard_gradients[shard + stride];
+						for (std::size_t coefficient = 0; coefficient <= monomial_count; coefficient++) {
+							gradient[coefficient] += partner[coefficient];
+						}
+					}
+				}
+			}
+
+			return shard_gradients[0];
+		}
+	};
+}
+
+#endif
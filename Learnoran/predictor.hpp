@@ -21,6 +21,16 @@ namespace Learnoran {
 
 		virtual EncryptedNumber predict(const std::unordered_map<std::string, EncryptedNumber> & features, const DecryptionManager * dec_manager = nullptr) = 0;
 
+		// Predictor::predict on a RowView -> same as above, reading the row in place; predictors should override these,
+		// the defaults materialize the row and defer to the overloads above
+		virtual double predict(const RowView<double> & features) {
+			return predict(features.to_map());
+		}
+
+		virtual EncryptedNumber predict(const RowView<EncryptedNumber> & features, const DecryptionManager * dec_manager = nullptr) {
+			return predict(features.to_map(), dec_manager);
+		}
+
 		// Predictor::compute_mean_square_error -> computes the mean square error of the model for the supplied dataframe
 		virtual EncryptedNumber compute_mean_square_error(const Dataframe<EncryptedNumber> & dataframe, const unsigned num_rows) = 0;
 
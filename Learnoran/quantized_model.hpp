@@ -0,0 +1,279 @@
+#ifndef _QUANTIZED_MODEL_HPP
+#define _QUANTIZED_MODEL_HPP
+
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cstdint>
+#include <cmath>
+#include <limits>
+#include <cassert>
+
+#include "lo_exception.hpp"
+#include "matrix.hpp"
+#include "span.hpp"
+#include "aligned_buffer.hpp"
+#include "activation.hpp"
+#include "dense_layer.hpp"
+#include "dataframe.hpp"
+#include "inference_model.hpp"
+#include "int8_gemm.hpp"
+
+namespace Learnoran {
+	class QuantizedModel {
+		// Post-training int8 quantization of a trained NeuralNetwork, see NeuralNetwork::quantize. Calibration runs the
+		// double precision network over sample rows and records the range every neuron spans. Each neuron is then
+		// quantized around the center of its range with its own scale: the scale is folded into the weights it feeds,
+		// which get one scale per output channel, and the center into the bias of every channel, so that a neuron that
+		// never changes costs no precision. A layer is an integer matrix product followed, for every row, by a fused
+		// step that turns the int32 sums back into doubles, adds the biases, applies the sigmoid and quantizes the result
+		// for the next layer while the row is still in L1. Values beyond the calibrated range saturate.
+		//
+		// Like InferenceModel, the model is immutable and every forward pass writes only to an InferenceArena, so one
+		// instance serves any number of threads
+	public:
+		QuantizedModel(const std::vector<Matrix<double>> & connections, const std::vector<double> & biases, const std::vector<std::string> & input_symbols,
+			const ActivationAccuracy accuracy, const MatrixView<const double> & calibration)
+			: input_symbols(input_symbols), hidden_activation(resolve_activation_kernel(Activation::sigmoid, accuracy)), kernel(resolve_int8_block_kernel()),
+			max_width(0), max_channels(0), max_depth(0), id(InferenceArena::next_model_id()) {
+			// Args:
+			// - connections, biases, input_symbols, accuracy: as for InferenceModel
+			// - calibration: sample inputs, one row per sample and the columns in the order of <input_symbols>
+			// Throws:
+			// - EmptyDataframeException: if <calibration> has no rows
+			assert(!connections.empty() && biases.size() >= connections.size());
+			assert(connections.front().get_shape().rows == input_symbols.size() && calibration.get_shape().cols == input_symbols.size());
+			if (calibration.get_shape().rows == 0) {
+				throw EmptyDataframeException();
+			}
+
+			std::vector<std::vector<double>> minima, maxima;
+			calibrate(connections, biases, calibration, minima, maxima);
+			for (unsigned layer = 0; layer < connections.size(); layer++) {
+				layers.push_back(quantize_layer(connections[layer], biases[layer], minima[layer], maxima[layer]));
+				max_width = std::max(max_width, std::max(layers.back().inputs, layers.back().outputs));
+				max_depth = std::max(max_depth, layers.back().depth);
+				max_channels = std::max(max_channels, layers.back().channels);
+			}
+			pitch = aligned_element_count(max_width, sizeof(double));
+		}
+
+		unsigned input_size() const {
+			return layers.front().inputs;
+		}
+
+		const std::vector<std::string> & get_input_symbols() const {
+			return input_symbols;
+		}
+
+		// MARK: Single rows
+
+		double predict(const Span<const double> features, InferenceArena & arena) const {
+			// Args:
+			// - features: the value of every input neuron, in the order of get_input_symbols()
+			// Returns:
+			//   the value of the first output neuron
+			assert(features.size() == input_size());
+			double * const inputs = arena.buffer(0, pitch);
+			std::copy(features.begin(), features.end(), inputs);
+
+			return propagate(1, arena)[0];
+		}
+
+		double predict(const RowView<double> & features, InferenceArena & arena) const {
+			// Throws:
+			// - MissingColumnException: if the row lacks any of the input symbols
+			const RowView<double> ordered = arena.bind(id, features, input_symbols);
+			double * const inputs = arena.buffer(0, pitch);
+			for (unsigned i = 0; i < input_size(); i++) {
+				inputs[i] = ordered[i];
+			}
+
+			return propagate(1, arena)[0];
+		}
+
+		template <typename Features>
+		double predict(const Features & features) const {
+			// any of the above with the arena of the calling thread
+			return predict(features, InferenceArena::thread_arena());
+		}
+
+		// MARK: Batches
+
+		void predict(const Span<const RowView<double>> rows, const Span<double> predictions, InferenceArena & arena) const {
+			// Args:
+			// - predictions: receives the prediction of every row, in order
+			// Throws:
+			// - MissingColumnException: if a row lacks any of the input symbols
+			assert(predictions.size() == rows.size());
+			for (std::size_t first_row = 0; first_row < rows.size(); first_row += INFERENCE_BLOCK_ROWS) {
+				const unsigned block_rows = static_cast<unsigned>(std::min<std::size_t>(INFERENCE_BLOCK_ROWS, rows.size() - first_row));
+				double * const inputs = arena.buffer(0, block_rows * pitch);
+
+				for (unsigned row = 0; row < block_rows; row++) {
+					const RowView<double> ordered = arena.bind(id, rows[first_row + row], input_symbols);
+					for (unsigned i = 0; i < input_size(); i++) {
+						inputs[row * pitch + i] = ordered[i];
+					}
+				}
+
+				const double * outputs = propagate(block_rows, arena);
+				for (unsigned row = 0; row < block_rows; row++) {
+					predictions[first_row + row] = outputs[row * pitch];
+				}
+			}
+		}
+
+		template <typename Batch>
+		void predict(const Batch & batch, const Span<double> predictions) const {
+			// the above with the arena of the calling thread
+			predict(batch, predictions, InferenceArena::thread_arena());
+		}
+	private:
+		struct Layer {
+			AlignedBuffer<std::int8_t> weights; // one row of <depth> elements per channel
+			std::vector<double> scales; // turn the sum of each channel back into a double
+			std::vector<double> biases; // of each channel, including the centers of the inputs
+			std::vector<double> centers, inverse_scales; // quantize each input neuron
+			unsigned inputs, outputs;
+			unsigned channels; // <outputs> rounded up to INT8_GEMM_CHANNELS
+			std::size_t depth; // <inputs> rounded up to INT8_GEMM_DEPTH_STEP
+		};
+
+		static void calibrate(const std::vector<Matrix<double>> & connections, const std::vector<double> & biases, const MatrixView<const double> & calibration,
+			std::vector<std::vector<double>> & minima, std::vector<std::vector<double>> & maxima) {
+			// Args:
+			// - minima, maxima: receive the smallest and the largest value of every neuron of every layer but the output
+			// layer over the calibration rows, computed with the double precision forward pass of InferenceModel
+			const unsigned rows = calibration.get_shape().rows;
+			const GemmElementwise sigmoid = resolve_activation_kernel(Activation::sigmoid, ActivationAccuracy::exact);
+			minima.assign(connections.size(), std::vector<double>());
+			maxima.assign(connections.size(), std::vector<double>());
+
+			for (unsigned first_row = 0; first_row < rows; first_row += INFERENCE_BLOCK_ROWS) {
+				const unsigned block_rows = std::min(INFERENCE_BLOCK_ROWS, rows - first_row);
+				Matrix<double> layer(calibration.submatrix(first_row, 0, block_rows, calibration.get_shape().cols));
+
+				for (unsigned connection = 0; connection < connections.size(); connection++) {
+					const unsigned width = layer.get_shape().cols;
+					minima[connection].resize(width, std::numeric_limits<double>::infinity());
+					maxima[connection].resize(width, -std::numeric_limits<double>::infinity());
+					for (unsigned row = 0; row < block_rows; row++) {
+						for (unsigned neuron = 0; neuron < width; neuron++) {
+							minima[connection][neuron] = std::min(minima[connection][neuron], layer(row, neuron));
+							maxima[connection][neuron] = std::max(maxima[connection][neuron], layer(row, neuron));
+						}
+					}
+
+					if (connection + 1 < connections.size()) {
+						Matrix<double> next(block_rows, connections[connection].get_shape().cols);
+						dense_layer_forward(layer.view(), connections[connection].view(), biases[connection], sigmoid, next.view());
+						layer = std::move(next);
+					}
+				}
+			}
+		}
+
+		static Layer quantize_layer(const Matrix<double> & weights, const double bias, const std::vector<double> & minima, const std::vector<double> & maxima) {
+			Layer layer;
+			layer.inputs = weights.get_shape().rows;
+			layer.outputs = weights.get_shape().cols;
+			layer.channels = (layer.outputs + INT8_GEMM_CHANNELS - 1) / INT8_GEMM_CHANNELS * INT8_GEMM_CHANNELS;
+			layer.depth = (layer.inputs + INT8_GEMM_DEPTH_STEP - 1) / INT8_GEMM_DEPTH_STEP * INT8_GEMM_DEPTH_STEP;
+
+			// x = center + scale * q for the inputs; a constant input keeps the unit scale, its value lives in the center
+			std::vector<double> input_scales(layer.inputs);
+			layer.centers.resize(layer.inputs);
+			layer.inverse_scales.resize(layer.inputs);
+			for (unsigned i = 0; i < layer.inputs; i++) {
+				const double half_range = (maxima[i] - minima[i]) / 2.0;
+				layer.centers[i] = minima[i] + half_range;
+				input_scales[i] = half_range > 0.0 ? half_range / INT8_MAX_LEVEL : 0.0;
+				layer.inverse_scales[i] = half_range > 0.0 ? 1.0 / input_scales[i] : 1.0;
+			}
+
+			// the weights of each channel as seen by the quantized inputs, w * input scale, quantized with their own
+			// scale; w * center is added to the bias of the channel once and for all
+			layer.weights = AlignedBuffer<std::int8_t>(layer.channels * layer.depth, 0);
+			layer.scales.assign(layer.channels, 0.0);
+			layer.biases.assign(layer.channels, 0.0);
+			std::vector<double> folded(layer.inputs);
+			for (unsigned channel = 0; channel < layer.outputs; channel++) {
+				double range = 0.0, channel_bias = bias;
+				for (unsigned i = 0; i < layer.inputs; i++) {
+					folded[i] = weights(i, channel) * input_scales[i];
+					range = std::max(range, std::abs(folded[i]));
+					channel_bias += weights(i, channel) * layer.centers[i];
+				}
+				const double scale = range > 0.0 ? range / INT8_MAX_LEVEL : 1.0;
+
+				layer.scales[channel] = scale;
+				layer.biases[channel] = channel_bias;
+				for (unsigned i = 0; i < layer.inputs; i++) {
+					layer.weights[channel * layer.depth + i] = quantize_value(folded[i], 1.0 / scale);
+				}
+			}
+			return layer;
+		}
+
+		const double * propagate(const unsigned rows, InferenceArena & arena) const {
+			// propagates the <rows> input rows in the first buffer of <arena> through every layer
+			// Returns:
+			//   the output layer, one row of <pitch> elements per input row
+			const std::size_t quantized_pitch = max_depth;
+			const double * inputs = arena.buffer(0, rows * pitch);
+			std::int8_t * source = arena.quantized_buffer(0, rows * quantized_pitch);
+			for (unsigned row = 0; row < rows; row++) {
+				quantize_input(layers.front(), inputs + row * pitch, source + row * quantized_pitch);
+			}
+
+			// the sums of a block of rows stay in L1 until the fused step has consumed them
+			std::int32_t * const sums = arena.sum_buffer(INT8_GEMM_ROWS * max_channels);
+			double * outputs = nullptr;
+			for (unsigned index = 0; index < layers.size(); index++) {
+				const Layer & layer = layers[index];
+				const bool hidden = index + 1 < layers.size();
+				std::int8_t * const destination = hidden ? arena.quantized_buffer((index + 1) % 2, rows * quantized_pitch) : nullptr;
+				outputs = arena.buffer(1, hidden ? pitch : rows * pitch);
+
+				for (unsigned first_row = 0; first_row < rows; first_row += INT8_GEMM_ROWS) {
+					const unsigned block_rows = std::min(INT8_GEMM_ROWS, rows - first_row);
+					int8_gemm(kernel, block_rows, source + first_row * quantized_pitch, quantized_pitch, layer.weights.data(), layer.depth, layer.channels, sums, max_channels);
+
+					// dequantize, add the biases and apply the sigmoid, then quantize for the next layer; a hidden row is
+					// only kept quantized
+					for (unsigned block_row = 0; block_row < block_rows; block_row++) {
+						const std::int32_t * const row_sums = sums + block_row * max_channels;
+						double * const values = hidden ? outputs : outputs + (first_row + block_row) * pitch;
+						for (unsigned channel = 0; channel < layer.outputs; channel++) {
+							values[channel] = row_sums[channel] * layer.scales[channel] + layer.biases[channel];
+						}
+						if (hidden) {
+							hidden_activation(values, values, layer.outputs);
+							quantize_input(layers[index + 1], values, destination + (first_row + block_row) * quantized_pitch);
+						}
+					}
+				}
+				source = destination;
+			}
+			return outputs;
+		}
+
+		static void quantize_input(const Layer & layer, const double * values, std::int8_t * quantized) {
+			// the padding must be zero, whatever a wider layer left in the buffer
+			quantize_row(values, layer.centers.data(), layer.inverse_scales.data(), quantized, layer.inputs);
+			std::fill(quantized + layer.inputs, quantized + layer.depth, static_cast<std::int8_t>(0));
+		}
+
+		std::vector<Layer> layers; // the incoming weights of every layer but the input layer
+		std::vector<std::string> input_symbols;
+		GemmElementwise hidden_activation; // the sigmoid of the accuracy tier of the network
+		Int8BlockKernel kernel;
+		unsigned max_width, max_channels;
+		std::size_t max_depth;
+		std::size_t pitch; // elements per row of the double precision buffers
+		std::size_t id; // tells the models sharing an arena apart, see InferenceArena::bind
+	};
+}
+
+#endif
@@ -0,0 +1,344 @@
+#ifndef _RANDOM_HPP
+#define _RANDOM_HPP
+
+/*
+Philox4x32-10, the counter-based generator of Salmon et al., "Parallel Random Numbers: As Easy as 1, 2, 3" (SC 2011).
+Block n of a stream is ten rounds of a keyed bijection applied to the counter (n, stream), so any block is computed
+without its predecessors: the bulk fills below split the work among threads and SIMD lanes, and their results depend
+only on the seed, the stream and the position, never on the thread count or the instruction set.
+
+A block is 4 uint32 words, which make 2 uniform doubles of 53 bits each, or 2 normal doubles through the Box-Muller
+transform of those uniforms. Value i of a fill comes from block i / 2 past the start of the fill.
+*/
+
+#include <cstddef>
+#include <cstdint>
+#include <cmath>
+#include <atomic>
+#include <algorithm>
+#include <utility>
+#include <cassert>
+
+#ifndef _SEQUENTIAL
+#include <omp.h>
+#endif
+
+#include "cpu_dispatch.hpp"
+#include "matrix.hpp"
+
+namespace Learnoran {
+	const std::uint32_t PHILOX_M0 = 0xD2511F53;
+	const std::uint32_t PHILOX_M1 = 0xCD9E8D57;
+	const std::uint32_t PHILOX_W0 = 0x9E3779B9; // the golden ratio
+	const std::uint32_t PHILOX_W1 = 0xBB67AE85; // sqrt(3) - 1
+	const unsigned PHILOX_ROUNDS = 10;
+	const std::size_t RANDOM_CHUNK_VALUES = 512; // values generated at a time by the bulk fills
+	const std::size_t RANDOM_PARALLEL_VALUES = 1 << 16; // smaller fills stay on the calling thread
+
+	struct PhiloxKey {
+		std::uint32_t words[2][PHILOX_ROUNDS]; // the key of every round
+
+		explicit PhiloxKey(const std::uint64_t seed = 0) {
+			std::uint32_t k0 = static_cast<std::uint32_t>(seed);
+			std::uint32_t k1 = static_cast<std::uint32_t>(seed >> 32);
+			for (unsigned round = 0; round < PHILOX_ROUNDS; round++) {
+				words[0][round] = k0;
+				words[1][round] = k1;
+				k0 += PHILOX_W0;
+				k1 += PHILOX_W1;
+			}
+		}
+	};
+
+	// MARK: Block kernels
+
+	inline void philox_blocks_generic(const PhiloxKey & key, const std::uint64_t stream, const std::uint64_t first_block, const std::size_t blocks, std::uint32_t * words) {
+		// Args:
+		// - words: receives the 4 words of every block, block after block
+		for (std::size_t block = 0; block < blocks; block++) {
+			const std::uint64_t counter = first_block + block;
+			std::uint32_t c0 = static_cast<std::uint32_t>(counter);
+			std::uint32_t c1 = static_cast<std::uint32_t>(counter >> 32);
+			std::uint32_t c2 = static_cast<std::uint32_t>(stream);
+			std::uint32_t c3 = static_cast<std::uint32_t>(stream >> 32);
+
+			for (unsigned round = 0; round < PHILOX_ROUNDS; round++) {
+				const std::uint64_t product0 = static_cast<std::uint64_t>(PHILOX_M0) * c0;
+				const std::uint64_t product1 = static_cast<std::uint64_t>(PHILOX_M1) * c2;
+				c0 = static_cast<std::uint32_t>(product1 >> 32) ^ c1 ^ key.words[0][round];
+				c1 = static_cast<std::uint32_t>(product1);
+				c2 = static_cast<std::uint32_t>(product0 >> 32) ^ c3 ^ key.words[1][round];
+				c3 = static_cast<std::uint32_t>(product0);
+			}
+
+			words[4 * block] = c0;
+			words[4 * block + 1] = c1;
+			words[4 * block + 2] = c2;
+			words[4 * block + 3] = c3;
+		}
+	}
+
+#ifdef LEARNORAN_X86
+	// One block per 64-bit lane: vpmuludq yields the full 64-bit products of the low words of the lanes
+
+	LEARNORAN_TARGET("avx2")
+	inline void philox_blocks_avx2(const PhiloxKey & key, const std::uint64_t stream, const std::uint64_t first_block, const std::size_t blocks, std::uint32_t * words) {
+		const __m256i low_words = _mm256_set1_epi64x(0xFFFFFFFF);
+		const __m256i m0 = _mm256_set1_epi64x(PHILOX_M0);
+		const __m256i m1 = _mm256_set1_epi64x(PHILOX_M1);
+		const __m256i stream_low = _mm256_set1_epi64x(static_cast<std::uint32_t>(stream));
+		const __m256i stream_high = _mm256_set1_epi64x(static_cast<std::uint32_t>(stream >> 32));
+
+		std::size_t block = 0;
+		for (; block + 4 <= blocks; block += 4) {
+			const __m256i counters = _mm256_add_epi64(_mm256_set1_epi64x(static_cast<long long>(first_block + block)), _mm256_setr_epi64x(0, 1, 2, 3));
+			__m256i c0 = _mm256_and_si256(counters, low_words);
+			__m256i c1 = _mm256_srli_epi64(counters, 32);
+			__m256i c2 = stream_low;
+			__m256i c3 = stream_high;
+
+			for (unsigned round = 0; round < PHILOX_ROUNDS; round++) {
+				const __m256i product0 = _mm256_mul_epu32(m0, c0);
+				const __m256i product1 = _mm256_mul_epu32(m1, c2);
+				c0 = _mm256_xor_si256(_mm256_xor_si256(_mm256_srli_epi64(product1, 32), c1), _mm256_set1_epi64x(key.words[0][round]));
+				c1 = _mm256_and_si256(product1, low_words);
+				c2 = _mm256_xor_si256(_mm256_xor_si256(_mm256_srli_epi64(product0, 32), c3), _mm256_set1_epi64x(key.words[1][round]));
+				c3 = _mm256_and_si256(product0, low_words);
+			}
+
+			// words 0, 1 and 2, 3 of a block in one lane each, then the lanes of a block next to each other
+			const __m256i first_half = _mm256_or_si256(c0, _mm256_slli_epi64(c1, 32));
+			const __m256i second_half = _mm256_or_si256(c2, _mm256_slli_epi64(c3, 32));
+			const __m256i even_blocks = _mm256_unpacklo_epi64(first_half, second_half);
+			const __m256i odd_blocks = _mm256_unpackhi_epi64(first_half, second_half);
+			_mm256_storeu_si256(reinterpret_cast<__m256i *>(words + 4 * block), _mm256_permute2x128_si256(even_blocks, odd_blocks, 0x20));
+			_mm256_storeu_si256(reinterpret_cast<__m256i *>(words + 4 * block + 8), _mm256_permute2x128_si256(even_blocks, odd_blocks, 0x31));
+		}
+		philox_blocks_generic(key, stream, first_block + block, blocks - block, words + 4 * block);
+	}
+
+	LEARNORAN_TARGET("avx512f")
+	inline void philox_blocks_avx512(const PhiloxKey & key, const std::uint64_t stream, const std::uint64_t first_block, const std::size_t blocks, std::uint32_t * words) {
+		const __m512i low_words = _mm512_set1_epi64(0xFFFFFFFF);
+		const __m512i m0 = _mm512_set1_epi64(PHILOX_M0);
+		const __m512i m1 = _mm512_set1_epi64(PHILOX_M1);
+		const __m512i stream_low = _mm512_set1_epi64(static_cast<std::uint32_t>(stream));
+		const __m512i stream_high = _mm512_set1_epi64(static_cast<std::uint32_t>(stream >> 32));
+		const __m512i first_blocks = _mm512_setr_epi64(0, 8, 1, 9, 2, 10, 3, 11);
+		const __m512i last_blocks = _mm512_setr_epi64(4, 12, 5, 13, 6, 14, 7, 15);
+
+		std::size_t block = 0;
+		for (; block + 8 <= blocks; block += 8) {
+			const __m512i counters = _mm512_add_epi64(_mm512_set1_epi64(static_cast<long long>(first_block + block)), _mm512_setr_epi64(0, 1, 2, 3, 4, 5, 6, 7));
+			__m512i c0 = _mm512_and_si512(counters, low_words);
+			__m512i c1 = _mm512_srli_epi64(counters, 32);
+			__m512i c2 = stream_low;
+			__m512i c3 = stream_high;
+
+			for (unsigned round = 0; round < PHILOX_ROUNDS; round++) {
+				const __m512i product0 = _mm512_mul_epu32(m0, c0);
+				const __m512i product1 = _mm512_mul_epu32(m1, c2);
+				c0 = _mm512_xor_si512(_mm512_xor_si512(_mm512_srli_epi64(product1, 32), c1), _mm512_set1_epi64(key.words[0][round]));
+				c1 = _mm512_and_si512(product1, low_words);
+				c2 = _mm512_xor_si512(_mm512_xor_si512(_mm512_srli_epi64(product0, 32), c3), _mm512_set1_epi64(key.words[1][round]));
+				c3 = _mm512_and_si512(product0, low_words);
+			}
+
+			const __m512i first_half = _mm512_or_si512(c0, _mm512_slli_epi64(c1, 32));
+			const __m512i second_half = _mm512_or_si512(c2, _mm512_slli_epi64(c3, 32));
+			_mm512_storeu_si512(words + 4 * block, _mm512_permutex2var_epi64(first_half, first_blocks, second_half));
+			_mm512_storeu_si512(words + 4 * block + 16, _mm512_permutex2var_epi64(first_half, last_blocks, second_half));
+		}
+		philox_blocks_generic(key, stream, first_block + block, blocks - block, words + 4 * block);
+	}
+#endif
+
+	inline void philox_blocks(const PhiloxKey & key, const std::uint64_t stream, const std::uint64_t first_block, const std::size_t blocks, std::uint32_t * words) {
+		// the blocks first_block .. first_block + blocks - 1 of <stream>; every kernel returns the same words
+#ifdef LEARNORAN_X86
+		if (cpu_features().avx512) {
+			philox_blocks_avx512(key, stream, first_block, blocks, words);
+			return;
+		}
+		if (cpu_features().avx2) {
+			philox_blocks_avx2(key, stream, first_block, blocks, words);
+			return;
+		}
+#endif
+		philox_blocks_generic(key, stream, first_block, blocks, words);
+	}
+
+	// MARK: Conversions
+
+	inline double philox_uniform(const std::uint32_t high, const std::uint32_t low) {
+		// Returns:
+		//   the 53-bit double in [0, 1) made of the top 27 bits of <high> and the top 26 bits of <low>
+		return ((high >> 5) * 67108864.0 + (low >> 6)) * (1.0 / 9007199254740992.0);
+	}
+
+	enum class Distribution {
+		uniform, // over [0, 1)
+		normal // standard normal
+	};
+
+	inline void philox_values(const PhiloxKey & key, const std::uint64_t stream, const std::uint64_t first_block, const Distribution distribution,
+		const std::size_t first, const std::size_t count, double * values) {
+		// Stateless core of the fills: values[i] receives value first + i of the fill starting at <first_block>
+		std::uint32_t words[2 * RANDOM_CHUNK_VALUES];
+		std::size_t done = 0;
+		while (done < count) {
+			const std::size_t position = first + done;
+			const std::size_t chunk = std::min(RANDOM_CHUNK_VALUES - position % 2, count - done);
+			// the values position .. position + chunk - 1 come from these blocks
+			const std::size_t blocks = (position % 2 + chunk + 1) / 2;
+			philox_blocks(key, stream, first_block + position / 2, blocks, words);
+
+			if (distribution == Distribution::uniform) {
+				for (std::size_t i = 0; i < chunk; i++) {
+					const std::size_t value = position % 2 + i;
+					const std::uint32_t * const block = words + 4 * (value / 2);
+					values[done + i] = philox_uniform(block[2 * (value % 2)], block[2 * (value % 2) + 1]);
+				}
+			}
+			else {
+				// Box-Muller, one pair per block; the first uniform is taken over (0, 1] to keep the logarithm finite
+				for (std::size_t block = 0; block < blocks; block++) {
+					const std::uint32_t * const block_words = words + 4 * block;
+					const double radius = std::sqrt(-2.0 * std::log(1.0 - philox_uniform(block_words[0], block_words[1])));
+					const double angle = 6.283185307179586 * philox_uniform(block_words[2], block_words[3]);
+					// the values of the block within the chunk, relative to its first value
+					const std::ptrdiff_t even = static_cast<std::ptrdiff_t>(2 * block) - static_cast<std::ptrdiff_t>(position % 2);
+					if (even >= 0) {
+						values[done + even] = radius * std::cos(angle);
+					}
+					if (even + 1 < static_cast<std::ptrdiff_t>(chunk)) {
+						values[done + even + 1] = radius * std::sin(angle);
+					}
+				}
+			}
+			done += chunk;
+		}
+	}
+
+	// MARK: Generator
+
+	class Philox4x32 {
+		// A seeded stream of Philox4x32-10 blocks. operator() makes it a UniformRandomBitGenerator for the standard
+		// library; the fills generate many values at once, in parallel for large counts, and always start at a fresh
+		// block, so that their values do not depend on the calls made before them other than through the stream position
+	public:
+		typedef std::uint32_t result_type;
+
+		explicit Philox4x32(const std::uint64_t seed = 0, const std::uint64_t stream = 0) : key(seed), stream(stream), next_block(0), buffered(0) { }
+
+		static constexpr result_type min() {
+			return 0;
+		}
+
+		static constexpr result_type max() {
+			return 0xFFFFFFFF;
+		}
+
+		result_type operator()() {
+			if (buffered == 0) {
+				philox_blocks_generic(key, stream, next_block++, 1, buffer);
+				buffered = 4;
+			}
+			return buffer[4 - buffered--];
+		}
+
+		std::uint64_t below(const std::uint64_t bound) {
+			// Returns:
+			//   an integer uniformly distributed over [0, bound); draws falling in the incomplete last copy of the range
+			//   are rejected, so there is no modulo bias
+			assert(bound > 0);
+			const std::uint64_t threshold = (0 - bound) % bound;
+			for (;;) {
+				const std::uint64_t high = (*this)();
+				const std::uint64_t value = high << 32 | (*this)();
+				if (value >= threshold) {
+					return value % bound;
+				}
+			}
+		}
+
+		double uniform() {
+			// over [0, 1)
+			const std::uint32_t high = (*this)();
+			return philox_uniform(high, (*this)());
+		}
+
+		double normal(const double mean = 0.0, const double standard_deviation = 1.0) {
+			double value;
+			fill(Distribution::normal, &value, 1);
+			return mean + standard_deviation * value;
+		}
+
+		void fill(const Distribution distribution, double * values, const std::size_t count) {
+			fill(distribution, MatrixView<double>(values, 1, static_cast<unsigned>(count), count));
+		}
+
+		void fill(const Distribution distribution, const MatrixView<double> & values) {
+			// Fills the elements of <values> in row-major order, the padding of the rows untouched
+			const Shape shape = values.get_shape();
+			const std::size_t count = static_cast<std::size_t>(shape.rows) * shape.cols;
+			const std::uint64_t first_block = next_block;
+			next_block += (count + 1) / 2;
+			buffered = 0;
+
+			if (values.get_col_stride() == 1 && values.get_row_stride() == shape.cols) {
+				fill_range(distribution, first_block, values.data(), count);
+				return;
+			}
+#ifndef _SEQUENTIAL
+#pragma omp parallel for if (count >= RANDOM_PARALLEL_VALUES)
+#endif
+			for (int row = 0; row < static_cast<int>(shape.rows); row++) {
+				if (values.get_col_stride() == 1) {
+					philox_values(key, stream, first_block, distribution, static_cast<std::size_t>(row) * shape.cols, shape.cols, values.data() + row * values.get_row_stride());
+				}
+				else {
+					for (unsigned col = 0; col < shape.cols; col++) {
+						philox_values(key, stream, first_block, distribution, static_cast<std::size_t>(row) * shape.cols + col, 1, &values(row, col));
+					}
+				}
+			}
+		}
+	private:
+		void fill_range(const Distribution distribution, const std::uint64_t first_block, double * values, const std::size_t count) const {
+			const std::size_t chunks = (count + RANDOM_CHUNK_VALUES - 1) / RANDOM_CHUNK_VALUES;
+#ifndef _SEQUENTIAL
+#pragma omp parallel for if (count >= RANDOM_PARALLEL_VALUES)
+#endif
+			for (int chunk = 0; chunk < static_cast<int>(chunks); chunk++) {
+				const std::size_t first = chunk * RANDOM_CHUNK_VALUES;
+				philox_values(key, stream, first_block, distribution, first, std::min(RANDOM_CHUNK_VALUES, count - first), values + first);
+			}
+		}
+
+		PhiloxKey key;
+		std::uint64_t stream;
+		std::uint64_t next_block; // the first block not handed out yet
+		std::uint32_t buffer[4]; // the block operator() hands out word by word
+		unsigned buffered; // words of <buffer> not handed out yet
+	};
+
+	template <typename RandomIt>
+	void shuffle_range(const RandomIt first, const RandomIt last, Philox4x32 & generator) {
+		// Fisher-Yates; unlike std::shuffle, whose algorithm is left to the standard library, a seed gives the same
+		// permutation on every platform
+		for (std::size_t remaining = static_cast<std::size_t>(last - first); remaining > 1; remaining--) {
+			std::swap(first[remaining - 1], first[static_cast<std::size_t>(generator.below(remaining))]);
+		}
+	}
+
+	inline Philox4x32 & thread_generator() {
+		// The generator of snd_random on the calling thread, seeded with 0; threads draw from distinct streams, numbered
+		// in the order of their first call. Assign e.g. Philox4x32(seed) to it to reseed
+		static std::atomic<std::uint64_t> streams(0);
+		static thread_local Philox4x32 generator(0, streams++);
+		return generator;
+	}
+}
+
+#endif
@@ -0,0 +1,85 @@
+#ifndef _SPAN_HPP
+#define _SPAN_HPP
+
+#include <cstddef>
+#include <cassert>
+
+namespace Learnoran {
+	template <typename T>
+	class Span {
+		// Non-owning view over <count> contiguous elements; the viewed storage must outlive the span
+	public:
+		Span() : pointer(nullptr), count(0) { }
+
+		Span(T * pointer, const std::size_t count) : pointer(pointer), count(count) { }
+
+		T & operator[](const std::size_t index) const {
+			assert(index < count);
+			return pointer[index];
+		}
+
+		T * data() const {
+			return pointer;
+		}
+
+		std::size_t size() const {
+			return count;
+		}
+
+		bool empty() const {
+			return count == 0;
+		}
+
+		T * begin() const {
+			return pointer;
+		}
+
+		T * end() const {
+			return pointer + count;
+		}
+
+		Span subspan(const std::size_t offset, const std::size_t length) const {
+			assert(offset + length <= count);
+			return Span(pointer + offset, length);
+		}
+	private:
+		T * pointer;
+		std::size_t count;
+	};
+
+	template <typename T>
+	class StridedSpan {
+		// Non-owning view over <count> elements placed <stride> elements apart, e.g. a row of a column-major buffer
+	public:
+		StridedSpan() : pointer(nullptr), count(0), stride(1) { }
+
+		StridedSpan(T * pointer, const std::size_t count, const std::size_t stride) : pointer(pointer), count(count), stride(stride) { }
+
+		T & operator[](const std::size_t index) const {
+			assert(index < count);
+			return pointer[index * stride];
+		}
+
+		std::size_t size() const {
+			return count;
+		}
+
+		std::size_t get_stride() const {
+			return stride;
+		}
+
+		bool is_contiguous() const {
+			return stride == 1;
+		}
+
+		T * data() const {
+			return pointer;
+		}
+	private:
+		T * pointer;
+		std::size_t count;
+		std::size_t stride;
+	};
+}
+
+#endif
@@ -0,0 +1,161 @@
+#ifndef _SPARSE_DATAFRAME_HPP
+#define _SPARSE_DATAFRAME_HPP
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <utility>
+#include <cassert>
+
+#include "dataframe.hpp"
+#include "sparse_matrix.hpp"
+#include "span.hpp"
+
+namespace Learnoran {
+	template <typename T>
+	class SparseRowView : public SparseVectorView<const T> {
+		// The nonzero feature values of one SparseDataframe row, together with the schema naming its columns; only valid
+		// as long as the dataframe it was taken from
+	public:
+		SparseRowView(const SparseVectorView<const T> & values, const DataframeSchema * schema)
+			: SparseVectorView<const T>(values), schema(schema) { }
+
+		const DataframeSchema & get_schema() const {
+			assert(schema != nullptr);
+			return *schema;
+		}
+	private:
+		const DataframeSchema * schema;
+	};
+
+	template <typename T>
+	class SparseDataframe {
+		// Counterpart of Dataframe for features that are mostly zeros, e.g. one-hot or hashed categorical columns. Only
+		// the nonzeros are stored: row by row in a CsrMatrix, and column by column in a CscMatrix for consumers that
+		// visit one feature at a time. Copies share the storage
+	public:
+		// Constructors
+
+		SparseDataframe(CsrMatrix<T> features, std::vector<T> labels, const std::vector<std::string> & csv_header)
+			: storage(std::make_shared<Storage>(std::move(features), std::move(labels))), columns(csv_header), schema(std::make_shared<DataframeSchema>(csv_header)) {
+			// Args:
+			// - features: one row per label, one column per feature symbol of <csv_header>
+			// - csv_header: the feature symbols followed by the label symbol
+			assert(storage->rows.get_shape().rows == storage->labels.size());
+			assert(storage->rows.get_shape().cols + 1 == csv_header.size());
+		}
+
+		explicit SparseDataframe(const Dataframe<T> & dataframe)
+			: SparseDataframe(compress(dataframe), labels_of(dataframe), dataframe.get_headers()) { }
+
+		// Accessors
+
+		DataframeShape shape() const {
+			return DataframeShape(storage->labels.size(), columns.size());
+		}
+
+		std::size_t nonzeros() const {
+			return storage->rows.nonzeros();
+		}
+
+		SparseRowView<T> get_row_view(const unsigned index) const {
+			return SparseRowView<T>(storage->rows.row(index), schema.get());
+		}
+
+		const T & get_row_label(const unsigned index) const {
+			return storage->labels[index];
+		}
+
+		Span<const T> get_labels() const {
+			return Span<const T>(storage->labels.data(), storage->labels.size());
+		}
+
+		const CsrMatrix<T> & get_rows() const {
+			// the features, row by row
+			return storage->rows;
+		}
+
+		const CscMatrix<T> & get_columns() const {
+			// the features, column by column
+			return storage->columns;
+		}
+
+		const DataframeSchema & get_schema() const {
+			return *schema;
+		}
+
+		std::vector<std::string> get_headers() const {
+			return columns;
+		}
+
+		std::vector<std::string> get_feature_headers() const {
+			return std::vector<std::string>(columns.begin(), columns.end() - 1);
+		}
+
+		std::string get_label_header() const {
+			return columns.back();
+		}
+
+		Dataframe<T> to_dense() const {
+			// Returns:
+			//   a Dataframe holding every feature value, zeros included
+			const std::size_t rows = storage->labels.size();
+			std::vector<std::vector<T>> features(rows, std::vector<T>(columns.size() - 1));
+
+			for (std::size_t row = 0; row < rows; row++) {
+				const SparseVectorView<const T> values = storage->rows.row(row);
+				for (std::size_t nonzero = 0; nonzero < values.nonzeros(); nonzero++) {
+					features[row][values.index(nonzero)] = values.value(nonzero);
+				}
+			}
+
+			return Dataframe<T>(std::move(features), storage->labels, columns);
+		}
+	private:
+		struct Storage {
+			Storage(CsrMatrix<T> && rows, std::vector<T> && labels) : rows(std::move(rows)), columns(this->rows.to_csc()), labels(std::move(labels)) { }
+
+			const CsrMatrix<T> rows;
+			const CscMatrix<T> columns;
+			const std::vector<T> labels;
+		};
+
+		static CsrMatrix<T> compress(const Dataframe<T> & dataframe) {
+			// keeps the feature values that differ from T()
+			const std::size_t rows = dataframe.shape().rows;
+			const std::size_t feature_columns = dataframe.shape().columns - 1;
+
+			std::vector<std::size_t> row_offsets(1, 0);
+			std::vector<unsigned> column_indices;
+			std::vector<T> values;
+			row_offsets.reserve(rows + 1);
+
+			for (std::size_t row = 0; row < rows; row++) {
+				const RowView<T> feature_row = dataframe.get_row_view(row);
+				for (std::size_t column = 0; column < feature_columns; column++) {
+					if (feature_row[column] != T()) {
+						column_indices.push_back(static_cast<unsigned>(column));
+						values.push_back(feature_row[column]);
+					}
+				}
+				row_offsets.push_back(values.size());
+			}
+
+			return CsrMatrix<T>(rows, feature_columns, std::move(row_offsets), std::move(column_indices), std::move(values));
+		}
+
+		static std::vector<T> labels_of(const Dataframe<T> & dataframe) {
+			std::vector<T> labels(dataframe.shape().rows);
+			for (std::size_t row = 0; row < labels.size(); row++) {
+				labels[row] = dataframe.get_row_label(row);
+			}
+			return labels;
+		}
+
+		std::shared_ptr<const Storage> storage;
+		std::vector<std::string> columns;
+		std::shared_ptr<DataframeSchema> schema;
+	};
+}
+
+#endif
@@ -0,0 +1,408 @@
+#ifndef _SPARSE_MATRIX_HPP
+#define _SPARSE_MATRIX_HPP
+
+#include <vector>
+#include <iostream>
+#include <assert.h>
+#include <algorithm>
+#include <cstddef>
+#include <utility>
+
+#include "matrix.hpp"
+
+/*
+Compressed sparse matrices, for data that is mostly zeros (one-hot or hashed categorical features).
+CsrMatrix stores the nonzeros row by row: the nonzeros of row i are values[row_offsets[i] .. row_offsets[i + 1]),
+in increasing column order, at the columns given by the parallel column_indices array. CscMatrix is the same layout
+column by column. Every product below touches each stored nonzero once, so its cost is proportional to the number of
+nonzeros rather than to rows * cols.
+*/
+
+// MARK: SparseVectorView
+
+template <typename T>
+class SparseVectorView {
+	// Non-owning view of one compressed row (or column): <nonzeros> (index, value) pairs in increasing index order out
+	// of a logical length of <count>
+public:
+	SparseVectorView(const unsigned * indices, T * values, const std::size_t nonzeros, const unsigned count)
+		: index_array(indices), value_array(values), nonzero_count(nonzeros), count(count) { }
+
+	template <typename U, typename = typename std::enable_if<std::is_convertible<U *, T *>::value>::type>
+	SparseVectorView(const SparseVectorView<U> & rhs)
+		: index_array(rhs.indices()), value_array(rhs.values()), nonzero_count(rhs.nonzeros()), count(rhs.size()) { }
+
+	std::size_t nonzeros() const {
+		return nonzero_count;
+	}
+
+	unsigned size() const {
+		// logical length, zeros included
+		return count;
+	}
+
+	unsigned index(const std::size_t nonzero) const {
+		assert(nonzero < nonzero_count);
+		return index_array[nonzero];
+	}
+
+	T & value(const std::size_t nonzero) const {
+		assert(nonzero < nonzero_count);
+		return value_array[nonzero];
+	}
+
+	const unsigned * indices() const {
+		return index_array;
+	}
+
+	T * values() const {
+		return value_array;
+	}
+
+	typename std::remove_const<T>::type operator[](const unsigned position) const {
+		// the element at <position>, zero if it is not stored; a binary search over the nonzeros
+		assert(position < count);
+		const unsigned * const found = std::lower_bound(index_array, index_array + nonzero_count, position);
+		if (found == index_array + nonzero_count || *found != position) {
+			return typename std::remove_const<T>::type();
+		}
+		return value_array[found - index_array];
+	}
+
+	template <typename U>
+	typename std::remove_const<T>::type dot(const U & dense) const {
+		// Args:
+		// - dense: any sequence indexable by position, e.g. a pointer or a VectorView
+		typename std::remove_const<T>::type sum = typename std::remove_const<T>::type();
+		for (std::size_t nonzero = 0; nonzero < nonzero_count; nonzero++) {
+			sum += value_array[nonzero] * dense[index_array[nonzero]];
+		}
+		return sum;
+	}
+private:
+	const unsigned * index_array;
+	T * value_array;
+	std::size_t nonzero_count;
+	unsigned count;
+};
+
+template <typename T>
+void sparse_dot_into(const SparseVectorView<const T> & lhs, const Matrix<T> & rhs, Matrix<T> & destination) {
+	// destination (1 x rhs cols) = lhs (as a row vector) * rhs: a weighted sum of the rows of <rhs> selected by the nonzeros
+	assert(lhs.size() == rhs.get_shape().rows);
+
+	if (destination.get_shape().rows != 1 || destination.get_shape().cols != rhs.get_shape().cols) {
+		destination = Matrix<T>(1, rhs.get_shape().cols);
+	}
+
+	T * const output = destination.data();
+	const unsigned cols = rhs.get_shape().cols;
+	std::fill(output, output + cols, T());
+
+	for (std::size_t nonzero = 0; nonzero < lhs.nonzeros(); nonzero++) {
+		const T weight = lhs.value(nonzero);
+		const T * const source = rhs.data() + lhs.index(nonzero) * rhs.get_pitch();
+		for (unsigned col = 0; col < cols; col++) {
+			output[col] += weight * source[col];
+		}
+	}
+}
+
+template <typename T>
+void transpose_compressed(const std::size_t minor, const std::vector<std::size_t> & offsets, const std::vector<unsigned> & indices, const std::vector<T> & values,
+	std::vector<std::size_t> & transposed_offsets, std::vector<unsigned> & transposed_indices, std::vector<T> & transposed_values) {
+	// Converts between the two compressed layouts with a counting sort over the minor index (columns of a CSR matrix,
+	// rows of a CSC one). The indices within every output line come out sorted because the input lines are visited in order
+	const std::size_t major = offsets.size() - 1;
+
+	transposed_offsets.assign(minor + 1, 0);
+	for (std::size_t nonzero = 0; nonzero < indices.size(); nonzero++) {
+		transposed_offsets[indices[nonzero] + 1]++;
+	}
+	for (std::size_t line = 0; line < minor; line++) {
+		transposed_offsets[line + 1] += transposed_offsets[line];
+	}
+
+	transposed_indices.resize(indices.size());
+	transposed_values.resize(values.size());
+	std::vector<std::size_t> next(transposed_offsets.begin(), transposed_offsets.end() - 1);
+	for (std::size_t line = 0; line < major; line++) {
+		for (std::size_t nonzero = offsets[line]; nonzero < offsets[line + 1]; nonzero++) {
+			const std::size_t destination = next[indices[nonzero]]++;
+			transposed_indices[destination] = static_cast<unsigned>(line);
+			transposed_values[destination] = values[nonzero];
+		}
+	}
+}
+
+template <typename T>
+class CscMatrix;
+
+// MARK: CsrMatrix
+
+template <typename T>
+class CsrMatrix {
+	// Compressed sparse row matrix, see the top of this file
+public:
+	typedef T value_type;
+
+	// CONSTRUCTORS
+	CsrMatrix() : rows(0), cols(0), row_offsets(1, 0) { }
+
+	CsrMatrix(const unsigned rows, const unsigned cols, std::vector<std::size_t> row_offsets, std::vector<unsigned> column_indices, std::vector<T> values)
+		: rows(rows), cols(cols), row_offsets(std::move(row_offsets)), column_indices(std::move(column_indices)), values(std::move(values)) {
+		// Args:
+		// - row_offsets: rows + 1 nondecreasing offsets into the other two arrays, starting at 0
+		// - column_indices, values: the nonzeros, row by row, in increasing column order within a row
+		assert(this->row_offsets.size() == static_cast<std::size_t>(rows) + 1 && this->row_offsets.front() == 0);
+		assert(this->row_offsets.back() == this->column_indices.size() && this->column_indices.size() == this->values.size());
+	}
+
+	explicit CsrMatrix(const Matrix<T> & dense) : rows(dense.get_shape().rows), cols(dense.get_shape().cols) {
+		// keeps the elements of <dense> that differ from T()
+		row_offsets.reserve(static_cast<std::size_t>(rows) + 1);
+		row_offsets.push_back(0);
+		for (unsigned row = 0; row < rows; row++) {
+			for (unsigned col = 0; col < cols; col++) {
+				if (dense(row, col) != T()) {
+					column_indices.push_back(col);
+					values.push_back(dense(row, col));
+				}
+			}
+			row_offsets.push_back(values.size());
+		}
+	}
+
+	// ACCESSORS
+	Shape get_shape() const {
+		return Shape(rows, cols);
+	}
+
+	std::size_t nonzeros() const {
+		return values.size();
+	}
+
+	SparseVectorView<const T> row(const unsigned row) const {
+		assert(row < rows);
+		const std::size_t begin = row_offsets[row];
+		return SparseVectorView<const T>(column_indices.data() + begin, values.data() + begin, row_offsets[row + 1] - begin, cols);
+	}
+
+	SparseVectorView<T> row(const unsigned row) {
+		// the stored values are writable, the sparsity pattern is not
+		assert(row < rows);
+		const std::size_t begin = row_offsets[row];
+		return SparseVectorView<T>(column_indices.data() + begin, values.data() + begin, row_offsets[row + 1] - begin, cols);
+	}
+
+	const std::vector<std::size_t> & get_row_offsets() const {
+		return row_offsets;
+	}
+
+	const std::vector<unsigned> & get_column_indices() const {
+		return column_indices;
+	}
+
+	const std::vector<T> & get_values() const {
+		return values;
+	}
+
+	// CONVERSIONS
+	Matrix<T> to_dense() const {
+		Matrix<T> dense(rows, cols);
+		for (unsigned row = 0; row < rows; row++) {
+			for (std::size_t nonzero = row_offsets[row]; nonzero < row_offsets[row + 1]; nonzero++) {
+				dense(row, column_indices[nonzero]) = values[nonzero];
+			}
+		}
+		return dense;
+	}
+
+	CscMatrix<T> to_csc() const;
+
+	// PRODUCTS
+	void dot_into(const Matrix<T> & rhs, Matrix<T> & destination) const {
+		// destination = this * rhs; row i of the result is the sum of the rows of <rhs> selected by the nonzeros of row i,
+		// so rows are independent and computed in parallel for large products
+		assert(cols == rhs.get_shape().rows);
+		assert(&destination != &rhs);
+
+		const unsigned rhs_cols = rhs.get_shape().cols;
+		if (destination.get_shape().rows != rows || destination.get_shape().cols != rhs_cols) {
+			destination = Matrix<T>(rows, rhs_cols);
+		}
+
+		const bool parallel = values.size() * rhs_cols >= PARALLEL_THRESHOLD;
+		(void)parallel;
+#ifndef _SEQUENTIAL
+#pragma omp parallel for schedule(dynamic, 64) if(parallel)
+#endif
+		for (long long row = 0; row < static_cast<long long>(rows); row++) {
+			T * const output = destination.data() + row * destination.get_pitch();
+			std::fill(output, output + rhs_cols, T());
+
+			for (std::size_t nonzero = row_offsets[row]; nonzero < row_offsets[row + 1]; nonzero++) {
+				const T weight = values[nonzero];
+				const T * const source = rhs.data() + column_indices[nonzero] * rhs.get_pitch();
+				for (unsigned col = 0; col < rhs_cols; col++) {
+					output[col] += weight * source[col];
+				}
+			}
+		}
+	}
+
+	Matrix<T> dot(const Matrix<T> & rhs) const {
+		Matrix<T> result;
+		dot_into(rhs, result);
+		return result;
+	}
+
+	std::vector<T> dot(const std::vector<T> & rhs) const {
+		// matrix-vector product
+		assert(rhs.size() == cols);
+		std::vector<T> result(rows);
+		for (unsigned row = 0; row < rows; row++) {
+			result[row] = this->row(row).dot(rhs.data());
+		}
+		return result;
+	}
+
+	void print(std::ostream & flux) const {
+		// one "row col value" line per nonzero
+		for (unsigned row = 0; row < rows; row++) {
+			for (std::size_t nonzero = row_offsets[row]; nonzero < row_offsets[row + 1]; nonzero++) {
+				flux << row << ' ' << column_indices[nonzero] << ' ' << values[nonzero] << '\n';
+			}
+		}
+	}
+private:
+	static const std::size_t PARALLEL_THRESHOLD = 1 << 16; // multiply-adds below which the product stays on one thread
+
+	unsigned rows;
+	unsigned cols;
+	std::vector<std::size_t> row_offsets;
+	std::vector<unsigned> column_indices;
+	std::vector<T> values;
+};
+
+// MARK: CscMatrix
+
+template <typename T>
+class CscMatrix {
+	// Compressed sparse column matrix, see the top of this file; suited to column-wise access such as updating the
+	// contribution of a single feature
+public:
+	typedef T value_type;
+
+	// CONSTRUCTORS
+	CscMatrix() : rows(0), cols(0), col_offsets(1, 0) { }
+
+	CscMatrix(const unsigned rows, const unsigned cols, std::vector<std::size_t> col_offsets, std::vector<unsigned> row_indices, std::vector<T> values)
+		: rows(rows), cols(cols), col_offsets(std::move(col_offsets)), row_indices(std::move(row_indices)), values(std::move(values)) {
+		// Args:
+		// - col_offsets: cols + 1 nondecreasing offsets into the other two arrays, starting at 0
+		// - row_indices, values: the nonzeros, column by column, in increasing row order within a column
+		assert(this->col_offsets.size() == static_cast<std::size_t>(cols) + 1 && this->col_offsets.front() == 0);
+		assert(this->col_offsets.back() == this->row_indices.size() && this->row_indices.size() == this->values.size());
+	}
+
+	explicit CscMatrix(const Matrix<T> & dense) : CscMatrix(CsrMatrix<T>(dense).to_csc()) { }
+
+	// ACCESSORS
+	Shape get_shape() const {
+		return Shape(rows, cols);
+	}
+
+	std::size_t nonzeros() const {
+		return values.size();
+	}
+
+	SparseVectorView<const T> col(const unsigned col) const {
+		assert(col < cols);
+		const std::size_t begin = col_offsets[col];
+		return SparseVectorView<const T>(row_indices.data() + begin, values.data() + begin, col_offsets[col + 1] - begin, rows);
+	}
+
+	const std::vector<std::size_t> & get_col_offsets() const {
+		return col_offsets;
+	}
+
+	const std::vector<unsigned> & get_row_indices() const {
+		return row_indices;
+	}
+
+	const std::vector<T> & get_values() const {
+		return values;
+	}
+
+	// CONVERSIONS
+	Matrix<T> to_dense() const {
+		Matrix<T> dense(rows, cols);
+		for (unsigned col = 0; col < cols; col++) {
+			for (std::size_t nonzero = col_offsets[col]; nonzero < col_offsets[col + 1]; nonzero++) {
+				dense(row_indices[nonzero], col) = values[nonzero];
+			}
+		}
+		return dense;
+	}
+
+	CsrMatrix<T> to_csr() const {
+		std::vector<std::size_t> row_offsets;
+		std::vector<unsigned> col_indices;
+		std::vector<T> row_values;
+		transpose_compressed(rows, col_offsets, row_indices, values, row_offsets, col_indices, row_values);
+		return CsrMatrix<T>(rows, cols, std::move(row_offsets), std::move(col_indices), std::move(row_values));
+	}
+
+	// PRODUCTS
+	void dot_into(const Matrix<T> & rhs, Matrix<T> & destination) const {
+		// destination = this * rhs; column j of this matrix scatters row j of <rhs> into the result rows it selects
+		assert(cols == rhs.get_shape().rows);
+		assert(&destination != &rhs);
+
+		const unsigned rhs_cols = rhs.get_shape().cols;
+		if (destination.get_shape().rows != rows || destination.get_shape().cols != rhs_cols) {
+			destination = Matrix<T>(rows, rhs_cols);
+		}
+		else {
+			for (unsigned row = 0; row < rows; row++) {
+				std::fill(destination.data() + row * destination.get_pitch(), destination.data() + row * destination.get_pitch() + rhs_cols, T());
+			}
+		}
+
+		for (unsigned col = 0; col < cols; col++) {
+			const T * const source = rhs.data() + col * rhs.get_pitch();
+			for (std::size_t nonzero = col_offsets[col]; nonzero < col_offsets[col + 1]; nonzero++) {
+				const T weight = values[nonzero];
+				T * const output = destination.data() + row_indices[nonzero] * destination.get_pitch();
+				for (unsigned rhs_col = 0; rhs_col < rhs_cols; rhs_col++) {
+					output[rhs_col] += weight * source[rhs_col];
+				}
+			}
+		}
+	}
+
+	Matrix<T> dot(const Matrix<T> & rhs) const {
+		Matrix<T> result;
+		dot_into(rhs, result);
+		return result;
+	}
+
+private:
+	unsigned rows;
+	unsigned cols;
+	std::vector<std::size_t> col_offsets;
+	std::vector<unsigned> row_indices;
+	std::vector<T> values;
+};
+
+template <typename T>
+CscMatrix<T> CsrMatrix<T>::to_csc() const {
+	std::vector<std::size_t> col_offsets;
+	std::vector<unsigned> row_indices;
+	std::vector<T> col_values;
+	transpose_compressed(cols, row_offsets, column_indices, values, col_offsets, row_indices, col_values);
+	return CscMatrix<T>(rows, cols, std::move(col_offsets), std::move(row_indices), std::move(col_values));
+}
+
+#endif
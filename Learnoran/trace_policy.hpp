@@ -0,0 +1,143 @@
+#ifndef _TRACE_POLICY_HPP
+#define _TRACE_POLICY_HPP
+
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <ostream>
+#include <cstddef>
+
+/*
+Tracing policies instrument the evaluation hot paths (currently Polynomial::operator()) at compile time.
+A policy provides a TimePoint type, a static now() and record_term() hooks which the instrumented code calls once per
+evaluated term. NoTrace implements all of them as empty inline functions over an empty TimePoint, so the
+instrumentation, including the noise budget measurements that would require a decryption, compiles to nothing.
+
+Define LEARNORAN_TRACE_POLYNOMIAL to make RingBufferTrace the default policy of Polynomial.
+*/
+
+namespace Learnoran {
+	struct TraceRecord {
+		static const int NO_NOISE_BUDGET = -1;
+
+		std::size_t term; // index of the term within the evaluation
+		int noise_budget_bits; // noise budget of the accumulated result after the term, NO_NOISE_BUDGET if not measured
+		long long latency_ns; // time spent evaluating the term
+	};
+
+	class NoTrace {
+	public:
+		struct TimePoint { };
+
+		static TimePoint now() {
+			return TimePoint();
+		}
+
+		void record_term(const std::size_t, const TimePoint &) { }
+
+		template <typename Value, typename NoiseOracle>
+		void record_term(const std::size_t, const TimePoint &, const Value &, const NoiseOracle *) { }
+
+		std::size_t size() const {
+			return 0;
+		}
+
+		std::vector<TraceRecord> records() const {
+			return std::vector<TraceRecord>();
+		}
+
+		void clear() { }
+
+		void print(std::ostream &) const { }
+	};
+
+	template <std::size_t Capacity = 1024>
+	class RingBufferTrace {
+		// Keeps the last <Capacity> term records in a preallocated ring buffer. Slots are claimed through an atomic
+		// counter so that concurrent evaluations of the same polynomial (e.g. OpenMP loops in LinearModel) never block;
+		// only reading the records while evaluations are in flight is unsynchronized
+	public:
+		typedef std::chrono::steady_clock::time_point TimePoint;
+
+		RingBufferTrace() : buffer(Capacity), head(0) { }
+
+		RingBufferTrace(const RingBufferTrace & rhs) : buffer(rhs.buffer), head(rhs.head.load()) { }
+
+		RingBufferTrace & operator=(const RingBufferTrace & rhs) {
+			buffer = rhs.buffer;
+			head.store(rhs.head.load());
+
+			return *this;
+		}
+
+		static TimePoint now() {
+			return std::chrono::steady_clock::now();
+		}
+
+		void record_term(const std::size_t term, const TimePoint & start) {
+			push(term, TraceRecord::NO_NOISE_BUDGET, start);
+		}
+
+		template <typename Value, typename NoiseOracle>
+		void record_term(const std::size_t term, const TimePoint & start, const Value & value, const NoiseOracle * noise_oracle) {
+			// the noise budget is measured once per term and only when an oracle (DecryptionManager) is supplied
+			const int noise_budget_bits = noise_oracle != nullptr ? noise_oracle->get_noise_budget_bits(value) : TraceRecord::NO_NOISE_BUDGET;
+			push(term, noise_budget_bits, start);
+		}
+
+		std::size_t size() const {
+			const std::size_t recorded = head.load();
+			return recorded < Capacity ? recorded : Capacity;
+		}
+
+		std::vector<TraceRecord> records() const {
+			// Returns:
+			//   the retained records, oldest first
+			const std::size_t recorded = head.load();
+			const std::size_t retained = size();
+
+			std::vector<TraceRecord> ordered;
+			ordered.reserve(retained);
+			for (std::size_t i = recorded - retained; i < recorded; i++) {
+				ordered.push_back(buffer[i % Capacity]);
+			}
+
+			return ordered;
+		}
+
+		void clear() {
+			head.store(0);
+		}
+
+		void print(std::ostream & os) const {
+			for (const TraceRecord & record : records()) {
+				os << "term " << record.term << " - " << record.latency_ns << " ns";
+				if (record.noise_budget_bits != TraceRecord::NO_NOISE_BUDGET) {
+					os << ", noise budget: " << record.noise_budget_bits << " bits";
+				}
+				os << '\n';
+			}
+		}
+	private:
+		void push(const std::size_t term, const int noise_budget_bits, const TimePoint & start) {
+			const long long latency_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(now() - start).count();
+			const std::size_t slot = head.fetch_add(1) % Capacity;
+
+			TraceRecord & record = buffer[slot];
+			record.term = term;
+			record.noise_budget_bits = noise_budget_bits;
+			record.latency_ns = latency_ns;
+		}
+
+		std::vector<TraceRecord> buffer;
+		std::atomic<std::size_t> head;
+	};
+
+#ifdef LEARNORAN_TRACE_POLYNOMIAL
+	typedef RingBufferTrace<> DefaultPolynomialTrace;
+#else
+	typedef NoTrace DefaultPolynomialTrace;
+#endif
+}
+
+#endif
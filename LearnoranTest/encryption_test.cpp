@@ -5,6 +5,20 @@
 #include "../Learnoran/encryption_manager.hpp"
 #include "../Learnoran/encrypted_number.hpp"
 #include "../Learnoran/decryption_manager.hpp"
+#include "../Learnoran/multivariate_polynomial.hpp"
+#include "../Learnoran/polynomial_model.hpp"
+#include "../Learnoran/columnar_dataframe.hpp"
+#include "../Learnoran/linear_model.hpp"
+#include "../Learnoran/lodf.hpp"
+#include "../Learnoran/lomf.hpp"
+#include "../Learnoran/csv_parser.hpp"
+#include "../Learnoran/compressed_stream.hpp"
+#include "../Learnoran/sparse_dataframe.hpp"
+#include "../Learnoran/neural_net.hpp"
+#include "../Learnoran/fixed_neural_net.hpp"
+
+#include <sstream>
+#include <thread>
 
 using namespace Microsoft::VisualStudio::CppUnitTestFramework;
 using namespace Learnoran;
@@ -301,6 +315,47 @@ namespace EncryptionTest
 		}
 	};
 
+	TEST_CLASS(TracePolicyTest)
+	{
+	public:
+
+		TEST_METHOD(RingBufferTraceRecordsNoiseBudget)
+		{
+			EncryptionManager enc_manager;
+			DecryptionManager dec_manager(enc_manager.get_secret_key());
+
+			Polynomial<EncryptedNumber, RingBufferTrace<4>> polynomial;
+			polynomial.add_term(enc_manager.encrypt(2), "x", 3);
+			polynomial.add_term(enc_manager.encrypt(1), "y", 2);
+
+			std::unordered_map<std::string, EncryptedNumber> eval_params({ { "x", enc_manager.encrypt(3) }, { "y", enc_manager.encrypt(2) } });
+			polynomial(eval_params, enc_manager.encrypt(0), &dec_manager);
+
+			const std::vector<TraceRecord> records = polynomial.get_tracer().records();
+			Assert::AreEqual(static_cast<size_t>(2), records.size(), L"one record per term expected", LINE_INFO());
+			for (const TraceRecord & record : records) {
+				Assert::IsTrue(record.noise_budget_bits > 0, L"noise budget must be recorded when a DecryptionManager is supplied", LINE_INFO());
+			}
+
+			// the ring buffer keeps only the most recent records
+			for (unsigned evaluation = 0; evaluation < 3; evaluation++) {
+				polynomial(eval_params, enc_manager.encrypt(0));
+			}
+			Assert::AreEqual(static_cast<size_t>(4), polynomial.get_tracer().size(), L"ring buffer must be capped at its capacity", LINE_INFO());
+			const int no_noise_budget = TraceRecord::NO_NOISE_BUDGET;
+			Assert::AreEqual(no_noise_budget, polynomial.get_tracer().records().back().noise_budget_bits, L"noise budget must not be measured without a DecryptionManager", LINE_INFO());
+		}
+
+		TEST_METHOD(NoTraceRecordsNothing)
+		{
+			Polynomial<double, NoTrace> polynomial;
+			polynomial.add_term(3, "x", 2);
+
+			Assert::AreEqual(75.0, polynomial({ {"x", 5} }), L"3x^2 must evaluate to 75 for x = 5", LINE_INFO());
+			Assert::AreEqual(static_cast<size_t>(0), polynomial.get_tracer().size(), L"NoTrace must not record anything", LINE_INFO());
+		}
+	};
+
 	// EncryptedNumberTest is actually an integration test suite rather than a unit test suite
 	TEST_CLASS(EncryptedNumberTest)
 	{
@@ -382,5 +437,1122 @@ namespace EncryptionTest
 
 			Assert::AreEqual(4251528.0, derived({ {"y", 3} }), L"143x^9 + 2y^12 partial derivative WRT y must evaluate to 4251528 for y = 3", LINE_INFO());
 		}
+
+		TEST_METHOD(CompiledEvaluation)
+		{
+			Polynomial<double> polynomial;
+			polynomial.add_term(9, "x", 3);
+			polynomial.add_term(2, "y", 1);
+			polynomial.add_term(-4, "z", 2);
+			polynomial.set_constant_term(7, "bias");
+
+			// the schema order deliberately differs from the insertion order
+			const CompiledPolynomial<double> compiled = polynomial.compile({ "z", "y", "x" });
+			const std::vector<double> row = { 1.5, -11, 4 };
+
+			Assert::AreEqual(polynomial({ {"x", 4}, {"y", -11}, {"z", 1.5} }), compiled(row), TOLERANCE, L"compiled polynomial must match the symbolic evaluation", LINE_INFO());
+			Assert::AreEqual(552.0, compiled(row), TOLERANCE, L"9x^3 + 2y - 4z^2 + 7 must evaluate to 552 for x=4, y=-11 and z=1.5", LINE_INFO());
+		}
+
+		TEST_METHOD(CompiledBatchEvaluation)
+		{
+			Polynomial<double> polynomial;
+			polynomial.add_term(3, "x", 2);
+			polynomial.add_term(1, "y", 1);
+
+			const CompiledPolynomial<double> compiled = polynomial.compile({ "x", "y" });
+			const std::vector<std::vector<double>> rows = { { 1, 2 }, { 2, 0 }, { 0, -5 } };
+
+			const std::vector<double> results = compiled.evaluate_batch(rows);
+
+			Assert::AreEqual(5.0, results[0], TOLERANCE, L"batch entry 0 invalid", LINE_INFO());
+			Assert::AreEqual(12.0, results[1], TOLERANCE, L"batch entry 1 invalid", LINE_INFO());
+			Assert::AreEqual(-5.0, results[2], TOLERANCE, L"batch entry 2 invalid", LINE_INFO());
+		}
+
+		TEST_METHOD(CompileMissingSymbol)
+		{
+			Polynomial<double> polynomial;
+			polynomial.add_term(3, "x", 2);
+
+			Assert::ExpectException<MissingParametersException>([&polynomial]() { polynomial.compile({ "y" }); }, L"compiling against a schema lacking a variable must throw", LINE_INFO());
+		}
+	};
+
+	TEST_CLASS(MultivariatePolynomialTest)
+	{
+	public:
+
+		TEST_METHOD(HornerEvaluation)
+		{
+			// f(x, y, z) = 2x^2y + 3xy + 5x^3 - z^2 + 4
+			MultivariatePolynomial<double> polynomial({ "x", "y", "z" });
+			polynomial.add_term(2, { 2, 1, 0 });
+			polynomial.add_term(3, { 1, 1, 0 });
+			polynomial.add_term(5, { 3, 0, 0 });
+			polynomial.add_term(-1, { 0, 0, 2 });
+			polynomial.add_term(4, { 0, 0, 0 });
+
+			const HornerPolynomial<double> horner = polynomial.compile_horner();
+			const std::vector<double> row = { 2, -3, 1.5 };
+
+			Assert::AreEqual(-0.25, horner(row), TOLERANCE, L"Horner form of 2x^2y + 3xy + 5x^3 - z^2 + 4 must evaluate to -0.25", LINE_INFO());
+		}
+
+		TEST_METHOD(EncryptedHornerEvaluation)
+		{
+			EncryptionManager enc_manager;
+			DecryptionManager dec_manager(enc_manager.get_secret_key());
+
+			// f(x, y) = 2x^2y + xy + 1 evaluated homomorphically for x = 2 and y = 3
+			MultivariatePolynomial<EncryptedNumber> polynomial({ "x", "y" });
+			polynomial.add_term(enc_manager.encrypt(2), { 2, 1 });
+			polynomial.add_term(enc_manager.encrypt(1), { 1, 1 });
+			polynomial.add_term(enc_manager.encrypt(1), { 0, 0 });
+
+			const std::vector<EncryptedNumber> row = { enc_manager.encrypt(2), enc_manager.encrypt(3) };
+			const EncryptedNumber eval_result = polynomial.compile_horner()(row.data(), enc_manager.encrypt(0));
+
+			const int eval_result_decrypted = dec_manager.decrypt(eval_result);
+			Assert::AreEqual(31, eval_result_decrypted, L"f(x, y) = 2x^2y + xy + 1 has yielded a false result homomorphically", LINE_INFO());
+		}
+
+		TEST_METHOD(CrossTermPartialDerivative)
+		{
+			// d/dx (2x^2y + 3xy) = 4xy + 3y
+			MultivariatePolynomial<double> polynomial({ "x", "y" });
+			polynomial.add_term(2, { 2, 1 });
+			polynomial.add_term(3, { 1, 1 });
+
+			const MultivariatePolynomial<double> derived = polynomial.partial_derivative("x");
+			const std::vector<double> row = { 2, 5 };
+
+			Assert::AreEqual(55.0, derived.compile_horner()(row), TOLERANCE, L"4xy + 3y must evaluate to 55 for x=2 and y=5", LINE_INFO());
+		}
+
+		TEST_METHOD(PolynomialFeatureGeneration)
+		{
+			PolynomialFeatures features(2);
+			features.fit({ "x", "y" });
+
+			const std::vector<std::string> expected = { "x", "y", "x^2", "x*y", "y^2" };
+			Assert::IsTrue(features.get_feature_names() == expected, L"degree 2 features over x, y mismatch", LINE_INFO());
+
+			const std::vector<double> row = { 3, -2 };
+			std::vector<double> expanded(expected.size());
+			features.expand(row.data(), expanded.data());
+
+			Assert::AreEqual(-6.0, expanded[3], TOLERANCE, L"x*y must expand to -6 for x=3 and y=-2", LINE_INFO());
+			Assert::AreEqual(4.0, expanded[4], TOLERANCE, L"y^2 must expand to 4 for y=-2", LINE_INFO());
+		}
+
+		TEST_METHOD(PolynomialModelFitsInteraction)
+		{
+			// labels follow 1 + 2xy exactly
+			std::vector<std::vector<double>> rows;
+			std::vector<double> labels;
+			for (int x = -2; x <= 2; x++) {
+				for (int y = -2; y <= 2; y++) {
+					rows.push_back({ x * 0.5, y * 0.5 });
+					labels.push_back(1 + 2 * (x * 0.5) * (y * 0.5));
+				}
+			}
+			Dataframe<double> df(rows, labels, { "x", "y", "label" });
+
+			PolynomialModel model(2);
+			model.fit(df, 500, 0.1);
+
+			Assert::IsTrue(model.compute_mean_square_error(df, 100) < 1e-3, L"polynomial model must fit an interaction term", LINE_INFO());
+			Assert::AreEqual(7.0, model.predict({ { "x", 1.5 }, { "y", 2.0 } }), 0.05, L"1 + 2xy must predict 7 for x=1.5 and y=2", LINE_INFO());
+
+			// the error of a frame with other columns, in another order, is resolved by symbol
+			std::vector<std::vector<double>> shuffled_rows;
+			for (const std::vector<double> & row : rows) {
+				shuffled_rows.push_back({ 3.0, row[1], row[0] });
+			}
+			Dataframe<double> shuffled(shuffled_rows, labels, { "w", "y", "x", "label" });
+			Assert::AreEqual(model.compute_mean_square_error(df, 100), model.compute_mean_square_error(shuffled, 100), TOLERANCE, L"mse must not depend on the column order", LINE_INFO());
+		}
+
+		TEST_METHOD(PolynomialModelTrainingIsReproducible)
+		{
+			// the shard gradients are summed in a fixed order, so repeated fits must agree bit for bit
+			std::vector<std::vector<double>> rows;
+			std::vector<double> labels;
+			for (int row = 0; row < 997; row++) {
+				const double x = (row % 31) * 0.1 - 1.5, y = (row % 17) * 0.2 - 1.7;
+				rows.push_back({ x, y });
+				labels.push_back(0.3 + x - 0.7 * x * y + 0.01 * (row % 7));
+			}
+			Dataframe<double> df(rows, labels, { "x", "y", "label" });
+
+			PolynomialModel first(2), second(2);
+			first.fit(df, 30, 0.05);
+			second.fit(df, 30, 0.05);
+
+			const MultivariatePolynomial<double> first_polynomial = first.get_plaintext_polynomial();
+			const MultivariatePolynomial<double> second_polynomial = second.get_plaintext_polynomial();
+			const std::vector<MonomialTerm<double>> & first_terms = first_polynomial.get_terms();
+			const std::vector<MonomialTerm<double>> & second_terms = second_polynomial.get_terms();
+			Assert::AreEqual(first_terms.size(), second_terms.size(), L"repeated fits must have the same terms", LINE_INFO());
+			for (std::size_t term = 0; term < first_terms.size(); term++) {
+				Assert::IsTrue(first_terms[term].coefficient == second_terms[term].coefficient, L"repeated fits must have identical coefficients", LINE_INFO());
+			}
+		}
+
+		TEST_METHOD(PolynomialModelEncryptedFitNeedsEncryptionManager)
+		{
+			std::shared_ptr<EncryptionManager> enc_manager = std::make_shared<EncryptionManager>();
+			Dataframe<double> df({ { 1, 2 }, { 3, 4 } }, { 10, 20 }, { "x", "y", "label" });
+			const Dataframe<EncryptedNumber> encrypted_df = enc_manager->encrypt_dataframe(df);
+
+			PolynomialModel model(2);
+			Assert::ExpectException<MissingEncryptionManagerException>([&]() { model.fit(encrypted_df, 1, 0.1, nullptr); }, L"encrypted training without an encryption manager must throw", LINE_INFO());
+		}
+	};
+
+	TEST_CLASS(ColumnarDataframeTest)
+	{
+	public:
+
+		TEST_METHOD(ColumnsAreAlignedAndContiguous)
+		{
+			Dataframe<double> df({ { 1, 2 }, { 3, 4 }, { 5, 6 } }, { 10, 20, 30 }, { "x", "y", "label" });
+			ColumnarDataframe<double> columnar(df);
+
+			for (unsigned column = 0; column < 2; column++) {
+				Assert::IsTrue(reinterpret_cast<uintptr_t>(columnar.get_column(column).data()) % 64 == 0, L"columns must be 64-byte aligned", LINE_INFO());
+			}
+			Assert::IsTrue(reinterpret_cast<uintptr_t>(columnar.get_labels().data()) % 64 == 0, L"labels column must be 64-byte aligned", LINE_INFO());
+
+			Assert::AreEqual(5.0, columnar.get_column(0)[2], TOLERANCE, L"column x, row 2 mismatch", LINE_INFO());
+			Assert::AreEqual(4.0, columnar.get_row_feature(1)[1], TOLERANCE, L"row 1, column y mismatch", LINE_INFO());
+			Assert::AreEqual(30.0, columnar.get_row_label(2), TOLERANCE, L"label of row 2 mismatch", LINE_INFO());
+		}
+
+		TEST_METHOD(RoundTripToDataframe)
+		{
+			Dataframe<double> df({ { 1, 2 }, { 3, 4 } }, { 10, 20 }, { "x", "y", "label" });
+			const Dataframe<double> round_trip = ColumnarDataframe<double>(df).to_dataframe();
+
+			Assert::IsTrue(round_trip.get_features() == df.get_features(), L"features must survive a columnar round trip", LINE_INFO());
+			Assert::IsTrue(round_trip.get_labels() == df.get_labels(), L"labels must survive a columnar round trip", LINE_INFO());
+		}
+
+		TEST_METHOD(LinearModelColumnarMatchesRowMajor)
+		{
+			Dataframe<double> df({ { 1, 2 }, { 3, 4 }, { 5, 7 } }, { 10, 20, 31 }, { "x", "y", "label" });
+
+			LinearModel row_major, columnar;
+			row_major.fit(df, 20, 0.001);
+			columnar.fit(ColumnarDataframe<double>(df), 20, 0.001);
+
+			Assert::AreEqual(row_major.compute_mean_square_error(df, 100), columnar.compute_mean_square_error(df, 100), TOLERANCE, L"columnar training must match row-major training", LINE_INFO());
+		}
+
+		TEST_METHOD(EncryptColumnarDataframe)
+		{
+			EncryptionManager enc_manager;
+			DecryptionManager dec_manager(enc_manager.get_secret_key());
+
+			Dataframe<double> df({ { 1.5, 2 }, { 3, 4 } }, { 10, 20 }, { "x", "y", "label" });
+			const ColumnarDataframe<EncryptedNumber> encrypted = enc_manager.encrypt_dataframe(ColumnarDataframe<double>(df));
+
+			Assert::AreEqual(1.5, dec_manager.decrypt(encrypted.get_column(0)[0]), TOLERANCE, L"encrypted column mismatch", LINE_INFO());
+			Assert::AreEqual(20.0, dec_manager.decrypt(encrypted.get_row_label(1)), TOLERANCE, L"encrypted label mismatch", LINE_INFO());
+		}
+	};
+
+	TEST_CLASS(SparseDataframeTest)
+	{
+	public:
+
+		TEST_METHOD(StoresOnlyNonzeros)
+		{
+			Dataframe<double> df({ { 0, 2, 0 }, { 1, 0, 0 }, { 0, 0, 3 } }, { 10, 20, 30 }, { "x", "y", "z", "label" });
+			const SparseDataframe<double> sparse(df);
+
+			Assert::AreEqual(static_cast<std::size_t>(3), sparse.nonzeros(), L"only the nonzeros must be stored", LINE_INFO());
+			Assert::AreEqual(static_cast<std::size_t>(1), sparse.get_row_view(0).nonzeros(), L"row 0 has a single nonzero", LINE_INFO());
+			Assert::AreEqual(2.0, sparse.get_row_view(0)[1], TOLERANCE, L"row 0, column y mismatch", LINE_INFO());
+			Assert::AreEqual(0.0, sparse.get_row_view(0)[2], TOLERANCE, L"an absent value must read as zero", LINE_INFO());
+			Assert::AreEqual(3.0, sparse.get_columns().col(2).value(0), TOLERANCE, L"column z mismatch", LINE_INFO());
+			Assert::IsTrue(sparse.to_dense().get_features() == df.get_features(), L"features must survive a sparse round trip", LINE_INFO());
+		}
+
+		TEST_METHOD(LinearModelSparseMatchesRowMajor)
+		{
+			Dataframe<double> df({ { 1, 0, 0 }, { 0, 4, 0 }, { 5, 0, 2 }, { 0, 0, 1 } }, { 10, 20, 31, 4 }, { "x", "y", "z", "label" });
+			const SparseDataframe<double> sparse(df);
+
+			LinearModel row_major, sparse_model;
+			row_major.fit(df, 20, 0.001);
+			sparse_model.fit(sparse, 20, 0.001);
+
+			Assert::AreEqual(row_major.compute_mean_square_error(df, 100), sparse_model.compute_mean_square_error(df, 100), TOLERANCE, L"sparse training must match row-major training", LINE_INFO());
+			Assert::AreEqual(row_major.predict(df.get_row_view(2)), sparse_model.predict(sparse.get_row_view(2)), TOLERANCE, L"sparse prediction must match row-major prediction", LINE_INFO());
+		}
+
+		TEST_METHOD(NeuralNetworkSparseMatchesRowMajor)
+		{
+			// every feature is zero in two rows out of three
+			const unsigned rows = 24, epochs = 3;
+			std::vector<std::vector<double>> features;
+			std::vector<double> labels;
+			for (unsigned row = 0; row < rows; row++) {
+				std::vector<double> values(6, 0.0);
+				for (unsigned feature = 0; feature < values.size(); feature++) {
+					if ((row + feature) % 3 == 0) {
+						values[feature] = std::sin(row * 0.9 + feature);
+					}
+				}
+				features.push_back(values);
+				labels.push_back(values[0] - 2 * values[3] + values[5]);
+			}
+			Dataframe<double> df(features, labels, { "a", "b", "c", "d", "e", "f", "label" });
+			const SparseDataframe<double> sparse(df);
+
+			const unsigned batch_sizes[] = { 1, 5 };
+			for (const unsigned batch_size : batch_sizes) {
+				NeuralNetwork row_major = sparse_test_network(batch_size, Optimizer::sgd()), sparse_network = sparse_test_network(batch_size, Optimizer::sgd());
+				row_major.fit(df, epochs, 0.05);
+				sparse_network.fit(sparse, epochs, 0.05);
+
+				const std::vector<double> expected = network_parameters(row_major), parameters = network_parameters(sparse_network);
+				for (std::size_t parameter = 0; parameter < expected.size(); parameter++) {
+					Assert::AreEqual(expected[parameter], parameters[parameter], 1e-10, L"sparse gradient descent must match row-major training", LINE_INFO());
+				}
+				Assert::AreEqual(row_major.compute_mean_square_error(df, 100), sparse_network.compute_mean_square_error(sparse, 100), 1e-10, L"sparse mse must match row-major mse", LINE_INFO());
+			}
+
+			// per-row Adam skips the connections of the zero inputs of every row, within the bound documented by fit
+			const double rate = 0.01, beta1 = 0.9, beta2 = 0.999;
+			NeuralNetwork row_major = sparse_test_network(1, Optimizer::adam(beta1, beta2)), sparse_network = sparse_test_network(1, Optimizer::adam(beta1, beta2));
+			row_major.fit(df, epochs, rate);
+			sparse_network.fit(sparse, epochs, rate);
+
+			const std::vector<double> expected = network_parameters(row_major), parameters = network_parameters(sparse_network);
+			const double bound = 2.0 * rows * epochs * rate * (1 - beta1) / std::sqrt(1 - beta2);
+			double divergence = 0.0;
+			for (std::size_t parameter = 0; parameter < expected.size(); parameter++) {
+				divergence = std::max(divergence, std::abs(expected[parameter] - parameters[parameter]));
+			}
+			Assert::IsTrue(divergence > 0.0, L"lazy adam updates must skip the zero inputs", LINE_INFO());
+			Assert::IsTrue(divergence <= bound, L"lazy adam updates exceed the documented divergence", LINE_INFO());
+		}
+	private:
+		static NeuralNetwork sparse_test_network(const unsigned batch_size, const Optimizer & optimizer) {
+			static std::ostringstream log;
+			std::vector<std::string> symbols = { "a", "b", "c", "d", "e", "f" };
+			NeuralNetwork network(log);
+			network.set_seed(11);
+			network.add_layer(6, &symbols);
+			network.add_layer(5);
+			network.add_layer(1);
+			network.set_batch_size(batch_size);
+			network.set_optimizer(optimizer);
+			network.set_activation_accuracy(ActivationAccuracy::exact);
+			return network;
+		}
+
+		static std::vector<double> network_parameters(const NeuralNetwork & network) {
+			// every connection, then the biases, as stored by save
+			network.save("sparse_network_test.lomf");
+			std::vector<double> parameters;
+			{
+				const LomfFile file("sparse_network_test.lomf");
+				for (std::size_t layer = 0; layer < file.count(LomfRole::weights); layer++) {
+					const Matrix<double> weights(file.values(LomfRole::weights, layer));
+					for (unsigned row = 0; row < weights.get_shape().rows; row++) {
+						parameters.insert(parameters.end(), weights.row(row).data(), weights.row(row).data() + weights.get_shape().cols);
+					}
+				}
+				const std::vector<double> biases = file.vector(LomfRole::biases);
+				parameters.insert(parameters.end(), biases.begin(), biases.end());
+			}
+			std::remove("sparse_network_test.lomf");
+			return parameters;
+		}
+	};
+
+	TEST_CLASS(NeuralNetworkTrainingTest)
+	{
+	public:
+
+		TEST_METHOD(MiniBatchMatchesSummedRowSteps)
+		{
+			// with a tiny learning rate the parameters barely move within an epoch, so a step along the mean gradient of a
+			// batch of B rows at B times the learning rate must match B steps of one row, up to second order terms
+			std::vector<std::vector<double>> features;
+			std::vector<double> labels;
+			for (unsigned row = 0; row < 10; row++) {
+				features.push_back({ std::sin(row * 1.0), std::cos(row * 0.5), row * 0.1 });
+				labels.push_back(1.0 + row * 0.3);
+			}
+			Dataframe<double> df(features, labels, { "x", "y", "z", "label" });
+			std::vector<std::string> symbols = { "x", "y", "z" };
+
+			std::ostringstream log;
+			NeuralNetwork per_row(log);
+			per_row.add_layer(3, &symbols);
+			per_row.add_layer(4);
+			per_row.add_layer(2);
+			per_row.add_layer(1);
+			NeuralNetwork batched(per_row); // the same initial parameters
+			batched.set_batch_size(5);
+
+			const double initial_prediction = per_row.predict(df.get_row_view(3));
+			per_row.fit(df, 1, 1e-6);
+			batched.fit(df, 1, 5e-6);
+
+			const double moved = std::abs(per_row.predict(df.get_row_view(3)) - initial_prediction);
+			Assert::IsTrue(moved > 1e-8, L"training must move the prediction", LINE_INFO());
+			for (unsigned row = 0; row < 10; row++) {
+				Assert::AreEqual(per_row.predict(df.get_row_view(row)), batched.predict(df.get_row_view(row)), moved * 1e-3, L"mini-batch step must match the summed row steps", LINE_INFO());
+			}
+		}
+
+		TEST_METHOD(ParallelBatchesAreReproducible)
+		{
+			// the shards of a batch are reduced in a fixed order, so training twice with the same thread count must give
+			// the same parameters bit for bit, and another thread count may only change the rounding
+			std::vector<std::vector<double>> features;
+			std::vector<double> labels;
+			for (unsigned row = 0; row < 100; row++) {
+				features.push_back({ std::sin(row * 1.3), std::cos(row * 0.7), row * 0.01 });
+				labels.push_back(std::cos(row * 0.3));
+			}
+			Dataframe<double> df(features, labels, { "x", "y", "z", "label" });
+			std::vector<std::string> symbols = { "x", "y", "z" };
+
+			std::ostringstream log;
+			NeuralNetwork first(log);
+			first.add_layer(3, &symbols);
+			first.add_layer(8);
+			first.add_layer(5);
+			first.add_layer(1);
+			first.set_batch_size(32);
+			NeuralNetwork second(first), single_thread(first);
+
+#ifndef _SEQUENTIAL
+			const int max_threads = omp_get_max_threads();
+			omp_set_num_threads(4);
+#endif
+			first.fit(df, 3, 0.1);
+			second.fit(df, 3, 0.1);
+#ifndef _SEQUENTIAL
+			omp_set_num_threads(1);
+#endif
+			single_thread.fit(df, 3, 0.1);
+#ifndef _SEQUENTIAL
+			omp_set_num_threads(max_threads);
+#endif
+
+			for (unsigned row = 0; row < 100; row += 9) {
+				const double prediction = first.predict(df.get_row_view(row));
+				Assert::IsTrue(prediction == second.predict(df.get_row_view(row)), L"parallel training must be reproducible", LINE_INFO());
+				Assert::AreEqual(prediction, single_thread.predict(df.get_row_view(row)), TOLERANCE, L"thread count must only change the rounding", LINE_INFO());
+			}
+		}
+
+		TEST_METHOD(AdaptiveOptimizersConvergeInFewerEpochs)
+		{
+			// a few epochs of Adam, row by row and in mini-batches, must reach a lower error than the same epochs of SGD
+			std::vector<std::vector<double>> features;
+			std::vector<double> labels;
+			for (unsigned row = 0; row < 100; row++) {
+				features.push_back({ std::sin(row * 1.3), std::cos(row * 0.7), row * 0.01 });
+				labels.push_back(0.5 + 0.4 * std::cos(row * 0.3));
+			}
+			Dataframe<double> df(features, labels, { "x", "y", "z", "label" });
+			std::vector<std::string> symbols = { "x", "y", "z" };
+
+			std::ostringstream log;
+			NeuralNetwork sgd(log);
+			sgd.add_layer(3, &symbols);
+			sgd.add_layer(6);
+			sgd.add_layer(1);
+			NeuralNetwork adam(sgd), batched_sgd(sgd), batched_adam(sgd);
+			adam.set_optimizer(Optimizer::adam());
+			batched_sgd.set_batch_size(10);
+			batched_adam.set_batch_size(10);
+			batched_adam.set_optimizer(Optimizer::adam());
+
+			sgd.fit(df, 5, 0.01);
+			adam.fit(df, 5, 0.01);
+			batched_sgd.fit(df, 5, 0.01);
+			batched_adam.fit(df, 5, 0.01);
+
+			double errors[4] = { 0, 0, 0, 0 };
+			for (unsigned row = 0; row < 100; row++) {
+				NeuralNetwork * networks[4] = { &sgd, &adam, &batched_sgd, &batched_adam };
+				for (unsigned i = 0; i < 4; i++) {
+					const double error = labels[row] - networks[i]->predict(df.get_row_view(row));
+					errors[i] += error * error;
+				}
+			}
+			Assert::IsTrue(errors[1] < errors[0], L"adam must converge faster than sgd", LINE_INFO());
+			Assert::IsTrue(errors[3] < errors[2], L"batched adam must converge faster than batched sgd", LINE_INFO());
+
+			// LinearModel updates one coefficient at a time; momentum must get closer to the labels than plain gradient descent
+			std::vector<double> linear_labels;
+			for (unsigned row = 0; row < 100; row++) {
+				linear_labels.push_back(1.0 + 2.0 * features[row][0] - features[row][1] + 3.0 * features[row][2]);
+			}
+			Dataframe<double> linear_df(features, linear_labels, { "x", "y", "z", "label" });
+			LinearModel linear_sgd, linear_momentum;
+			linear_momentum.set_optimizer(Optimizer::momentum());
+			linear_sgd.fit(linear_df, 20, 0.003);
+			linear_momentum.fit(linear_df, 20, 0.003);
+
+			double linear_errors[2] = { 0, 0 };
+			for (unsigned row = 0; row < 100; row++) {
+				const double sgd_error = linear_labels[row] - linear_sgd.predict(linear_df.get_row_view(row));
+				const double momentum_error = linear_labels[row] - linear_momentum.predict(linear_df.get_row_view(row));
+				linear_errors[0] += sgd_error * sgd_error;
+				linear_errors[1] += momentum_error * momentum_error;
+			}
+			Assert::IsTrue(linear_errors[1] < linear_errors[0], L"momentum must converge faster than gradient descent", LINE_INFO());
+		}
+	};
+
+	TEST_CLASS(FixedNeuralNetworkTest)
+	{
+	public:
+
+		TEST_METHOD(TrainsLikeNeuralNetwork)
+		{
+			std::vector<std::vector<double>> features;
+			std::vector<double> labels;
+			for (unsigned row = 0; row < 20; row++) {
+				features.push_back({ std::sin(row * 1.3), std::cos(row * 0.7), row * 0.05 });
+				labels.push_back(features.back()[0] - 2 * features.back()[2]);
+			}
+			Dataframe<double> df(features, labels, { "x", "y", "z", "label" });
+			std::vector<std::string> symbols = { "x", "y", "z" };
+
+			// the fixed-size network starts from the parameters of the dynamic one
+			std::ostringstream log;
+			NeuralNetwork network(log);
+			network.set_seed(5);
+			network.add_layer(3, &symbols);
+			network.add_layer(4);
+			network.add_layer(1);
+			network.save("fixed_network_test.lomf");
+			FixedNeuralNetwork<3, 4, 1> fixed(log, symbols);
+			fixed.load("fixed_network_test.lomf");
+			std::remove("fixed_network_test.lomf");
+
+			for (unsigned row = 0; row < 20; row++) {
+				Assert::AreEqual(network.predict(df.get_row_view(row)), fixed.predict(df.get_row_view(row)), 1e-9, L"loaded fixed-size network must predict as the network", LINE_INFO());
+			}
+
+			const double initial_prediction = network.predict(df.get_row_view(3));
+			network.fit(df, 5, 0.05);
+			fixed.fit(df, 5, 0.05);
+			Assert::IsTrue(std::abs(network.predict(df.get_row_view(3)) - initial_prediction) > 1e-4, L"training must move the prediction", LINE_INFO());
+			for (unsigned row = 0; row < 20; row++) {
+				Assert::AreEqual(network.predict(df.get_row_view(row)), fixed.predict(df.get_row_view(row)), 1e-9, L"fixed-size network must train as the network", LINE_INFO());
+			}
+			Assert::AreEqual(network.compute_mean_square_error(df, 100), fixed.compute_mean_square_error(df, 100), 1e-9, L"fixed-size network mse mismatch", LINE_INFO());
+		}
+
+		TEST_METHOD(EncryptedOperationsAreUnsupported)
+		{
+			std::shared_ptr<EncryptionManager> enc_manager = std::make_shared<EncryptionManager>();
+			Dataframe<double> df({ { 1, 2 }, { 3, 4 } }, { 10, 20 }, { "x", "y", "label" });
+			const Dataframe<EncryptedNumber> encrypted_df = enc_manager->encrypt_dataframe(df);
+			const std::unordered_map<std::string, EncryptedNumber> features = { { "x", enc_manager->encrypt(1.0) }, { "y", enc_manager->encrypt(2.0) } };
+
+			std::ostringstream log;
+			FixedNeuralNetwork<2, 3, 1> fixed(log, { "x", "y" });
+			Assert::ExpectException<UnsupportedOperationException>([&]() { fixed.predict(features, nullptr); }, L"encrypted map prediction must throw", LINE_INFO());
+			Assert::ExpectException<UnsupportedOperationException>([&]() { fixed.predict(encrypted_df.get_row_view(0), nullptr); }, L"encrypted row prediction must throw", LINE_INFO());
+			Assert::ExpectException<UnsupportedOperationException>([&]() { fixed.fit(encrypted_df, 1, 0.1, nullptr); }, L"encrypted training must throw", LINE_INFO());
+			Assert::ExpectException<UnsupportedOperationException>([&]() { fixed.compute_mean_square_error(encrypted_df, 2); }, L"encrypted mse must throw", LINE_INFO());
+		}
+	};
+
+	TEST_CLASS(InferenceModelTest)
+	{
+	public:
+
+		TEST_METHOD(FrozenModelMatchesNetwork)
+		{
+			std::vector<std::vector<double>> features;
+			std::vector<double> labels;
+			for (unsigned row = 0; row < 300; row++) {
+				features.push_back({ std::sin(row * 1.3), std::cos(row * 0.7), row * 0.01 });
+				labels.push_back(std::cos(row * 0.3));
+			}
+			Dataframe<double> df(features, labels, { "x", "y", "z", "label" });
+			std::vector<std::string> symbols = { "z", "x", "y" }; // not in column order
+
+			std::ostringstream log;
+			NeuralNetwork nn(log);
+			nn.add_layer(3, &symbols);
+			nn.add_layer(7);
+			nn.add_layer(5);
+			nn.add_layer(1);
+			nn.fit(df, 2, 0.1);
+
+			const InferenceModel model = nn.freeze();
+			std::vector<RowView<double>> rows;
+			std::vector<double> expected;
+			for (unsigned row = 0; row < 300; row++) {
+				rows.push_back(df.get_row_view(row));
+				expected.push_back(nn.predict(df.get_row_view(row)));
+				Assert::AreEqual(expected[row], model.predict(df.get_row_view(row)), TOLERANCE, L"frozen prediction mismatch", LINE_INFO());
+			}
+
+			std::vector<double> predictions(300);
+			InferenceArena arena;
+			model.predict(Span<const RowView<double>>(rows.data(), rows.size()), Span<double>(predictions.data(), predictions.size()), arena);
+			for (unsigned row = 0; row < 300; row++) {
+				Assert::AreEqual(expected[row], predictions[row], TOLERANCE, L"batched prediction mismatch", LINE_INFO());
+			}
+
+			const std::unordered_map<std::string, double> named = { { "x", features[4][0] }, { "y", features[4][1] }, { "z", features[4][2] } };
+			Assert::AreEqual(expected[4], model.predict(named), TOLERANCE, L"named feature prediction mismatch", LINE_INFO());
+
+			nn.fit(df, 1, 0.1);
+			Assert::AreEqual(expected[0], model.predict(df.get_row_view(0), arena), TOLERANCE, L"training must not affect a frozen model", LINE_INFO());
+		}
+
+		TEST_METHOD(ConcurrentPredictions)
+		{
+			std::vector<std::vector<double>> features;
+			std::vector<double> labels;
+			for (unsigned row = 0; row < 200; row++) {
+				features.push_back({ std::sin(row * 0.9), row * 0.02 });
+				labels.push_back(row * 0.01);
+			}
+			Dataframe<double> df(features, labels, { "a", "b", "label" });
+			std::vector<std::string> symbols = { "a", "b" };
+
+			std::ostringstream log;
+			NeuralNetwork nn(log);
+			nn.add_layer(2, &symbols);
+			nn.add_layer(16);
+			nn.add_layer(1);
+			const InferenceModel model = nn.freeze();
+
+			double expected = 0.0;
+			for (unsigned row = 0; row < 200; row++) {
+				expected += model.predict(df.get_row_view(row));
+			}
+
+			// every thread predicts with its own arena, through the same model
+			std::vector<double> sums(4, 0.0);
+			std::vector<std::thread> threads;
+			for (unsigned thread = 0; thread < sums.size(); thread++) {
+				threads.push_back(std::thread([&, thread]() {
+					for (unsigned row = 0; row < 200; row++) {
+						sums[thread] += model.predict(df.get_row_view(row));
+					}
+				}));
+			}
+			for (std::thread & thread : threads) {
+				thread.join();
+			}
+
+			for (const double sum : sums) {
+				Assert::IsTrue(sum == expected, L"concurrent predictions must match", LINE_INFO());
+			}
+		}
+
+		TEST_METHOD(QuantizedModelTracksNetwork)
+		{
+			// inputs on very different scales, a constant input and a network wide enough to use every kernel path
+			std::vector<std::vector<double>> features;
+			std::vector<double> labels;
+			for (unsigned row = 0; row < 300; row++) {
+				features.push_back({ std::sin(row * 1.3) * 20.0 + 8.0, std::cos(row * 0.7) * 0.01, 3.0, row * 0.01 });
+				labels.push_back(std::cos(row * 0.3));
+			}
+			Dataframe<double> df(features, labels, { "x", "y", "c", "z", "label" });
+			std::vector<std::string> symbols = { "z", "x", "c", "y" };
+
+			std::ostringstream log;
+			NeuralNetwork nn(log);
+			nn.add_layer(4, &symbols);
+			nn.add_layer(40);
+			nn.add_layer(9);
+			nn.add_layer(1);
+			nn.fit(df, 2, 0.1);
+
+			const InferenceModel model = nn.freeze();
+			const QuantizedModel quantized = nn.quantize(df);
+			std::vector<RowView<double>> rows;
+			double low = std::numeric_limits<double>::infinity(), high = -low;
+			for (unsigned row = 0; row < 300; row++) {
+				rows.push_back(df.get_row_view(row));
+				low = std::min(low, model.predict(rows.back()));
+				high = std::max(high, model.predict(rows.back()));
+			}
+
+			std::vector<double> predictions(300);
+			InferenceArena arena;
+			quantized.predict(Span<const RowView<double>>(rows.data(), rows.size()), Span<double>(predictions.data(), predictions.size()), arena);
+			double squared_error = 0;
+			for (unsigned row = 0; row < 300; row++) {
+				const double error = predictions[row] - model.predict(rows[row]);
+				squared_error += error * error;
+				Assert::AreEqual(0.0, error, 0.1 * (high - low), L"quantized prediction strays from the network", LINE_INFO());
+				Assert::IsTrue(predictions[row] == quantized.predict(rows[row]), L"batched quantized prediction mismatch", LINE_INFO());
+			}
+			Assert::IsTrue(std::sqrt(squared_error / 300) < 0.02 * (high - low), L"quantization error must stay within a few int8 steps", LINE_INFO());
+
+			Dataframe<double> missing(features, labels, { "x", "y", "d", "z", "label" });
+			Assert::ExpectException<MissingColumnException>([&]() { quantized.predict(missing.get_row_view(0)); }, L"a missing input must throw", LINE_INFO());
+		}
+	};
+
+	TEST_CLASS(RowViewTest)
+	{
+	public:
+
+		TEST_METHOD(RowViewReadsInPlace)
+		{
+			Dataframe<double> df({ { 1, 2 }, { 3, 4 } }, { 10, 20 }, { "x", "y", "label" });
+			const RowView<double> row = df.get_row_view(1);
+
+			Assert::IsTrue(row.data() == df.get_row_feature_array(1).data(), L"row view must reference the dataframe storage", LINE_INFO());
+			Assert::AreEqual(4.0, row["y"], TOLERANCE, L"symbol lookup mismatch", LINE_INFO());
+
+			ColumnarDataframe<double> columnar(df);
+			Assert::AreEqual(4.0, columnar.get_row_view(1)[1], TOLERANCE, L"columnar row view mismatch", LINE_INFO());
+			Assert::ExpectException<MissingColumnException>([&row]() { row["z"]; }, L"unknown symbols must throw", LINE_INFO());
+		}
+
+		TEST_METHOD(PredictFromRowViewMatchesMap)
+		{
+			Dataframe<double> df({ { 1, 2 }, { 3, 4 }, { 5, 7 } }, { 10, 20, 31 }, { "x", "y", "label" });
+			const ColumnarDataframe<double> columnar(df);
+
+			LinearModel model;
+			model.fit(df, 20, 0.001);
+
+			for (unsigned row = 0; row < 3; row++) {
+				const double expected = model.predict(df.get_row_feature(row));
+				Assert::AreEqual(expected, model.predict(df.get_row_view(row)), TOLERANCE, L"row-major row view prediction mismatch", LINE_INFO());
+				Assert::AreEqual(expected, model.predict(columnar.get_row_view(row)), TOLERANCE, L"columnar row view prediction mismatch", LINE_INFO());
+			}
+		}
+
+		TEST_METHOD(EncryptedPredictFromRowView)
+		{
+			std::shared_ptr<EncryptionManager> enc_manager = std::make_shared<EncryptionManager>();
+			DecryptionManager dec_manager(enc_manager->get_secret_key());
+
+			Dataframe<double> df({ { 1, 2 }, { 3, 4 } }, { 10, 20 }, { "x", "y", "label" });
+			const Dataframe<EncryptedNumber> encrypted_df = enc_manager->encrypt_dataframe(df);
+
+			LinearModel model;
+			model.fit(df, 10, 0.001);
+			model.encrypt_model(enc_manager);
+
+			const double expected = model.predict(df.get_row_feature(1));
+			Assert::AreEqual(expected, dec_manager.decrypt(model.predict(encrypted_df.get_row_view(1))), TOLERANCE, L"encrypted row view prediction mismatch", LINE_INFO());
+		}
+	};
+
+	TEST_CLASS(DataframeViewTest)
+	{
+	public:
+
+		TEST_METHOD(ViewsShareStorage)
+		{
+			Dataframe<double> df({ { 1, 2, 3 }, { 4, 5, 6 }, { 7, 8, 9 }, { 10, 11, 12 } }, { 10, 20, 30, 40 }, { "x", "y", "z", "label" });
+			const Dataframe<double> copy(df);
+			const Dataframe<double> slice = df.slice(1, 3);
+			const Dataframe<double> taken = df.take({ 3, 0 });
+
+			Assert::IsTrue(copy.get_row_feature_array(0).data() == df.get_row_feature_array(0).data(), L"copies must share storage", LINE_INFO());
+			Assert::IsTrue(slice.get_row_feature_array(0).data() == df.get_row_feature_array(1).data(), L"slices must share storage", LINE_INFO());
+			Assert::AreEqual(2u, slice.shape().rows, L"slice row count mismatch", LINE_INFO());
+			Assert::AreEqual(40.0, taken.get_row_label(0), TOLERANCE, L"taken row label mismatch", LINE_INFO());
+			Assert::AreEqual(10.0, taken.slice(1, 2).take({ 0 }).get_row_label(0), TOLERANCE, L"nested views must compose", LINE_INFO());
+			Assert::ExpectException<DataframeViewException>([&slice]() { slice.get_features(); }, L"views must not expose the whole storage", LINE_INFO());
+		}
+
+		TEST_METHOD(SelectColumns)
+		{
+			Dataframe<double> df({ { 1, 2, 3 }, { 4, 5, 6 } }, { 10, 20 }, { "x", "y", "z", "label" });
+			const Dataframe<double> selected = df.slice(1, 2).select({ "z", "x" });
+
+			Assert::AreEqual(3u, static_cast<unsigned>(selected.shape().columns), L"selected column count mismatch", LINE_INFO());
+			Assert::AreEqual(6.0, selected.get_row_view(0)[0], TOLERANCE, L"selected column order mismatch", LINE_INFO());
+			Assert::AreEqual(4.0, selected.get_row_view(0)["x"], TOLERANCE, L"selected symbol lookup mismatch", LINE_INFO());
+			Assert::AreEqual(4.0, selected.select({ "x" }).get_row_feature(0).at("x"), TOLERANCE, L"nested selections must compose", LINE_INFO());
+			Assert::IsTrue(selected.materialize().get_features() == std::vector<std::vector<double>>{ { 6, 4 } }, L"materialized view mismatch", LINE_INFO());
+		}
+
+		TEST_METHOD(TrainTestSplitAndKFold)
+		{
+			std::vector<std::vector<double>> features;
+			std::vector<double> labels;
+			for (unsigned row = 0; row < 10; row++) {
+				features.push_back({ static_cast<double>(row) });
+				labels.push_back(row);
+			}
+			Dataframe<double> df(features, labels, { "x", "label" });
+
+			const std::pair<Dataframe<double>, Dataframe<double>> split = df.train_test_split(0.3, true, 7);
+			Assert::AreEqual(7u, split.first.shape().rows, L"train row count mismatch", LINE_INFO());
+			Assert::AreEqual(3u, split.second.shape().rows, L"test row count mismatch", LINE_INFO());
+
+			std::vector<int> seen(10, 0);
+			for (unsigned row = 0; row < 7; row++) {
+				seen[static_cast<int>(split.first.get_row_label(row))]++;
+			}
+			for (unsigned row = 0; row < 3; row++) {
+				seen[static_cast<int>(split.second.get_row_label(row))]++;
+			}
+			Assert::IsTrue(std::count(seen.begin(), seen.end(), 1) == 10, L"split must partition the rows", LINE_INFO());
+
+			for (const std::pair<Dataframe<double>, Dataframe<double>> & fold : df.slice(0, 9).k_fold(3, false)) {
+				std::vector<int> fold_seen(9, 0);
+				for (unsigned row = 0; row < fold.first.shape().rows; row++) {
+					fold_seen[static_cast<int>(fold.first.get_row_label(row))]++;
+				}
+				for (unsigned row = 0; row < fold.second.shape().rows; row++) {
+					fold_seen[static_cast<int>(fold.second.get_row_label(row))]++;
+				}
+				Assert::AreEqual(3u, fold.second.shape().rows, L"fold test row count mismatch", LINE_INFO());
+				Assert::IsTrue(std::count(fold_seen.begin(), fold_seen.end(), 1) == 9, L"each fold must partition the rows", LINE_INFO());
+			}
+		}
+	};
+
+	TEST_CLASS(LodfTest)
+	{
+	public:
+
+		TEST_METHOD(RoundTripIsMappedInPlace)
+		{
+			Dataframe<double> df({ { 1, 2 }, { 3, 4 }, { 5, 6 } }, { 10, 20, 30 }, { "x", "y", "label" });
+			write_lodf("lodf_round_trip.lodf", ColumnarDataframe<double>(df));
+
+			{
+				const LodfFile file("lodf_round_trip.lodf");
+				const ColumnarDataframe<double> & mapped = file.get_dataframe();
+
+				Assert::IsTrue(mapped.get_headers() == df.get_headers(), L"headers must survive the round trip", LINE_INFO());
+				Assert::IsTrue(reinterpret_cast<uintptr_t>(mapped.get_column(1).data()) % 64 == 0, L"mapped columns must be 64-byte aligned", LINE_INFO());
+				Assert::IsTrue(mapped.to_dataframe().get_features() == df.get_features(), L"features must survive the round trip", LINE_INFO());
+				Assert::AreEqual(30.0, mapped.get_row_label(2), TOLERANCE, L"label mismatch", LINE_INFO());
+
+				Assert::IsTrue(file.has_statistics(), L"statistics must be stored by default", LINE_INFO());
+				Assert::AreEqual(1.0, file.get_statistics(0).minimum, TOLERANCE, L"column minimum mismatch", LINE_INFO());
+				Assert::AreEqual(6.0, file.get_statistics(1).maximum, TOLERANCE, L"column maximum mismatch", LINE_INFO());
+				Assert::AreEqual(20.0, file.get_statistics(2).mean, TOLERANCE, L"label mean mismatch", LINE_INFO());
+			}
+			std::remove("lodf_round_trip.lodf");
+		}
+
+		TEST_METHOD(RejectsInvalidFile)
+		{
+			{
+				std::ofstream stream("lodf_invalid.lodf", std::ios::binary);
+				stream << "not a learnoran dataframe, just some text that is long enough to hold a header";
+			}
+			Assert::ExpectException<InvalidFileFormatException>([]() { LodfFile("lodf_invalid.lodf"); }, L"invalid files must be rejected", LINE_INFO());
+			std::remove("lodf_invalid.lodf");
+		}
+	};
+
+	TEST_CLASS(LomfTest)
+	{
+	public:
+
+		TEST_METHOD(RegressorsRoundTrip)
+		{
+			Dataframe<double> df({ { 1, 2 }, { 3, 1 }, { 5, 6 }, { 2, 2 } }, { 10, 20, 30, 15 }, { "x", "y", "label" });
+			std::shared_ptr<EncryptionManager> enc_manager = std::make_shared<EncryptionManager>();
+			DecryptionManager dec_manager(enc_manager->get_secret_key());
+
+			LinearModel linear;
+			linear.fit(df, 5, 0.01);
+			linear.encrypt_model(enc_manager);
+			linear.save("lomf_linear.lomf");
+
+			LinearModel loaded_linear(enc_manager);
+			loaded_linear.load("lomf_linear.lomf");
+			const std::unordered_map<std::string, EncryptedNumber> encrypted_row = { { "x", enc_manager->encrypt(3) }, { "y", enc_manager->encrypt(1) } };
+			Assert::AreEqual(linear.predict(df.get_row_view(1)), loaded_linear.predict(df.get_row_view(1)), TOLERANCE, L"linear model coefficients must survive the round trip", LINE_INFO());
+			Assert::AreEqual(linear.predict(df.get_row_view(1)), dec_manager.decrypt(loaded_linear.predict(encrypted_row)), TOLERANCE, L"encrypted coefficients must survive the round trip", LINE_INFO());
+
+			PolynomialModel polynomial(2);
+			polynomial.fit(df, 5, 0.001);
+			polynomial.save("lomf_polynomial.lomf");
+
+			PolynomialModel loaded_polynomial(3);
+			loaded_polynomial.load("lomf_polynomial.lomf");
+			Assert::AreEqual(2u, loaded_polynomial.get_features().get_degree(), L"the degree must survive the round trip", LINE_INFO());
+			Assert::AreEqual(polynomial.predict(df.get_row_view(2)), loaded_polynomial.predict(df.get_row_view(2)), TOLERANCE, L"polynomial model coefficients must survive the round trip", LINE_INFO());
+
+			polynomial.encrypt_model(enc_manager);
+			polynomial.save("lomf_polynomial.lomf");
+			PolynomialModel loaded_encrypted_polynomial(3, enc_manager);
+			loaded_encrypted_polynomial.load("lomf_polynomial.lomf");
+			Assert::AreEqual(polynomial.predict(df.get_row_view(1)), dec_manager.decrypt(loaded_encrypted_polynomial.predict(encrypted_row)), TOLERANCE, L"encrypted polynomial coefficients must survive the round trip", LINE_INFO());
+
+			// a file holding only encrypted coefficients cannot be loaded without the keys they were encrypted under
+			const Dataframe<EncryptedNumber> encrypted_df = enc_manager->encrypt_dataframe(df);
+			LinearModel encrypted_linear(enc_manager);
+			encrypted_linear.fit(encrypted_df, 1, 0.01);
+			encrypted_linear.save("lomf_linear.lomf");
+			Assert::ExpectException<MissingEncryptionManagerException>([]() { LinearModel().load("lomf_linear.lomf"); }, L"encrypted linear coefficients must not load without an encryption manager", LINE_INFO());
+			PolynomialModel encrypted_polynomial(2, enc_manager);
+			encrypted_polynomial.fit(encrypted_df, 1, 0.001);
+			encrypted_polynomial.save("lomf_polynomial.lomf");
+			Assert::ExpectException<MissingEncryptionManagerException>([]() { PolynomialModel().load("lomf_polynomial.lomf"); }, L"encrypted polynomial coefficients must not load without an encryption manager", LINE_INFO());
+
+			Assert::ExpectException<InvalidFileFormatException>([]() { LinearModel().load("lomf_polynomial.lomf"); }, L"a file of another kind of model must be rejected", LINE_INFO());
+
+			// the plaintext model gains a feature the encrypted model lacks, so their coefficients cannot share symbols
+			Dataframe<double> wider_df({ { 1, 2, 0 }, { 3, 1, 1 } }, { 10, 20 }, { "x", "y", "z", "label" });
+			linear.fit(wider_df, 1, 0.01);
+			Assert::ExpectException<InvalidFileFormatException>([&linear]() { linear.save("lomf_linear.lomf"); }, L"models with different terms must not be saved together", LINE_INFO());
+			std::remove("lomf_linear.lomf");
+			std::remove("lomf_polynomial.lomf");
+		}
+
+		TEST_METHOD(NetworkIsServedFromMapping)
+		{
+			std::vector<std::vector<double>> features;
+			std::vector<double> labels;
+			for (unsigned row = 0; row < 50; row++) {
+				features.push_back({ std::sin(row * 1.3), std::cos(row * 0.7), row * 0.01 });
+				labels.push_back(features.back()[0] - 2 * features.back()[2]);
+			}
+			Dataframe<double> df(features, labels, { "x", "y", "z", "label" });
+			std::vector<std::string> symbols = { "z", "x", "y" };
+
+			std::ostringstream log;
+			NeuralNetwork nn(log);
+			nn.add_layer(3, &symbols);
+			nn.add_layer(9);
+			nn.add_layer(1);
+			nn.set_activation_accuracy(ActivationAccuracy::exact);
+			nn.fit(df, 2, 0.1);
+			nn.save("lomf_network.lomf");
+
+			{
+				const LomfFile file("lomf_network.lomf");
+				Assert::IsTrue(file.get_symbols() == symbols, L"input symbols must survive the round trip", LINE_INFO());
+				Assert::AreEqual(static_cast<std::size_t>(2), file.count(LomfRole::weights), L"one weight block per layer", LINE_INFO());
+				Assert::IsTrue(reinterpret_cast<uintptr_t>(file.values(LomfRole::weights, 1).data()) % 64 == 0, L"weight blocks must be 64-byte aligned", LINE_INFO());
+			}
+
+			NeuralNetwork loaded(log);
+			loaded.load("lomf_network.lomf");
+			const InferenceModel served = load_inference_model("lomf_network.lomf");
+			for (unsigned row = 0; row < 50; row++) {
+				const double expected = nn.predict(df.get_row_view(row));
+				Assert::IsTrue(expected == loaded.predict(df.get_row_view(row)), L"loaded network must predict exactly as the saved one", LINE_INFO());
+				Assert::AreEqual(expected, served.predict(df.get_row_view(row)), TOLERANCE, L"mapped inference model mismatch", LINE_INFO());
+			}
+			std::remove("lomf_network.lomf");
+		}
+
+		TEST_METHOD(RejectsInvalidFile)
+		{
+			{
+				std::ofstream stream("lomf_invalid.lomf", std::ios::binary);
+				stream << "not a learnoran model, just some text that is long enough to hold a header";
+			}
+			Assert::ExpectException<InvalidFileFormatException>([]() { LomfFile("lomf_invalid.lomf"); }, L"invalid files must be rejected", LINE_INFO());
+			std::remove("lomf_invalid.lomf");
+		}
+	};
+
+	TEST_CLASS(CsvParserTest)
+	{
+	public:
+
+		TEST_METHOD(FastPathMatchesStrtod)
+		{
+			const char * const fields[] = { "0", "-0.00632", "396.9", "1e5", "2.5E-3", "123456789012345678901234", "0.1", "-17", "inf", "" };
+			for (const char * field : fields) {
+				double value = -1.0;
+				parse_double(field, field + std::strlen(field), ',', value);
+				Assert::IsTrue(value == std::strtod(field, nullptr), L"parsed value must match strtod exactly", LINE_INFO());
+			}
+		}
+
+		TEST_METHOD(ParsesIntoColumns)
+		{
+			const std::string csv = "x,y,label\r\n1,2.5,10\r\n\r\n-3,4e1,20\n5,,30";
+			const ColumnarDataframe<double> df = parse_csv_columnar(csv.data(), csv.size());
+
+			Assert::IsTrue(df.get_headers() == std::vector<std::string>{ "x", "y", "label" }, L"header mismatch", LINE_INFO());
+			Assert::AreEqual(3u, df.shape().rows, L"empty lines must be skipped", LINE_INFO());
+			Assert::AreEqual(-3.0, df.get_column(0)[1], TOLERANCE, L"column x mismatch", LINE_INFO());
+			Assert::AreEqual(40.0, df.get_column(1)[1], TOLERANCE, L"column y mismatch", LINE_INFO());
+			Assert::AreEqual(0.0, df.get_column(1)[2], TOLERANCE, L"empty fields must read as 0", LINE_INFO());
+			Assert::AreEqual(30.0, df.get_row_label(2), TOLERANCE, L"label mismatch", LINE_INFO());
+		}
+
+		TEST_METHOD(MatchesLineReader)
+		{
+			{
+				std::ofstream stream("csv_parser_test.csv");
+				stream << "a,b,label\n";
+				for (unsigned row = 0; row < 1000; row++) {
+					stream << row * 0.37 << ',' << -1.0 / (row + 1) << ',' << row % 7 << '\n';
+				}
+			}
+
+			IOhelper reader;
+			reader.open_file("csv_parser_test.csv");
+			const std::pair<std::vector<std::vector<double>>, std::vector<double>> dataset = reader.read_csv();
+			const Dataframe<double> expected(dataset, reader.get_csv_header());
+			reader.open_file("csv_parser_test.csv");
+			const Dataframe<double> parsed = reader.read_csv_columnar().to_dataframe();
+
+			Assert::IsTrue(parsed.get_features() == expected.get_features(), L"features must match the line reader", LINE_INFO());
+			Assert::IsTrue(parsed.get_labels() == expected.get_labels(), L"labels must match the line reader", LINE_INFO());
+			std::remove("csv_parser_test.csv");
+		}
+	};
+
+	TEST_CLASS(TrainTestSplitReaderTest)
+	{
+	public:
+
+		TEST_METHOD(SinglePassSplit)
+		{
+			write_dataset();
+			typedef std::pair<std::vector<std::vector<double>>, std::vector<double>> Dataset;
+
+			IOhelper reader;
+			reader.open_file("split_test.csv");
+			const std::pair<Dataset, Dataset> exact = reader.read_csv_train_test_split(0.7, 100, ',', 3);
+			Assert::AreEqual(static_cast<size_t>(70), exact.first.second.size(), L"known row counts must yield exact split sizes", LINE_INFO());
+			Assert::AreEqual(static_cast<size_t>(30), exact.second.second.size(), L"test set size mismatch", LINE_INFO());
+			Assert::AreEqual(exact.first.second[5] * 2.0, exact.first.first[5][0], TOLERANCE, L"rows must keep their features and labels together", LINE_INFO());
+
+			reader.open_file("split_test.csv");
+			const std::pair<Dataset, Dataset> repeated = reader.read_csv_train_test_split(0.7, 100, ',', 3);
+			Assert::IsTrue(repeated.second.second == exact.second.second, L"the same seed must reproduce the split", LINE_INFO());
+
+			reader.open_file("split_test.csv");
+			const std::pair<Dataset, Dataset> bernoulli = reader.read_csv_train_test_split(0.7);
+			Assert::AreEqual(static_cast<size_t>(100), bernoulli.first.second.size() + bernoulli.second.second.size(), L"every row must be assigned", LINE_INFO());
+
+			std::remove("split_test.csv");
+		}
+
+		TEST_METHOD(StratifiedSplitBalancesLabels)
+		{
+			write_dataset();
+			typedef std::pair<std::vector<std::vector<double>>, std::vector<double>> Dataset;
+
+			IOhelper reader;
+			reader.open_file("split_test.csv");
+			const std::pair<Dataset, Dataset> split = reader.read_csv_train_test_split(0.7, UNKNOWN, ',', 5, true);
+
+			std::vector<int> test_rows_per_decile(10, 0);
+			for (const double label : split.second.second) {
+				test_rows_per_decile[static_cast<int>(label) / 10]++;
+			}
+			Assert::IsTrue(std::count(test_rows_per_decile.begin(), test_rows_per_decile.end(), 3) == 10, L"every label decile must contribute 30% to the test set", LINE_INFO());
+
+			std::remove("split_test.csv");
+		}
+	private:
+		static void write_dataset() {
+			// labels 0..99 in shuffled order, features are twice the label
+			std::ofstream stream("split_test.csv");
+			stream << "x,label\n";
+			for (unsigned row = 0; row < 100; row++) {
+				const unsigned label = (row * 37) % 100;
+				stream << label * 2.0 << ',' << label << '\n';
+			}
+		}
+	};
+
+	TEST_CLASS(CompressedStreamTest)
+	{
+	public:
+
+		TEST_METHOD(DecoderErrorsReachTheReader)
+		{
+			{
+				std::ofstream stream("compressed_stream_test.bin");
+				stream << "placeholder";
+			}
+
+			DecompressingInputStream stream("compressed_stream_test.bin", std::unique_ptr<BlockDecoder>(new FailingDecoder()));
+			std::string line;
+			std::getline(stream, line);
+			Assert::AreEqual(std::string("a,label"), line, L"decoded blocks must be readable in order", LINE_INFO());
+			std::getline(stream, line);
+			Assert::AreEqual(std::string("1,2"), line, L"lines spanning blocks must be joined", LINE_INFO());
+			Assert::ExpectException<DecompressionException>([&stream, &line]() { std::getline(stream, line); }, L"decoder errors must propagate", LINE_INFO());
+
+			std::remove("compressed_stream_test.bin");
+		}
+
+		TEST_METHOD(ReadsGzipInput)
+		{
+#ifdef LEARNORAN_USE_ZLIB
+			{
+				gzFile file = gzopen("compressed_stream_test.csv.gz", "wb");
+				gzputs(file, "a,b,label\n");
+				for (unsigned row = 0; row < 20000; row++) {
+					const std::string line = std::to_string(row) + "," + std::to_string(row % 13) + "," + std::to_string(row * 2) + "\n";
+					gzputs(file, line.c_str());
+				}
+				gzclose(file);
+			}
+
+			IOhelper reader;
+			reader.open_file("compressed_stream_test.csv.gz");
+			const std::pair<std::vector<std::vector<double>>, std::vector<double>> dataset = reader.read_csv();
+			Assert::AreEqual(static_cast<size_t>(20000), dataset.second.size(), L"every row must be decompressed", LINE_INFO());
+			Assert::AreEqual(39998.0, dataset.second.back(), TOLERANCE, L"last label mismatch", LINE_INFO());
+
+			reader.open_file("compressed_stream_test.csv.gz");
+			const ColumnarDataframe<double> columnar = reader.read_csv_columnar();
+			Assert::AreEqual(static_cast<size_t>(20000), columnar.shape().rows, L"columnar reader row count mismatch", LINE_INFO());
+			Assert::AreEqual(12.0, columnar.get_column(1)[12], TOLERANCE, L"columnar reader value mismatch", LINE_INFO());
+
+			// a compressed file read to its end is opened again by the next reader
+			const SparseDataframe<double> sparse = reader.read_csv_sparse();
+			Assert::AreEqual(static_cast<size_t>(20000), sparse.shape().rows, L"sparse reader must read the file again", LINE_INFO());
+			const ColumnarDataframe<double> reread = reader.read_csv_columnar();
+			Assert::AreEqual(static_cast<size_t>(20000), reread.shape().rows, L"columnar reader must read the file again", LINE_INFO());
+
+			std::remove("compressed_stream_test.csv.gz");
+#else
+			{
+				std::ofstream stream("compressed_stream_test.csv.gz");
+			}
+			IOhelper reader;
+			Assert::ExpectException<UnsupportedCompressionException>([&reader]() { reader.open_file("compressed_stream_test.csv.gz"); }, L"gzip input requires zlib support", LINE_INFO());
+			std::remove("compressed_stream_test.csv.gz");
+#endif
+		}
+	private:
+		class FailingDecoder : public BlockDecoder {
+			// yields two blocks splitting a line, then fails
+		public:
+			FailingDecoder() : calls(0) { }
+
+			std::size_t decode(std::istream &, char * output, const std::size_t) override {
+				const char * const blocks[] = { "a,label\n1", ",2\n" };
+				if (calls == 2) {
+					throw DecompressionException();
+				}
+				const std::size_t length = std::strlen(blocks[calls]);
+				std::memcpy(output, blocks[calls++], length);
+				return length;
+			}
+		private:
+			int calls;
+		};
 	};
-}
\ No newline at end of file
+}
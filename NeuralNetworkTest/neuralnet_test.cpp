@@ -1,8 +1,20 @@
 #include "stdafx.h"
 #include "CppUnitTest.h"
 #include "../Learnoran/matrix.hpp"
-
+#include "../Learnoran/fixed_matrix.hpp"
+#include "../Learnoran/sparse_matrix.hpp"
+#include "../Learnoran/activation.hpp"
+#include "../Learnoran/dense_layer.hpp"
+#include "../Learnoran/optimizer.hpp"
+#include "../Learnoran/int8_gemm.hpp"
+#include "../Learnoran/aligned_buffer.hpp"
+#include "../Learnoran/random.hpp"
+
+#include <algorithm>
 #include <vector>
+#include <cstdint>
+#include <cmath>
+#include <limits>
 
 using namespace Microsoft::VisualStudio::CppUnitTestFramework;
 
@@ -299,5 +311,572 @@ namespace NeuralNetworkTest
 				}
 			}
 		}
+
+		TEST_METHOD(ViewsShareStorageTest)
+		{
+			const unsigned rows = 5;
+			const unsigned cols = 3;
+
+			Matrix<double> mat(rows, cols);
+			for (unsigned row = 0; row < rows; row++) {
+				for (unsigned col = 0; col < cols; col++) {
+					mat(row, col) = row * 10.0 + col;
+				}
+			}
+
+			Assert::IsTrue(reinterpret_cast<std::uintptr_t>(mat.row(1).data()) % 64 == 0, L"ROWS MUST START ON ALIGNED BOUNDARIES", LINE_INFO());
+			Assert::AreEqual(21.0, mat.col(1)[2], 0.0001, L"COLUMN VIEW MISMATCH", LINE_INFO());
+
+			MatrixView<double> block = mat.submatrix(1, 1, 3, 2);
+			Assert::AreEqual(32.0, block(2, 1), 0.0001, L"SUBMATRIX VIEW MISMATCH", LINE_INFO());
+			Assert::AreEqual(32.0, block.transpose()(1, 2), 0.0001, L"TRANSPOSED VIEW MISMATCH", LINE_INFO());
+
+			block(0, 0) = -1.0;
+			mat.row(4)[2] = -2.0;
+			Assert::AreEqual(-1.0, mat(1, 1), 0.0001, L"WRITES THROUGH VIEWS MUST REACH THE MATRIX", LINE_INFO());
+			Assert::AreEqual(-2.0, mat[4][2], 0.0001, L"WRITES THROUGH VIEWS MUST REACH THE MATRIX", LINE_INFO());
+
+			const std::vector<double> row_copy = mat[3];
+			Assert::IsTrue(row_copy == std::vector<double>({ 30.0, 31.0, 32.0 }), L"ROW COPY MISMATCH", LINE_INFO());
+			Assert::IsTrue(Matrix<double>(mat.submatrix(0, 0, 2, 3)) == Matrix<double>(std::vector<std::vector<double>>({ { 0.0, 1.0, 2.0 }, { 10.0, -1.0, 12.0 } })), L"MATERIALIZED SUBMATRIX MISMATCH", LINE_INFO());
+		}
+
+		TEST_METHOD(MoveAssignmentTest)
+		{
+			Matrix<double> lhs(2, 2), rhs(2, 2);
+			rhs(1, 0) = 3.0;
+
+			lhs = std::move(rhs);
+			Assert::AreEqual(3.0, lhs(1, 0), 0.0001, L"MOVED MATRIX MISMATCH", LINE_INFO());
+			Assert::AreEqual(0u, rhs.get_shape().rows, L"MOVED-FROM MATRIX MUST BE EMPTY", LINE_INFO());
+
+			// a moved-from matrix must take a new value like any other
+			rhs = lhs;
+			Assert::AreEqual(3.0, rhs(1, 0), 0.0001, L"ASSIGNMENT TO A MOVED-FROM MATRIX MISMATCH", LINE_INFO());
+			lhs(1, 0) = 4.0;
+			Assert::AreEqual(3.0, rhs(1, 0), 0.0001, L"ASSIGNED MATRIX MUST OWN ITS ELEMENTS", LINE_INFO());
+		}
+
+		TEST_METHOD(ExpressionChainTest)
+		{
+			Matrix<double> a(std::vector<std::vector<double>>({ { 1.0, 2.0 }, { 3.0, 4.0 } }));
+			Matrix<double> b(std::vector<std::vector<double>>({ { 5.0, 6.0 }, { 7.0, 8.0 } }));
+
+			Matrix<double> chained = a + b * 2.0 - a * b;
+			Assert::AreEqual(6.0, chained(0, 0), 0.0001, L"FUSED CHAIN MISMATCH", LINE_INFO());
+			Assert::AreEqual(4.0 + 16.0 - 32.0, chained(1, 1), 0.0001, L"FUSED CHAIN MISMATCH", LINE_INFO());
+
+			// the expression owns the product it maps, so it outlives the statement that created it
+			auto mapped = a.dot(b).map(&sample_map_func);
+			const Matrix<double> evaluated = mapped;
+			Assert::AreEqual(19.0 * 19.0, evaluated(0, 0), 0.0001, L"MAPPED PRODUCT MISMATCH", LINE_INFO());
+
+			// every element only depends on the same position of the operands, so expressions may assign to an operand
+			a = a + a * 0.5;
+			Assert::AreEqual(6.0, a(1, 1), 0.0001, L"SELF ASSIGNMENT MISMATCH", LINE_INFO());
+		}
+
+		TEST_METHOD(InPlaceOperationsTest)
+		{
+			Matrix<double> a(std::vector<std::vector<double>>({ { 1.0, 2.0 }, { 3.0, 4.0 } }));
+			Matrix<double> b(std::vector<std::vector<double>>({ { 5.0, 6.0 }, { 7.0, 8.0 } }));
+			const double * const storage = a.data();
+
+			a += b;
+			a -= b * 0.5;
+			a *= b; // hadamard
+			Assert::AreEqual((1.0 + 2.5) * 5.0, a(0, 0), 0.0001, L"COMPOUND ASSIGNMENT MISMATCH", LINE_INFO());
+			Assert::AreEqual((4.0 + 4.0) * 8.0, a(1, 1), 0.0001, L"COMPOUND ASSIGNMENT MISMATCH", LINE_INFO());
+
+			a *= 0.5;
+			a.axpy(-2.0, b).map_inplace(&sample_map_func);
+			Assert::AreEqual(std::pow(8.75 - 10.0, 2), a(0, 0), 0.0001, L"AXPY MISMATCH", LINE_INFO());
+			Assert::IsTrue(a.data() == storage, L"IN-PLACE OPERATION REALLOCATED", LINE_INFO());
+
+			// the destination keeps its storage when the shape already matches
+			Matrix<double> product(2, 2);
+			const double * const product_storage = product.data();
+			b.dot_into(b, product);
+			Assert::AreEqual(5.0 * 5.0 + 6.0 * 7.0, product(0, 0), 0.0001, L"DOT_INTO MISMATCH", LINE_INFO());
+			b.dot_into(b, product);
+			Assert::AreEqual(7.0 * 6.0 + 8.0 * 8.0, product(1, 1), 0.0001, L"DOT_INTO MISMATCH", LINE_INFO());
+			Assert::IsTrue(product.data() == product_storage, L"DOT_INTO REALLOCATED", LINE_INFO());
+		}
+	};
+	TEST_CLASS(FixedMatrixTest)
+	{
+	public:
+
+		TEST_METHOD(MatchesDynamicMatrixTest)
+		{
+			const FixedMatrix<double, 2, 3> lhs({ { 2.3, 5.0, 6.0 }, { 4.0, -1.7, 0.0 } });
+			const FixedMatrix<double, 3, 2> rhs({ { 1.0, 2.0 }, { 3.0, 4.0 }, { 5.0, 6.0 } });
+
+			const Matrix<double> expected = lhs.to_matrix().dot(rhs.to_matrix());
+			const FixedMatrix<double, 2, 2> product = lhs.dot(rhs);
+			for (unsigned row = 0; row < 2; row++) {
+				for (unsigned col = 0; col < 2; col++) {
+					Assert::AreEqual(expected(row, col), product(row, col), 0.0001, L"FIXED DOT PRODUCT MISMATCH", LINE_INFO());
+				}
+			}
+
+			const FixedMatrix<double, 3, 2> transposed = lhs.transpose();
+			Assert::AreEqual(lhs(0, 2), transposed(2, 0), 0.0001, L"FIXED TRANSPOSE MISMATCH", LINE_INFO());
+			Assert::IsTrue(FixedMatrix<double, 2, 3>(transposed.to_matrix().transpose()) == lhs, L"FIXED ROUND TRIP MISMATCH", LINE_INFO());
+
+			FixedMatrix<double, 2, 3> updated(lhs);
+			updated += lhs;
+			updated.axpy(-0.5, lhs * 2.0).map_inplace(&sample_map_func);
+			Assert::IsTrue(updated == lhs.map(&sample_map_func), L"FIXED ELEMENT-WISE MISMATCH", LINE_INFO());
+			Assert::AreEqual(2.0 * 16.0, (updated + updated)(1, 0), 0.0001, L"FIXED ELEMENT-WISE MISMATCH", LINE_INFO());
+		}
+	};
+	TEST_CLASS(SparseMatrixTest)
+	{
+	public:
+
+		TEST_METHOD(ProductsMatchDenseTest)
+		{
+			const Matrix<double> dense(std::vector<std::vector<double>>({ { 0.0, 2.0, 0.0 }, { 1.0, 0.0, 3.0 }, { 0.0, 0.0, 0.0 }, { 4.0, 0.0, 5.0 } }));
+			const Matrix<double> rhs(std::vector<std::vector<double>>({ { 1.0, 2.0 }, { 3.0, 4.0 }, { 5.0, 6.0 } }));
+
+			const CsrMatrix<double> csr(dense);
+			const CscMatrix<double> csc = csr.to_csc();
+			Assert::AreEqual(static_cast<std::size_t>(5), csr.nonzeros(), L"CSR NONZERO COUNT MISMATCH", LINE_INFO());
+			Assert::IsTrue(csc.to_dense() == dense && csc.to_csr().to_dense() == dense, L"SPARSE LAYOUT ROUND TRIP MISMATCH", LINE_INFO());
+
+			const Matrix<double> expected = dense.dot(rhs);
+			const Matrix<double> csr_product = csr.dot(rhs);
+			const Matrix<double> csc_product = csc.dot(rhs);
+			for (unsigned row = 0; row < 4; row++) {
+				for (unsigned col = 0; col < 2; col++) {
+					Assert::AreEqual(expected(row, col), csr_product(row, col), 0.0001, L"CSR PRODUCT MISMATCH", LINE_INFO());
+					Assert::AreEqual(expected(row, col), csc_product(row, col), 0.0001, L"CSC PRODUCT MISMATCH", LINE_INFO());
+				}
+			}
+
+			Matrix<double> row_product;
+			sparse_dot_into(csr.row(3), rhs, row_product);
+			Assert::AreEqual(expected(3, 1), row_product(0, 1), 0.0001, L"SPARSE ROW PRODUCT MISMATCH", LINE_INFO());
+		}
+	};
+	TEST_CLASS(ActivationTest)
+	{
+	public:
+
+		TEST_METHOD(TiersWithinDocumentedErrorTest)
+		{
+			// every activation and tier against the exact tier, relative to max(|exact|, 1e-300); the bounds are those
+			// documented in activation.hpp, plus the error of the exact tier itself
+			using Learnoran::Activation;
+			using Learnoran::ActivationAccuracy;
+			const unsigned count = 1003; // not a multiple of the SIMD width, so the tails are covered
+			const Activation activations[] = { Activation::exp, Activation::sigmoid, Activation::sigmoid_prime, Activation::tanh, Activation::relu };
+			const double accurate_bounds[] = { 5e-16, 6e-16, 9e-16, 9e-16, 0.0 };
+			const double fast_bounds[] = { 2e-7, 2e-7, 2e-7, 5e-7, 0.0 };
+
+			std::vector<double> input(count), exact(count), approximation(count);
+			for (unsigned i = 0; i < count; i++) {
+				input[i] = 40.0 * std::sin(i * 1.7) * (i % 3 == 0 ? 1e-4 : 1.0);
+			}
+
+			for (unsigned a = 0; a < 5; a++) {
+				Learnoran::activation_kernel(activations[a], input.data(), exact.data(), count, ActivationAccuracy::exact);
+
+				Learnoran::activation_kernel(activations[a], input.data(), approximation.data(), count, ActivationAccuracy::accurate);
+				for (unsigned i = 0; i < count; i++) {
+					const double error = std::fabs(approximation[i] - exact[i]) / std::fmax(std::fabs(exact[i]), 1e-300);
+					Assert::IsTrue(error <= accurate_bounds[a], L"ACCURATE ACTIVATION OUTSIDE ITS ERROR BOUND", LINE_INFO());
+				}
+
+				Learnoran::activation_kernel(activations[a], input.data(), approximation.data(), count, ActivationAccuracy::fast);
+				for (unsigned i = 0; i < count; i++) {
+					const double error = std::fabs(approximation[i] - exact[i]) / std::fmax(std::fabs(exact[i]), 1e-300);
+					Assert::IsTrue(error <= fast_bounds[a], L"FAST ACTIVATION OUTSIDE ITS ERROR BOUND", LINE_INFO());
+				}
+			}
+
+			// special values survive the approximations
+			const double specials[] = { 1000.0, -1000.0, std::numeric_limits<double>::quiet_NaN() };
+			double results[3];
+			Learnoran::activation_kernel(Activation::exp, specials, results, 3, ActivationAccuracy::fast);
+			Assert::IsTrue(results[0] == std::numeric_limits<double>::infinity() && results[1] == 0.0 && results[2] != results[2], L"EXP SPECIAL VALUES MISMATCH", LINE_INFO());
+			Learnoran::activation_kernel(Activation::tanh, specials, results, 3, ActivationAccuracy::fast);
+			Assert::IsTrue(results[0] == 1.0 && results[1] == -1.0 && results[2] != results[2], L"TANH SPECIAL VALUES MISMATCH", LINE_INFO());
+		}
+
+		TEST_METHOD(MapAcceptsCallablesTest)
+		{
+			Matrix<double> mat(std::vector<std::vector<double>>({ { -1.0, 0.0 }, { 2.0, -3.5 } }));
+			const double offset = 0.5;
+
+			const Matrix<double> shifted = mat.map([offset](const double x) { return x + offset; });
+			Assert::AreEqual(2.5, shifted(1, 0), 0.0001, L"LAMBDA MAPPING RESULT MISMATCHING", LINE_INFO());
+
+			const Matrix<double> rectified = mat.map(Learnoran::ActivationFunction<Learnoran::Activation::relu>());
+			Assert::IsTrue(rectified == Matrix<double>(std::vector<std::vector<double>>({ { 0.0, 0.0 }, { 2.0, 0.0 } })), L"FUNCTOR MAPPING RESULT MISMATCHING", LINE_INFO());
+
+			Matrix<double> activated(mat);
+			Learnoran::apply_activation(activated, Learnoran::Activation::sigmoid, Learnoran::ActivationAccuracy::accurate);
+			mat.map_inplace(Learnoran::ActivationFunction<Learnoran::Activation::sigmoid>());
+			for (unsigned row = 0; row < 2; row++) {
+				for (unsigned col = 0; col < 2; col++) {
+					Assert::AreEqual(mat(row, col), activated(row, col), 1e-15, L"KERNEL AND FUNCTOR MISMATCH", LINE_INFO());
+				}
+			}
+		}
+	};
+
+	TEST_CLASS(GemmTest)
+	{
+	public:
+
+		TEST_METHOD(KernelsMatchReferenceTest)
+		{
+			// sizes that leave partial tiles in every dimension and span several KC slices
+			const unsigned m = 29, n = 37, k = 300;
+			const double alpha = 0.5, beta = 2.0;
+
+			Matrix<double> a(k, m), b(k, n), c(m, n); // a is stored transposed
+			for (unsigned p = 0; p < k; p++) {
+				for (unsigned i = 0; i < m; i++) {
+					a(p, i) = std::sin(p * 0.1 + i);
+				}
+				for (unsigned j = 0; j < n; j++) {
+					b(p, j) = std::cos(p * 0.2 - j);
+				}
+			}
+
+			const Learnoran::GemmKernel kernels[] = { Learnoran::GemmKernel::generic, Learnoran::GemmKernel::avx2, Learnoran::GemmKernel::avx512 };
+			for (const Learnoran::GemmKernel kernel : kernels) {
+				if (!Learnoran::gemm_kernel_supported(kernel)) {
+					continue;
+				}
+
+				for (unsigned i = 0; i < m; i++) {
+					for (unsigned j = 0; j < n; j++) {
+						c(i, j) = i - 0.5 * j;
+					}
+				}
+				Learnoran::gemm(alpha, a.view().transpose(), b.view(), beta, c.view(), kernel);
+
+				for (unsigned i = 0; i < m; i++) {
+					for (unsigned j = 0; j < n; j++) {
+						double expected = 0.0;
+						for (unsigned p = 0; p < k; p++) {
+							expected += a(p, i) * b(p, j);
+						}
+						expected = alpha * expected + beta * (i - 0.5 * j);
+						Assert::AreEqual(expected, c(i, j), 1e-9, L"GEMM RESULT MISMATCHES THE REFERENCE PRODUCT", LINE_INFO());
+					}
+				}
+			}
+		}
+
+		TEST_METHOD(ZeroBetaIgnoresOutputTest)
+		{
+			Matrix<double> a(std::vector<std::vector<double>>({ { 1.0, 2.0 }, { 3.0, 4.0 } }));
+			Matrix<double> c(2, 2);
+			for (unsigned i = 0; i < 2; i++) {
+				for (unsigned j = 0; j < 2; j++) {
+					c(i, j) = std::numeric_limits<double>::quiet_NaN();
+				}
+			}
+
+			Learnoran::gemm(1.0, a.view(), a.view(), 0.0, c.view());
+			Assert::IsTrue(c == a.dot(a), L"GEMM MUST MATCH MATRIX::DOT", LINE_INFO());
+			Assert::AreEqual(22.0, c(1, 1), 0.0001, L"ENTRY [1][1] INVALID", LINE_INFO());
+		}
+
+		TEST_METHOD(PackedOperandMatchesUnpackedTest)
+		{
+			// B spans two NC blocks and two KC slices, so every block offset of the packed operand is exercised
+			const unsigned m = 5, n = 4100, k = 300;
+
+			Matrix<double> a(m, k), b(k, n), packed_c(m, n), c(m, n);
+			for (unsigned p = 0; p < k; p++) {
+				for (unsigned i = 0; i < m; i++) {
+					a(i, p) = std::sin(p * 0.3 + i);
+				}
+				for (unsigned j = 0; j < n; j++) {
+					b(p, j) = std::cos(p * 0.7 - j * 0.01);
+				}
+			}
+
+			const Learnoran::GemmKernel kernels[] = { Learnoran::GemmKernel::generic, Learnoran::GemmKernel::avx2, Learnoran::GemmKernel::avx512 };
+			for (const Learnoran::GemmKernel kernel : kernels) {
+				if (!Learnoran::gemm_kernel_supported(kernel)) {
+					continue;
+				}
+
+				const Learnoran::GemmPackedMatrix packed(k, n, b.data(), b.get_pitch(), 1, kernel);
+				Learnoran::gemm(m, 1.0, a.data(), a.get_pitch(), 1, packed, 0.0, packed_c.data(), packed_c.get_pitch());
+				Learnoran::gemm(1.0, a.view(), b.view(), 0.0, c.view(), kernel);
+
+				Assert::IsTrue(packed_c == c, L"PREPACKED B MUST GIVE THE SAME PRODUCT", LINE_INFO());
+			}
+		}
+
+		TEST_METHOD(DenseLayerMatchesSeparatePassesTest)
+		{
+			// partial tiles and two KC slices, so that the epilogue must only run once C is complete
+			const unsigned rows = 29, inputs = 300, width = 37;
+			const double bias = 0.25;
+			const Learnoran::GemmElementwise sigmoid = Learnoran::resolve_activation_kernel(Learnoran::Activation::sigmoid, Learnoran::ActivationAccuracy::accurate);
+			const Learnoran::GemmElementwise derivative = Learnoran::resolve_activation_kernel(Learnoran::Activation::sigmoid_prime, Learnoran::ActivationAccuracy::accurate);
+
+			Matrix<double> source(rows, inputs), weights(inputs, width), outputs(rows, width), expected(rows, width);
+			for (unsigned p = 0; p < inputs; p++) {
+				for (unsigned i = 0; i < rows; i++) {
+					source(i, p) = std::sin(p * 0.3 + i);
+				}
+				for (unsigned j = 0; j < width; j++) {
+					weights(p, j) = std::cos(p * 0.7 - j) / inputs;
+				}
+			}
+
+			Learnoran::dense_layer_forward(source.view(), weights.view(), bias, sigmoid, outputs.view());
+			Learnoran::gemm(1.0, source.view(), weights.view(), 0.0, expected.view());
+			for (unsigned i = 0; i < rows; i++) {
+				for (unsigned j = 0; j < width; j++) {
+					expected(i, j) += bias;
+				}
+				sigmoid(expected.data() + i * expected.get_pitch(), expected.data() + i * expected.get_pitch(), width);
+			}
+			Assert::IsTrue(outputs == expected, L"FUSED FORWARD PASS MUST MATCH THE SEPARATE PASSES", LINE_INFO());
+
+			// back propagating <outputs> as the gradients of the layer into the source layer
+			Matrix<double> gradients(rows, inputs);
+			Learnoran::dense_layer_backward(outputs.view(), weights.view(), source.view(), derivative, gradients.view());
+			const Matrix<double> product = outputs.dot(weights.transpose());
+			const Learnoran::ActivationFunction<Learnoran::Activation::sigmoid_prime> exact_derivative;
+			for (unsigned i = 0; i < rows; i++) {
+				for (unsigned p = 0; p < inputs; p++) {
+					const double factor = exact_derivative(source(i, p));
+					Assert::AreEqual(product(i, p) * factor, gradients(i, p), 1e-9, L"FUSED BACKWARD PASS MUST MATCH THE SEPARATE PASSES", LINE_INFO());
+				}
+			}
+		}
+
+		TEST_METHOD(Int8KernelsMatchReferenceTest)
+		{
+			// every row count of a block, and values at both ends of the int8 range
+			const unsigned rows = 7, depth = 64, channels = 12;
+			Learnoran::AlignedBuffer<std::int8_t> inputs(rows * depth), weights(channels * depth);
+			for (unsigned i = 0; i < rows * depth; i++) {
+				inputs[i] = static_cast<std::int8_t>(i % 3 == 0 ? -127 : (i * 37) % 255 - 127);
+			}
+			for (unsigned i = 0; i < channels * depth; i++) {
+				weights[i] = static_cast<std::int8_t>(i % 5 == 0 ? 127 : (i * 53) % 255 - 127);
+			}
+
+			std::vector<std::int32_t> expected(rows * channels), sums(rows * channels);
+			for (unsigned row = 0; row < rows; row++) {
+				for (unsigned channel = 0; channel < channels; channel++) {
+					for (unsigned k = 0; k < depth; k++) {
+						expected[row * channels + channel] += inputs[row * depth + k] * weights[channel * depth + k];
+					}
+				}
+			}
+
+			const Learnoran::Int8BlockKernel kernel = Learnoran::resolve_int8_block_kernel();
+			for (unsigned first_row = 0; first_row < rows; first_row += Learnoran::INT8_GEMM_ROWS) {
+				const unsigned block_rows = std::min(Learnoran::INT8_GEMM_ROWS, rows - first_row);
+				Learnoran::int8_gemm(kernel, block_rows, inputs.data() + first_row * depth, depth, weights.data(), depth, channels, sums.data() + first_row * channels, channels);
+			}
+			Assert::IsTrue(sums == expected, L"INT8 GEMM MUST BE EXACT", LINE_INFO());
+
+			// the vectorized quantization must round like quantize_value, saturation and ties included
+			const unsigned count = 37;
+			std::vector<double> values(count), centers(count, 0.5), inverse_scales(count, 2.0);
+			for (unsigned i = 0; i < count; i++) {
+				values[i] = i % 4 == 0 ? 0.5 + (static_cast<int>(i) - 18) * 0.25 : std::sin(i * 1.7) * 80.0;
+			}
+			std::vector<std::int8_t> quantized(count), reference(count);
+			Learnoran::quantize_row(values.data(), centers.data(), inverse_scales.data(), quantized.data(), count);
+			Learnoran::quantize_row_generic(values.data(), centers.data(), inverse_scales.data(), reference.data(), count);
+			Assert::IsTrue(quantized == reference, L"QUANTIZATION DEPENDS ON THE KERNEL", LINE_INFO());
+			Assert::AreEqual(127, static_cast<int>(Learnoran::quantize_value(1000.0, 1.0)), L"QUANTIZATION MUST SATURATE", LINE_INFO());
+			Assert::AreEqual(-3, static_cast<int>(Learnoran::quantize_value(-2.5, 1.0)), L"TIES MUST ROUND AWAY FROM ZERO", LINE_INFO());
+		}
 	};
-}
\ No newline at end of file
+
+	TEST_CLASS(OptimizerTest)
+	{
+	public:
+
+		TEST_METHOD(UpdateRulesMatchReferenceTest)
+		{
+			// two steps of every rule on 11 parameters, so that the SIMD kernels also run their scalar tail
+			const unsigned count = 11;
+			const double rate = 0.1, momentum = 0.9, beta2 = 0.999, epsilon = 1e-8;
+			const Learnoran::Optimizer optimizers[] = { Learnoran::Optimizer::sgd(), Learnoran::Optimizer::momentum(momentum), Learnoran::Optimizer::nesterov(momentum),
+				Learnoran::Optimizer::rmsprop(momentum, epsilon), Learnoran::Optimizer::adam(momentum, beta2, epsilon) };
+
+			for (Learnoran::Optimizer optimizer : optimizers) {
+				optimizer.reset(count + 1);
+				std::vector<double> parameters(count), expected(count), first(count, 0.0), second(count, 0.0);
+				for (unsigned i = 0; i < count; i++) {
+					parameters[i] = expected[i] = std::sin(i * 1.0);
+				}
+
+				for (unsigned step = 1; step <= 2; step++) {
+					std::vector<double> gradients(count);
+					for (unsigned i = 0; i < count; i++) {
+						gradients[i] = std::cos(i * 0.5 + step);
+						const double g = gradients[i];
+						switch (optimizer.get_method()) {
+						case Learnoran::OptimizerMethod::sgd:
+							expected[i] -= rate * g;
+							break;
+						case Learnoran::OptimizerMethod::momentum:
+							first[i] = momentum * first[i] + g;
+							expected[i] -= rate * first[i];
+							break;
+						case Learnoran::OptimizerMethod::nesterov:
+							first[i] = momentum * first[i] + g;
+							expected[i] -= rate * (g + momentum * first[i]);
+							break;
+						case Learnoran::OptimizerMethod::rmsprop:
+							first[i] = momentum * first[i] + (1.0 - momentum) * g * g;
+							expected[i] -= rate * g / (std::sqrt(first[i]) + epsilon);
+							break;
+						case Learnoran::OptimizerMethod::adam:
+							first[i] = momentum * first[i] + (1.0 - momentum) * g;
+							second[i] = beta2 * second[i] + (1.0 - beta2) * g * g;
+							expected[i] -= rate * (first[i] / (1.0 - std::pow(momentum, step))) / (std::sqrt(second[i] / (1.0 - std::pow(beta2, step))) + epsilon);
+							break;
+						}
+					}
+
+					// the slots are offset by one, as a model with several runs of parameters would
+					optimizer.next_step();
+					optimizer.update(1, parameters.data(), gradients.data(), count, rate);
+				}
+
+				for (unsigned i = 0; i < count; i++) {
+					Assert::AreEqual(expected[i], parameters[i], 1e-12, L"OPTIMIZER STEP MISMATCHES THE REFERENCE RULE", LINE_INFO());
+				}
+			}
+		}
+
+		TEST_METHOD(KernelsAreBitIdenticalTest)
+		{
+			// the SIMD kernels of RMSProp and Adam must round exactly like the generic loops
+			const unsigned count = 37;
+			std::vector<double> gradients(count), generic(count), dispatched(count);
+			std::vector<double> generic_mean(count, 0.1), generic_square(count, 0.2), dispatched_mean(count, 0.1), dispatched_square(count, 0.2);
+			for (unsigned i = 0; i < count; i++) {
+				gradients[i] = std::sin(i * 0.7) * 3.0;
+				generic[i] = dispatched[i] = std::cos(i * 1.0);
+			}
+
+			Learnoran::rmsprop_update_generic(generic.data(), gradients.data(), generic_square.data(), count, 0.01, 0.9, 1e-8);
+			Learnoran::rmsprop_update(dispatched.data(), gradients.data(), dispatched_square.data(), count, 0.01, 0.9, 1e-8);
+			Learnoran::adam_update_generic(generic.data(), gradients.data(), generic_mean.data(), generic_square.data(), count, 0.01, 0.9, 0.999, 1e-8, 1.5, 30.0);
+			Learnoran::adam_update(dispatched.data(), gradients.data(), dispatched_mean.data(), dispatched_square.data(), count, 0.01, 0.9, 0.999, 1e-8, 1.5, 30.0);
+
+			Assert::IsTrue(generic == dispatched, L"PARAMETERS DEPEND ON THE KERNEL", LINE_INFO());
+			Assert::IsTrue(generic_mean == dispatched_mean && generic_square == dispatched_square, L"OPTIMIZER STATE DEPENDS ON THE KERNEL", LINE_INFO());
+		}
+	};
+
+	TEST_CLASS(RandomTest)
+	{
+	public:
+
+		TEST_METHOD(KnownAnswerTest)
+		{
+			// the Philox4x32-10 known-answer vectors of Random123, counter (c0, c1, c2, c3) = (block, stream) and key = seed
+			std::uint32_t words[4];
+			Learnoran::philox_blocks_generic(Learnoran::PhiloxKey(0), 0, 0, 1, words);
+			const std::uint32_t zeros[4] = { 0x6627e8d5, 0xe169c58d, 0xbc57ac4c, 0x9b00dbd8 };
+			Assert::IsTrue(std::equal(words, words + 4, zeros), L"PHILOX MISMATCHES THE ZERO VECTOR", LINE_INFO());
+
+			Learnoran::philox_blocks_generic(Learnoran::PhiloxKey(0x299f31d0a4093822), 0x0370734413198a2e, 0x85a308d3243f6a88, 1, words);
+			const std::uint32_t pi[4] = { 0xd16cfe09, 0x94fdcceb, 0x5001e420, 0x24126ea1 };
+			Assert::IsTrue(std::equal(words, words + 4, pi), L"PHILOX MISMATCHES THE PI VECTOR", LINE_INFO());
+		}
+
+		TEST_METHOD(KernelsMatchGenericTest)
+		{
+			// 43 blocks, so that the SIMD kernels also run their scalar tail, across a carry into the high counter word
+			const std::size_t blocks = 43;
+			const Learnoran::PhiloxKey key(12345);
+			const std::uint64_t first_block = 0xFFFFFFF0;
+			std::vector<std::uint32_t> generic(4 * blocks), dispatched(4 * blocks);
+			Learnoran::philox_blocks_generic(key, 7, first_block, blocks, generic.data());
+			Learnoran::philox_blocks(key, 7, first_block, blocks, dispatched.data());
+			Assert::IsTrue(generic == dispatched, L"PHILOX BLOCKS DEPEND ON THE KERNEL", LINE_INFO());
+		}
+
+		TEST_METHOD(FillsAreReproducibleTest)
+		{
+			// a fill split in two pieces, or written into a padded matrix, must give the values of a single fill
+			const unsigned rows = 9, cols = 131;
+			std::vector<double> whole(rows * cols), pieces(rows * cols);
+			Learnoran::Philox4x32(42).fill(Learnoran::Distribution::normal, whole.data(), whole.size());
+			const Learnoran::PhiloxKey key(42);
+			Learnoran::philox_values(key, 0, 0, Learnoran::Distribution::normal, 0, 301, pieces.data());
+			Learnoran::philox_values(key, 0, 0, Learnoran::Distribution::normal, 301, pieces.size() - 301, pieces.data() + 301);
+			Assert::IsTrue(whole == pieces, L"FILL DEPENDS ON ITS SPLITTING", LINE_INFO());
+
+			std::vector<double> padded(rows * (cols + 5));
+			Learnoran::Philox4x32(42).fill(Learnoran::Distribution::normal, MatrixView<double>(padded.data(), rows, cols, cols + 5));
+			for (unsigned row = 0; row < rows; row++) {
+				Assert::IsTrue(std::equal(whole.begin() + row * cols, whole.begin() + (row + 1) * cols, padded.begin() + row * (cols + 5)), L"FILL DEPENDS ON THE LAYOUT", LINE_INFO());
+			}
+
+			Learnoran::Philox4x32 other(43);
+			std::vector<double> reseeded(rows * cols);
+			other.fill(Learnoran::Distribution::normal, reseeded.data(), reseeded.size());
+			Assert::IsFalse(whole == reseeded, L"SEEDS MUST GIVE DISTINCT VALUES", LINE_INFO());
+			other.fill(Learnoran::Distribution::normal, reseeded.data(), reseeded.size());
+			Assert::IsFalse(whole == reseeded, L"A FILL MUST ADVANCE THE GENERATOR", LINE_INFO());
+		}
+
+		TEST_METHOD(DistributionsTest)
+		{
+			const std::size_t count = 200000;
+			std::vector<double> values(count);
+			Learnoran::Philox4x32 generator(1);
+
+			generator.fill(Learnoran::Distribution::normal, values.data(), count);
+			double mean = 0, square = 0;
+			for (const double value : values) {
+				mean += value;
+				square += value * value;
+			}
+			mean /= count;
+			Assert::AreEqual(0.0, mean, 0.01, L"NORMAL MEAN", LINE_INFO());
+			Assert::AreEqual(1.0, square / count - mean * mean, 0.02, L"NORMAL VARIANCE", LINE_INFO());
+
+			generator.fill(Learnoran::Distribution::uniform, values.data(), count);
+			mean = 0;
+			for (const double value : values) {
+				Assert::IsTrue(value >= 0.0 && value < 1.0, L"UNIFORM OUT OF [0, 1)", LINE_INFO());
+				mean += value;
+			}
+			Assert::AreEqual(0.5, mean / count, 0.01, L"UNIFORM MEAN", LINE_INFO());
+		}
+
+		TEST_METHOD(ShuffleIsSeededTest)
+		{
+			std::vector<unsigned> first(100), second(100);
+			for (unsigned i = 0; i < first.size(); i++) {
+				first[i] = second[i] = i;
+			}
+			Learnoran::Philox4x32 first_generator(5), second_generator(5);
+			Learnoran::shuffle_range(first.begin(), first.end(), first_generator);
+			Learnoran::shuffle_range(second.begin(), second.end(), second_generator);
+			Assert::IsTrue(first == second, L"A SEED MUST GIVE ONE PERMUTATION", LINE_INFO());
+
+			std::vector<unsigned> sorted = first;
+			std::sort(sorted.begin(), sorted.end());
+			for (unsigned i = 0; i < sorted.size(); i++) {
+				Assert::AreEqual(i, sorted[i], L"SHUFFLE MUST PERMUTE", LINE_INFO());
+			}
+			Assert::IsFalse(first == sorted, L"SHUFFLE LEFT THE ORDER", LINE_INFO());
+		}
+	};
+}